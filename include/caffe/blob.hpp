@@ -2,6 +2,7 @@
 #define CAFFE_BLOB_HPP_
 
 #include <algorithm>
+#include <cstdlib>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,20 @@ const int kMaxBlobAxes = 32;
 
 namespace caffe {
 
+/**
+ * @brief Element type held in a Blob's memory.
+ *
+ * STORAGE_DTYPE blobs hold Dtype values as usual. The other storage types
+ * keep the Blob<Dtype> interface for shapes and for passing blobs between
+ * layers, but size the data and diff allocations to the narrower element
+ * type, which is then accessed through the typed *_as<T>() accessors.
+ */
+enum BlobStorage {
+  STORAGE_DTYPE = 0,
+  STORAGE_CPFP = 1,
+  STORAGE_INT8 = 2
+};
+
 /**
  * @brief A wrapper around SyncedMemory holders serving as the basic
  *        computational unit through which Layer%s, Net%s, and Solver%s
@@ -24,7 +39,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), storage_(STORAGE_DTYPE),
+         data_exp_bias_(0), diff_exp_bias_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -74,6 +90,42 @@ class Blob {
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
 
+  /**
+   * @brief Set the element type held by the blob, reallocating the data and
+   *        diff if the element size changes. Existing values are not kept.
+   */
+  void set_storage(BlobStorage storage);
+  inline BlobStorage storage() const { return storage_; }
+  /**
+   * @brief Shared exponent bias of the cpfp data and diff.
+   *
+   * A STORAGE_CPFP blob with an exponent bias b holds each value v as
+   * float2cpfp(v, b), the cpfp of v * 2^-b, so that each tensor can place the
+   * format's dynamic range where its values are. Both are 0 by default and
+   * have no meaning for the other storage types.
+   */
+  inline int data_exp_bias() const { return data_exp_bias_; }
+  inline int diff_exp_bias() const { return diff_exp_bias_; }
+  inline void set_data_exp_bias(int exp_bias) {
+    CHECK_LE(std::abs(exp_bias), CPFP_MAX_EXP_BIAS);
+    data_exp_bias_ = exp_bias;
+  }
+  inline void set_diff_exp_bias(int exp_bias) {
+    CHECK_LE(std::abs(exp_bias), CPFP_MAX_EXP_BIAS);
+    diff_exp_bias_ = exp_bias;
+  }
+  /// @brief Size in bytes of one stored element.
+  inline size_t element_size() const {
+    switch (storage_) {
+    case STORAGE_CPFP:
+      return sizeof(cpfp);
+    case STORAGE_INT8:
+      return sizeof(signed char);
+    default:
+      return sizeof(Dtype);
+    }
+  }
+
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
    *        among a range of axes.
@@ -216,31 +268,62 @@ class Blob {
     return diff_;
   }
 
+  // The Dtype accessors need STORAGE_DTYPE, the other storage types are
+  // accessed through the typed *_as<T>() accessors below
   const Dtype* cpu_data() const;
-  const Dtype* cpu_data(size_t size) const;
   void set_cpu_data(Dtype* data);
   const int* gpu_shape() const;
   const Dtype* gpu_data() const;
   const Dtype* ocl_data() const;
-  const Dtype* ocl_data(size_t size) const;
   void set_gpu_data(Dtype* data);
   const Dtype* cpu_diff() const;
-  const Dtype* cpu_diff(size_t size) const;
   const Dtype* gpu_diff() const;
   const Dtype* ocl_diff() const;
-  const Dtype* ocl_diff(size_t size) const;
   Dtype* mutable_cpu_data();
-  Dtype* mutable_cpu_data(size_t size);
   Dtype* mutable_gpu_data();
   Dtype* mutable_ocl_data();
   Dtype* mutable_ocl_data(int RW);
-  Dtype* mutable_ocl_data(int RW, size_t size);
   Dtype* mutable_cpu_diff();
-  Dtype* mutable_cpu_diff(size_t size);
   Dtype* mutable_gpu_diff();
   Dtype* mutable_ocl_diff();
   Dtype* mutable_ocl_diff(int RW);
-  Dtype* mutable_ocl_diff(int RW, size_t size);
+
+  /**
+   * @brief Typed access to the stored elements, e.g. cpu_data_as<cpfp>() on
+   *        a STORAGE_CPFP blob. T must match the element size of the storage.
+   */
+  template <typename T> const T* cpu_data_as() const {
+    CheckElementType(sizeof(T));
+    return static_cast<const T*>(data()->cpu_data());
+  }
+  template <typename T> const T* cpu_diff_as() const {
+    CheckElementType(sizeof(T));
+    return static_cast<const T*>(diff()->cpu_data());
+  }
+  template <typename T> const T* ocl_data_as() const {
+    CheckElementType(sizeof(T));
+    return static_cast<const T*>(data()->ocl_data());
+  }
+  template <typename T> const T* ocl_diff_as() const {
+    CheckElementType(sizeof(T));
+    return static_cast<const T*>(diff()->ocl_data());
+  }
+  template <typename T> T* mutable_cpu_data_as() {
+    CheckElementType(sizeof(T));
+    return static_cast<T*>(data()->mutable_cpu_data());
+  }
+  template <typename T> T* mutable_cpu_diff_as() {
+    CheckElementType(sizeof(T));
+    return static_cast<T*>(diff()->mutable_cpu_data());
+  }
+  template <typename T> T* mutable_ocl_data_as(int RW = 1) {
+    CheckElementType(sizeof(T));
+    return static_cast<T*>(data()->mutable_ocl_data(RW));
+  }
+  template <typename T> T* mutable_ocl_diff_as(int RW = 1) {
+    CheckElementType(sizeof(T));
+    return static_cast<T*>(diff()->mutable_ocl_data(RW));
+  }
   void Update();
   void FromProto(const BlobProto& proto, bool reshape = true);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
@@ -277,16 +360,34 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to a SyncedMemory that is at least as
+   *        large as this Blob, e.g. a buffer shared with other Blob%s whose
+   *        values are never needed at the same time.
+   */
+  void ShareDataBuffer(const shared_ptr<SyncedMemory>& buffer);
 
   bool ShapeEquals(const BlobProto& other);
 
  protected:
+  inline void CheckElementType(size_t size) const {
+    CHECK_EQ(size, element_size()) << "element type does not match the "
+        << "storage of the blob";
+  }
+  inline void CheckDtypeStorage() const {
+    CHECK_EQ(storage_, STORAGE_DTYPE) << "Dtype access to a blob of another "
+        << "storage, use the typed *_as<T>() accessors";
+  }
+
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
   shared_ptr<SyncedMemory> shape_data_;
   vector<int> shape_;
   int count_;
   int capacity_;
+  BlobStorage storage_;
+  int data_exp_bias_;
+  int diff_exp_bias_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
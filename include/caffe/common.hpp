@@ -104,6 +104,8 @@ using std::vector;
   extern cl_device_id oclDevices;
   extern cl_context oclContext;
   extern cl_command_queue oclCommandQueue;
+  // Parameter gradient passes run here, beside the passes on oclCommandQueue
+  extern cl_command_queue oclGradientQueue;
 #endif
 
 // A global initialization function that you should call in your main function.
@@ -184,6 +186,25 @@ class Caffe {
   inline static bool multiprocess() { return Get().multiprocess_; }
   inline static void set_multiprocess(bool val) { Get().multiprocess_ = val; }
   inline static bool root_solver() { return Get().solver_rank_ == 0; }
+  // Profiling counters of this thread: the bytes SyncedMemory has copied
+  // between host and device, and the microseconds OCL kernels have run
+  inline static size_t host_to_device_bytes() {
+    return Get().host_to_device_bytes_;
+  }
+  inline static size_t device_to_host_bytes() {
+    return Get().device_to_host_bytes_;
+  }
+  inline static double kernel_us() { return Get().kernel_us_; }
+  inline static void count_host_to_device(size_t bytes) {
+    Get().host_to_device_bytes_ += bytes;
+  }
+  inline static void count_device_to_host(size_t bytes) {
+    Get().device_to_host_bytes_ += bytes;
+  }
+#ifdef USE_OCL
+  // Adds the run time of finished kernel events to kernel_us()
+  static void count_kernel_time(int num_events, const cl_event* events);
+#endif
 
  protected:
 #ifndef CPU_ONLY
@@ -199,6 +220,11 @@ class Caffe {
   int solver_rank_;
   bool multiprocess_;
 
+  // Profiling
+  size_t host_to_device_bytes_;
+  size_t device_to_host_bytes_;
+  double kernel_us_;
+
  private:
   // The private constructor to avoid duplicate instantiation.
   Caffe();
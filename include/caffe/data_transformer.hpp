@@ -37,6 +37,23 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to a Datum whose data bytes are held outside of
+   * it, as parsed by ParseDatumAliasingData.
+   *
+   * @param datum
+   *    Datum with every field but data.
+   * @param data
+   *    The data bytes of the Datum, e.g. inside a memory-mapped database.
+   * @param data_size
+   *    Number of data bytes; 0 if the Datum holds float_data.
+   * @param transformed_blob
+   *    This is destination blob, as for Transform(const Datum&, Blob*).
+   */
+  void Transform(const Datum& datum, const char* data, size_t data_size,
+                Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -137,7 +154,8 @@ class DataTransformer {
    */
   virtual int Rand(int n);
 
-  void Transform(const Datum& datum, Dtype* transformed_data);
+  void Transform(const Datum& datum, const char* data, size_t data_size,
+                 Dtype* transformed_data);
   // Tranformation parameters
   TransformationParameter param_;
 
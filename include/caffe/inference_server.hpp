@@ -0,0 +1,99 @@
+#ifndef CAFFE_INFERENCE_SERVER_HPP_
+#define CAFFE_INFERENCE_SERVER_HPP_
+
+#include <deque>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+
+namespace boost { class condition_variable; class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Serves the forward pass of a TEST net to many callers, gathering
+ *        their items into dynamic batches.
+ *
+ * Infer() queues one item and blocks until its outputs are ready. The serving
+ * thread takes the oldest item, waits up to max_delay_us after its arrival
+ * for up to max_batch items, then zero-pads the batch to a multiple of
+ * batch_multiple (16 for nets with FPGA layers, whose engines work on 16
+ * images at a time), reshapes the net to it and runs Forward. The layers
+ * thus see batches other than the one the net was set up with, down to
+ * batch_multiple items, and must follow it in Reshape. Items are
+ * stacked along axis 0 of the net's input, either its only input blob or the
+ * top of a leading Input layer, and taken back along axis 0 of every output,
+ * so each output must keep the batch on axis 0.
+ */
+template <typename Dtype>
+class InferenceServer : public InternalThread {
+ public:
+  struct Stats {
+    int requests;
+    int batches;
+    // Served items over the padded batch sizes they ran in
+    double fill;
+    // Latency from Infer() to the outputs, over the last kLatencyWindow
+    // requests
+    double p50_ms;
+    double p99_ms;
+  };
+  static const int kLatencyWindow = 10000;
+
+  InferenceServer(const shared_ptr<Net<Dtype> >& net, int max_batch,
+      int batch_multiple, int max_delay_us);
+  virtual ~InferenceServer();
+
+  /// @brief The number of values in one input item.
+  int input_size() const { return input_size_; }
+  /// @brief The number of values in one item of each net output.
+  const vector<int>& output_sizes() const { return output_sizes_; }
+
+  /**
+   * @brief Runs input_size() values through the net, filling outputs with
+   *        one vector per net output. Returns false, with outputs untouched,
+   *        if the server stops before the item is served.
+   */
+  bool Infer(const Dtype* input, vector<vector<Dtype> >* outputs);
+
+  Stats stats() const;
+
+ protected:
+  virtual void InternalThreadEntry();
+
+ private:
+  struct Request;
+
+  void RunBatch(const vector<Request*>& batch);
+
+  shared_ptr<Net<Dtype> > net_;
+  Blob<Dtype>* input_blob_;
+  int max_batch_;
+  int batch_multiple_;
+  int max_delay_us_;
+  int input_size_;
+  vector<int> output_sizes_;
+
+  // Guards everything below
+  shared_ptr<boost::mutex> mutex_;
+  // Signalled when an item is queued
+  shared_ptr<boost::condition_variable> queued_;
+  // Signalled when a batch is served, or the server stops
+  shared_ptr<boost::condition_variable> served_;
+  std::deque<Request*> queue_;
+  bool stopped_;
+  int requests_;
+  int batches_;
+  double padded_items_;
+  vector<double> latencies_ms_;
+  int latency_next_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceServer);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_SERVER_HPP_
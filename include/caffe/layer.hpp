@@ -38,7 +38,8 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param) {
+    : layer_param_(param), async_param_diffs_(false),
+      param_diff_passes_(1) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -275,6 +276,32 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether the forward pass may write its top over its bottom.
+   *
+   * Net's activation memory planner only gives a top the buffer of a bottom
+   * that dies at this layer if this returns true. Elementwise layers override
+   * it.
+   */
+  virtual inline bool AllowInPlace() const { return false; }
+
+  /**
+   * @brief Return whether Forward_ocl runs the layer on the OCL device.
+   *
+   * Net's pipelined forward pass groups consecutive layers by this flag into
+   * device and host stages that work on different micro-batches at once.
+   */
+  virtual inline bool RunsOnDevice() const { return false; }
+
+  /**
+   * @brief Return the axis of top blob top_index that runs over the items of
+   *        the batch.
+   *
+   * Net's pipelined forward pass splits the tops of the data layers into
+   * micro-batches along this axis. Layers writing HWCN tops override it.
+   */
+  virtual inline int BatchAxis(const int top_index) const { return 0; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -297,6 +324,41 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Sets whether Backward may return while the gradients w.r.t. the
+   *        parameters are still being computed, e.g. on the OCL device.
+   *
+   * The bottom diffs are always complete when Backward returns, so the
+   * layers below can start. SyncParamDiffs completes the parameter diffs.
+   */
+  inline void set_async_param_diffs(const bool value) {
+    async_param_diffs_ = value;
+  }
+  /**
+   * @brief Sets the number of Backward passes whose parameter diffs add up
+   *        before each SyncParamDiffs, the iter_size of the solver.
+   *
+   * A layer with async parameter diffs may keep a running sum on its device
+   * over these passes and read it back once.
+   */
+  inline void set_param_diff_passes(const int value) {
+    param_diff_passes_ = value;
+  }
+  /**
+   * @brief Completes the gradients w.r.t. the parameters the last Backward
+   *        left in flight. Layers that complete them in Backward need not
+   *        override this.
+   */
+  virtual void SyncParamDiffs() {}
+  /**
+   * @brief Waits until the work the last Backward left in flight no longer
+   *        reads the bottoms and tops, which the next Forward overwrites.
+   *
+   * Unlike SyncParamDiffs, this leaves the parameter diffs where they are,
+   * so that a layer may sum them over several passes, as for iter_size > 1,
+   * before completing them once.
+   */
+  virtual void FinishBackward() {}
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -307,6 +369,10 @@ class Layer {
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
+  /** Whether Backward may leave the param diffs to SyncParamDiffs. */
+  bool async_param_diffs_;
+  /** The number of Backward passes summed before each SyncParamDiffs. */
+  int param_diff_passes_;
 
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
@@ -319,6 +385,10 @@ class Layer {
   /** The variable that stores the floating point implementation of the given 
    * layer. */
   static cl_kernel ocl_kernel;
+
+  /** Held while setting the arguments of ocl_kernel and queueing it, as the
+   *  layers of nets on other threads share the kernel. */
+  static boost::mutex& ocl_kernel_mutex();
 #endif
 
   /** @brief Using the CPU device, compute the layer output. */
@@ -27,6 +27,7 @@ class XCLProgramLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "XCLProgram"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 0; }
+  virtual inline bool RunsOnDevice() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
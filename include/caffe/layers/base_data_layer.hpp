@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <boost/function.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -46,7 +47,13 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : load_time_(0) {}
   Blob<Dtype> data_, label_;
+  // data_ in the layout and precision of the first device layer, filled
+  // when the data_param asks for staged batches
+  Blob<Dtype> staged_data_;
+  // Time the prefetch thread took to load (and stage) this batch, in ms
+  float load_time_;
 };
 
 template <typename Dtype>
@@ -54,6 +61,7 @@ class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
  public:
   explicit BasePrefetchingDataLayer(const LayerParameter& param);
+  virtual ~BasePrefetchingDataLayer();
   // LayerSetUp: implements common data layer setup functionality, and calls
   // DataLayerSetUp to do special data layer setup for individual layer types.
   // This method may not be overridden.
@@ -64,10 +72,37 @@ class BasePrefetchingDataLayer :
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Staged HWCN batches run over the items along their last axis
+  virtual inline int BatchAxis(const int top_index) const {
+    return (top_index == 0 && stage_hwcn_) ? 3 : 0;
+  }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Shape of a staged batch for a loaded NCHW batch of the given shape.
+  vector<int> StagedShape(const vector<int>& shape) const;
+  // Fill batch->staged_data_ from batch->data_.
+  void StageBatch(Batch<Dtype>* batch);
+
+  // Call transform_item(item_id, worker) for every item of a batch, the
+  // decode_threads workers each taking a contiguous slice of the items. A
+  // worker only touches its own transformer() and transformed_data(), so
+  // that mirror and crop stay deterministic under a seed.
+  void ForEachItem(int batch_size,
+      const boost::function<void(int, int)>& transform_item);
+  // Loop of the decode worker of the given index, run for every batch.
+  void DecodeWorkerEntry(int worker);
+  // Reshape transformed_data() of every worker to a single item's shape.
+  void ReshapeTransformedData(const vector<int>& shape);
+  inline DataTransformer<Dtype>* transformer(int worker) {
+    return worker == 0 ? this->data_transformer_.get() :
+        worker_transformers_[worker - 1].get();
+  }
+  inline Blob<Dtype>* transformed_data(int worker) {
+    return worker == 0 ? &transformed_data_ :
+        worker_transformed_data_[worker - 1].get();
+  }
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
@@ -75,6 +110,24 @@ class BasePrefetchingDataLayer :
   Batch<Dtype>* prefetch_current_;
 
   Blob<Dtype> transformed_data_;
+  int decode_threads_;
+  // Transformers and item views of the decode workers other than the
+  // prefetch thread itself, which uses data_transformer_ and
+  // transformed_data_
+  vector<shared_ptr<DataTransformer<Dtype> > > worker_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > worker_transformed_data_;
+  // The threads of those workers, started with the layer and kept for its
+  // lifetime. ForEachItem wakes each with the batch size through its start
+  // queue and waits for as many ids on decode_done_.
+  vector<shared_ptr<boost::thread> > decode_workers_;
+  vector<shared_ptr<BlockingQueue<int> > > decode_start_;
+  BlockingQueue<int> decode_done_;
+  const boost::function<void(int, int)>* decode_item_;
+
+  bool stage_batches_;
+  bool stage_hwcn_;
+  int stage_pad_to_;
+  bool stage_cpfp_;
 };
 
 }  // namespace caffe
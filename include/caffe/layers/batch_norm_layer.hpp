@@ -55,6 +55,10 @@ class BatchNormLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Divide the elements [begin, end) by the standard deviation and
+  ///        cache them in x_norm_.
+  void NormalizeRange_cpu(const Dtype* temp_data, Dtype* top_data,
+      Dtype* x_norm_data, const int begin, const int end);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
@@ -48,6 +48,10 @@ class ConcatLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Forward_cpu for the concats (outer indices) [begin, end).
+  void ForwardConcats_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<const Dtype*>& bottom_data, const int top_concat_axis,
+      Dtype* top_data, const int begin, const int end);
 
   /**
    * @brief Computes the error gradient w.r.t. the concatenate inputs.
@@ -60,6 +60,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
+   *  - subengine (\b optional, default DIRECT). On the CPU, WINOGRAD
+   *    (3x3 filters, output tiles of winograd_tile) and FFT replace im2col
+   *    for the forward and data passes of stride 1, undilated 2D layers.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -77,6 +80,19 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+  // The subengine the CPU passes run with, DIRECT when the configured one
+  // can't take this shape. The data pass also needs pad < kernel, as it is
+  // a forward pass over the top diff padded by kernel - 1 - pad.
+  ConvolutionParameter_SubEngine cpu_subengine(bool backward);
+  // Runs the WINOGRAD or FFT subengine over all num_ images
+  void transform_conv_cpu(ConvolutionParameter_SubEngine subengine,
+      const Dtype* input, const int channels, const int height,
+      const int width, const Dtype* weights, const int num_output,
+      const int pad_h, const int pad_w, Dtype* output);
+
+  /// @brief The filters flipped in space, with the input and output channels
+  ///        of each group swapped, for the data pass of the subengines.
+  Blob<Dtype> flipped_weights_;
 };
 
 }  // namespace caffe
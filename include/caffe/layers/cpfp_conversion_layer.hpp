@@ -11,7 +11,11 @@ namespace caffe {
 
 /**
  * @brief Converts the input blob from Dtype to half precision, but maintains
- * the shape and types.
+ * the shape and types. The half precision side is a STORAGE_CPFP blob.
+ *
+ * The cpfp side can carry an exponent bias, fixed by exp_bias or picked for
+ * every batch by calibrate, so that narrow formats keep small gradients and
+ * large activations in range.
  * 
  */
 template <typename Dtype>
@@ -36,10 +40,20 @@ class CPFPConversionLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Convert the elements [begin, end) to and from cpfp.
+  void ToCPFP_cpu(const Dtype* bottom_data, cpfp* top_data,
+      const int exp_bias, const int begin, const int end);
+  void FromCPFP_cpu(const cpfp* bottom_data, Dtype* top_data,
+      const int exp_bias, const int begin, const int end);
+  /// @brief The exponent bias for converting the count values of x to cpfp.
+  int exp_bias(const int count, const Dtype* x);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   vector<int> bottom_shape_;
   bool convert_to_;
+  int exp_bias_;
+  bool calibrate_;
+  int calibration_exp_;
 };
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -29,10 +30,19 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   void Next();
   bool Skip();
   virtual void load_batch(Batch<Dtype>* batch);
+  void TransformItem(Dtype* top_data, Dtype* top_label, int item_id,
+      int worker);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+  // Whether the DB already leaves out the items of the other solvers
+  bool partitioned_;
+  // Serialized items of the batch being loaded, either viewed in place in
+  // the DB or copied into values_
+  vector<string> values_;
+  vector<const char*> value_data_;
+  vector<size_t> value_size_;
 };
 
 }  // namespace caffe
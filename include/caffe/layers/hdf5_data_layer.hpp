@@ -7,23 +7,37 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 #include "caffe/layers/base_data_layer.hpp"
 
 namespace caffe {
 
+// One batch of every top, filled by the streaming prefetch thread
+template <typename Dtype>
+class HDF5Batch {
+ public:
+  vector<shared_ptr<Blob<Dtype> > > blobs_;
+};
+
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * By default each file is loaded whole when the layer moves on to it. With
+ * hdf5_data_param.stream, hdf_blobs_ instead holds one chunk of batch_size
+ * rows of the current file, read as a hyperslab, and a prefetch thread fills
+ * hdf5_data_param.prefetch batches ahead of Forward, opening the next file
+ * while the batches already read are consumed.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), offset_() {}
+      : Layer<Dtype>(param), offset_(), stream_(false), stream_file_(-1),
+        stream_current_(NULL) {}
   virtual ~HDF5DataLayer();
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -38,6 +52,8 @@ class HDF5DataLayer : public Layer<Dtype> {
  protected:
   void Next();
   bool Skip();
+  // Copy the next batch_size rows into the (CPU) data of top.
+  void FillBatch(const vector<Blob<Dtype>*>& top);
 
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -48,6 +64,17 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
   virtual void LoadHDF5FileData(const char* filename);
+  // Shuffle order with shuffle_rng_, on whichever thread reads the rows.
+  void Shuffle(std::vector<unsigned int>* order);
+
+  // Streaming
+  virtual void InternalThreadEntry();
+  // Opens the current file and orders its chunks.
+  void OpenStreamFile();
+  // Reads the current chunk into hdf_blobs_.
+  void LoadStreamChunk();
+  // Moves to the next chunk, and the next file after a file's last chunk.
+  void NextStreamChunk();
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
@@ -57,6 +84,17 @@ class HDF5DataLayer : public Layer<Dtype> {
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
   uint64_t offset_;
+  shared_ptr<Caffe::RNG> shuffle_rng_;
+
+  bool stream_;
+  hid_t stream_file_;
+  hsize_t stream_rows_;
+  unsigned int current_chunk_;
+  std::vector<unsigned int> chunk_permutation_;
+  vector<shared_ptr<HDF5Batch<Dtype> > > stream_batches_;
+  BlockingQueue<HDF5Batch<Dtype>*> stream_free_;
+  BlockingQueue<HDF5Batch<Dtype>*> stream_full_;
+  HDF5Batch<Dtype>* stream_current_;
 };
 
 }  // namespace caffe
@@ -34,6 +34,9 @@ class HWCNLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Convert the outermost top rows [begin, end) of a 4-D shape.
+  void ConvertRows_cpu(const Dtype* bottom_data, Dtype* top_data,
+      const vector<int>& shape, const int begin, const int end);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   vector<int> bottom_shape_;
@@ -36,9 +36,13 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  void TransformItem(Dtype* prefetch_data, Dtype* prefetch_label,
+      int item_id, int worker);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Images and labels of the batch being loaded
+  vector<std::pair<std::string, int> > batch_lines_;
 };
 
 
@@ -47,6 +47,13 @@ class LRNLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelForward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Compute the scale of the images [begin, end).
+  void CrossChannelScale_cpu(const Dtype* bottom_data, Dtype* scale_data,
+      const int begin, const int end);
+  /// @brief Apply the scale to the elements [begin, end).
+  void CrossChannelOutput_cpu(const Dtype* bottom_data,
+      const Dtype* scale_data, Dtype* top_data, const int begin,
+      const int end);
   virtual void WithinChannelForward(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
@@ -16,7 +16,8 @@ namespace caffe {
  * @brief Convolves the input image with a bank of learned filters,
  *        and (optionally) adds biases.
  *
- *   The input is H x W x C x N convolved with a filter that is K x K x O x C.
+ *   The input is H x W x C x N convolved with a filter that is
+ *   KH x KW x O x C.
  *
  */
 template <typename Dtype>
@@ -27,12 +28,16 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
    *    with ConvolutionLayer options:
    *  - num_output. The number of filters.
    *  - kernel_size / kernel_h / kernel_w. The filter dimensions, given by
-   *  kernel_h and kernel_w have to be the same (i.e. square kernels only).
+   *  kernel_size for square filters or kernel_h and kernel_w for rectangular
+   *  filters, each at most 11.
    *  - stride / stride_h / stride_w (\b optional, default 1). The filter
-   *  stride, in the case of stride_h and stride_w have to be the same.
+   *  stride, given by stride for equal dimensions or stride_h and stride_w
+   *  for different strides.
    *  - pad / pad_h / pad_w (\b optional, default 0). The zero-padding for
-   *  convolution, given by pad for equal dimensions, pad_h and pad_w have to 
-   *  be the same. 
+   *  convolution, given by pad for equal dimensions or pad_h and pad_w for
+   *  different padding along each axis.
+   *  - dilation (\b optional, default 1). The filter dilation, given once
+   *  for both dimensions or once per dimension.
    *  - group (\b optional, default 1). The number of filter groups. Group
    *  convolution is a method for reducing parameterization by selectively
    *  connecting input and output channels. The input and output channel 
@@ -42,22 +47,57 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
    *  1 / group of the output channels. Concretely 4 input channels, 8 output
    *  channels, and 2 groups separate input channels 1-2 and output channels
    *  1-4 into the first group and input channels 3-4 and output channels 5-8
-   *  into the second group (only supported in forward pass currently).
+   *  into the second group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - subengine: DIRECT or WINOGRAD OCL engines.
+   *
+   * Forward_cpu and Backward_cpu run the direct HWCN engine of
+   * caffe/util/hwcn_conv.hpp, which also takes over in OCL mode for shapes
+   * the FPGA engine can't handle. With cr_param.emulate_engine the forward
+   * pass instead emulates the FPGA engine in cpfp, bit for bit.
    */
   explicit OCLCRHWCNLayer(const LayerParameter& param)
-      : ConvolutionLayer<Dtype>(param) {}
+      : ConvolutionLayer<Dtype>(param), ocl_params_(), ocl_params_bw_(),
+        ocl_params_bb_(), ocl_params_bi_(), engine_num_(0),
+        ocl_engine_(true),
+        weight_exp_bias_(0), pending_weight_diff_(false),
+        pending_bias_diff_(false), weight_diff_exp_bias_(0),
+        bias_diff_exp_bias_(0), diff_sums_on_device_(false) {}
+  virtual ~OCLCRHWCNLayer() { FinishBackward(); }
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual inline bool RunsOnDevice() const { return ocl_engine_; }
+  /**
+   * Backward_ocl queues the data pass first, so that the layer below can
+   * start once it is done, and the weight and bias passes on
+   * oclGradientQueue. With async_param_diffs, nothing waits for those, and
+   * the next Backward_ocl or this reads their diffs back and adds them to
+   * the parameter diffs. When more than one backward pass adds to them
+   * before this, as for iter_size > 1, the passes instead add to float sums
+   * on the device, read back once here.
+   */
+  virtual void SyncParamDiffs();
+  virtual void FinishBackward();
 
  protected:
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+  /// @brief Packs the layer for the FPGA engine and a batch of bottom[0].
+  void SetUpEngine(const vector<Blob<Dtype>*>& bottom);
+  int backward_data_pad(int axis);
+  bool ocl_engine_supports(const vector<Blob<Dtype>*>& bottom);
+  void fall_back_to_cpu(const char* reason);
+  kernel_params cpu_params(const Blob<Dtype>& bottom);
+  void forward_cpu_emulated(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Forward_ocl(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_ocl(const vector<Blob<Dtype>*>& top,
@@ -68,15 +108,31 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   void backward_weights(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  void copyToHalf(const Dtype *input, cpfp *output, int size);
+  void copyToHalf(const Dtype *input, cpfp *output, int size, int exp_bias);
   void copyToHalfWeights(const Dtype *input, cpfp *output,
-      kernel_params params);
-  void copyToFloatWeights(cpfp *input, Dtype *output, const vector<int>,
-      kernel_params params);
+      kernel_params params, int exp_bias);
+  template <typename T>
+  void copyToFloatWeights(const T *input, Dtype *output,
+      const vector<int>, kernel_params params, int exp_bias);
+  template <typename T>
+  void copyToFloatBias(const T *input, Dtype *output,
+      kernel_params params, int exp_bias);
   void RotateWeightsHalf(const Dtype *input, cpfp *output,
-      kernel_params params);
+      kernel_params params, int exp_bias);
+  /// @brief The exponent bias of the cpfp weights, 0 unless calibrated.
+  int weight_exp_bias();
+  /// @brief Sets the output exponent shift in the kernel parameters params.
+  void set_exp_shift(Blob<int>* params, int shift);
+  /**
+   * @brief Sets whether the weight pass of params writes cpfp diffs (0),
+   *        starts (1) or adds to (2) the float sums, and the exponent bias
+   *        of its diffs.
+   */
+  void set_accumulate(Blob<int>* params, int mode, int exp_bias);
   void launchKernel(const cpfp *bottom, const cpfp *weights, const cpfp *bias,
-      cpfp *top, int *tags, const int *params, int numgroups);
+      cpfp *top, int *tags, const int *params, float *accum, int numgroups,
+      cl_command_queue queue, std::vector<cl_event>* events);
+  void waitKernels(std::vector<cl_event>* events);
  private:
   kernel_params ocl_params_;
   kernel_params ocl_params_bw_;
@@ -87,6 +143,12 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
   Blob<cpfp> weights_h_r;
   Blob<cpfp> bias_h, bias_placeholder, weights_placeholder;
   Blob<int> param_vals;
+  Blob<int> param_vals_bw;
+  Blob<int> param_vals_bi;
+  Blob<int> param_vals_bb;
+  std::vector<cl_event> events_;
+  // The weight and bias passes on oclGradientQueue
+  std::vector<cl_event> param_events_;
   int conv_out_channels_;
   int conv_in_channels_;
   int conv_out_spatial_dim_;
@@ -94,6 +156,29 @@ class OCLCRHWCNLayer : public ConvolutionLayer<Dtype> {
   int num_cu_;
   int num_pe_;
   int burstoc_limit_;
+  // The batch size the engine parameters were computed for
+  int engine_num_;
+  // False when the layer always runs on the CPU engine
+  bool ocl_engine_;
+  // Exponent bias of the cpfp weights of the last forward pass
+  int weight_exp_bias_;
+  // Whether the device holds weight and bias diffs still to be read back,
+  // and the exponent biases of their sums
+  bool pending_weight_diff_;
+  bool pending_bias_diff_;
+  int weight_diff_exp_bias_;
+  int bias_diff_exp_bias_;
+  // Whether the pending diffs are float sums in weight_diff_sum_ and
+  // bias_diff_sum_ rather than cpfp diffs in weights_h and bias_h
+  bool diff_sums_on_device_;
+  Blob<float> weight_diff_sum_;
+  Blob<float> bias_diff_sum_;
+  // Dtype copies of the cpfp blobs for the CPU engine
+  Blob<Dtype> cpu_bottom_;
+  Blob<Dtype> cpu_top_;
+  // The parameters in cpfp for the emulated engine
+  Blob<cpfp> cpu_weights_h_;
+  Blob<cpfp> cpu_bias_h_;
 };
 #endif
 
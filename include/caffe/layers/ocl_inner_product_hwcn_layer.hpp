@@ -22,7 +22,8 @@ template <typename Dtype>
 class OCLHWCNInnerProductLayer : public InnerProductLayer<Dtype> {
  public:
   explicit OCLHWCNInnerProductLayer(const LayerParameter& param)
-      : InnerProductLayer<Dtype>(param) {}
+      : InnerProductLayer<Dtype>(param), ocl_params_(), ocl_params_bw_(),
+        ocl_params_bb_(), ocl_params_bi_() {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -31,6 +32,7 @@ class OCLHWCNInnerProductLayer : public InnerProductLayer<Dtype> {
   virtual inline const char* type() const { return "OCLHWCNInnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool RunsOnDevice() const { return true; }
 
  protected:
   virtual void Forward_ocl(const vector<Blob<Dtype>*>& bottom,
@@ -43,8 +45,10 @@ class OCLHWCNInnerProductLayer : public InnerProductLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void backward_weights(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Packs the layer for the FPGA engine and a batch of M_ images.
+  void SetUpEngine();
   void copyToHalf(const Dtype *input, cpfp *output, int size, int xdim,
-      int xdim_pad);
+      int xdim_pad, int exp_bias);
   void launchKernel(const cpfp *bottom, const cpfp *weights, const cpfp *bias,
       cpfp *top, int *tags, const int *params);
 
@@ -16,13 +16,14 @@ template <typename Dtype>
 class OCLPoolingHWCNLayer : public PoolingLayer<Dtype> {
  public:
   explicit OCLPoolingHWCNLayer(const LayerParameter& param)
-      : PoolingLayer<Dtype>(param) {}
+      : PoolingLayer<Dtype>(param), ocl_params_(), ocl_params_bi_() {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Pooling"; }
+  virtual inline bool RunsOnDevice() const { return true; }
 
  protected:
   virtual inline bool reverse_dimensions() { return false; }
@@ -36,6 +36,10 @@ class PadLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Pad the items [begin, end) along the first axis.
+  void PadItems_cpu(const Dtype* bottom_data, Dtype* top_data,
+      const vector<int>& shape, const vector<int>& top_shape,
+      const int begin, const int end);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   vector<int> bottom_shape_;
@@ -43,6 +43,9 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Pool the (n, c) planes [begin, end) of the bottom.
+  void PoolPlanes_cpu(const Dtype* bottom_data, Dtype* top_data, int* mask,
+      Dtype* top_mask, const int begin, const int end);
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
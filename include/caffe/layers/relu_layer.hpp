@@ -45,6 +45,9 @@ class ReLULayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Forward_cpu for the elements [begin, end).
+  void ForwardRange_cpu(const Dtype* bottom_data, Dtype* top_data,
+      const int begin, const int end);
 
   /**
    * @brief Computes the error gradient w.r.t. the ReLU inputs.
@@ -31,6 +31,10 @@ class SoftmaxLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Forward_cpu for the outer rows [begin, end).
+  void ForwardRows_cpu(const Dtype* bottom_data, Dtype* top_data,
+      const Dtype* sum_multiplier, const int channels, const int begin,
+      const int end);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
@@ -12,8 +12,16 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
+/**
+ Forward declare the boost synchronization types instead of including
+ boost/thread.hpp to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class condition_variable; class mutex; }
+
 namespace caffe {
 
+class TensorFile;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -89,6 +97,18 @@ class Net {
     return loss;
   }
 
+  /**
+   * @brief Lets the layers return from Backward before their parameter
+   *        diffs are complete; see Layer::set_async_param_diffs.
+   */
+  void set_async_param_diffs(const bool value);
+  /**
+   * @brief Sets the number of backward passes summed before each
+   *        SyncParamDiffs; see Layer::set_param_diff_passes.
+   */
+  void set_param_diff_passes(const int value);
+  /// @brief Completes the parameter diffs of the backward passes so far.
+  void SyncParamDiffs();
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
   /**
@@ -114,10 +134,23 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Copies the pre-trained layers from a tensor file, written by
+   *        ToTensorFile.
+   *
+   * With alias, parameters whose type matches Dtype take the mapped pages
+   * of the file as their CPU data, copy-on-write, instead of a copy; the
+   * net keeps the file mapped for as long as it lives. Otherwise each
+   * parameter is copied out of the mapping in one pass.
+   */
+  void CopyTrainedLayersFromTensorFile(const string trained_filename,
+      const bool alias = true);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /// @brief Writes the parameters the net owns to a tensor file.
+  void ToTensorFile(const string& filename) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -266,6 +299,31 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Let top blobs with disjoint lifetimes share data buffers.
+  void PlanActivationMemory();
+  /**
+   * @brief Split the layers after the data layers into alternating device and
+   *        host stages, and give every blob passed between stages one copy
+   *        per micro-batch in flight.
+   */
+  void PlanPipeline(const int micro_batch_size);
+  /**
+   * @brief Run the data layers on the whole batch, then push its
+   *        micro-batches through the stages, the device stages on a second
+   *        thread. Returns the loss averaged over the micro-batches.
+   */
+  Dtype ForwardPipelined();
+  /// @brief Run the stages of one side for every micro-batch, in wave order.
+  void RunPipelineWorker(const bool on_device, const Caffe::Brew mode);
+  /// @brief Block until the stage has finished count micro-batches.
+  void WaitForStage(const int stage, const int count);
+  /// @brief The blob a layer of micro-batch m reads or writes for blob_id.
+  inline Blob<Dtype>* micro_blob(const int blob_id, const int m) {
+    const vector<shared_ptr<Blob<Dtype> > >& copies = micro_blobs_[blob_id];
+    return copies.size() > 0 ? copies[m % copies.size()].get() :
+        blobs_[blob_id].get();
+  }
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -326,10 +384,36 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The tensor files whose mapped pages parameters use as their data
+  vector<shared_ptr<TensorFile> > mapped_weights_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Pipelined forward: the number of micro-batches per batch (0 when off),
+  /// the first layer after the data layers, and the first layer and side of
+  /// every stage.
+  int num_micro_batches_;
+  int pipeline_begin_;
+  vector<int> stage_begin_;
+  vector<bool> stage_on_device_;
+  /// Per blob, the copies cycled through by the micro-batches; empty for
+  /// blobs used within a single stage, which use the net blob.
+  vector<vector<shared_ptr<Blob<Dtype> > > > micro_blobs_;
+  /// The data layer tops split into micro-batches, and their batch axes.
+  vector<int> source_blob_ids_;
+  vector<int> source_batch_axes_;
+  /// Per stage, the (stage, copies) pairs of the blobs it produces: a copy
+  /// may only be overwritten once that stage is done with its last reader.
+  vector<vector<pair<int, int> > > stage_reuse_;
+  /// The bottom and top vectors of every layer, per micro-batch.
+  vector<vector<vector<Blob<Dtype>*> > > micro_bottom_vecs_;
+  vector<vector<vector<Blob<Dtype>*> > > micro_top_vecs_;
+  /// Progress of the current pipelined pass, guarded by pipeline_mutex_.
+  shared_ptr<boost::mutex> pipeline_mutex_;
+  shared_ptr<boost::condition_variable> pipeline_cond_;
+  vector<int> stage_done_;
+  Dtype pipeline_loss_;
   // Callbacks
   vector<Callback*> before_forward_;
   vector<Callback*> after_forward_;
@@ -1,11 +1,10 @@
 #ifndef CAFFE_PARALLEL_HPP_
 #define CAFFE_PARALLEL_HPP_
 
-#ifdef USE_NCCL
-
 #include <boost/thread.hpp>
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -16,7 +15,9 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
+#endif
 
 namespace caffe {
 
@@ -48,6 +49,99 @@ class Params {
 DISABLE_COPY_AND_ASSIGN(Params);
 };
 
+// Params stored in host memory, for solvers in CPU or OCL mode.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUParams();
+
+  void Configure(Solver<Dtype>* solver) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+/**
+ * Data parallel training in CPU mode, on one thread per worker. Each
+ * worker owns a solver and a replica of the net, and the gradients are
+ * averaged between the host buffers of the workers by a ring all-reduce.
+ *
+ * The gradients are reduced in buckets of about reduce_bucket_size values,
+ * on a thread of each worker's own. With layer_wise_reduce, a bucket is
+ * handed to that thread as soon as backward has completed it, so the
+ * reduction of the top layers overlaps the backward of the bottom ones.
+ * A parameter shared between layers is complete once its owner, the lowest
+ * of them, is done, so nets with shared weights can overlap too.
+ *
+ * OCL mode is limited to one worker: the FPGA layers of every net share one
+ * kernel object and the command queues of the process's single device, so
+ * several solvers can't each drive a board of their own.
+ */
+template<typename Dtype>
+class HostSync : public CPUParams<Dtype>,
+                 public Solver<Dtype>::Callback,
+                 public Net<Dtype>::Callback,
+                 public InternalThread {
+ public:
+  explicit HostSync(shared_ptr<Solver<Dtype> > solver);
+  ~HostSync();
+
+  /**
+   * Joins the instances of the other workers, each storing itself at its
+   * solver rank in syncs, and starts reducing.
+   */
+  void Connect(vector<HostSync<Dtype>*>* syncs, boost::barrier* barrier,
+      boost::barrier* reduce_barrier);
+
+  /**
+   * Broadcast weights from rank 0 other solvers.
+   */
+  void Broadcast();
+
+  /**
+   * Trains with this solver as rank 0 and workers - 1 others, each on a
+   * thread, until max_iter. Caffe::solver_count() should be workers.
+   */
+  void Run(int workers, const char* restore);
+
+ protected:
+  void on_start();
+  void run(int layer);  // Net callback
+  void on_gradients_ready();
+  virtual void InternalThreadEntry();
+  // Hands buckets_[bucket] to the reducing thread.
+  void Push(int bucket);
+  // Averages buckets_[bucket] over all the workers.
+  void Reduce(int bucket);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  int rank_;
+  vector<HostSync<Dtype>*>* syncs_;
+  // Synchronizes the solver threads, and the reducing threads
+  boost::barrier* barrier_;
+  boost::barrier* reduce_barrier_;
+  // The offset of each learnable param in the buffers, and the range of
+  // learnable params of each bucket, in the order backward completes them
+  vector<size_t> param_offsets_;
+  vector<pair<int, int> > buckets_;
+  // The range of layers owning the learnable params of each bucket
+  vector<pair<int, int> > bucket_layers_;
+  // The bucket backward completes with each layer, or -1
+  vector<int> layer_buckets_;
+  int backward_passes_;
+  int pushed_;
+  BlockingQueue<int> ready_;
+  BlockingQueue<int> done_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+#ifdef USE_NCCL
+
 // Params stored in GPU memory.
 template<typename Dtype>
 class GPUParams : public Params<Dtype> {
@@ -117,7 +211,8 @@ class NCCL : public GPUParams<Dtype>,
   using Params<Dtype>::diff_;
 };
 
+#endif  // USE_NCCL
+
 }  // namespace caffe
 
-#endif  // USE_NCCL
 #endif  // header
@@ -7,6 +7,7 @@
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -100,10 +101,18 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  string SnapshotToTensorFile();
+  // Hands a copy of the net and the history to snapshot_writer_.
+  void SnapshotAsync();
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
+  // The history blobs of the solver state, for asynchronous snapshots.
+  // Solvers that return NULL are always snapshotted synchronously.
+  virtual const vector<shared_ptr<Blob<Dtype> > >* snapshot_history() {
+    return NULL;
+  }
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
@@ -129,6 +138,10 @@ class Solver {
   Timer iteration_timer_;
   float iterations_last_;
 
+  // Writes the snapshots when async_snapshot is set. Created by the first
+  // of them, so that solvers which never snapshot run no extra thread.
+  shared_ptr<SnapshotWriter<Dtype> > snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -60,18 +60,14 @@ class SyncedMemory {
   explicit SyncedMemory(size_t size);
   ~SyncedMemory();
   const void* cpu_data();
-  const void* cpu_data(size_t size);
   void set_cpu_data(void* data);
   const void* gpu_data();
   const void* ocl_data();
-  const void* ocl_data(size_t size);
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
-  void* mutable_cpu_data(size_t size);
   void* mutable_gpu_data();
   void* mutable_ocl_data();
   void* mutable_ocl_data(int RW);
-  void* mutable_ocl_data(int RW, size_t size);
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, HEAD_AT_OCL,
     SYNCED };
   SyncedHead head() { return head_; }
@@ -79,12 +75,18 @@ class SyncedMemory {
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
 #endif
+#ifdef USE_OCL
+  void async_ocl_push(const cl_command_queue& queue);
+  // Queues the read back of the device copy; the host copy is current once
+  // event has completed
+  void async_ocl_pull(const cl_command_queue& queue, cl_event* event);
+#endif
 
  private:
-  void to_cpu(size_t size);
+  void to_cpu();
   void check_device();
   void to_gpu();
-  void to_ocl(int RW, size_t size);
+  void to_ocl(int RW);
   void* cpu_ptr_;
   void* gpu_ptr_;
   void* ocl_ptr_;
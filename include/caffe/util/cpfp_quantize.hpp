@@ -0,0 +1,36 @@
+#ifndef CAFFE_UTIL_CPFP_QUANTIZE_HPP_
+#define CAFFE_UTIL_CPFP_QUANTIZE_HPP_
+
+namespace caffe {
+
+/**
+ * @brief Rounds the n values of x in place to the nearest values of a
+ *        custom-precision floating-point format with exp_size exponent bits
+ *        and mant_size mantissa bits, and back to Dtype.
+ *
+ * This is float2cpfp() followed by cpfp2float() with the format chosen at
+ * run time rather than by EXP_SIZE and MANT_SIZE, so for the compiled format
+ * and round_nearest it gives the values a cpfp blob holds. Magnitudes below
+ * the smallest normal flush to a signed zero, those above the largest
+ * saturate to it, and round_nearest false truncates the mantissa towards
+ * zero, as the FPGA multipliers do. Double inputs are narrowed to float
+ * first. exp_size must be in [2, 8] and mant_size in [1, 23].
+ */
+template <typename Dtype>
+void cpfp_quantize(const int n, const int exp_size, const int mant_size,
+    const bool round_nearest, Dtype* x);
+
+/**
+ * @brief Returns the exponent bias that places the largest magnitude of the
+ *        n values of x at 2^target in cpfp, so float2cpfp(x[i], bias) keeps
+ *        the most significant values of x in range.
+ *
+ * The result is clamped to [-CPFP_MAX_EXP_BIAS, CPFP_MAX_EXP_BIAS]. All-zero
+ * and non-finite inputs give 0.
+ */
+template <typename Dtype>
+int cpfp_calibrate_exp_bias(const int n, const Dtype* x, const int target);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPFP_QUANTIZE_HPP_
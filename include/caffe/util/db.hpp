@@ -18,7 +18,13 @@ class Cursor {
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // Point *data at the current value without copying it. Backends whose
+  // values do not stay put until the cursor is destroyed return false, and
+  // value() has to be used instead.
+  virtual bool value_view(const char** data, size_t* size) { return false; }
   virtual bool valid() = 0;
+  // Move to the item with the given key, returning false if there is none.
+  virtual bool SeekToKey(const string& key) = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
@@ -47,6 +53,9 @@ class DB {
 
 DB* GetDB(DataParameter::DB backend);
 DB* GetDB(const string& backend);
+// The DB a DataLayer reads: the backend of param, or a ShardedDB when the
+// source is sharded or shuffled, which gives solver rank of size its part.
+DB* GetDB(const DataParameter& param, int rank, int size);
 
 }  // namespace db
 }  // namespace caffe
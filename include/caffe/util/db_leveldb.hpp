@@ -24,6 +24,10 @@ class LevelDBCursor : public Cursor {
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
   virtual bool valid() { return iter_->Valid(); }
+  virtual bool SeekToKey(const string& key) {
+    iter_->Seek(key);
+    return iter_->Valid() && iter_->key() == key;
+  }
 
  private:
   leveldb::Iterator* iter_;
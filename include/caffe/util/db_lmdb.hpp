@@ -34,7 +34,11 @@ class LMDBCursor : public Cursor {
     return string(static_cast<const char*>(mdb_value_.mv_data),
         mdb_value_.mv_size);
   }
+  // Values of the read-only transaction point into the memory map and stay
+  // valid for the lifetime of the cursor.
+  virtual bool value_view(const char** data, size_t* size);
   virtual bool valid() { return valid_; }
+  virtual bool SeekToKey(const string& key);
 
  private:
   void Seek(MDB_cursor_op op) {
@@ -0,0 +1,111 @@
+#ifndef CAFFE_UTIL_DB_SHARDED_HPP
+#define CAFFE_UTIL_DB_SHARDED_HPP
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+class ShardedDB;
+
+// An item of a sharded data set, found by its key in one of the shards.
+struct ShardedItem {
+  int shard;
+  string key;
+};
+
+// Reads the values of the items of one shard on its own thread and cursor,
+// in the order the plans of the epochs visit them, up to read_ahead items
+// ahead of the ShardedCursor that pops them.
+class ShardReader : public InternalThread {
+ public:
+  ShardReader(const ShardedDB* db, int shard);
+  virtual ~ShardReader();
+
+  // Let the reader start on the given epoch once it is done with the last.
+  void Allow(int epoch) { epochs_.push(epoch); }
+  string* Pop();
+  // Hand back a value from Pop once it is no longer needed.
+  void Release(string* value) { free_.push(value); }
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  const ShardedDB* db_;
+  int shard_;
+  string wait_message_;
+  vector<string> values_;
+  BlockingQueue<int> epochs_;
+  BlockingQueue<string*> free_;
+  BlockingQueue<string*> full_;
+
+  DISABLE_COPY_AND_ASSIGN(ShardReader);
+};
+
+// Visits the items of the plan of each epoch in turn. SeekToFirst moves on
+// to the first item of the next epoch, unless the cursor is already at the
+// first item of one. Values are copies, so value_view isn't supported, and
+// the keys are visited in the order of the plan, so neither is SeekToKey.
+class ShardedCursor : public Cursor {
+ public:
+  explicit ShardedCursor(const ShardedDB* db);
+  virtual void SeekToFirst();
+  virtual void Next();
+  virtual string key();
+  virtual string value() { return *value_; }
+  virtual bool valid() { return position_ < plan_.size(); }
+  virtual bool SeekToKey(const string& key);
+
+ private:
+  void StartEpoch();
+  void Fetch();
+
+  const ShardedDB* db_;
+  vector<shared_ptr<ShardReader> > readers_;
+  int epoch_;
+  vector<int> plan_;
+  int position_;
+  string* value_;
+};
+
+// One data set read from several databases of the same backend, given as a
+// comma separated source. Open indexes the keys of every shard. Each epoch
+// then visits the items striped across the shards, item i of every shard
+// before item i + 1 of any, or in a random order seeded by shuffle_seed and
+// the epoch. Solver rank of size gets every size-th item of that order.
+class ShardedDB : public DB {
+ public:
+  ShardedDB(const DataParameter& param, int rank, int size);
+  virtual ~ShardedDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual ShardedCursor* NewCursor();
+  virtual Transaction* NewTransaction();
+
+  // The items of an epoch, as indices into items().
+  void Plan(int epoch, vector<int>* plan) const;
+  inline const vector<ShardedItem>& items() const { return items_; }
+  inline int num_shards() const { return shards_.size(); }
+  inline DB* shard(int i) const { return shards_[i].get(); }
+  inline int read_ahead() const { return param_.shard_read_ahead(); }
+
+ private:
+  DataParameter param_;
+  int rank_;
+  int size_;
+  vector<shared_ptr<DB> > shards_;
+  vector<ShardedItem> items_;
+  // The striped order of the items, before shuffling and partitioning
+  vector<int> order_;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_SHARDED_HPP
@@ -0,0 +1,27 @@
+#ifndef CAFFE_UTIL_FFT_CONV_HPP_
+#define CAFFE_UTIL_FFT_CONV_HPP_
+
+namespace caffe {
+
+/**
+ * @brief Convolves num N x C x H x W images with num_output x (C / group) x
+ *        kernel_h x kernel_w filters, stride 1 and no dilation, by pointwise
+ *        products in the frequency domain.
+ *
+ * The padded images and the filters are zero-filled to the next power of two
+ * at least H + 2 pad_h by W + 2 pad_w, which is large enough that the
+ * circular correlation the transforms compute never wraps into the output.
+ * Each filter is transformed once for a chunk of images, so the engine pays
+ * off for large kernels, where the im2col buffer grows with the kernel area
+ * and the transforms do not. data_out is overwritten with the N x num_output
+ * x (H + 2 pad_h - kernel_h + 1) x (W + 2 pad_w - kernel_w + 1) correlation.
+ */
+template <typename Dtype>
+void fft_conv_cpu(const Dtype* data_im, const int num, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int group, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FFT_CONV_HPP_
@@ -1,6 +1,7 @@
 #ifndef CAFFE_UTIL_HDF5_H_
 #define CAFFE_UTIL_HDF5_H_
 
+#include <boost/thread/recursive_mutex.hpp>
 #include <string>
 
 #include "hdf5.h"
@@ -10,6 +11,14 @@
 
 namespace caffe {
 
+// libhdf5 is usually built without its thread-safe option, and the streaming
+// HDF5Data prefetch threads read while the solver thread snapshots, loads
+// weights or writes HDF5Output. Every call into libhdf5 in the process is made
+// holding this lock. The helpers below take it themselves; code that calls
+// libhdf5 directly takes it around the whole open-to-close of a file. It is
+// recursive so such code can still call the helpers.
+boost::recursive_mutex& hdf5_mutex();
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,6 +29,17 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+// Reads rows [first_row, first_row + num_rows) along the first axis of a
+// dataset into blob, reshaped to num_rows by the other axes, without reading
+// the rest of the dataset.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, Blob<Dtype>* blob);
+
+// The size of the first axis of a dataset.
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
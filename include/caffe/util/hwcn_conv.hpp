@@ -0,0 +1,59 @@
+#ifndef CAFFE_UTIL_HWCN_CONV_HPP_
+#define CAFFE_UTIL_HWCN_CONV_HPP_
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * Direct convolution on HWCN blobs for the CPU, without im2col and without
+ * converting to NCHW.
+ *
+ * The geometry comes from the same kernel_params the OCL engine takes:
+ * ydim x xdim x (inchannels * numgroups) x numimages bottoms, filters laid
+ * out as Caffe's (outchannels * numgroups) x inchannels x ksize x ksize_w,
+ * and (top ydim) x (top xdim) x (outchannels * numgroups) x numimages tops.
+ * Only the geometry fields (and relu for the forward pass, and burstchannels
+ * and exp_shift for the cpfp one) are read. The
+ * innermost loops run over the contiguous images of a pixel, and each row of
+ * bottom values is reused for a block of output channels while it is in
+ * registers. Rows of the output are split over caffe_parallel_for, and every
+ * output keeps the same summation order for any thread count.
+ */
+
+/// The top height and width of a convolution with the given geometry.
+int hwcn_conv_top_height(const kernel_params& params);
+int hwcn_conv_top_width(const kernel_params& params);
+
+/// top = conv(bottom, weights) + bias, clamped at zero if params.relu is set.
+/// bias may be NULL.
+template <typename Dtype>
+void hwcn_conv_forward_cpu(const Dtype* bottom, const Dtype* weights,
+    const Dtype* bias, const kernel_params& params, Dtype* top);
+
+/// The forward pass in cpfp arithmetic, in the order the FPGA engine sums, so
+/// the tops match the engine's bit for bit: products of four input channels
+/// go through the engine's adder tree and join the sum started from the bias,
+/// over bursts of params.burstchannels input channels (one burst of the group
+/// if 0), then the window positions inside the image. Bursts that aren't a
+/// multiple of 4 channels, which the engine can't take, are padded with zero
+/// products. Finished tops are clamped at zero if params.relu is set and
+/// scaled by 2^params.exp_shift. bias may be NULL.
+void hwcn_conv_forward_cpfp(const cpfp* bottom, const cpfp* weights,
+    const cpfp* bias, const kernel_params& params, cpfp* top);
+
+/// bottom_diff = the correlation of top_diff with the flipped weights.
+/// bottom_diff is overwritten.
+template <typename Dtype>
+void hwcn_conv_backward_data_cpu(const Dtype* top_diff, const Dtype* weights,
+    const kernel_params& params, Dtype* bottom_diff);
+
+/// Adds the weight gradient to weight_diff and the bias gradient to
+/// bias_diff. Either may be NULL to skip that gradient.
+template <typename Dtype>
+void hwcn_conv_backward_weights_cpu(const Dtype* bottom, const Dtype* top_diff,
+    const kernel_params& params, Dtype* weight_diff, Dtype* bias_diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HWCN_CONV_HPP_
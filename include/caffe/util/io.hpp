@@ -126,6 +126,18 @@ inline bool ReadImageToDatum(const string& filename, const int label,
   return ReadImageToDatum(filename, label, 0, 0, true, encoding, datum);
 }
 
+/**
+ * @brief Parse a serialized Datum without copying its data bytes.
+ *
+ * datum gets every field except data, which is left empty; *data and
+ * *data_size point at the bytes inside buffer instead, so they are only
+ * valid as long as buffer is. A buffer repeating the data field is parsed
+ * and copied as usual, with *data pointing into datum instead. Returns false
+ * if buffer is not a valid Datum.
+ */
+bool ParseDatumAliasingData(const char* buffer, size_t size, Datum* datum,
+    const char** data, size_t* data_size);
+
 bool DecodeDatumNative(Datum* datum);
 bool DecodeDatum(Datum* datum, bool is_color);
 
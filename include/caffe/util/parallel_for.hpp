@@ -0,0 +1,45 @@
+#ifndef CAFFE_UTIL_PARALLEL_FOR_HPP_
+#define CAFFE_UTIL_PARALLEL_FOR_HPP_
+
+#include <boost/function.hpp>
+
+#include <algorithm>
+
+namespace caffe {
+
+/**
+ * @brief Set the number of threads caffe_parallel_for splits a loop over,
+ *        counting the calling thread. 0 uses one per hardware thread. The
+ *        default of 1 runs every loop serially on the caller.
+ */
+void caffe_set_cpu_threads(int threads);
+int caffe_cpu_threads();
+
+/**
+ * @brief Run body(begin, end) over the index range [0, n), split into one
+ *        contiguous chunk per thread.
+ *
+ * Chunk boundaries fall on multiples of grain, so ranges of fewer than two
+ * grains stay on the calling thread. Every index is visited exactly once,
+ * so a body that only writes the outputs of its own indices gives the same
+ * result as the serial loop for any thread count. Nested calls, and calls
+ * made while another thread's loop holds the pool, run serially.
+ */
+void caffe_parallel_for(const int n, const int grain,
+    const boost::function<void(int, int)>& body);
+
+/**
+ * @brief The grain for a loop whose indices each cost about work element
+ *        operations, so that a chunk is worth handing to a thread. Grains of
+ *        64 or more are rounded to a multiple of 64, which keeps the chunk
+ *        boundaries of elementwise loops on the vector lanes of the math
+ *        kernels, so their results match the serial call bit for bit.
+ */
+inline int caffe_parallel_grain(const int work) {
+  const int grain = std::max(1, 16384 / std::max(1, work));
+  return grain < 64 ? grain : grain / 64 * 64;
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PARALLEL_FOR_HPP_
@@ -0,0 +1,82 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A copy of the parameters of a Net and the history of its solver,
+ *        taken at an iteration boundary, and the files to write it to.
+ */
+template <typename Dtype>
+class SnapshotJob {
+ public:
+  SnapshotJob() {}
+
+  SolverParameter::SnapshotFormat format_;
+  bool write_diff_;
+  string model_filename_;
+  string state_filename_;
+  // The layers of the net without their blobs, and the iter, current_step
+  // and learned_net of the solver state without its history
+  NetParameter net_param_;
+  SolverState state_;
+  // The copies of the blobs of each layer, and whether the net owns each
+  // (rather than sharing it with another layer)
+  vector<vector<shared_ptr<Blob<Dtype> > > > layer_blobs_;
+  vector<vector<bool> > layer_blob_owned_;
+  vector<shared_ptr<Blob<Dtype> > > history_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotJob);
+};
+
+/**
+ * @brief Writes solver snapshots on a thread of its own, so that training
+ *        only stalls for a copy of the parameters and history.
+ *
+ * Write() copies the blobs into host memory it reuses from snapshot to
+ * snapshot and returns; the thread then serializes them in the format and
+ * layout of Solver::Snapshot and SGDSolver::SnapshotSolverState. Each file is
+ * written under a temporary name, synced to disk and renamed into place, the
+ * model before the solver state, so a crash never leaves a partial snapshot
+ * under its final name. Only binary protos and tensor files are supported:
+ * libhdf5 isn't thread-safe, and HDF5 layers use it on other threads. Only
+ * one snapshot is written at a time: Write() waits for the previous one
+ * first.
+ */
+template <typename Dtype>
+class SnapshotWriter : public InternalThread {
+ public:
+  SnapshotWriter();
+  virtual ~SnapshotWriter();
+
+  void Write(const Net<Dtype>& net,
+      const vector<shared_ptr<Blob<Dtype> > >& history,
+      const SolverState& state, const SolverParameter::SnapshotFormat format,
+      const bool write_diff, const string& model_filename,
+      const string& state_filename);
+  /// @brief Blocks until the last snapshot is on disk.
+  void Wait();
+
+ protected:
+  virtual void InternalThreadEntry();
+  void WriteJob(const SnapshotJob<Dtype>& job);
+
+  SnapshotJob<Dtype> job_;
+  BlockingQueue<SnapshotJob<Dtype>*> free_;
+  BlockingQueue<SnapshotJob<Dtype>*> full_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
@@ -0,0 +1,67 @@
+#ifndef CAFFE_UTIL_SOLVER_UPDATE_HPP_
+#define CAFFE_UTIL_SOLVER_UPDATE_HPP_
+
+#include <cstddef>
+
+namespace caffe {
+
+/**
+ * @brief The update rules of the SGD solver family, as computed by
+ *        caffe_cpu_solver_update.
+ */
+enum SolverUpdateRule {
+  SOLVER_UPDATE_SGD,
+  SOLVER_UPDATE_NESTEROV,
+  SOLVER_UPDATE_ADAGRAD,
+  SOLVER_UPDATE_RMSPROP,
+  SOLVER_UPDATE_ADADELTA,
+  SOLVER_UPDATE_ADAM
+};
+
+/**
+ * @brief The blobs and hyperparameters of one parameter's update.
+ *
+ * history and history2 are the solver's history blobs for the parameter;
+ * history2 is only read by AdaDelta (the update history) and Adam (the
+ * second moment). momentum is the momentum of SGD, Nesterov and AdaDelta,
+ * the rms_decay of RMSProp and beta1 of Adam; momentum2 is beta2 of Adam.
+ * rate is the learning rate including the parameter's lr_mult and, for
+ * Adam, the bias correction.
+ */
+template <typename Dtype>
+struct SolverUpdateArgs {
+  SolverUpdateArgs()
+      : data(NULL), diff(NULL), history(NULL), history2(NULL), diff_scale(1),
+        decay(0), l1(false), rate(0), momentum(0), momentum2(0), delta(0) {}
+
+  Dtype* data;
+  Dtype* diff;
+  Dtype* history;
+  Dtype* history2;
+  Dtype diff_scale;
+  Dtype decay;
+  bool l1;
+  Dtype rate;
+  Dtype momentum;
+  Dtype momentum2;
+  Dtype delta;
+};
+
+/**
+ * @brief Applies one solver step to the n values of a parameter in a single
+ *        pass: scales the gradient by diff_scale, adds the L2 (or, with l1,
+ *        the L1) weight decay, updates the history, stores the update value
+ *        in diff and subtracts it from data.
+ *
+ * This is SGDSolver's Normalize, Regularize and ComputeUpdateValue followed
+ * by Blob::Update, with each element read and written once instead of once
+ * per step. The loop is split over caffe_parallel_for, and the results match
+ * the multi-pass path to rounding.
+ */
+template <typename Dtype>
+void caffe_cpu_solver_update(const SolverUpdateRule rule, const int n,
+    const SolverUpdateArgs<Dtype>& args);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SOLVER_UPDATE_HPP_
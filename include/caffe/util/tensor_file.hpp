@@ -0,0 +1,98 @@
+#ifndef CAFFE_UTIL_TENSOR_FILE_HPP_
+#define CAFFE_UTIL_TENSOR_FILE_HPP_
+
+#include <stdint.h>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * The first bytes of a tensor file. The arrays follow, each starting on a
+ * multiple of kTensorFileAlignment, and the serialized TensorFileIndex ends
+ * the file. Everything is in host byte order.
+ */
+struct TensorFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t index_offset;
+  uint64_t index_size;
+};
+
+const char kTensorFileMagic[8] = {'C', 'A', 'F', 'F', 'E', 'T', 'N', 'S'};
+const uint32_t kTensorFileVersion = 1;
+// A cache line, and a multiple of the vector width of every SIMD extension
+const uint32_t kTensorFileAlignment = 64;
+
+/**
+ * @brief Writes the parameters of a net to a tensor file, one blob at a
+ *        time. The blobs go to filename.tmp, which Close() syncs to disk and
+ *        renames over filename, so an existing file is replaced whole and
+ *        never rewritten in place.
+ */
+template <typename Dtype>
+class TensorFileWriter {
+ public:
+  TensorFileWriter(const string& filename, const string& net_name);
+  ~TensorFileWriter();
+
+  /// @brief Appends the data of blob, index of layer's blobs.
+  void Add(const string& layer, const int index, const Blob<Dtype>& blob);
+  /// @brief Writes the index and the header and closes the file.
+  void Close();
+
+ private:
+  string filename_;
+  string temp_filename_;
+  std::ofstream file_;
+  TensorFileIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(TensorFileWriter);
+};
+
+/**
+ * @brief A tensor file mapped into memory, copy-on-write.
+ *
+ * The arrays can be read in place, or handed to blobs as their CPU data.
+ * Pages are shared through the page cache with every other process that maps
+ * the same file until written, when the writer gets a private copy. Nothing
+ * written through the mapping reaches the file, and TensorFileWriter replaces
+ * rather than rewrites files, so the mapping stays valid when a new file is
+ * written under the same name; anything else that truncates or rewrites the
+ * file in place breaks it. The mapping lasts as long as the TensorFile does.
+ */
+class TensorFile {
+ public:
+  explicit TensorFile(const string& filename);
+  ~TensorFile();
+
+  /// @brief Returns true if filename starts with the tensor file magic.
+  static bool IsTensorFile(const string& filename);
+
+  inline const TensorFileIndex& index() const { return index_; }
+  inline const string& filename() const { return filename_; }
+  /// @brief The first element of the array of an entry of the index.
+  inline void* data(const TensorFileEntry& entry) const {
+    return static_cast<char*>(map_) + entry.offset();
+  }
+  /// @brief The number of elements of an entry of the index.
+  static int count(const TensorFileEntry& entry);
+
+ private:
+  string filename_;
+  void* map_;
+  size_t size_;
+  TensorFileIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(TensorFile);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TENSOR_FILE_HPP_
@@ -0,0 +1,27 @@
+#ifndef CAFFE_UTIL_WINOGRAD_HPP_
+#define CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+/**
+ * @brief Convolves num N x C x H x W images with num_output x (C / group) x
+ *        3 x 3 filters, stride 1 and no dilation, using the Winograd minimal
+ *        filtering algorithm F(tile x tile, 3 x 3) of Lavin and Gray (2015).
+ *
+ * tile is 2 or 4, giving 4 x 4 or 6 x 6 transformed tiles. The filters and
+ * the zero-padded input tiles of one image are transformed, every one of the
+ * (tile + 2)^2 transformed points is then a (num_output / group) x
+ * (C / group) by (C / group) x tiles GEMM per group, and the products are
+ * transformed back into the output tiles. data_out is overwritten with the
+ * N x num_output x (H + 2 pad_h - 2) x (W + 2 pad_w - 2) correlation, which
+ * matches im2col + GEMM up to rounding.
+ */
+template <typename Dtype>
+void winograd_conv_cpu(const Dtype* data_im, const int num,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const int num_output, const int group,
+    const int pad_h, const int pad_w, const int tile, Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WINOGRAD_HPP_
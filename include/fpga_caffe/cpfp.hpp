@@ -31,6 +31,9 @@
 #define ROUND_NEAREST_ADD 1 
 #define CPFP_MIN_VAL (1 << SIGN_SHIFT) | (MAX_EXP << EXP_SHIFT) | MAX_MANT
 #define CPFP_MAX_VAL (MAX_EXP << EXP_SHIFT) | MAX_MANT
+// Largest magnitude of a per-tensor exponent bias, which keeps every biased
+// cpfp value a normal float
+#define CPFP_MAX_EXP_BIAS 64
 
 #if (EXP_SIZE + MANT_SIZE + 1) > 16
   #define DIFF_SIZE (32 - EXP_SIZE - MANT_SIZE - 1)
@@ -43,6 +46,10 @@ typedef uint32_t uint32;
 typedef int16_t int16;
 typedef int32_t int32;
 
+#ifndef SYNTHESIS
+#include "cpfp_emu.hpp"
+#endif
+
 class cpfp;
 
 cpfp operator*(cpfp T, float U);
@@ -61,14 +68,19 @@ bool operator!=(cpfp T, cpfp U);
 cpfp max(cpfp T, cpfp U, short Tmask, short Umask, short *out_mask);
 cpfp max(cpfp T, cpfp U);
 cpfp max(cpfp T);
+cpfp exp_shift(cpfp T, int shift);
 
-/// Convert IEEE single-precision to cpfp-precision.
-inline uint32 float2cpfp(float value)
+/// Convert IEEE single-precision to cpfp-precision. A nonzero exp_bias
+/// stores value * 2^-exp_bias, for tensors whose values sit outside the
+/// range of the shared EXP_OFFSET; its magnitude is at most CPFP_MAX_EXP_BIAS.
+inline uint32 float2cpfp(float value, int exp_bias = 0)
 {
   uint32 bits;		//violating strict aliasing!
   float *temp = &value;
   bits = *((uint32 *)temp);
-  int32 exp = ((bits >> 23) & 0xFF) - 127;
+  // Zeros and denormals have no exponent to bias
+  int32 exp = (((bits >> 23) & 0xFF) == 0) ? -255 :
+    (int32)((bits >> 23) & 0xFF) - 127 - exp_bias;
   uint32 sign = (bits >> (31 - SIGN_SHIFT)) & SIGN_MASK;
   uint32 mant = (bits & 0x7FFFFF);
   uint32 guard = (mant >> (22 - MANT_SIZE)) & 0x1;
@@ -90,14 +102,15 @@ inline uint32 float2cpfp(float value)
   return hbits;
 }
 
-// Convert cpfp-precision to IEEE single-precision.
-inline float cpfp2float(uint32 value)
+// Convert cpfp-precision to IEEE single-precision, multiplying by
+// 2^exp_bias for a value stored with float2cpfp(value, exp_bias).
+inline float cpfp2float(uint32 value, int exp_bias = 0)
 {
   float out;
   uint32 sign = (value & SIGN_MASK) << (31 - SIGN_SHIFT);
   uint32 mant = value & MANT_MASK;
   uint32 exp = (value >> MANT_SIZE) & MAX_EXP;
-  uint32 eresf = (exp != 0) ? (exp + 127 - EXP_OFFSET) << 23 : 0;
+  uint32 eresf = (exp != 0) ? (exp + 127 - EXP_OFFSET + exp_bias) << 23 : 0;
   uint32 mantf = (exp != 0) ? (mant) << (23 - MANT_SIZE) : 0;
   uint32 bits = sign | eresf | mantf;
   uint32 *temp = &bits;
@@ -118,6 +131,7 @@ class cpfp {
       short *out_mask);
   friend cpfp max(cpfp T, cpfp U);
   friend cpfp max(cpfp T);
+  friend cpfp exp_shift(cpfp T, int shift);
   friend cpfp operator/(cpfp T, cpfp U);
   friend cpfp operator/(cpfp T, int U);
   friend bool operator<(cpfp T, cpfp U);
@@ -261,7 +275,7 @@ cpfp operator*(cpfp T, cpfp U) {
 
   return cpfp(res);
 #else
-  return cpfp(float(T) * float(U));
+  return cpfp(cpfp_emu_mult(T.data_, U.data_));
 #endif
 }
 
@@ -392,8 +406,10 @@ void mult2_1(cpfp T1, cpfp T2, cpfp U, cpfp *O1, cpfp *O2) {
   *O1 = cpfp(O1_temp);
   *O2 = cpfp(O2_temp);
 #else
-  *O1 = cpfp(float(T1) * float(U));
-  *O2 = cpfp(float(T2) * float(U));
+  uint32 O1_temp, O2_temp;
+  cpfp_emu_mult2_1(T1.data_, T2.data_, U.data_, &O1_temp, &O2_temp);
+  *O1 = cpfp(O1_temp);
+  *O2 = cpfp(O2_temp);
 #endif
 }
 
@@ -1016,7 +1032,7 @@ cpfp operator+(cpfp T, cpfp U) {
 
   return cpfp(res);
 #else
-  return cpfp(float(T) + float(U));
+  return cpfp(cpfp_emu_add(T.data_, U.data_));
 #endif
 }
 
@@ -1223,7 +1239,7 @@ cpfp operator-(cpfp T, cpfp U) {
 
   return cpfp(res);
 #else
-  return cpfp(float(T) - float(U));
+  return cpfp(cpfp_emu_sub(T.data_, U.data_));
 #endif
 }
 
@@ -1338,6 +1354,39 @@ cpfp max(cpfp T) {
   return res;
 }
 
+// Multiplies T by 2^shift, moving it from one exponent bias to another:
+// products carry the sum of their operands' biases and are shifted back
+// before they are written out. Results past the largest exponent saturate
+// and those below the smallest flush to a zero of the same sign.
+#ifndef SYNTHESIS
+inline
+#endif
+cpfp exp_shift(cpfp T, int shift) {
+#ifdef SYNTHESIS
+#pragma HLS INLINE off
+#pragma HLS pipeline
+  ap_uint<FP_WIDTH> Tdata_ = T.data_;
+  ap_uint<EXP_SIZE> e = Tdata_ >> EXP_SHIFT;
+  ap_uint<FP_WIDTH> sign = Tdata_ & SIGN_MASK;
+  ap_uint<MANT_SIZE> mantresf = Tdata_ & MANT_MASK;
+  ap_int<EXP_SIZE + 9> eres = e + shift;
+  ap_uint<EXP_SIZE> eres_t = eres;
+  if (e == 0 || eres <= 0) {
+    eres_t = 0;
+    mantresf = 0;
+  } else if (eres >= MAX_EXP) {
+    eres_t = MAX_EXP - 1;
+    mantresf = MAX_MANT;
+  }
+  ap_uint<FP_WIDTH> eresf = eres_t;
+  ap_uint<FP_WIDTH> res = sign | ((eresf << EXP_SHIFT) & EXP_MASK) |
+    mantresf;
+  return cpfp(res);
+#else
+  return cpfp(cpfp_emu_shift(T.data_, shift));
+#endif
+}
+
 inline cpfp operator*(cpfp T, float U) {
   return cpfp(float(T) * U);
 }
@@ -0,0 +1,321 @@
+#ifndef CPFP_EMU_HPP_
+#define CPFP_EMU_HPP_
+
+/* Host emulation of the synthesised cpfp datapath.
+ *
+ * Each function follows the ap_uint code of the matching operator in
+ * cpfp.hpp step by step on plain integers, keeping the hardware bit widths,
+ * so host results match the kernels bit for bit: multiplies truncate unless
+ * ROUND_NEAREST_MULT is set, adds take the far or close path with the
+ * configured rounding, and results that under- or overflow are flushed to
+ * zero or saturated. The functions are branch free and always inlined, and
+ * the 16-lane forms compute into a local array before storing, so their loops
+ * vectorise at -O2 with no aliasing checks. hwcn_conv_forward_cpfp runs the
+ * forward pass of the engine on them.
+ *
+ * Included by cpfp.hpp when SYNTHESIS is not defined.
+ */
+
+#ifdef __GNUC__
+#define CPFP_EMU_INLINE inline __attribute__((always_inline))
+#else
+#define CPFP_EMU_INLINE inline
+#endif
+
+// cond ? a : b for a cond of 0 or 1, in arithmetic so lanes stay branch free
+CPFP_EMU_INLINE uint32 cpfp_emu_sel(uint32 cond, uint32 a, uint32 b) {
+  return b ^ ((a ^ b) & (0u - cond));
+}
+
+// x << amount for amounts below 16, built from constant shifts like a barrel
+// shifter, since per-lane variable shifts don't vectorise on every target
+CPFP_EMU_INLINE uint32 cpfp_emu_shl(uint32 x, uint32 amount) {
+  x = (amount & 0x1) ? x << 1 : x;
+  x = (amount & 0x2) ? x << 2 : x;
+  x = (amount & 0x4) ? x << 4 : x;
+  x = (amount & 0x8) ? x << 8 : x;
+  return x;
+}
+
+// Shifts a MANT_SIZE + 2 bit close path sum left until its leading one is in
+// the top bit and returns the shift, which is what LOD() computes. A zero sum
+// is left as it is.
+CPFP_EMU_INLINE uint32 cpfp_emu_lod(uint32 *sum) {
+  uint32 zeros = 0;
+  // Unrolled, as g++ at -O2 doesn't vectorise the lane loops around it
+  // otherwise
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC unroll 16
+#endif
+  for (int i = 1; i < MANT_SIZE + 2; ++i) {
+    const uint32 shift = (*sum != 0) & (*sum < (1u << (MANT_SIZE + 1)));
+    *sum = shift ? *sum << 1 : *sum;
+    zeros += shift;
+  }
+  return zeros;
+}
+
+// Exponent, rounding and saturation stage of the multipliers. product holds
+// the (M + 1) * (M + 1) mantissa product in its low PRODUCT_SIZE bits; in
+// the packed multiplier the other lane's product sits above it and reaches
+// the mantissa register when it is shifted, just as in hardware.
+CPFP_EMU_INLINE uint32 cpfp_emu_mult_result(uint32 e1, uint32 e2, uint32 sign,
+    uint32 product) {
+  // Shift the resulting mantissa by 1 and add 1 to the resulting exponent if
+  // there is a leading one in position MANT_SIZE + 1
+  const uint32 shift = (product >> (PRODUCT_SIZE - 1)) & 0x1;
+  uint32 mantres = (shift ? product >> (MANT_SIZE + 1) :
+    product >> MANT_SIZE) & ((1 << (MANT_SIZE + 2)) - 1);
+  int32 eres = int32(e1 + e2) - EXP_OFFSET + int32(shift);
+
+#if ROUND_NEAREST_MULT == 1
+  const uint32 last = mantres & 0x1;
+  const uint32 guard = (shift ? product >> MANT_SIZE :
+    product >> (MANT_SIZE - 1)) & 0x1;
+  const uint32 sticky = (product & (shift ? MAX_MANT : MAX_MANT >> 1)) > 0;
+  const uint32 rnd = guard & (sticky | last);
+  eres += rnd & (mantres == (MAX_MANT | MANT_NORM));
+  mantres += rnd;
+#endif
+
+  const uint32 saturate = eres >= MAX_EXP;
+  const uint32 zero = (e1 == 0) | (e2 == 0) | (eres <= 0);
+  const uint32 eres_t = saturate ? MAX_EXP - 1 : zero ? 0 : eres & MAX_EXP;
+  const uint32 mantresf = saturate ? MAX_MANT : zero ? 0 : mantres & MANT_MASK;
+  return (sign << SIGN_SHIFT) | (eres_t << EXP_SHIFT) | mantresf;
+}
+
+// T * U, as operator*(cpfp, cpfp) computes it
+CPFP_EMU_INLINE uint32 cpfp_emu_mult(uint32 T, uint32 U) {
+  const uint32 e1 = (T >> EXP_SHIFT) & MAX_EXP;
+  const uint32 e2 = (U >> EXP_SHIFT) & MAX_EXP;
+  const uint32 sign = ((T ^ U) >> SIGN_SHIFT) & 0x1;
+  const uint32 product = ((T & MANT_MASK) | MANT_NORM) *
+    ((U & MANT_MASK) | MANT_NORM);
+  return cpfp_emu_mult_result(e1, e2, sign, product);
+}
+
+// T1 * U and T2 * U from one packed multiplier, as mult2_1() computes them
+inline void cpfp_emu_mult2_1(uint32 T1, uint32 T2, uint32 U, uint32 *O1,
+    uint32 *O2) {
+  const uint32 e_T1 = (T1 >> EXP_SHIFT) & MAX_EXP;
+  const uint32 e_T2 = (T2 >> EXP_SHIFT) & MAX_EXP;
+  const uint32 e_U = (U >> EXP_SHIFT) & MAX_EXP;
+  const uint32 op = (((T2 & MANT_MASK) | MANT_NORM) << PRODUCT_SIZE) |
+    (T1 & MANT_MASK) | MANT_NORM;
+  const uint32 product = op * ((U & MANT_MASK) | MANT_NORM);
+  *O1 = cpfp_emu_mult_result(e_T1, e_U, ((T1 ^ U) >> SIGN_SHIFT) & 0x1,
+      product);
+  *O2 = cpfp_emu_mult_result(e_T2, e_U, ((T2 ^ U) >> SIGN_SHIFT) & 0x1,
+      product >> PRODUCT_SIZE);
+}
+
+// T + U, as operator+(cpfp, cpfp) computes it
+CPFP_EMU_INLINE uint32 cpfp_emu_add(uint32 T, uint32 U) {
+  const uint32 e1 = (T >> EXP_SHIFT) & MAX_EXP;
+  const uint32 e2 = (U >> EXP_SHIFT) & MAX_EXP;
+  const uint32 sign1 = (T >> SIGN_SHIFT) & 0x1;
+  const uint32 sign2 = (U >> SIGN_SHIFT) & 0x1;
+
+  // EOP = 1 -> add, EOP = 0 -> sub
+  const uint32 EOP = sign1 == sign2;
+
+  // 1 if e1 is bigger, 0 if e2 is bigger
+  const uint32 exp_cmp = e1 >= e2;
+  const uint32 mant1_s = cpfp_emu_sel(exp_cmp, T, U) & MANT_MASK;
+  const uint32 mant2_s = cpfp_emu_sel(exp_cmp, U, T) & MANT_MASK;
+  const uint32 e1_s = cpfp_emu_sel(exp_cmp, e1, e2);
+  const uint32 e2_s = cpfp_emu_sel(exp_cmp, e2, e1);
+  const uint32 sign1_s = cpfp_emu_sel(exp_cmp, sign1, sign2);
+  const uint32 sign2_s = cpfp_emu_sel(exp_cmp, sign2, sign1);
+
+  const uint32 diff = e1_s - e2_s;
+
+  // Flag for determining if we're in the far or close path
+  const uint32 fpath_flag = (diff > 1) | EOP;
+
+  const uint32 mant1_large = cpfp_emu_sel(e1_s != 0, mant1_s | MANT_NORM, 0);
+  const uint32 mant2_large = cpfp_emu_sel(e2_s != 0, mant2_s | MANT_NORM, 0);
+
+  // Close path, sub and (diff = 0 or diff = 1)
+  const uint32 mant1_cpath = mant1_large << 1;
+  const uint32 mant2_cpath = cpfp_emu_sel(diff == 1, mant2_large,
+      mant2_large << 1);
+  // If the result is negative then mant1 < mant2, need to complement the
+  // result and set the sign to sign2_s
+  const uint32 cpath_neg = mant1_cpath < mant2_cpath;
+  const uint32 sum_cpath = cpfp_emu_sel(cpath_neg, mant2_cpath - mant1_cpath,
+      mant1_cpath - mant2_cpath);
+  const uint32 sum_cpath_sign = cpfp_emu_sel(cpath_neg, sign2_s, sign1_s);
+  const uint32 zero_flag = sum_cpath == 0;
+  uint32 sum_cpath_n = sum_cpath;
+  const uint32 Lshifter = cpfp_emu_lod(&sum_cpath_n);
+  const uint32 sum_cpath_f = (sum_cpath_n >> 1) & MANT_MASK;
+
+  // Far path: mant2 is aligned with MANT_SIZE + 4 bits to spare, the bits
+  // shifted past the guard and round positions collapse into a sticky bit
+  const uint32 diff_sat = cpfp_emu_sel(diff > (MANT_SIZE + 4), MANT_SIZE + 4,
+      diff);
+  const uint32 mant2_a = cpfp_emu_shl(mant2_large,
+      (MANT_SIZE + 4) - diff_sat);
+#if ROUND_NEAREST_ADD == 1
+  const uint32 sticky_a = (mant2_a & ((1 << (MANT_SIZE + 1)) - 1)) > 0;
+#else
+  const uint32 sticky_a = 0;
+#endif
+  const uint32 mant1_fpath = mant1_large << 3;
+  const uint32 mant2_fpath = (mant2_a >> (MANT_SIZE + 1)) | sticky_a;
+  const uint32 sum_fpath = cpfp_emu_sel(EOP, mant1_fpath + mant2_fpath,
+      mant1_fpath - mant2_fpath) & ((1 << (MANT_SIZE + 5)) - 1);
+
+  const uint32 sum_n = sum_fpath >> 3;
+  const uint32 guard_n = (sum_fpath >> 2) & 0x1;
+  const uint32 round_n = (sum_fpath >> 1) & 0x1;
+  const uint32 sticky_n = sum_fpath & 0x1;
+
+  // A carry shifts the output and the rounding bits to the right, a leading
+  // 0 shifts them to the left
+  const uint32 carry = (sum_n >> (MANT_SIZE + 1)) & 0x1;
+  const uint32 lead0 = (sum_n >> MANT_SIZE) == 0;
+  const uint32 sticky = sticky_n | (carry & round_n);
+  const uint32 round = cpfp_emu_sel(carry, guard_n, round_n & (lead0 ^ 0x1));
+  const uint32 guard = cpfp_emu_sel(carry, sum_n & 0x1,
+      cpfp_emu_sel(lead0, round_n, guard_n));
+  uint32 sum_t = cpfp_emu_sel(carry, sum_fpath >> 4,
+      cpfp_emu_sel(lead0, (sum_fpath >> 2) & ((1 << (MANT_SIZE + 2)) - 1),
+      sum_n));
+
+#if ROUND_NEAREST_ADD == 1
+  const uint32 rnd = guard & ((sum_t & 0x1) | round | sticky);
+  const uint32 rnd_ovfl = rnd & (sum_t == (MAX_MANT | MANT_NORM));
+  sum_t += rnd;
+#else
+  const uint32 rnd_ovfl = 0;
+#endif
+
+  const uint32 sum_fpath_f = sum_t & MANT_MASK;
+
+  // Select sign based off of close or far path in use
+  const uint32 sign = cpfp_emu_sel(fpath_flag, sign1_s, sum_cpath_sign);
+
+  // Compute the resulting exponent for the far path/close path, Rshifter
+  // being +1 on a carry and -1 on a leading 0
+  const int32 eres_fpath = int32(e1_s + carry + rnd_ovfl) - int32(lead0);
+  const int32 eres_cpath = int32(e1_s) - int32(Lshifter);
+
+  // Set the result to 0 if the exponent underflows, or if the close path
+  // leading one detector does not detect a one; saturate the far path result
+  // if the exponent overflows
+  const uint32 saturate = fpath_flag & (eres_fpath >= MAX_EXP);
+  const uint32 zero = cpfp_emu_sel(fpath_flag, eres_fpath <= 0,
+      (eres_cpath < 1) | zero_flag);
+  const uint32 eres_t = cpfp_emu_sel(saturate, MAX_EXP - 1,
+      cpfp_emu_sel(zero, 0, cpfp_emu_sel(fpath_flag, eres_fpath, eres_cpath) &
+      MAX_EXP));
+  const uint32 mantresf = cpfp_emu_sel(saturate, MAX_MANT,
+      cpfp_emu_sel(zero, 0, cpfp_emu_sel(fpath_flag, sum_fpath_f,
+      sum_cpath_f)));
+  return (sign << SIGN_SHIFT) | (eres_t << EXP_SHIFT) | mantresf;
+}
+
+// T - U, as operator-(cpfp, cpfp) computes it: the adder with U's sign
+// flipped
+CPFP_EMU_INLINE uint32 cpfp_emu_sub(uint32 T, uint32 U) {
+  return cpfp_emu_add(T, U ^ SIGN_MASK);
+}
+
+// Maps a cpfp value to a key that orders like operator<(cpfp, cpfp) does,
+// with -0 below +0
+CPFP_EMU_INLINE uint32 cpfp_emu_order(uint32 T) {
+  const uint32 mag = T & (SIGN_MASK - 1);
+  return ((T >> SIGN_SHIFT) & 0x1) ? (SIGN_MASK - 1) - mag : SIGN_MASK + mag;
+}
+
+// max(T, U)
+CPFP_EMU_INLINE uint32 cpfp_emu_max(uint32 T, uint32 U) {
+  return (cpfp_emu_order(T) < cpfp_emu_order(U)) ? U : T;
+}
+
+// max(T), which compares T with 0
+CPFP_EMU_INLINE uint32 cpfp_emu_relu(uint32 T) {
+  return ((T >> SIGN_SHIFT) & 0x1) ? 0 : T;
+}
+
+// exp_shift(T, shift), T * 2^shift with saturation and flush to zero
+CPFP_EMU_INLINE uint32 cpfp_emu_shift(uint32 T, int shift) {
+  const int32 e = (T >> EXP_SHIFT) & MAX_EXP;
+  const int32 eres = e + shift;
+  const uint32 sign = T & SIGN_MASK;
+  if (e == 0 || eres <= 0) {
+    return sign;
+  } else if (eres >= MAX_EXP) {
+    return sign | ((MAX_EXP - 1) << EXP_SHIFT) | MAX_MANT;
+  }
+  return sign | (eres << EXP_SHIFT) | (T & MANT_MASK);
+}
+
+// 16-lane forms of the operators above, over the values of a cpfp16 or any
+// other 16 consecutive cpfp values
+inline void cpfp16_emu_mult(const uint16 *T, const uint16 *U, uint16 *out) {
+  uint16 res[16];
+  for (int j = 0; j < 16; ++j)
+    res[j] = cpfp_emu_mult(T[j], U[j]);
+  std::memcpy(out, res, sizeof(res));
+}
+
+inline void cpfp16_emu_add(const uint16 *T, const uint16 *U, uint16 *out) {
+  uint16 res[16];
+  for (int j = 0; j < 16; ++j)
+    res[j] = cpfp_emu_add(T[j], U[j]);
+  std::memcpy(out, res, sizeof(res));
+}
+
+inline void cpfp16_emu_max(const uint16 *T, const uint16 *U, uint16 *out) {
+  uint16 res[16];
+  for (int j = 0; j < 16; ++j)
+    res[j] = cpfp_emu_max(T[j], U[j]);
+  std::memcpy(out, res, sizeof(res));
+}
+
+inline void cpfp16_emu_relu(const uint16 *T, uint16 *out) {
+  uint16 res[16];
+  for (int j = 0; j < 16; ++j)
+    res[j] = cpfp_emu_relu(T[j]);
+  std::memcpy(out, res, sizeof(res));
+}
+
+// Forward adder tree: lane j of out is ((in[0][j] + in[1][j]) +
+// (in[2][j] + in[3][j])), addTreeS1 and addTreeS2 of the forward pass
+inline void cpfp16_emu_add_tree4(const uint16 in[4][16], uint16 *out) {
+  uint16 s1[2][16];
+  for (int off = 0; off < 2; ++off)
+    cpfp16_emu_add(in[off * 2], in[off * 2 + 1], s1[off]);
+  cpfp16_emu_add(s1[0], s1[1], out);
+}
+
+// Backward adder tree: sums the 16 lanes of in pairwise, neighbours first,
+// addTreeS1 through addTreeS4 of the backward pass
+inline uint16 cpfp_emu_add_tree16(const uint16 *in) {
+  uint16 sum[16];
+  for (int j = 0; j < 16; ++j)
+    sum[j] = in[j];
+  for (int width = 8; width >= 1; width /= 2) {
+    for (int j = 0; j < width; ++j)
+      sum[j] = cpfp_emu_add(sum[j * 2], sum[j * 2 + 1]);
+  }
+  return sum[0];
+}
+
+// One forward step of a processing element: the 4x16 products of in and
+// weights, reduced by the forward adder tree and added to acc
+inline void cpfp16_emu_fw_mac(const uint16 in[4][16],
+    const uint16 weights[4][16], uint16 *acc) {
+  uint16 products[4][16];
+  uint16 tree[16];
+  for (int m = 0; m < 4; ++m)
+    cpfp16_emu_mult(in[m], weights[m], products[m]);
+  cpfp16_emu_add_tree4(products, tree);
+  cpfp16_emu_add(acc, tree, acc);
+}
+
+#endif  // CPFP_EMU_HPP_
@@ -29,6 +29,24 @@ typedef struct {
   int pad;
   int pool;
   int pksize;
+  // ksize, stride and pad above are the y values, a ksize_w of 0 keeps the
+  // kernel square with the same stride and pad in x and no dilation. In
+  // pooling mode ksize_w is the window width, pksize its height
+  int ksize_w;
+  int stride_w;
+  int pad_w;
+  int dilation_h;
+  int dilation_w;
+  // Exponent shift applied to the finished outputs of the convolution
+  // passes, moving them from the products' exponent bias, the sum of the
+  // input and weight biases, to the bias of the output blob
+  int exp_shift;
+  // Weight pass only: 0 writes the cpfp weight diffs to the output, 1 stores
+  // them as floats in the accumulator and 2 adds them to the floats there,
+  // summing over several batches on the device
+  int accumulate;
+  // Exponent bias of the weight diffs, for their conversion to float
+  int accum_exp_bias;
 } kernel_params;
 
 #endif  // LAYER_HPP_
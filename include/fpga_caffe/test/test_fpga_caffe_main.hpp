@@ -55,6 +55,13 @@ int main(int argc, char** argv);
 
 void ref_relu_layer(std::vector<float>& output);
 
+int ref_pooled_dim(int dim, int pksize, int stride, int pad);
+
+int ref_pooled_dim(int dim, kernel_params params);
+
+void ref_pool_geometry(kernel_params params, int *pksize_w, int *stride_w,
+    int *pad_w);
+
 void ref_pool_layer_hwcn(std::vector<float> input, std::vector<float>& output,
     std::vector<short>& sw_relu_vals, kernel_params params);
 
@@ -69,6 +76,11 @@ void ref_backward_fc_layer(std::vector<float> input,
     std::vector<float> weights, std::vector<float>& output,
     kernel_params params);
 
+void ref_conv_geometry(kernel_params params, int *ksize_w, int *stride_w,
+    int *pad_w, int *dilation_h, int *dilation_w);
+
+int ref_conv_dim(int dim, int ksize, int stride, int pad, int dilation);
+
 void ref_conv_layer_hwcn(std::vector<float> input, std::vector<float> weights,
     std::vector<float> bias, std::vector<float>& output, kernel_params params,
     bool wino = false);
@@ -147,6 +147,30 @@ cpfp16 max(const cpfp16 rhs) {
   return val;
 }
 
+/* Implements 16 parallel exp_shift(rhs, shift) functions */
+
+cpfp16 exp_shift(const cpfp16 rhs, int shift) {
+#pragma HLS INLINE
+  cpfp16 val;
+  val.s0 = exp_shift(rhs.s0, shift);
+  val.s1 = exp_shift(rhs.s1, shift);
+  val.s2 = exp_shift(rhs.s2, shift);
+  val.s3 = exp_shift(rhs.s3, shift);
+  val.s4 = exp_shift(rhs.s4, shift);
+  val.s5 = exp_shift(rhs.s5, shift);
+  val.s6 = exp_shift(rhs.s6, shift);
+  val.s7 = exp_shift(rhs.s7, shift);
+  val.s8 = exp_shift(rhs.s8, shift);
+  val.s9 = exp_shift(rhs.s9, shift);
+  val.sa = exp_shift(rhs.sa, shift);
+  val.sb = exp_shift(rhs.sb, shift);
+  val.sc = exp_shift(rhs.sc, shift);
+  val.sd = exp_shift(rhs.sd, shift);
+  val.se = exp_shift(rhs.se, shift);
+  val.sf = exp_shift(rhs.sf, shift);
+  return val;
+}
+
 /* Implements 16 parallel max(a, b) functions */
 
 cpfp16 max(const cpfp16 T, const cpfp16 U) {
@@ -240,6 +264,73 @@ cpfp16 operator*(cpfp16 T, cpfp16 U) {
   return retval;
 }
 
+cpfp16 operator+(cpfp16 T, cpfp16 U) {
+  cpfp16 retval;
+  retval.s0 = T.s0 + U.s0;
+  retval.s1 = T.s1 + U.s1;
+  retval.s2 = T.s2 + U.s2;
+  retval.s3 = T.s3 + U.s3;
+  retval.s4 = T.s4 + U.s4;
+  retval.s5 = T.s5 + U.s5;
+  retval.s6 = T.s6 + U.s6;
+  retval.s7 = T.s7 + U.s7;
+  retval.s8 = T.s8 + U.s8;
+  retval.s9 = T.s9 + U.s9;
+  retval.sa = T.sa + U.sa;
+  retval.sb = T.sb + U.sb;
+  retval.sc = T.sc + U.sc;
+  retval.sd = T.sd + U.sd;
+  retval.se = T.se + U.se;
+  retval.sf = T.sf + U.sf;
+  return retval;
+}
+
+cpfp16 operator*(cpfp16 T, cpfp U) {
+  cpfp16 retval;
+  retval.s0 = T.s0 * U;
+  retval.s1 = T.s1 * U;
+  retval.s2 = T.s2 * U;
+  retval.s3 = T.s3 * U;
+  retval.s4 = T.s4 * U;
+  retval.s5 = T.s5 * U;
+  retval.s6 = T.s6 * U;
+  retval.s7 = T.s7 * U;
+  retval.s8 = T.s8 * U;
+  retval.s9 = T.s9 * U;
+  retval.sa = T.sa * U;
+  retval.sb = T.sb * U;
+  retval.sc = T.sc * U;
+  retval.sd = T.sd * U;
+  retval.se = T.se * U;
+  retval.sf = T.sf * U;
+  return retval;
+}
+
+/* Passes through the lanes of T whose tag in mask equals idx, zeroes the
+ * remaining lanes */
+
+cpfp16 select(const cpfp16 T, const short16 mask, const short idx) {
+#pragma HLS INLINE
+  cpfp16 val;
+  val.s0 = (mask.s0 == idx) ? T.s0 : cpfp(0);
+  val.s1 = (mask.s1 == idx) ? T.s1 : cpfp(0);
+  val.s2 = (mask.s2 == idx) ? T.s2 : cpfp(0);
+  val.s3 = (mask.s3 == idx) ? T.s3 : cpfp(0);
+  val.s4 = (mask.s4 == idx) ? T.s4 : cpfp(0);
+  val.s5 = (mask.s5 == idx) ? T.s5 : cpfp(0);
+  val.s6 = (mask.s6 == idx) ? T.s6 : cpfp(0);
+  val.s7 = (mask.s7 == idx) ? T.s7 : cpfp(0);
+  val.s8 = (mask.s8 == idx) ? T.s8 : cpfp(0);
+  val.s9 = (mask.s9 == idx) ? T.s9 : cpfp(0);
+  val.sa = (mask.sa == idx) ? T.sa : cpfp(0);
+  val.sb = (mask.sb == idx) ? T.sb : cpfp(0);
+  val.sc = (mask.sc == idx) ? T.sc : cpfp(0);
+  val.sd = (mask.sd == idx) ? T.sd : cpfp(0);
+  val.se = (mask.se == idx) ? T.se : cpfp(0);
+  val.sf = (mask.sf == idx) ? T.sf : cpfp(0);
+  return val;
+}
+
 struct cpfp32 {
   cpfp16 l, u;
 };
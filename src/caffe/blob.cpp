@@ -1,4 +1,5 @@
 #include <climits>
+#include <cstring>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -39,8 +40,8 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
   }
   if (count_ > capacity_) {
     capacity_ = count_;
-    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
-    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_.reset(new SyncedMemory(capacity_ * element_size()));
+    diff_.reset(new SyncedMemory(capacity_ * element_size()));
   }
 }
 
@@ -59,18 +60,35 @@ void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.shape());
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_storage(BlobStorage storage) {
+  if (storage == storage_) {
+    return;
+  }
+  const size_t old_size = element_size();
+  storage_ = storage;
+  if (data_ && element_size() != old_size) {
+    // Force a new allocation at the new element size
+    capacity_ = 0;
+    vector<int> shape(shape_);
+    Reshape(shape);
+  }
+}
+
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), storage_(STORAGE_DTYPE), data_exp_bias_(0),
+    diff_exp_bias_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), storage_(STORAGE_DTYPE), data_exp_bias_(0),
+    diff_exp_bias_(0) {
   Reshape(shape);
 }
 
@@ -83,20 +101,16 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
+  CheckDtypeStorage();
   return (const Dtype*)data_->cpu_data();
 }
 
-template <typename Dtype>
-const Dtype* Blob<Dtype>::cpu_data(size_t size) const {
-  CHECK(data_);
-  return (const Dtype*)data_->cpu_data(size);
-}
-
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  CheckDtypeStorage();
   // Make sure CPU and GPU sizes remain equal
-  size_t size = count_ * sizeof(Dtype);
+  size_t size = count_ * element_size();
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
@@ -107,26 +121,23 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
+  CheckDtypeStorage();
   return (const Dtype*)data_->gpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_data() const {
   CHECK(data_);
+  CheckDtypeStorage();
   return (const Dtype*)data_->ocl_data();
 }
 
-template <typename Dtype>
-const Dtype* Blob<Dtype>::ocl_data(size_t size) const {
-  CHECK(data_);
-  return (const Dtype*)data_->ocl_data(size);
-}
-
 template <typename Dtype>
 void Blob<Dtype>::set_gpu_data(Dtype* data) {
   CHECK(data);
+  CheckDtypeStorage();
   // Make sure CPU and GPU sizes remain equal
-  size_t size = count_ * sizeof(Dtype);
+  size_t size = count_ * element_size();
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
@@ -137,115 +148,103 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
+  CheckDtypeStorage();
   return (const Dtype*)diff_->cpu_data();
 }
 
-template <typename Dtype>
-const Dtype* Blob<Dtype>::cpu_diff(size_t size) const {
-  CHECK(diff_);
-  return (const Dtype*)diff_->cpu_data(size);
-}
-
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
   CHECK(diff_);
+  CheckDtypeStorage();
   return (const Dtype*)diff_->gpu_data();
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::ocl_diff() const {
   CHECK(diff_);
+  CheckDtypeStorage();
   return (const Dtype*)diff_->ocl_data();
 }
 
-template <typename Dtype>
-const Dtype* Blob<Dtype>::ocl_diff(size_t size) const {
-  CHECK(diff_);
-  return (const Dtype*)diff_->ocl_data(size);
-}
-
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(data_->mutable_cpu_data());
 }
 
-template <typename Dtype>
-Dtype* Blob<Dtype>::mutable_cpu_data(size_t size) {
-  CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_cpu_data(size));
-}
-
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(data_->mutable_gpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_data() {
   CHECK(data_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(data_->mutable_ocl_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_data(int RW) {
   CHECK(data_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(data_->mutable_ocl_data(RW));
 }
 
-template <typename Dtype>
-Dtype* Blob<Dtype>::mutable_ocl_data(int RW, size_t size) {
-  CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_ocl_data(RW, size));
-}
-
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
   CHECK(diff_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(diff_->mutable_cpu_data());
 }
 
-template <typename Dtype>
-Dtype* Blob<Dtype>::mutable_cpu_diff(size_t size) {
-  CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_cpu_data(size));
-}
-
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
   CHECK(diff_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(diff_->mutable_gpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_diff() {
   CHECK(diff_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(diff_->mutable_ocl_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_ocl_diff(int RW) {
   CHECK(diff_);
+  CheckDtypeStorage();
   return static_cast<Dtype*>(diff_->mutable_ocl_data(RW));
 }
 
-template <typename Dtype>
-Dtype* Blob<Dtype>::mutable_ocl_diff(int RW, size_t size) {
-  CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_ocl_data(RW, size));
-}
-
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK_EQ(storage_, other.storage());
   data_ = other.data();
+  data_exp_bias_ = other.data_exp_bias();
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK_EQ(storage_, other.storage());
   diff_ = other.diff();
+  diff_exp_bias_ = other.diff_exp_bias();
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataBuffer(const shared_ptr<SyncedMemory>& buffer) {
+  CHECK(buffer);
+  CHECK_GE(buffer->size(), count_ * element_size());
+  data_ = buffer;
+  // Growing past the buffer has to go through a new allocation
+  capacity_ = std::min<int>(capacity_, buffer->size() / element_size());
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -258,6 +257,7 @@ template <> void Blob<cpfp>::Update() { NOT_IMPLEMENTED; }
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  CHECK_EQ(storage_, STORAGE_DTYPE) << "Update needs Dtype storage";
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
@@ -282,6 +282,21 @@ void Blob<Dtype>::Update() {
   }
 }
 
+// Reduction over the elements of a blob whose storage is not Dtype, done on
+// the host after converting each element to float.
+template <typename Dtype>
+static Dtype storage_reduce(BlobStorage storage, const void* mem, int count,
+    bool square) {
+  float sum = 0;
+  for (int i = 0; i < count; ++i) {
+    float val = (storage == STORAGE_CPFP) ?
+      float(static_cast<const cpfp*>(mem)[i]) :
+      static_cast<float>(static_cast<const signed char*>(mem)[i]);
+    sum += square ? val * val : std::fabs(val);
+  }
+  return Dtype(sum);
+}
+
 template <> unsigned int Blob<unsigned int>::asum_data() const {
   NOT_IMPLEMENTED;
   return 0;
@@ -305,6 +320,10 @@ template <> char Blob<char>::asum_data() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
+  if (storage_ != STORAGE_DTYPE) {
+    return storage_reduce<Dtype>(storage_, data_->cpu_data(), count_,
+        false);
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
@@ -350,6 +369,10 @@ template <> char Blob<char>::asum_diff() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_diff() const {
   if (!diff_) { return 0; }
+  if (storage_ != STORAGE_DTYPE) {
+    return storage_reduce<Dtype>(storage_, diff_->cpu_data(), count_,
+        false);
+  }
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_diff());
@@ -397,6 +420,10 @@ Dtype Blob<Dtype>::sumsq_data() const {
   Dtype sumsq;
   const Dtype* data;
   if (!data_) { return 0; }
+  if (storage_ != STORAGE_DTYPE) {
+    return storage_reduce<Dtype>(storage_, data_->cpu_data(), count_,
+        true);
+  }
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
@@ -444,6 +471,10 @@ Dtype Blob<Dtype>::sumsq_diff() const {
   Dtype sumsq;
   const Dtype* diff;
   if (!diff_) { return 0; }
+  if (storage_ != STORAGE_DTYPE) {
+    return storage_reduce<Dtype>(storage_, diff_->cpu_data(), count_,
+        true);
+  }
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = cpu_diff();
@@ -486,6 +517,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
+  CHECK_EQ(storage_, STORAGE_DTYPE) << "scale_data needs Dtype storage";
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
@@ -527,6 +559,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_diff(Dtype scale_factor) {
   Dtype* diff;
   if (!diff_) { return; }
+  CHECK_EQ(storage_, STORAGE_DTYPE) << "scale_diff needs Dtype storage";
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = mutable_cpu_diff();
@@ -573,6 +606,8 @@ bool Blob<Dtype>::ShapeEquals(const BlobProto& other) {
 
 template <typename Dtype>
 void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
+  CHECK_EQ(storage_, source.storage())
+      << "Trying to copy blobs of different storage types.";
   if (source.count() != count_ || source.shape() != shape_) {
     if (reshape) {
       ReshapeLike(source);
@@ -580,6 +615,20 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       LOG(FATAL) << "Trying to copy blobs of different sizes.";
     }
   }
+  if (storage_ != STORAGE_DTYPE) {
+    // Non-Dtype elements are copied bytewise on the host
+    const shared_ptr<SyncedMemory>& src =
+      copy_diff ? source.diff() : source.data();
+    const shared_ptr<SyncedMemory>& dst = copy_diff ? diff_ : data_;
+    memcpy(dst->mutable_cpu_data(), src->cpu_data(),
+        count_ * element_size());
+    if (copy_diff) {
+      diff_exp_bias_ = source.diff_exp_bias();
+    } else {
+      data_exp_bias_ = source.data_exp_bias();
+    }
+    return;
+  }
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
@@ -628,6 +677,7 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   } else {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
+  CHECK_EQ(storage_, STORAGE_DTYPE) << "FromProto needs Dtype storage";
   // copy data
   Dtype* data_vec = mutable_cpu_data();
   if (proto.double_data_size() > 0) {
@@ -658,6 +708,7 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
 
 template <>
 void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
+  CHECK_EQ(storage_, STORAGE_DTYPE) << "ToProto needs Dtype storage";
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
@@ -678,6 +729,7 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
 
 template <>
 void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
+  CHECK_EQ(storage_, STORAGE_DTYPE) << "ToProto needs Dtype storage";
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
@@ -17,6 +17,7 @@ namespace caffe {
   cl_device_id oclDevices;
   cl_context oclContext;
   cl_command_queue oclCommandQueue;
+  cl_command_queue oclGradientQueue;
 #endif
 
 // Make sure each thread can have different values.
@@ -96,7 +97,23 @@ void Caffe::SetOCLDevice() {
   status = clGetDeviceIDs(oclPlatform[0], CL_DEVICE_TYPE_ACCELERATOR, 1,
       &oclDevices, NULL);
   oclContext = clCreateContext(NULL, 1, &oclDevices, NULL, NULL, &status);
-  oclCommandQueue = clCreateCommandQueue(oclContext, oclDevices, 0, &status);
+  // Profiling lets count_kernel_time() read back how long kernels ran
+  oclCommandQueue = clCreateCommandQueue(oclContext, oclDevices,
+      CL_QUEUE_PROFILING_ENABLE, &status);
+  oclGradientQueue = clCreateCommandQueue(oclContext, oclDevices,
+      CL_QUEUE_PROFILING_ENABLE, &status);
+}
+
+void Caffe::count_kernel_time(int num_events, const cl_event* events) {
+  for (int i = 0; i < num_events; ++i) {
+    cl_ulong start, end;
+    if (clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START,
+        sizeof(start), &start, NULL) == CL_SUCCESS &&
+        clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END,
+        sizeof(end), &end, NULL) == CL_SUCCESS) {
+      Get().kernel_us_ += (end - start) / 1000.;
+    }
+  }
 }
 
 #else
@@ -112,7 +129,8 @@ void Caffe::SetOCLDevice(void) {
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), solver_rank_(0), multiprocess_(false) { }
+      solver_count_(1), solver_rank_(0), multiprocess_(false),
+      host_to_device_bytes_(0), device_to_host_bytes_(0), kernel_us_(0) { }
 
 Caffe::~Caffe() { }
 
@@ -166,7 +184,8 @@ void* Caffe::RNG::generator() {
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
     mode_(Caffe::CPU),
-    solver_count_(1), solver_rank_(0), multiprocess_(false) {
+    solver_count_(1), solver_rank_(0), multiprocess_(false),
+    host_to_device_bytes_(0), device_to_host_bytes_(0), kernel_us_(0) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
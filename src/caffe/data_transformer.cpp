@@ -39,9 +39,8 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
 }
 
 template<typename Dtype>
-void DataTransformer<Dtype>::Transform(const Datum& datum,
-                                       Dtype* transformed_data) {
-  const string& data = datum.data();
+void DataTransformer<Dtype>::Transform(const Datum& datum, const char* data,
+    size_t data_size, Dtype* transformed_data) {
   const int datum_channels = datum.channels();
   const int datum_height = datum.height();
   const int datum_width = datum.width();
@@ -50,7 +49,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
   const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
+  const bool has_uint8 = data_size > 0;
   const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
@@ -147,10 +146,22 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
-  } else {
-    if (param_.force_color() || param_.force_gray()) {
-      LOG(ERROR) << "force_color and force_gray only for encoded datum";
-    }
+  }
+  const string& data = datum.data();
+  Transform(datum, data.data(), data.size(), transformed_blob);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum, const char* data,
+    size_t data_size, Blob<Dtype>* transformed_blob) {
+  if (datum.encoded()) {
+    // Decoding reads the bytes from the Datum itself.
+    Datum encoded_datum(datum);
+    encoded_datum.set_data(data, data_size);
+    return Transform(encoded_datum, transformed_blob);
+  }
+  if (param_.force_color() || param_.force_gray()) {
+    LOG(ERROR) << "force_color and force_gray only for encoded datum";
   }
 
   const int crop_size = param_.crop_size();
@@ -178,7 +189,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   }
 
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  Transform(datum, transformed_data);
+  Transform(datum, data, data_size, transformed_data);
 }
 
 template<typename Dtype>
@@ -0,0 +1,186 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "caffe/inference_server.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+struct InferenceServer<Dtype>::Request {
+  const Dtype* input;
+  vector<vector<Dtype> >* outputs;
+  boost::system_time arrival;
+  bool done;
+  bool served;
+};
+
+template <typename Dtype>
+InferenceServer<Dtype>::InferenceServer(const shared_ptr<Net<Dtype> >& net,
+    int max_batch, int batch_multiple, int max_delay_us)
+    : net_(net), max_batch_(max_batch), batch_multiple_(batch_multiple),
+      max_delay_us_(max_delay_us), mutex_(new boost::mutex()),
+      queued_(new boost::condition_variable()),
+      served_(new boost::condition_variable()), stopped_(false),
+      requests_(0), batches_(0), padded_items_(0), latency_next_(0) {
+  CHECK_GT(batch_multiple_, 0);
+  CHECK_GE(max_delay_us_, 0);
+  CHECK_EQ(max_batch_ % batch_multiple_, 0)
+      << "max_batch must be a multiple of the batch multiple.";
+  if (net_->input_blobs().size()) {
+    CHECK_EQ(net_->input_blobs().size(), 1)
+        << "InferenceServer serves nets with a single input.";
+    input_blob_ = net_->input_blobs()[0];
+  } else {
+    CHECK(net_->layers().size() && net_->layers()[0]->type() ==
+        string("Input") && net_->top_vecs()[0].size() == 1)
+        << "InferenceServer needs a net input or a leading Input layer with "
+        << "one top.";
+    input_blob_ = net_->top_vecs()[0][0];
+  }
+  input_size_ = input_blob_->count(1);
+  for (int i = 0; i < net_->output_blobs().size(); ++i) {
+    output_sizes_.push_back(net_->output_blobs()[i]->count(1));
+  }
+  StartInternalThread();
+}
+
+template <typename Dtype>
+InferenceServer<Dtype>::~InferenceServer() {
+  StopInternalThread();
+}
+
+template <typename Dtype>
+bool InferenceServer<Dtype>::Infer(const Dtype* input,
+    vector<vector<Dtype> >* outputs) {
+  Request request;
+  request.input = input;
+  request.outputs = outputs;
+  request.arrival = boost::get_system_time();
+  request.done = false;
+  request.served = false;
+  boost::unique_lock<boost::mutex> lock(*mutex_);
+  if (stopped_) {
+    return false;
+  }
+  queue_.push_back(&request);
+  queued_->notify_one();
+  while (!request.done) {
+    served_->wait(lock);
+  }
+  return request.served;
+}
+
+template <typename Dtype>
+typename InferenceServer<Dtype>::Stats InferenceServer<Dtype>::stats() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  Stats stats;
+  stats.requests = requests_;
+  stats.batches = batches_;
+  stats.fill = padded_items_ ? requests_ / padded_items_ : 0;
+  vector<double> latencies(latencies_ms_);
+  stats.p50_ms = stats.p99_ms = 0;
+  if (latencies.size()) {
+    const int p50 = (latencies.size() - 1) / 2;
+    const int p99 = (latencies.size() - 1) * 99 / 100;
+    std::nth_element(latencies.begin(), latencies.begin() + p50,
+        latencies.end());
+    stats.p50_ms = latencies[p50];
+    std::nth_element(latencies.begin(), latencies.begin() + p99,
+        latencies.end());
+    stats.p99_ms = latencies[p99];
+  }
+  return stats;
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      vector<Request*> batch;
+      {
+        boost::unique_lock<boost::mutex> lock(*mutex_);
+        while (queue_.empty()) {
+          queued_->wait(lock);
+        }
+        // The oldest item sets how long the batch may keep filling
+        const boost::system_time deadline = queue_.front()->arrival +
+            boost::posix_time::microseconds(max_delay_us_);
+        while (static_cast<int>(queue_.size()) < max_batch_ &&
+            queued_->timed_wait(lock, deadline)) {}
+        while (queue_.size() && static_cast<int>(batch.size()) < max_batch_) {
+          batch.push_back(queue_.front());
+          queue_.pop_front();
+        }
+      }
+      RunBatch(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted while waiting for items
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  stopped_ = true;
+  for (int i = 0; i < queue_.size(); ++i) {
+    queue_[i]->done = true;
+  }
+  queue_.clear();
+  served_->notify_all();
+}
+
+template <typename Dtype>
+void InferenceServer<Dtype>::RunBatch(const vector<Request*>& batch) {
+  const int items = batch.size();
+  const int padded = (items + batch_multiple_ - 1) / batch_multiple_ *
+      batch_multiple_;
+  if (input_blob_->shape(0) != padded) {
+    vector<int> shape = input_blob_->shape();
+    shape[0] = padded;
+    input_blob_->Reshape(shape);
+    net_->Reshape();
+  }
+  Dtype* input_data = input_blob_->mutable_cpu_data();
+  for (int i = 0; i < items; ++i) {
+    caffe_copy(input_size_, batch[i]->input, input_data + i * input_size_);
+  }
+  caffe_set((padded - items) * input_size_, Dtype(0),
+      input_data + items * input_size_);
+  net_->Forward();
+
+  // The callers stay blocked in Infer() until done is set, so their output
+  // vectors can be filled without the lock
+  const vector<Blob<Dtype>*>& outputs = net_->output_blobs();
+  for (int j = 0; j < outputs.size(); ++j) {
+    CHECK_EQ(outputs[j]->shape(0), padded)
+        << "InferenceServer outputs must keep the batch on axis 0.";
+    const Dtype* output_data = outputs[j]->cpu_data();
+    for (int i = 0; i < items; ++i) {
+      batch[i]->outputs->resize(outputs.size());
+      (*batch[i]->outputs)[j].assign(output_data + i * output_sizes_[j],
+          output_data + (i + 1) * output_sizes_[j]);
+    }
+  }
+
+  const boost::system_time now = boost::get_system_time();
+  boost::mutex::scoped_lock lock(*mutex_);
+  for (int i = 0; i < items; ++i) {
+    const double latency_ms =
+        (now - batch[i]->arrival).total_microseconds() / 1000.;
+    if (latencies_ms_.size() < kLatencyWindow) {
+      latencies_ms_.push_back(latency_ms);
+    } else {
+      latencies_ms_[latency_next_] = latency_ms;
+      latency_next_ = (latency_next_ + 1) % kLatencyWindow;
+    }
+    batch[i]->served = true;
+    batch[i]->done = true;
+  }
+  requests_ += items;
+  ++batches_;
+  padded_items_ += padded;
+  served_->notify_all();
+}
+
+INSTANTIATE_CLASS(InferenceServer);
+
+}  // namespace caffe
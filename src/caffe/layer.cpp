@@ -1,7 +1,17 @@
+#include <boost/thread.hpp>
+
 #include "caffe/layer.hpp"
 
 namespace caffe {
 
+#ifdef USE_OCL
+template <typename Dtype>
+boost::mutex& Layer<Dtype>::ocl_kernel_mutex() {
+  static boost::mutex mutex;
+  return mutex;
+}
+#endif
+
 INSTANTIATE_CLASS(Layer);
 
 }  // namespace caffe
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -32,6 +33,7 @@ void XCLProgramLayer<Dtype>::Forward_ocl(const vector <Blob<Dtype>*>& bottom,
         &error);
 
     delete[] sourceStr;
+    boost::mutex::scoped_lock lock(this->ocl_kernel_mutex());
     this->ocl_kernel = clCreateKernel(this->ocl_layer_program,
         xcl_param.kernel_name().c_str(), &error);
     if (xcl_param.once())
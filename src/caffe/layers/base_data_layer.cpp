@@ -1,4 +1,6 @@
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,6 +9,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -37,11 +40,30 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      decode_item_(NULL) {
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
   }
+  const DataParameter& data_param = param.data_param();
+  stage_hwcn_ = data_param.stage_hwcn();
+  stage_pad_to_ = data_param.stage_pad_to();
+  stage_cpfp_ = data_param.stage_cpfp();
+  stage_batches_ = stage_hwcn_ || stage_cpfp_;
+  decode_threads_ = data_param.decode_threads();
+  CHECK_GT(decode_threads_, 0) << "decode_threads must be positive";
+  CHECK(stage_hwcn_ || stage_pad_to_ == 0)
+      << "stage_pad_to pads the channels of HWCN batches; set stage_hwcn";
+}
+
+template <typename Dtype>
+BasePrefetchingDataLayer<Dtype>::~BasePrefetchingDataLayer() {
+  // Subclasses stop the prefetch thread first, so no batch is in flight
+  for (int i = 0; i < decode_workers_.size(); ++i) {
+    decode_workers_[i]->interrupt();
+    decode_workers_[i]->join();
+  }
 }
 
 template <typename Dtype>
@@ -49,6 +71,21 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
 
+  if (stage_batches_) {
+    CHECK(Caffe::mode() != Caffe::GPU)
+        << "Staged batches are only produced for the CPU and OCL devices";
+    const BlobStorage storage = stage_cpfp_ ? STORAGE_CPFP : STORAGE_DTYPE;
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->staged_data_.set_storage(storage);
+      prefetch_[i]->staged_data_.Reshape(
+          StagedShape(prefetch_[i]->data_.shape()));
+    }
+    top[0]->set_storage(storage);
+    top[0]->Reshape(StagedShape(top[0]->shape()));
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Staging batches as " << top[0]->shape_string();
+  }
+
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
@@ -69,6 +106,31 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     }
   }
 #endif
+#ifdef USE_OCL
+  if (Caffe::mode() == Caffe::OCL) {
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      Blob<Dtype>& data = stage_batches_ ? prefetch_[i]->staged_data_ :
+          prefetch_[i]->data_;
+      data.data()->mutable_cpu_data();
+      data.data()->ocl_data();
+    }
+  }
+#endif
+  // Each extra decode worker gets its own transformer, seeded from the
+  // Caffe RNG here so that its random stream is fixed by the seed.
+  for (int i = 1; i < decode_threads_; ++i) {
+    worker_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    worker_transformers_.back()->InitRand();
+    worker_transformed_data_.push_back(shared_ptr<Blob<Dtype> >(
+        new Blob<Dtype>(transformed_data_.shape())));
+    decode_start_.push_back(shared_ptr<BlockingQueue<int> >(
+        new BlockingQueue<int>()));
+    decode_workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &BasePrefetchingDataLayer<Dtype>::DecodeWorkerEntry, this, i)));
+  }
+  LOG_IF(INFO, Caffe::root_solver() && decode_threads_ > 1)
+      << "Decoding batches with " << decode_threads_ << " threads";
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
   StartInternalThread();
@@ -83,11 +145,27 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
     CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
   }
 #endif
+#ifdef USE_OCL
+  // The batch is written on a queue of its own so that it overlaps the
+  // kernels the net runs on oclCommandQueue.
+  cl_command_queue queue = NULL;
+  if (Caffe::mode() == Caffe::OCL) {
+    cl_int status;
+    queue = clCreateCommandQueue(oclContext, oclDevices, 0, &status);
+    CHECK_EQ(status, CL_SUCCESS) << "Could not create the prefetch queue";
+  }
+#endif
 
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      CPUTimer load_timer;
+      load_timer.Start();
       load_batch(batch);
+      if (stage_batches_) {
+        StageBatch(batch);
+      }
+      batch->load_time_ = load_timer.MilliSeconds();
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -96,6 +174,15 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
         }
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
+#endif
+#ifdef USE_OCL
+      if (Caffe::mode() == Caffe::OCL) {
+        // Labels stay on the host for the loss and accuracy layers
+        Blob<Dtype>& data = stage_batches_ ? batch->staged_data_ :
+            batch->data_;
+        data.data().get()->async_ocl_push(queue);
+        clFinish(queue);
+      }
 #endif
       prefetch_full_.push(batch);
     }
@@ -107,6 +194,147 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
     CUDA_CHECK(cudaStreamDestroy(stream));
   }
 #endif
+#ifdef USE_OCL
+  if (Caffe::mode() == Caffe::OCL) {
+    clReleaseCommandQueue(queue);
+  }
+#endif
+}
+
+namespace {
+
+void TransformSlice(const boost::function<void(int, int)>& transform_item,
+    int begin, int end, int worker) {
+  for (int item_id = begin; item_id < end; ++item_id) {
+    transform_item(item_id, worker);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ForEachItem(int batch_size,
+    const boost::function<void(int, int)>& transform_item) {
+  const int num_workers = std::min(decode_threads_, batch_size);
+  decode_item_ = &transform_item;
+  for (int worker = 1; worker < num_workers; ++worker) {
+    decode_start_[worker - 1]->push(batch_size);
+  }
+  TransformSlice(transform_item, 0, batch_size / num_workers, 0);
+  // The workers write into the batch, so they must be done with it even if
+  // the prefetch thread is being stopped.
+  boost::this_thread::disable_interruption no_interruption;
+  for (int worker = 1; worker < num_workers; ++worker) {
+    decode_done_.pop();
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::DecodeWorkerEntry(int worker) {
+  try {
+    while (true) {
+      const int batch_size = decode_start_[worker - 1]->pop();
+      const int num_workers = std::min(decode_threads_, batch_size);
+      TransformSlice(*decode_item_, worker * batch_size / num_workers,
+          (worker + 1) * batch_size / num_workers, worker);
+      decode_done_.push(worker);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ReshapeTransformedData(
+    const vector<int>& shape) {
+  transformed_data_.Reshape(shape);
+  for (int i = 0; i < worker_transformed_data_.size(); ++i) {
+    worker_transformed_data_[i]->Reshape(shape);
+  }
+}
+
+template <typename Dtype>
+vector<int> BasePrefetchingDataLayer<Dtype>::StagedShape(
+    const vector<int>& shape) const {
+  if (!stage_hwcn_) {
+    return shape;
+  }
+  CHECK_EQ(shape.size(), 4) << "HWCN staging needs NCHW batches";
+  vector<int> staged_shape(4);
+  staged_shape[0] = shape[2];
+  staged_shape[1] = shape[3];
+  staged_shape[2] = std::max(shape[1], stage_pad_to_);
+  staged_shape[3] = shape[0];
+  return staged_shape;
+}
+
+namespace {
+
+template <typename T, typename Dtype>
+inline T StagedValue(Dtype value) {
+  return value;
+}
+
+template <>
+inline cpfp StagedValue<cpfp, double>(double value) {
+  return cpfp(static_cast<float>(value));
+}
+
+// Copy NCHW values to HWCN with the channels zero-padded to
+// padded_channels, converting them to T.
+template <typename T, typename Dtype>
+void StageHWCN(const Dtype* src, const vector<int>& shape,
+    const int padded_channels, T* dst) {
+  const int num = shape[0];
+  const int channels = shape[1];
+  const int height = shape[2];
+  const int width = shape[3];
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < padded_channels; ++c) {
+        T* dst_row = dst + ((h * width + w) * padded_channels + c) * num;
+        if (c >= channels) {
+          for (int n = 0; n < num; ++n) {
+            dst_row[n] = StagedValue<T>(Dtype(0));
+          }
+          continue;
+        }
+        for (int n = 0; n < num; ++n) {
+          dst_row[n] = StagedValue<T>(
+              src[((n * channels + c) * height + h) * width + w]);
+        }
+      }
+    }
+  }
+}
+
+template <typename T, typename Dtype>
+void StageValues(const Dtype* src, const int count, T* dst) {
+  for (int i = 0; i < count; ++i) {
+    dst[i] = StagedValue<T>(src[i]);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::StageBatch(Batch<Dtype>* batch) {
+  const vector<int>& shape = batch->data_.shape();
+  Blob<Dtype>& staged = batch->staged_data_;
+  staged.Reshape(StagedShape(shape));
+  const Dtype* data = batch->data_.cpu_data();
+  if (stage_hwcn_) {
+    const int padded_channels = staged.shape(2);
+    if (stage_cpfp_) {
+      StageHWCN(data, shape, padded_channels,
+          staged.template mutable_cpu_data_as<cpfp>());
+    } else {
+      StageHWCN(data, shape, padded_channels, staged.mutable_cpu_data());
+    }
+  } else {
+    StageValues(data, batch->data_.count(),
+        staged.template mutable_cpu_data_as<cpfp>());
+  }
 }
 
 template <typename Dtype>
@@ -115,10 +343,28 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
+  CPUTimer wait_timer;
+  wait_timer.Start();
+  const bool starved = prefetch_full_.size() == 0;
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
-  // Reshape to loaded data.
-  top[0]->ReshapeLike(prefetch_current_->data_);
-  top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  if (starved) {
+    LOG_EVERY_N(INFO, 100) << this->layer_param_.name() << " starved: waited "
+        << wait_timer.MilliSeconds() << " ms for a batch that took "
+        << prefetch_current_->load_time_ << " ms to load with "
+        << decode_threads_ << " decode threads";
+  }
+  if (stage_batches_) {
+    // Share the staged batch, along with the copy already on the device
+    top[0]->ReshapeLike(prefetch_current_->staged_data_);
+    top[0]->ShareData(prefetch_current_->staged_data_);
+  } else if (Caffe::mode() == Caffe::OCL) {
+    top[0]->ReshapeLike(prefetch_current_->data_);
+    top[0]->ShareData(prefetch_current_->data_);
+  } else {
+    // Reshape to loaded data.
+    top[0]->ReshapeLike(prefetch_current_->data_);
+    top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  }
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(prefetch_current_->label_);
@@ -1,8 +1,10 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -158,11 +160,19 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
       spatial_dim, 1, 1., num_by_chans_.cpu_data(),
       spatial_sum_multiplier_.cpu_data(), 0., temp_.mutable_cpu_data());
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
   // TODO(cdoersch): The caching is only needed because later in-place layers
   //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data,
-      x_norm_.mutable_cpu_data());
+  caffe_parallel_for(temp_.count(), caffe_parallel_grain(2),
+      boost::bind(&BatchNormLayer<Dtype>::NormalizeRange_cpu, this,
+          temp_.cpu_data(), top_data, x_norm_.mutable_cpu_data(), _1, _2));
+}
+
+template <typename Dtype>
+void BatchNormLayer<Dtype>::NormalizeRange_cpu(const Dtype* temp_data,
+    Dtype* top_data, Dtype* x_norm_data, const int begin, const int end) {
+  caffe_div(end - begin, top_data + begin, temp_data + begin,
+      top_data + begin);
+  caffe_copy(end - begin, top_data + begin, x_norm_data + begin);
 }
 
 template <typename Dtype>
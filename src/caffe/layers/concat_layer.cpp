@@ -1,7 +1,9 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/concat_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -58,14 +60,28 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (bottom.size() == 1) { return; }
   Dtype* top_data = top[0]->mutable_cpu_data();
+  vector<const Dtype*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  caffe_parallel_for(num_concats_,
+      caffe_parallel_grain(top[0]->count(concat_axis_)),
+      boost::bind(&ConcatLayer<Dtype>::ForwardConcats_cpu, this,
+          boost::cref(bottom), boost::cref(bottom_data),
+          top[0]->shape(concat_axis_), top_data, _1, _2));
+}
+
+template <typename Dtype>
+void ConcatLayer<Dtype>::ForwardConcats_cpu(
+    const vector<Blob<Dtype>*>& bottom,
+    const vector<const Dtype*>& bottom_data, const int top_concat_axis,
+    Dtype* top_data, const int begin, const int end) {
   int offset_concat_axis = 0;
-  const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    for (int n = 0; n < num_concats_; ++n) {
+    for (int n = begin; n < end; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
-          bottom_data + n * bottom_concat_axis * concat_input_size_,
+          bottom_data[i] + n * bottom_concat_axis * concat_input_size_,
           top_data + (n * top_concat_axis + offset_concat_axis)
               * concat_input_size_);
     }
@@ -1,6 +1,8 @@
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/fft_conv.hpp"
+#include "caffe/util/winograd.hpp"
 
 namespace caffe {
 
@@ -21,16 +23,69 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+ConvolutionParameter_SubEngine ConvolutionLayer<Dtype>::cpu_subengine(
+    bool backward) {
+  const ConvolutionParameter_SubEngine subengine =
+      this->layer_param_.convolution_param().subengine();
+  if (subengine == ConvolutionParameter_SubEngine_DIRECT ||
+      this->num_spatial_axes_ != 2 || this->channel_axis_ != 1) {
+    return ConvolutionParameter_SubEngine_DIRECT;
+  }
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  for (int i = 0; i < this->num_spatial_axes_; ++i) {
+    if (stride_data[i] != 1 || dilation_data[i] != 1 ||
+        (backward && pad_data[i] >= kernel_shape_data[i]) ||
+        (subengine == ConvolutionParameter_SubEngine_WINOGRAD &&
+         kernel_shape_data[i] != 3)) {
+      return ConvolutionParameter_SubEngine_DIRECT;
+    }
+  }
+  return subengine;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::transform_conv_cpu(
+    ConvolutionParameter_SubEngine subengine, const Dtype* input,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const int num_output, const int pad_h,
+    const int pad_w, Dtype* output) {
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  if (subengine == ConvolutionParameter_SubEngine_WINOGRAD) {
+    winograd_conv_cpu(input, this->num_, channels, height, width, weights,
+        num_output, this->group_, pad_h, pad_w, conv_param.winograd_tile(),
+        output);
+  } else {
+    CHECK_EQ(subengine, ConvolutionParameter_SubEngine_FFT);
+    fft_conv_cpu(input, this->num_, channels, height, width, weights,
+        num_output, this->group_, this->kernel_shape_.cpu_data()[0],
+        this->kernel_shape_.cpu_data()[1], pad_h, pad_w, output);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const ConvolutionParameter_SubEngine subengine = cpu_subengine(false);
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+    if (subengine != ConvolutionParameter_SubEngine_DIRECT) {
+      transform_conv_cpu(subengine, bottom_data, this->channels_,
+          this->input_shape(1), this->input_shape(2), weight,
+          this->num_output_, this->pad_.cpu_data()[0],
+          this->pad_.cpu_data()[1], top_data);
+    }
     for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
+      if (subengine == ConvolutionParameter_SubEngine_DIRECT) {
+        this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
+      }
       if (this->bias_term_) {
         const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
@@ -51,10 +106,49 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     caffe_set(this->blobs_[1]->count(), Dtype(0),
         this->blobs_[1]->mutable_cpu_diff());
   }
+  const ConvolutionParameter_SubEngine subengine = cpu_subengine(true);
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  if (subengine != ConvolutionParameter_SubEngine_DIRECT) {
+    // The data pass correlates the top diff with each filter turned by 180
+    // degrees, reading the top channels of a group as its inputs
+    const int kh = kernel_shape_data[0];
+    const int kw = kernel_shape_data[1];
+    const int in_channels = this->channels_ / this->group_;
+    const int out_channels = this->num_output_ / this->group_;
+    vector<int> flipped_shape(4);
+    flipped_shape[0] = this->channels_;
+    flipped_shape[1] = out_channels;
+    flipped_shape[2] = kh;
+    flipped_shape[3] = kw;
+    flipped_weights_.Reshape(flipped_shape);
+    Dtype* flipped = flipped_weights_.mutable_cpu_data();
+    for (int g = 0; g < this->group_; ++g) {
+      for (int o = 0; o < out_channels; ++o) {
+        for (int c = 0; c < in_channels; ++c) {
+          const Dtype* filter = weight +
+              ((g * out_channels + o) * in_channels + c) * kh * kw;
+          Dtype* turned = flipped +
+              ((g * in_channels + c) * out_channels + o) * kh * kw;
+          for (int j = 0; j < kh * kw; ++j) {
+            turned[j] = filter[kh * kw - 1 - j];
+          }
+        }
+      }
+    }
+  }
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    if (propagate_down[i] &&
+        subengine != ConvolutionParameter_SubEngine_DIRECT) {
+      transform_conv_cpu(subengine, top_diff, this->num_output_,
+          this->output_shape_[0], this->output_shape_[1],
+          flipped_weights_.cpu_data(), this->channels_,
+          kernel_shape_data[0] - 1 - pad_data[0],
+          kernel_shape_data[1] - 1 - pad_data[1], bottom_diff);
+    }
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
@@ -70,7 +164,8 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
               top_diff + n * this->top_dim_, weight_diff);
         }
         // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
+        if (propagate_down[i] &&
+            subengine == ConvolutionParameter_SubEngine_DIRECT) {
           this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
               bottom_diff + n * this->bottom_dim_);
         }
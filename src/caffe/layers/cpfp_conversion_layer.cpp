@@ -1,7 +1,11 @@
+#include <boost/bind.hpp>
 #include <algorithm>
+#include <cstdlib>
 #include <vector>
 
 #include "caffe/layers/cpfp_conversion_layer.hpp"
+#include "caffe/util/cpfp_quantize.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -12,6 +16,17 @@ void CPFPConversionLayer<Dtype>::LayerSetUp(
     this->layer_param_.cpfp_conversion_param();
 
   convert_to_ = cpfp_param.convert_to(); 
+  exp_bias_ = cpfp_param.exp_bias();
+  CHECK_LE(std::abs(exp_bias_), CPFP_MAX_EXP_BIAS)
+      << "exp_bias must be at most " << CPFP_MAX_EXP_BIAS << " in magnitude";
+  calibrate_ = cpfp_param.calibrate();
+  calibration_exp_ = cpfp_param.calibration_exp();
+}
+
+template <typename Dtype>
+int CPFPConversionLayer<Dtype>::exp_bias(const int count, const Dtype* x) {
+  return calibrate_ ? cpfp_calibrate_exp_bias(count, x, calibration_exp_) :
+      exp_bias_;
 }
 
 template <typename Dtype>
@@ -19,7 +34,14 @@ void CPFPConversionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
    const vector<Blob<Dtype>*>& top) {
   bottom_shape_ = bottom[0]->shape();
 
+  BlobStorage bottom_storage = convert_to_ ? STORAGE_DTYPE : STORAGE_CPFP;
+  BlobStorage top_storage = convert_to_ ? STORAGE_CPFP : STORAGE_DTYPE;
+  for (int bottom_id = 0; bottom_id < bottom.size(); ++bottom_id) {
+    CHECK_EQ(bottom[bottom_id]->storage(), bottom_storage)
+      << "Unexpected bottom storage for cpfp conversion";
+  }
   for (int top_id = 0; top_id < top.size(); ++top_id) {
+    top[top_id]->set_storage(top_storage);
     top[top_id]->Reshape(bottom[0]->shape());
   }
 } 
@@ -30,25 +52,38 @@ void CPFPConversionLayer<Dtype>::Forward_cpu(
   for (int i = 0; i < bottom.size(); ++i) {
     const int count = bottom[i]->count();
     if (convert_to_) {
-      int outsize = sizeof(cpfp) * count;
-      const Dtype *bottom_data = bottom[i]->cpu_data();
-      cpfp *top_data =
-        reinterpret_cast<cpfp *>(top[i]->mutable_cpu_data(outsize));
-      for (int j = 0; j < count; ++j) {
-        top_data[j] = cpfp((float)bottom_data[j]);
-      }
+      const int bias = exp_bias(count, bottom[i]->cpu_data());
+      top[i]->set_data_exp_bias(bias);
+      caffe_parallel_for(count, caffe_parallel_grain(1),
+          boost::bind(&CPFPConversionLayer<Dtype>::ToCPFP_cpu, this,
+              bottom[i]->cpu_data(),
+              top[i]->template mutable_cpu_data_as<cpfp>(), bias, _1, _2));
     } else {
-      int insize = sizeof(cpfp) * count;
-      const cpfp *bottom_data =
-        reinterpret_cast<const cpfp *>(bottom[i]->cpu_data(insize));
-      Dtype *top_data = top[i]->mutable_cpu_data();
-      for (int j = 0; j < count; ++j) {
-        top_data[j] = (Dtype)(float(bottom_data[j]));
-      }
+      caffe_parallel_for(count, caffe_parallel_grain(1),
+          boost::bind(&CPFPConversionLayer<Dtype>::FromCPFP_cpu, this,
+              bottom[i]->template cpu_data_as<cpfp>(),
+              top[i]->mutable_cpu_data(), bottom[i]->data_exp_bias(), _1,
+              _2));
     }
   }
 }
 
+template <typename Dtype>
+void CPFPConversionLayer<Dtype>::ToCPFP_cpu(const Dtype* bottom_data,
+    cpfp* top_data, const int exp_bias, const int begin, const int end) {
+  for (int j = begin; j < end; ++j) {
+    top_data[j] = cpfp(float2cpfp((float)bottom_data[j], exp_bias));
+  }
+}
+
+template <typename Dtype>
+void CPFPConversionLayer<Dtype>::FromCPFP_cpu(const cpfp* bottom_data,
+    Dtype* top_data, const int exp_bias, const int begin, const int end) {
+  for (int j = begin; j < end; ++j) {
+    top_data[j] = (Dtype)cpfp2float(bottom_data[j], exp_bias);
+  }
+}
+
 template <typename Dtype>
 void CPFPConversionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
@@ -57,21 +92,18 @@ void CPFPConversionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     for (int i = 0; i < bottom.size(); ++i) {  
       const int count = bottom[i]->count();
       if (convert_to_) {
-        int outsize = sizeof(cpfp) * count;
         Dtype *bottom_diff = bottom[i]->mutable_cpu_diff();
-        const cpfp *top_diff =
-          reinterpret_cast<const cpfp *>(top[i]->cpu_diff(outsize));
-        for (int j = 0; j < count; ++j) {
-          bottom_diff[j] = (Dtype)(float(top_diff[j]));
-        }
+        const cpfp *top_diff = top[i]->template cpu_diff_as<cpfp>();
+        FromCPFP_cpu(top_diff, bottom_diff, top[i]->diff_exp_bias(), 0,
+            count);
       } else {
-        int insize = sizeof(cpfp) * count;
-        cpfp *bottom_diff =
-          reinterpret_cast<cpfp *>(bottom[i]->mutable_cpu_diff(insize));
+        // The gradients get their own bias, they are usually far smaller
+        // than the values
+        cpfp *bottom_diff = bottom[i]->template mutable_cpu_diff_as<cpfp>();
         const Dtype *top_diff = top[i]->cpu_diff();
-        for (int j = 0; j < count; ++j) {
-          bottom_diff[j] = cpfp((float)top_diff[j]);
-        }
+        const int bias = exp_bias(count, top_diff);
+        bottom[i]->set_diff_exp_bias(bias);
+        ToCPFP_cpu(top_diff, bottom_diff, bias, 0, count);
       }
     }
   }
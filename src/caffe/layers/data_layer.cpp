@@ -3,11 +3,15 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/db_sharded.hpp"
+#include "caffe/util/io.hpp"
 
 namespace caffe {
 
@@ -15,9 +19,14 @@ template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
     offset_() {
-  db_.reset(db::GetDB(param.data_param().backend()));
+  // In test mode, only rank 0 runs and reads everything
+  const bool train = param.phase() == TRAIN;
+  db_.reset(db::GetDB(param.data_param(), train ? Caffe::solver_rank() : 0,
+      train ? Caffe::solver_count() : 1));
   db_->Open(param.data_param().source(), db::READ);
   cursor_.reset(db_->NewCursor());
+  // Sharded sources only hand this solver its own items
+  partitioned_ = dynamic_cast<db::ShardedDB*>(db_.get()) != NULL;
 }
 
 template <typename Dtype>
@@ -62,7 +71,7 @@ bool DataLayer<Dtype>::Skip() {
   int rank = Caffe::solver_rank();
   bool keep = (offset_ % size) == rank ||
               // In test mode, only rank 0 runs, so avoid skipping
-              this->layer_param_.phase() == TEST;
+              this->layer_param_.phase() == TEST || partitioned_;
   return !keep;
 }
 
@@ -89,40 +98,46 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
-  Datum datum;
+  // The cursor is only moved on this thread; the decode workers get the
+  // serialized items. LMDB hands out views into its memory map, so the
+  // pixels are only copied once, into the batch.
+  timer.Start();
+  values_.resize(batch_size);
+  value_data_.resize(batch_size);
+  value_size_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
     while (Skip()) {
       Next();
     }
-    datum.ParseFromString(cursor_->value());
-    read_time += timer.MicroSeconds();
-
-    if (item_id == 0) {
-      // Reshape according to the first datum of each batch
-      // on single input batches allows for inputs of varying dimension.
-      // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
-      // Reshape batch according to the batch_size.
-      top_shape[0] = batch_size;
-      batch->data_.Reshape(top_shape);
-    }
-
-    // Apply data transformations (mirror, scale, crop...)
-    timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+    if (!cursor_->value_view(&value_data_[item_id], &value_size_[item_id])) {
+      values_[item_id] = cursor_->value();
+      value_data_[item_id] = values_[item_id].data();
+      value_size_[item_id] = values_[item_id].size();
     }
-    trans_time += timer.MicroSeconds();
     Next();
   }
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  Datum datum;
+  datum.ParseFromArray(value_data_[0], value_size_[0]);
+  read_time += timer.MicroSeconds();
+  // Use data_transformer to infer the expected blob shape from datum.
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  this->ReshapeTransformedData(top_shape);
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+
+  // Apply data transformations (mirror, scale, crop...)
+  timer.Start();
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = NULL;
+  if (this->output_labels_) {
+    top_label = batch->label_.mutable_cpu_data();
+  }
+  this->ForEachItem(batch_size, boost::bind(&DataLayer<Dtype>::TransformItem,
+      this, top_data, top_label, _1, _2));
+  trans_time += timer.MicroSeconds();
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
@@ -130,6 +145,26 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the decode workers
+template<typename Dtype>
+void DataLayer<Dtype>::TransformItem(Dtype* top_data, Dtype* top_label,
+    int item_id, int worker) {
+  Datum datum;
+  const char* data;
+  size_t data_size;
+  CHECK(ParseDatumAliasingData(value_data_[item_id], value_size_[item_id],
+      &datum, &data, &data_size)) << "Could not parse datum " << item_id;
+  Blob<Dtype>* transformed_data = this->transformed_data(worker);
+  transformed_data->set_cpu_data(top_data +
+      item_id * transformed_data->count());
+  this->transformer(worker)->Transform(datum, data, data_size,
+      transformed_data);
+  // Copy label.
+  if (top_label) {
+    top_label[item_id] = datum.label();
+  }
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
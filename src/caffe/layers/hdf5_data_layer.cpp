@@ -1,11 +1,11 @@
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
 */
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -16,16 +16,31 @@ TODO:
 
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+  if (stream_file_ >= 0) {
+    boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+    H5Fclose(stream_file_);
+  }
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::Shuffle(std::vector<unsigned int>* order) {
+  caffe::rng_t* shuffle_rng =
+      static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+  shuffle(order->begin(), order->end(), shuffle_rng);
+}
 
 // Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
   if (file_id < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
@@ -46,6 +61,7 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
 
   herr_t status = H5Fclose(file_id);
   CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+  lock.unlock();
 
   // MinTopBlobs==1 guarantees at least one top blob
   CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
@@ -61,7 +77,7 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
 
   // Shuffle if needed.
   if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+    Shuffle(&data_permutation_);
     DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0)
                << " rows (shuffled)";
   } else {
@@ -69,12 +85,96 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   }
 }
 
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::OpenStreamFile() {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  if (stream_file_ >= 0) {
+    herr_t status = H5Fclose(stream_file_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file.";
+  }
+  const char* filename = hdf_filenames_[file_permutation_[current_file_]]
+      .c_str();
+  DLOG(INFO) << "Streaming HDF5 file: " << filename;
+  stream_file_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (stream_file_ < 0) {
+    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+  }
+  stream_rows_ = hdf5_get_num_rows(stream_file_,
+      this->layer_param_.top(0).c_str());
+  CHECK_GT(stream_rows_, 0) << "No rows in HDF5 file: " << filename;
+  for (int i = 1; i < this->layer_param_.top_size(); ++i) {
+    CHECK_EQ(hdf5_get_num_rows(stream_file_,
+        this->layer_param_.top(i).c_str()), stream_rows_);
+  }
+  lock.unlock();
+  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  chunk_permutation_.resize((stream_rows_ + batch_size - 1) / batch_size);
+  for (int i = 0; i < chunk_permutation_.size(); ++i) {
+    chunk_permutation_[i] = i;
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    Shuffle(&chunk_permutation_);
+  }
+  current_chunk_ = 0;
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::LoadStreamChunk() {
+  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const hsize_t first_row =
+      static_cast<hsize_t>(chunk_permutation_[current_chunk_]) * batch_size;
+  const hsize_t rows = std::min<hsize_t>(batch_size, stream_rows_ - first_row);
+  const int top_size = this->layer_param_.top_size();
+  hdf_blobs_.resize(top_size);
+  for (int i = 0; i < top_size; ++i) {
+    if (!hdf_blobs_[i]) {
+      hdf_blobs_[i].reset(new Blob<Dtype>());
+    }
+    hdf5_load_nd_dataset_rows(stream_file_, this->layer_param_.top(i).c_str(),
+        first_row, rows, hdf_blobs_[i].get());
+  }
+  data_permutation_.resize(rows);
+  for (int i = 0; i < rows; ++i) {
+    data_permutation_[i] = i;
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    Shuffle(&data_permutation_);
+  }
+  current_row_ = 0;
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextStreamChunk() {
+  if (++current_chunk_ == chunk_permutation_.size()) {
+    if (num_files_ > 1) {
+      ++current_file_;
+      if (current_file_ == num_files_) {
+        current_file_ = 0;
+        if (this->layer_param_.hdf5_data_param().shuffle()) {
+          Shuffle(&file_permutation_);
+        }
+        DLOG(INFO) << "Looping around to first file.";
+      }
+      OpenStreamFile();
+    } else {
+      current_chunk_ = 0;
+      if (this->layer_param_.hdf5_data_param().shuffle()) {
+        Shuffle(&chunk_permutation_);
+      }
+    }
+  }
+  LoadStreamChunk();
+}
+
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
       this->type() << " does not transform data.";
+  // The prefetch thread of an earlier setup owns the stream state
+  this->StopInternalThread();
+  stream_ = this->layer_param_.hdf5_data_param().stream();
   // Read the source to parse the filenames.
   const string& source = this->layer_param_.hdf5_data_param().source();
   LOG(INFO) << "Loading list of HDF5 filenames from: " << source;
@@ -102,17 +202,28 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     file_permutation_[i] = i;
   }
 
-  // Shuffle if needed.
+  // Shuffle if needed, with a stream of the layer's own, as the prefetch
+  // thread shuffles the chunks and rows of the files it streams.
   if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+    const unsigned int shuffle_rng_seed = caffe_rng_rand();
+    shuffle_rng_.reset(new Caffe::RNG(shuffle_rng_seed));
+    Shuffle(&file_permutation_);
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  // Load the first HDF5 file, or its first chunk when streaming, and
+  // initialize the line counter.
+  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  if (stream_) {
+    CHECK_GT(batch_size, 0) << "Streaming needs a batch size.";
+    OpenStreamFile();
+    LoadStreamChunk();
+  } else {
+    LoadHDF5FileData(
+        hdf_filenames_[file_permutation_[current_file_]].c_str());
+  }
   current_row_ = 0;
 
   // Reshape blobs.
-  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   const int top_size = this->layer_param_.top_size();
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
@@ -123,6 +234,46 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
     top[i]->Reshape(top_shape);
   }
+
+  if (stream_) {
+    HDF5Batch<Dtype>* batch;
+    while (stream_full_.try_pop(&batch)) {}
+    while (stream_free_.try_pop(&batch)) {}
+    stream_current_ = NULL;
+    const int prefetch = this->layer_param_.hdf5_data_param().prefetch();
+    CHECK_GT(prefetch, 0);
+    stream_batches_.resize(prefetch);
+    for (int i = 0; i < prefetch; ++i) {
+      stream_batches_[i].reset(new HDF5Batch<Dtype>());
+      for (int j = 0; j < top_size; ++j) {
+        stream_batches_[i]->blobs_.push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>(top[j]->shape())));
+        // Allocate here rather than on the prefetch thread, as
+        // BasePrefetchingDataLayer does, so GPU mode pins the memory
+        stream_batches_[i]->blobs_[j]->mutable_cpu_data();
+      }
+      stream_free_.push(stream_batches_[i].get());
+    }
+    DLOG(INFO) << "Initializing HDF5 prefetch";
+    this->StartInternalThread();
+  }
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      HDF5Batch<Dtype>* batch = stream_free_.pop();
+      vector<Blob<Dtype>*> blobs;
+      for (int j = 0; j < batch->blobs_.size(); ++j) {
+        blobs.push_back(batch->blobs_[j].get());
+      }
+      FillBatch(blobs);
+      stream_full_.push(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
 }
 
 template <typename Dtype>
@@ -137,14 +288,20 @@ bool HDF5DataLayer<Dtype>::Skip() {
 
 template<typename Dtype>
 void HDF5DataLayer<Dtype>::Next() {
+  if (stream_) {
+    if (++current_row_ == hdf_blobs_[0]->shape(0)) {
+      NextStreamChunk();
+    }
+    offset_++;
+    return;
+  }
   if (++current_row_ == hdf_blobs_[0]->shape(0)) {
     if (num_files_ > 1) {
       ++current_file_;
       if (current_file_ == num_files_) {
         current_file_ = 0;
         if (this->layer_param_.hdf5_data_param().shuffle()) {
-          std::random_shuffle(file_permutation_.begin(),
-                              file_permutation_.end());
+          Shuffle(&file_permutation_);
         }
         DLOG(INFO) << "Looping around to first file.";
       }
@@ -153,14 +310,13 @@ void HDF5DataLayer<Dtype>::Next() {
     }
     current_row_ = 0;
     if (this->layer_param_.hdf5_data_param().shuffle())
-      std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+      Shuffle(&data_permutation_);
   }
   offset_++;
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataLayer<Dtype>::FillBatch(const vector<Blob<Dtype>*>& top) {
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   for (int i = 0; i < batch_size; ++i) {
     while (Skip()) {
@@ -176,6 +332,23 @@ void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (!stream_) {
+    FillBatch(top);
+    return;
+  }
+  if (stream_current_) {
+    stream_free_.push(stream_current_);
+  }
+  stream_current_ = stream_full_.pop("Waiting for HDF5 data");
+  for (int j = 0; j < this->layer_param_.top_size(); ++j) {
+    caffe_copy(top[j]->count(), stream_current_->blobs_[j]->cpu_data(),
+        top[j]->mutable_cpu_data());
+  }
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(HDF5DataLayer, Forward);
 #endif
@@ -16,6 +16,17 @@ namespace caffe {
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (stream_) {
+    if (stream_current_) {
+      stream_free_.push(stream_current_);
+    }
+    stream_current_ = stream_full_.pop("Waiting for HDF5 data");
+    for (int j = 0; j < this->layer_param_.top_size(); ++j) {
+      caffe_copy(top[j]->count(), stream_current_->blobs_[j]->cpu_data(),
+          top[j]->mutable_gpu_data());
+    }
+    return;
+  }
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   for (int i = 0; i < batch_size; ++i) {
     while (Skip()) {
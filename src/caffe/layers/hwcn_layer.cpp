@@ -1,7 +1,9 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/hwcn_layer.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -18,7 +20,8 @@ void HWCNLayer<Dtype>::LayerSetUp(
 template <typename Dtype>
 void HWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
    const vector<Blob<Dtype>*>& top) {
-
+  // Taken again here, as the batch size can change after setup
+  bottom_shape_ = bottom[0]->shape();
   vector<int> top_shape(bottom_shape_.size());
 
   if (bottom_shape_.size() == 2) {
@@ -46,42 +49,55 @@ void HWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void HWCNLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  std::vector<int> shape = bottom_shape_;
+  if (convert_to_) {
+    if (shape.size() == 2) {
+      shape.push_back(1);
+      shape.push_back(1);
+    }
+  } else {
+    if (shape.size() == 2) {
+      shape.insert(shape.begin(), 1);
+      shape.insert(shape.begin(), 1);
+    }
+  }
+  // The threads take whole rows of the top: h in HWCN, n in NCHW.
+  const int rows = convert_to_ ? shape[2] : shape[3];
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    std::vector<int> shape = bottom_shape_;
-    if (convert_to_) {
-      if (shape.size() == 2) {
-        shape.push_back(1);
-        shape.push_back(1);
-      }
-      for (int n = 0; n < shape[0]; ++n) {
+    caffe_parallel_for(rows, caffe_parallel_grain(bottom[i]->count() / rows),
+        boost::bind(&HWCNLayer<Dtype>::ConvertRows_cpu, this,
+            bottom[i]->cpu_data(), top[i]->mutable_cpu_data(),
+            boost::cref(shape), _1, _2));
+  }
+}
+
+template <typename Dtype>
+void HWCNLayer<Dtype>::ConvertRows_cpu(const Dtype* bottom_data,
+    Dtype* top_data, const vector<int>& shape, const int begin,
+    const int end) {
+  if (convert_to_) {
+    for (int h = begin; h < end; ++h) {
+      for (int w = 0; w < shape[3]; ++w) {
         for (int c = 0; c < shape[1]; ++c) {
-          for (int h = 0; h < shape[2]; ++h) {
-            for (int w = 0; w < shape[3]; ++w) {
-              int bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3] + w;
-              int top_idx = ((h * shape[3] + w) * shape[1] + c) * shape[0] + n;
-              top_data[top_idx] = bottom_data[bot_idx];
-            }
+          for (int n = 0; n < shape[0]; ++n) {
+            int bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3] + w;
+            int top_idx = ((h * shape[3] + w) * shape[1] + c) * shape[0] + n;
+            top_data[top_idx] = bottom_data[bot_idx];
           }
         }
       }
-    } else {
-      if (shape.size() == 2) {
-        shape.insert(shape.begin(), 1);
-        shape.insert(shape.begin(), 1);
-      }
-      for (int n = 0; n < shape[3]; ++n) {
-        for (int c = 0; c < shape[2]; ++c) {
-          for (int h = 0; h < shape[0]; ++h) {
-            for (int w = 0; w < shape[1]; ++w) {
-              int bot_idx = ((h * shape[1] + w) * shape[2] + c) * shape[3] + n;
-              int top_idx = ((n * shape[2] + c) * shape[0] + h) * shape[1] + w;
-              top_data[top_idx] = bottom_data[bot_idx];
-            }
+    }
+  } else {
+    for (int n = begin; n < end; ++n) {
+      for (int c = 0; c < shape[2]; ++c) {
+        for (int h = 0; h < shape[0]; ++h) {
+          for (int w = 0; w < shape[1]; ++w) {
+            int bot_idx = ((h * shape[1] + w) * shape[2] + c) * shape[3] + n;
+            int top_idx = ((n * shape[2] + c) * shape[0] + h) * shape[1] + w;
+            top_data[top_idx] = bottom_data[bot_idx];
           }
         }
-      }     
+      }
     }
   }
 }
@@ -1,6 +1,7 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
+#include <boost/bind.hpp>
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
 #include <string>
@@ -130,7 +131,7 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
   // Use data_transformer to infer the expected blob shape from a cv_img.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-  this->transformed_data_.Reshape(top_shape);
+  this->ReshapeTransformedData(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
@@ -138,24 +139,13 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-  // datum scales
+  // Pick the images of the batch here; the decode workers read them.
+  timer.Start();
   const int lines_size = lines_.size();
+  batch_lines_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-    prefetch_label[item_id] = lines_[lines_id_].second;
+    batch_lines_[item_id] = lines_[lines_id_];
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -167,12 +157,38 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  read_time += timer.MicroSeconds();
+  // Read the images and apply transformations (mirror, crop...)
+  timer.Start();
+  this->ForEachItem(batch_size, boost::bind(
+      &ImageDataLayer<Dtype>::TransformItem, this, prefetch_data,
+      prefetch_label, _1, _2));
+  trans_time += timer.MicroSeconds();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the decode workers
+template <typename Dtype>
+void ImageDataLayer<Dtype>::TransformItem(Dtype* prefetch_data,
+    Dtype* prefetch_label, int item_id, int worker) {
+  ImageDataParameter image_data_param = this->layer_param_.image_data_param();
+  const std::pair<std::string, int>& line = batch_lines_[item_id];
+  cv::Mat cv_img = ReadImageToCVMat(
+      image_data_param.root_folder() + line.first,
+      image_data_param.new_height(), image_data_param.new_width(),
+      image_data_param.is_color());
+  CHECK(cv_img.data) << "Could not load " << line.first;
+  // Apply transformations (mirror, crop...) to the image
+  Blob<Dtype>* transformed_data = this->transformed_data(worker);
+  transformed_data->set_cpu_data(prefetch_data +
+      item_id * transformed_data->count());
+  this->transformer(worker)->Transform(cv_img, transformed_data);
+  prefetch_label[item_id] = line.second;
+}
+
 INSTANTIATE_CLASS(ImageDataLayer);
 REGISTER_LAYER_CLASS(ImageData);
 
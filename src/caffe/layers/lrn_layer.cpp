@@ -1,7 +1,9 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -110,19 +112,32 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
+  // go through the images
+  caffe_parallel_for(num_,
+      caffe_parallel_grain(channels_ * height_ * width_ * 4),
+      boost::bind(&LRNLayer<Dtype>::CrossChannelScale_cpu, this, bottom_data,
+          scale_data, _1, _2));
+  // In the end, compute output
+  caffe_parallel_for(scale_.count(), caffe_parallel_grain(1),
+      boost::bind(&LRNLayer<Dtype>::CrossChannelOutput_cpu, this, bottom_data,
+          scale_data, top_data, _1, _2));
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelScale_cpu(const Dtype* bottom_data,
+    Dtype* scale_data, const int begin, const int end) {
   // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
+  for (int i = scale_.offset(begin); i < scale_.offset(end); ++i) {
     scale_data[i] = k_;
   }
   Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
   Dtype* padded_square_data = padded_square.mutable_cpu_data();
   caffe_set(padded_square.count(), Dtype(0), padded_square_data);
   Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
+  for (int n = begin; n < end; ++n) {
     // compute the padded square
     caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
+        bottom_data + scale_.offset(n),
         padded_square_data + padded_square.offset(0, pre_pad_));
     // Create the first channel scale
     for (int c = 0; c < size_; ++c) {
@@ -145,10 +160,16 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
           scale_data + scale_.offset(n, c));
     }
   }
+}
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelOutput_cpu(const Dtype* bottom_data,
+    const Dtype* scale_data, Dtype* top_data, const int begin,
+    const int end) {
+  caffe_powx<Dtype>(end - begin, scale_data + begin, -beta_,
+      top_data + begin);
+  caffe_mul<Dtype>(end - begin, top_data + begin, bottom_data + begin,
+      top_data + begin);
 }
 
 template <typename Dtype>
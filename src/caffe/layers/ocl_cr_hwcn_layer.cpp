@@ -1,12 +1,33 @@
+#include <boost/thread.hpp>
+#include <cstddef>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/ocl_cr_hwcn_layer.hpp"
+#include "caffe/util/cpfp_quantize.hpp"
+#include "caffe/util/hwcn_conv.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
 #ifdef USE_OCL
 
+// The engine rounds channel counts up to a multiple of 16 when it packs
+// weights and weight diffs
+static inline int pad_channels(int channels) {
+  return (channels % 16 == 0) ? channels : (channels / 16 + 1) * 16;
+}
+
+// The value of a weight or bias diff read back from the device, a cpfp diff
+// of the last pass or a float sum of several
+static inline float diff_value(cpfp value, int exp_bias) {
+  return cpfp2float(value, exp_bias);
+}
+
+static inline float diff_value(float value, int exp_bias) {
+  return value;
+}
+
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -87,6 +108,26 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
           conv_param.pad((num_pad_dims == 1) ? 0 : i);
     }
   }
+  // Setup dilation dimensions (dilation_).
+  this->dilation_.Reshape(spatial_dim_blob_shape);
+  int* dilation_data = this->dilation_.mutable_cpu_data();
+  const int num_dilation_dims = conv_param.dilation_size();
+  CHECK(num_dilation_dims == 0 || num_dilation_dims == 1 ||
+        num_dilation_dims == this->num_spatial_axes_)
+      << "dilation must be specified once, or once per spatial dimension "
+      << "(dilation specified " << num_dilation_dims << " times; "
+      << this->num_spatial_axes_ << " spatial dims).";
+  const int kDefaultDilation = 1;
+  for (int i = 0; i < this->num_spatial_axes_; ++i) {
+    dilation_data[i] = (num_dilation_dims == 0) ? kDefaultDilation :
+        conv_param.dilation((num_dilation_dims == 1) ? 0 : i);
+  }
+  // Both engines work on HWCN blobs, so there are exactly two spatial axes
+  CHECK_EQ(this->num_spatial_axes_, 2)
+      << "OCLCRHWCN only supports 2D convolution.";
+  for (int i = 0; i < this->num_spatial_axes_; ++i) {
+    CHECK_GT(dilation_data[i], 0) << "Dilation must be nonzero.";
+  }
   // Configure output channels and groups.
   this->channels_ = bottom[0]->shape(2);
   this->num_output_ = this->layer_param_.convolution_param().num_output();
@@ -151,6 +192,22 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  this->bottom_shape_ = &bottom[0]->shape();
+  compute_output_shape();
+  SetUpEngine(bottom);
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::SetUpEngine(const vector<Blob<Dtype>*>& bottom) {
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  engine_num_ = bottom[0]->shape(3);
+  // Everything below packs the layer for the FPGA engine
+  ocl_engine_ = ocl_engine_supports(bottom);
+  if (!ocl_engine_)
+    return;
 
   if ((bottom[0]->shape(2) / this->group_) % 16 == 0)
     weight_pad_ = bottom[0]->shape(2) / this->group_;
@@ -158,7 +215,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     weight_pad_ = ((bottom[0]->shape(2) / this->group_) / 16 + 1) * 16;
 
   CRParameter cr_param = this->layer_param_.cr_param();
-  int num_ = bottom[0]->shape(3);
+  int num_ = engine_num_;
   num_cu_ = cr_param.num_cu();
   num_pe_ = cr_param.num_pe();
   switch(num_pe_) {
@@ -170,15 +227,15 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
               break;
   }
   kernel_params *forward_params = &ocl_params_;
-  CHECK(num_ % 16 == 0);
 
   forward_params->ydim = bottom[0]->shape(0);
   forward_params->xdim = bottom[0]->shape(1);
   forward_params->inchannels = bottom[0]->shape(2) / this->group_;
   forward_params->outchannels = this->num_output_ / this->group_;
   forward_params->numimages = num_;
-  forward_params->ksize = (this->blobs_[0])->shape(3);  
- 
+  forward_params->ksize = kernel_shape_data[0];
+  forward_params->ksize_w = kernel_shape_data[1];
+
   int rpofm = num_cu_;
   int burstoc = 1;
   if (rpofm > forward_params->outchannels) {
@@ -193,12 +250,10 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
 
-  int ksize = (this->blobs_[0])->shape(3);
+  int ksize_area = kernel_shape_data[0] * kernel_shape_data[1];
 
-  int burstchannels_ = std::min(8 * 256 * 256 / (forward_params->ksize *
-      forward_params->ksize * forward_params->numimages), 
-      8 * 256 * 16 / (forward_params->ksize * forward_params->ksize *
-      burstoc));
+  int burstchannels_ = std::min(8 * 256 * 256 / (ksize_area *
+      forward_params->numimages), 8 * 256 * 16 / (ksize_area * burstoc));
 
   if (burstchannels_ > forward_params->inchannels) {
     burstchannels_ = forward_params->inchannels;
@@ -209,13 +264,20 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     burstchannels_ = tchannel;
   }
 
-  CHECK(burstoc * (num_ / 16) >= 16);
-  CHECK(burstoc * burstchannels_ * ksize * ksize >= 16);
+  if (burstoc * (num_ / 16) < 16 ||
+      burstoc * burstchannels_ * ksize_area < 16) {
+    fall_back_to_cpu("the forward bursts are too short");
+    return;
+  }
   forward_params->rpofm = rpofm;
   forward_params->xtile_pad = 0;
   forward_params->burstydim = burstoc;
   forward_params->stride = stride_data[0];
+  forward_params->stride_w = stride_data[1];
   forward_params->pad = pad_data[0];
+  forward_params->pad_w = pad_data[1];
+  forward_params->dilation_h = dilation_data[0];
+  forward_params->dilation_w = dilation_data[1];
   forward_params->burstchannels = burstchannels_;
   forward_params->rpo = forward_params->inchannels / burstchannels_;
   forward_params->numgroups = this->group_;
@@ -225,20 +287,23 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   forward_params->pksize = 2;
 
   // Backward params
-  this->bottom_shape_ = &bottom[0]->shape();
-  compute_output_shape();
   kernel_params *backward_params = &ocl_params_bw_;
   backward_params->ydim = bottom[0]->shape(0);
   backward_params->xdim = bottom[0]->shape(1);
   backward_params->outchannels = this->num_output_ / this->group_;
   backward_params->inchannels = bottom[0]->shape(2) / this->group_;
-  backward_params->ksize = (this->blobs_[0])->shape(3);
+  backward_params->ksize = kernel_shape_data[0];
+  backward_params->ksize_w = kernel_shape_data[1];
   backward_params->numimages = num_;
   backward_params->rpofm = rpofm;
   backward_params->xtile_pad = 0;
   backward_params->burstydim = burstoc;
   backward_params->stride = stride_data[0];
+  backward_params->stride_w = stride_data[1];
   backward_params->pad = pad_data[0];
+  backward_params->pad_w = pad_data[1];
+  backward_params->dilation_h = dilation_data[0];
+  backward_params->dilation_w = dilation_data[1];
   backward_params->burstchannels = burstchannels_;
   backward_params->rpo = backward_params->inchannels / burstchannels_;
   backward_params->numgroups = this->group_;
@@ -253,15 +318,16 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params_bi->xdim = this->output_shape_[1];
   backward_params_bi->inchannels = this->num_output_ / this->group_;
   backward_params_bi->outchannels = bottom[0]->shape(2) / this->group_;
-  backward_params_bi->ksize = (this->blobs_[0])->shape(3);
+  backward_params_bi->ksize = kernel_shape_data[0];
+  backward_params_bi->ksize_w = kernel_shape_data[1];
   backward_params_bi->numimages = num_;
   backward_params_bi->xtile_pad = 0;
   backward_params_bi->stride = stride_data[0];
-  if ((pad_data[0] == 0) && (stride_data[0] == 1)) {
-    backward_params_bi->pad = backward_params_bi->ksize - 1;
-  } else {
-    backward_params_bi->pad = pad_data[0];
-  }
+  backward_params_bi->stride_w = stride_data[1];
+  backward_params_bi->pad = backward_data_pad(0);
+  backward_params_bi->pad_w = backward_data_pad(1);
+  backward_params_bi->dilation_h = dilation_data[0];
+  backward_params_bi->dilation_w = dilation_data[1];
 
   rpofm = num_cu_;
   burstoc = 1;
@@ -286,10 +352,8 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
 
-  burstchannels_ = std::min(8 * 256 * 256 / (backward_params_bi->ksize *
-      backward_params_bi->ksize * backward_params_bi->numimages),
-      256 * 8 * 16 / (backward_params_bi->ksize * backward_params_bi->ksize *
-      burstoc));
+  burstchannels_ = std::min(8 * 256 * 256 / (ksize_area *
+      backward_params_bi->numimages), 256 * 8 * 16 / (ksize_area * burstoc));
 
   if (burstchannels_ > backward_params_bi->inchannels) {
     burstchannels_ = backward_params_bi->inchannels;
@@ -300,7 +364,10 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     burstchannels_ = tchannel;
   }
 
-  CHECK(burstoc * (num_ / 16) >= 16);
+  if (burstoc * (num_ / 16) < 16 || burstchannels_ < 16) {
+    fall_back_to_cpu("the backward data bursts are too short");
+    return;
+  }
 
   backward_params_bi->burstchannels = burstchannels_;
   backward_params_bi->rpo = backward_params_bi->inchannels / burstchannels_;
@@ -312,14 +379,16 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params_bi->rpofm = rpofm;
   backward_params_bi->burstydim = burstoc;
 
-  CHECK(burstchannels_ >= 16);
-
   // Set bias update parameters
   kernel_params *bias_params = &ocl_params_bb_;
   bias_params->rpofm = 1;
   bias_params->burstydim = 1;
   bias_params->stride = 1;
+  bias_params->stride_w = 1;
   bias_params->pad = 0;
+  bias_params->pad_w = 0;
+  bias_params->dilation_h = 1;
+  bias_params->dilation_w = 1;
   bias_params->ydim = backward_params_bi->ydim;
   bias_params->xdim = backward_params_bi->xdim;
   bias_params->inchannels = backward_params_bi->inchannels;
@@ -327,6 +396,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   bias_params->burstchannels = burstchannels_;
   bias_params->numimages = num_;
   bias_params->ksize = 1;
+  bias_params->ksize_w = 1;
   bias_params->rpo = bias_params->inchannels / burstchannels_;
   bias_params->numgroups = this->group_;
   bias_params->fc = 0;
@@ -337,7 +407,7 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   vector<int> shape(4);
   shape[0] = bottom[0]->shape(0);
   shape[1] = bottom[0]->shape(1);
-  shape[2] = 1;
+  shape[2] = this->group_;
   shape[3] = bottom[0]->shape(3);
 
   weights_placeholder.Reshape(shape);
@@ -353,20 +423,107 @@ void OCLCRHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   weights_h.Reshape(shape);
 
+  // Rotated weights are packed per group the same way as the forward weights,
+  // with the bottom channels as outputs and the top channels as inputs
   shape = (this->blobs_[0])->shape();
 
-  if (shape[0] % 16 != 0)
-    shape[0] = ((shape[0] / 16) + 1) * 16;
-  shape[1] = backward_params_bi->rpofm * backward_params_bi->burstydim;
+  shape[0] = backward_params_bi->rpofm * backward_params_bi->burstydim *
+    backward_params_bi->numgroups;
+  shape[1] = pad_channels(backward_params_bi->inchannels);
 
   weights_h_r.Reshape(shape);
 
-  bias_h.Reshape((this->blobs_[1])->shape());
+  // The bias diffs of each group start on a 16 channel boundary
+  shape.resize(1);
+  shape[0] = std::max(this->num_output_,
+      pad_channels(bias_params->inchannels) * this->group_);
+
+  bias_h.Reshape(shape);
+
+  // Float sums of the weight and bias diffs over several backward passes,
+  // packed as the cpfp diffs
+  weight_diff_sum_.Reshape(weights_h.shape());
+  bias_diff_sum_.Reshape(bias_h.shape());
+
+  shape[0] = sizeof(kernel_params) / sizeof(int);
+  param_vals.Reshape(shape);
+  param_vals_bw.Reshape(shape);
+  param_vals_bi.Reshape(shape);
+  param_vals_bb.Reshape(shape);
+
+  forward_params->backward = 0;
+  backward_params->backward = 1;
+  backward_params_bi->backward = 2;
+  bias_params->backward = 1;
+
+  for (int i = 0; i < shape[0]; ++i) {
+    param_vals.mutable_cpu_data()[i] = ((int *)forward_params)[i];
+    param_vals_bw.mutable_cpu_data()[i] = ((int *)backward_params)[i];
+    param_vals_bi.mutable_cpu_data()[i] = ((int *)backward_params_bi)[i];
+    param_vals_bb.mutable_cpu_data()[i] = ((int *)bias_params)[i];
+  }
+}
+
+template <typename Dtype>
+bool OCLCRHWCNLayer<Dtype>::ocl_engine_supports(
+    const vector<Blob<Dtype>*>& bottom) {
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  // The kernel geometry has to fit in the engine's bit widths
+  for (int i = 0; i < this->num_spatial_axes_; ++i) {
+    if (kernel_shape_data[i] > 11) {
+      fall_back_to_cpu("kernel dimensions must be <= 11");
+      return false;
+    }
+    if (stride_data[i] >= 16 || pad_data[i] >= 16 ||
+        dilation_data[i] >= 16) {
+      fall_back_to_cpu("stride, padding and dilation must fit in 4 bits");
+      return false;
+    }
+    const int kernel_extent = dilation_data[i] *
+      (kernel_shape_data[i] - 1) + 1;
+    const int backward_pad = kernel_extent - 1 - pad_data[i];
+    if (stride_data[i] == 1 && (backward_pad < 0 || backward_pad >= 16)) {
+      fall_back_to_cpu("backward padding must fit in 4 bits");
+      return false;
+    }
+  }
+  if (bottom[0]->shape(3) % 16 != 0) {
+    fall_back_to_cpu("the batch size must be a multiple of 16");
+    return false;
+  }
+  const int num_pe = this->layer_param_.cr_param().num_pe();
+  if (num_pe != 4 && num_pe != 8 && num_pe != 16) {
+    fall_back_to_cpu("num_pe must be 4, 8 or 16");
+    return false;
+  }
+  return true;
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::fall_back_to_cpu(const char* reason) {
+  ocl_engine_ = false;
+  LOG(INFO) << this->layer_param_.name() << " runs on the CPU engine: "
+      << reason << ".";
 }
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  // The gradient passes of the last backward may still read the buffers
+  FinishBackward();
+  CHECK_EQ(bottom[0]->storage(), STORAGE_CPFP)
+      << "OCLCRHWCN input must hold cpfp values.";
+  // The bursts and image counts of the engine follow the batch size, which
+  // can change after setup, e.g. for the micro-batches of a pipelined net.
+  // Diffs the device still sums up are read back first, as the new packing
+  // differs
+  if (bottom[0]->shape(3) != engine_num_) {
+    SyncParamDiffs();
+    SetUpEngine(bottom);
+  }
   // Shape the tops.
   vector<int> top_shape;
   for (int i = 0; i < this->num_spatial_axes_; ++i) {
@@ -376,6 +533,7 @@ void OCLCRHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_shape.push_back(this->num_output_);
   top_shape.push_back(bottom[0]->shape(3));
   for (int top_id = 0; top_id < top.size(); ++top_id) {
+    top[top_id]->set_storage(STORAGE_CPFP);
     top[top_id]->Reshape(top_shape);
   }
 
@@ -398,12 +556,9 @@ void OCLCRHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::launchKernel(const cpfp *bottom,
     const cpfp *weights, const cpfp *bias, cpfp *top, int *tags,
-    const int *params, int numgroups) {
-  std::vector<cl_event> events;
-
-  int events_size = numgroups;
-  events.resize(events_size, 0);
-  
+    const int *params, float *accum, int numgroups, cl_command_queue queue,
+    std::vector<cl_event>* events) {
+  boost::mutex::scoped_lock lock(this->ocl_kernel_mutex());
   clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
     (const void *)&bottom);
   clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
@@ -416,12 +571,28 @@ void OCLCRHWCNLayer<Dtype>::launchKernel(const cpfp *bottom,
     (const void *)&tags);
   clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
     (const void *)&params);
+  clSetKernelArg(this->ocl_kernel, 7, sizeof(cl_mem),
+    (const void *)&accum);
+  // Groups are queued back to back, the caller waits for all of them with
+  // waitKernels() once it needs the results on the host
   for (int g = 0; g < numgroups; ++g) {
+    cl_event event;
     clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
         (const void *)&g);
-    clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
+    clEnqueueTask(queue, this->ocl_kernel, 0, NULL, &event);
+    events->push_back(event);
   }
-  clWaitForEvents(events.size(), events.data()); 
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::waitKernels(std::vector<cl_event>* events) {
+  if (events->size() == 0)
+    return;
+  clWaitForEvents(events->size(), events->data());
+  Caffe::count_kernel_time(events->size(), events->data());
+  for (int i = 0; i < events->size(); ++i)
+    clReleaseEvent((*events)[i]);
+  events->clear();
 }
 
 template <typename Dtype>
@@ -429,33 +600,84 @@ void OCLCRHWCNLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
   const int* stride_data = this->stride_.cpu_data();
   const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
   this->output_shape_.clear();
   for (int i = 0; i < this->num_spatial_axes_; ++i) {
-    // i + 1 to skip channel axis
+    // HWCN, the spatial axes come first
     const int input_dim = (*this->bottom_shape_)[i];
-    const int output_dim = (input_dim + 2 * pad_data[i] - kernel_shape_data[i])
+    const int kernel_extent = dilation_data[i] * (kernel_shape_data[i] - 1) + 1;
+    const int output_dim = (input_dim + 2 * pad_data[i] - kernel_extent)
         / stride_data[i] + 1;
     this->output_shape_.push_back(output_dim);
   }
 }
 
+template <typename Dtype>
+int OCLCRHWCNLayer<Dtype>::backward_data_pad(int axis) {
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  // With a stride of one the data pass is a full correlation of the top diff
+  // with the flipped weights, padding by the kernel extent less the forward
+  // padding gives back the bottom dimensions. Strided layers keep the
+  // forward padding
+  if (stride_data[axis] != 1)
+    return pad_data[axis];
+  const int kernel_extent = dilation_data[axis] *
+    (kernel_shape_data[axis] - 1) + 1;
+  const int pad = kernel_extent - 1 - pad_data[axis];
+  CHECK_GE(pad, 0) << "Padding must be smaller than the kernel extent.";
+  CHECK_LT(pad, 16) << "Backward padding must fit in 4 bits.";
+  return pad;
+}
+
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::copyToHalf(const Dtype *input, cpfp *output,
-    int size) {
+    int size, int exp_bias) {
   for (int i = 0; i < size; ++i)
-    output[i] = cpfp((float)input[i]);
+    output[i] = cpfp(float2cpfp((float)input[i], exp_bias));
+}
+
+template <typename Dtype>
+int OCLCRHWCNLayer<Dtype>::weight_exp_bias() {
+  if (!this->layer_param_.cr_param().calibrate_weights())
+    return 0;
+  return cpfp_calibrate_exp_bias(this->blobs_[0]->count(),
+      this->blobs_[0]->cpu_data(), 0);
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::set_exp_shift(Blob<int>* params, int shift) {
+  int* values = params->mutable_cpu_data();
+  values[offsetof(kernel_params, exp_shift) / sizeof(int)] = shift;
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::set_accumulate(Blob<int>* params, int mode,
+    int exp_bias) {
+  const int index = offsetof(kernel_params, accumulate) / sizeof(int);
+  const int bias_index = offsetof(kernel_params, accum_exp_bias) / sizeof(int);
+  if (params->cpu_data()[index] == mode &&
+      params->cpu_data()[bias_index] == exp_bias)
+    return;
+  params->mutable_cpu_data()[index] = mode;
+  params->mutable_cpu_data()[bias_index] = exp_bias;
+  // Pushed now, as a blocking write behind the data pass on oclCommandQueue
+  // would hold up the gradient passes until it is done
+  params->ocl_data();
 }
 
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
-    cpfp *output, kernel_params params) {
+    cpfp *output, kernel_params params, int exp_bias) {
   int oc = params.outchannels * params.numgroups;
   int ic = params.inchannels;
   int bc = params.burstchannels;
   int ic_new = weight_pad_;
   int bc_new = weight_pad_ / params.rpo;
-  int ksize = params.ksize;
+  int ksize_area = params.ksize * params.ksize_w;
   int burstoc = params.burstydim;
   int rpofm = params.rpofm;
   for (int g = 0; g < params.numgroups; ++g) {
@@ -463,17 +685,18 @@ void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
     for (int o = 0; o < rpofm; ++o) {
       for (int b = 0; b < burstoc; ++b) {
         for (int n = 0; n < ic_new / bc_new; ++n) {
-          for (int k = 0; k < params.ksize * params.ksize; ++k) {
+          for (int k = 0; k < ksize_area; ++k) {
             for (int m = 0; m < bc_new / num_pe_; ++m) {
               for (int j = 0; j < num_pe_; ++j) {
-                int burst_idx = k * bc_new + m * num_pe_ + j + b * ksize *
-                  ksize * bc_new; 
+                int burst_idx = k * bc_new + m * num_pe_ + j + b *
+                  ksize_area * bc_new;
                 int in_idx = ((o * burstoc + b + o_head) * ic + n * bc + m +
-                  j * (bc / num_pe_)) * ksize * ksize + k;
-                int out_idx = (o * burstoc + o_head) * ksize * ksize * ic_new +
-                  n * bc_new * ksize * ksize * burstoc + burst_idx;
+                  j * (bc / num_pe_)) * ksize_area + k;
+                int out_idx = (o * burstoc + o_head) * ksize_area * ic_new +
+                  n * bc_new * ksize_area * burstoc + burst_idx;
                 if (m < bc / num_pe_ && o * burstoc + b + o_head < oc) {
-                  output[out_idx] = cpfp((float)input[in_idx]);
+                  output[out_idx] = cpfp(float2cpfp((float)input[in_idx],
+                        exp_bias));
                 } else {
                   output[out_idx] = cpfp(0);
                 }
@@ -488,29 +711,37 @@ void OCLCRHWCNLayer<Dtype>::copyToHalfWeights(const Dtype *input,
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::RotateWeightsHalf(const Dtype *input,
-    cpfp *output, kernel_params params) {
-  int oc = params.outchannels * params.numgroups;
+    cpfp *output, kernel_params params, int exp_bias) {
+  int oc = params.outchannels;
   int ic = params.inchannels;
+  int ic_new = pad_channels(ic);
   int bc = params.burstchannels;
-  int ksize = params.ksize;
+  int ksize_area = params.ksize * params.ksize_w;
   int rpofm = params.rpofm;
   int burstoc = params.burstydim;
-  for (int o = 0; o < rpofm; ++o) {
-    for (int b = 0; b < burstoc; ++b) {
-      for (int n = 0; n < ic / bc; ++n) {
-        for (int k = 0; k < ksize * ksize; ++k) {
-          for (int m = 0; m < bc / num_pe_; ++m) {
-            for (int j = 0; j < num_pe_; ++j) {
-              int in_idx = ((n * bc + m + j * bc / num_pe_) * oc + o *
-                burstoc + b) * ksize * ksize + k;
-              int burst_idx = (ksize * ksize - 1 - k) * bc + m * num_pe_ + j +
-                b * ksize * ksize * bc;
-              int out_idx = o * burstoc * ksize * ksize * ic +
-                n * bc * ksize * ksize * burstoc + burst_idx;
-              if (o * burstoc + b < oc) 
-                output[out_idx] = cpfp((float)input[in_idx]);
-              else
-                output[out_idx] = 0;
+  // Groups are packed in order so the zero fill past the end of one group is
+  // overwritten by the next group
+  for (int g = 0; g < params.numgroups; ++g) {
+    int o_head = oc * g;
+    int i_head = ic * g;
+    for (int o = 0; o < rpofm; ++o) {
+      for (int b = 0; b < burstoc; ++b) {
+        for (int n = 0; n < ic / bc; ++n) {
+          for (int k = 0; k < ksize_area; ++k) {
+            for (int m = 0; m < bc / num_pe_; ++m) {
+              for (int j = 0; j < num_pe_; ++j) {
+                int in_idx = ((i_head + n * bc + m + j * bc / num_pe_) * oc +
+                  o * burstoc + b) * ksize_area + k;
+                int burst_idx = (ksize_area - 1 - k) * bc + m * num_pe_ +
+                  j + b * ksize_area * bc;
+                int out_idx = (o * burstoc + o_head) * ksize_area * ic_new +
+                  n * bc * ksize_area * burstoc + burst_idx;
+                if (o * burstoc + b < oc)
+                  output[out_idx] = cpfp(float2cpfp((float)input[in_idx],
+                        exp_bias));
+                else
+                  output[out_idx] = 0;
+              }
             }
           }
         }
@@ -520,31 +751,38 @@ void OCLCRHWCNLayer<Dtype>::RotateWeightsHalf(const Dtype *input,
 }
 
 template <typename Dtype>
-void OCLCRHWCNLayer<Dtype>::copyToFloatWeights(cpfp *input,
-    Dtype *output, const vector<int> shape, kernel_params params) {
-  int oc = params.outchannels * params.numgroups;
+template <typename T>
+void OCLCRHWCNLayer<Dtype>::copyToFloatWeights(const T *input,
+    Dtype *output, const vector<int> shape, kernel_params params,
+    int exp_bias) {
+  int oc = params.outchannels;
   int ic = params.inchannels;
   int bc = params.burstchannels;
   int ic_new = weight_pad_;
   int bc_new = weight_pad_ / params.rpo;
-  int ksize = params.ksize;
+  int ksize_area = params.ksize * params.ksize_w;
   int rpofm = params.rpofm;
   int burstoc = params.burstydim;
 
-  for (int o = 0; o < rpofm; ++o) {
-    for (int b = 0; b < burstoc; ++b) {
-      for (int n = 0; n < ic_new / bc_new; ++n) {
-        for (int k = 0; k < params.ksize * params.ksize; ++k) {
-          for (int m = 0; m < bc / num_pe_; ++m) {
-            for (int j = 0; j < num_pe_; ++j) {
-              int in_idx = ((o * burstoc + b) * ic + n * bc + m + j *
-                (bc / num_pe_)) * ksize * ksize + k;
-              int burst_idx = k * bc_new + m * num_pe_ + j + b * ksize * ksize
-                * bc_new;
-              int out_idx = o * burstoc * ksize * ksize * ic_new + 
-                n * ksize * ksize * burstoc * bc_new + burst_idx;
-              if (o * burstoc + b < oc)
-                output[in_idx] = (Dtype)float(input[out_idx]);
+  for (int g = 0; g < params.numgroups; ++g) {
+    int o_head = oc * g;
+    for (int o = 0; o < rpofm; ++o) {
+      for (int b = 0; b < burstoc; ++b) {
+        for (int n = 0; n < ic_new / bc_new; ++n) {
+          for (int k = 0; k < ksize_area; ++k) {
+            for (int m = 0; m < bc / num_pe_; ++m) {
+              for (int j = 0; j < num_pe_; ++j) {
+                int in_idx = ((o * burstoc + b + o_head) * ic + n * bc + m +
+                  j * (bc / num_pe_)) * ksize_area + k;
+                int burst_idx = k * bc_new + m * num_pe_ + j + b *
+                  ksize_area * bc_new;
+                int out_idx = (o * burstoc + o_head) * ksize_area * ic_new +
+                  n * ksize_area * burstoc * bc_new + burst_idx;
+                if (o * burstoc + b < oc) {
+                  output[in_idx] += (Dtype)diff_value(input[out_idx],
+                      exp_bias);
+                }
+              }
             }
           }
         }
@@ -553,191 +791,380 @@ void OCLCRHWCNLayer<Dtype>::copyToFloatWeights(cpfp *input,
   }
 }
 
+template <typename Dtype>
+template <typename T>
+void OCLCRHWCNLayer<Dtype>::copyToFloatBias(const T *input,
+    Dtype *output, kernel_params params, int exp_bias) {
+  int ic = params.inchannels;
+  int ic_new = pad_channels(ic);
+  int bc = params.burstchannels;
+
+  for (int g = 0; g < params.numgroups; ++g) {
+    for (int n = 0; n < ic / bc; ++n) {
+      for (int m = 0; m < bc / num_pe_; ++m) {
+        for (int j = 0; j < num_pe_; ++j) {
+          int out_idx = g * ic + n * bc + m + j * (bc / num_pe_);
+          output[out_idx] += (Dtype)diff_value(input[g * ic_new + n * bc +
+              m * num_pe_ + j], exp_bias);
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::backward_bias(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  kernel_params *params = &ocl_params_bb_;
-
-  vector<int> shape(1);
   const cpfp *weights_data = weights_placeholder.ocl_data();
 
   cpfp *bias_diff = bias_h.mutable_ocl_diff(0);
+  // The first pass of a float sum overwrites it
+  float *bias_sum = (diff_sums_on_device_) ?
+    bias_diff_sum_.mutable_ocl_data(pending_bias_diff_ ? 1 : 0) : NULL;
 
-  params->backward = 1;
-  int numgroups = params->numgroups;
-
-  shape[0] = sizeof(kernel_params) / sizeof(int);
-  param_vals.Reshape(shape);
-
-  int *conv_params = param_vals.mutable_cpu_data();
-
-  for (int i = 0; i < shape[0]; ++i) {
-    conv_params[i] = ((int *)params)[i];
-  }
-  
-  const int* cr_params_b = param_vals.ocl_data();
-
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  int numgroups = ocl_params_bb_.numgroups;
+  const int* cr_params_b = param_vals_bb.ocl_data();
 
   const cpfp *top_diff;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    top_diff = top[i]->template ocl_diff_as<cpfp>();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weights_data, (const cpfp *)bias_diff, bias_diff,
-        relu_vals, cr_params_b, numgroups);
-  } 
-  bias_diff = bias_h.mutable_cpu_diff();
-  Dtype *bias_diff_out = this->blobs_[1]->mutable_cpu_diff();
-
-  for (int i = 0; i < bias_h.count() / num_pe_; ++i) {
-    for (int j = 0; j < num_pe_; ++j) {
-      bias_diff_out[i + j * bias_h.count() / num_pe_] =
-        (Dtype)float(bias_diff[i * num_pe_ + j]);
-    }
+        relu_vals, cr_params_b, bias_sum, numgroups, oclGradientQueue,
+        &param_events_);
   }
 }
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::backward_data(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  kernel_params *params = &ocl_params_bi_;
+  // The rotated weights keep the exponent bias of the forward pass, which
+  // the engine takes off the bottom diffs again
   RotateWeightsHalf(this->blobs_[0]->cpu_data(),
-      weights_h_r.mutable_cpu_data(), ocl_params_bi_);
+      weights_h_r.mutable_cpu_data(), ocl_params_bi_, weight_exp_bias_);
+  set_exp_shift(&param_vals_bi, weight_exp_bias_);
 
   const cpfp *weight_data_r = weights_h_r.ocl_data();
-  vector<int> shape(1);
-  shape[0] = bottom[0]->shape(2);
 
   const cpfp *bias_data = bias_placeholder.ocl_data();
 
-  params->backward = 2;
-  int numgroups = params->numgroups;
-
-  shape[0] = sizeof(kernel_params) / sizeof(int);
-  param_vals.Reshape(shape);
-
-  int *conv_params = param_vals.mutable_cpu_data();
-
-  for (int i = 0; i < shape[0]; ++i) {
-    conv_params[i] = ((int *)params)[i];
-  }
-  
-  const int* cr_params_b = param_vals.ocl_data();
-
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  int numgroups = ocl_params_bi_.numgroups;
+  const int* cr_params_b = param_vals_bi.ocl_data();
 
   const cpfp *top_diff;
   int *relu_vals;
   cpfp *bottom_diff;
   for (int i = 0; i < bottom.size(); i++) {
-    bottom_diff =
-      reinterpret_cast<cpfp *>(bottom[i]->mutable_ocl_diff(0, insize));
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    bottom[i]->set_diff_exp_bias(top[i]->diff_exp_bias());
+    bottom_diff = bottom[i]->template mutable_ocl_diff_as<cpfp>(0);
+    top_diff = top[i]->template ocl_diff_as<cpfp>();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weight_data_r, bias_data, bottom_diff, relu_vals,
-        cr_params_b, numgroups);
+        cr_params_b, NULL, numgroups, oclCommandQueue, &events_);
   }
 }
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::backward_weights(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  kernel_params *params = &ocl_params_bw_;
-
-  Dtype* weight_diff_dtype = this->blobs_[0]->mutable_cpu_diff();
- 
   cpfp* weight_diff = weights_h.mutable_ocl_diff(0);
+  float *weight_sum = (diff_sums_on_device_) ?
+    weight_diff_sum_.mutable_ocl_data(pending_weight_diff_ ? 1 : 0) : NULL;
 
   const cpfp *bias_data = bias_placeholder.ocl_data();
 
-  params->backward = 1;
-  int numgroups = params->numgroups;
-
-  vector<int> shape(1);
-  shape[0] = sizeof(kernel_params) / sizeof(int);
-  param_vals.Reshape(shape);
-
-  int *conv_params = param_vals.mutable_cpu_data();
-
-  for (int i = 0; i < shape[0]; ++i) {
-    conv_params[i] = ((int *)params)[i];
-  }
-  
-  const int* cr_params_b = param_vals.ocl_data();
-
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
+  int numgroups = ocl_params_bw_.numgroups;
+  const int* cr_params_b = param_vals_bw.ocl_data();
 
   const cpfp *top_diff;
   int *relu_vals;
   const cpfp *bottom_data;
   for (int i = 0; i < bottom.size(); i++) {
-    bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    bottom_data = bottom[i]->template ocl_data_as<cpfp>();
+    top_diff = top[i]->template ocl_diff_as<cpfp>();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(bottom_data, top_diff, bias_data, weight_diff, relu_vals,
-        cr_params_b, numgroups);
+        cr_params_b, weight_sum, numgroups, oclGradientQueue, &param_events_);
+  }
+}
+
+
+template <typename Dtype>
+kernel_params OCLCRHWCNLayer<Dtype>::cpu_params(const Blob<Dtype>& bottom) {
+  // Only the geometry is needed, taken from the bottom as it is now so that
+  // reshaped batches work too
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  kernel_params params = kernel_params();
+  params.ydim = bottom.shape(0);
+  params.xdim = bottom.shape(1);
+  params.inchannels = bottom.shape(2) / this->group_;
+  params.outchannels = this->num_output_ / this->group_;
+  params.numimages = bottom.shape(3);
+  params.numgroups = this->group_;
+  params.ksize = kernel_shape_data[0];
+  params.ksize_w = kernel_shape_data[1];
+  params.stride = stride_data[0];
+  params.stride_w = stride_data[1];
+  params.pad = pad_data[0];
+  params.pad_w = pad_data[1];
+  params.dilation_h = dilation_data[0];
+  params.dilation_w = dilation_data[1];
+  params.relu = this->layer_param_.cr_param().relu();
+  return params;
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (this->layer_param_.cr_param().emulate_engine()) {
+    forward_cpu_emulated(bottom, top);
+    return;
+  }
+  // The engine computes in Dtype. Widening and narrowing the cpfp values
+  // keeps the HWCN order, so no element moves
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const kernel_params params = cpu_params(*bottom[i]);
+    cpu_bottom_.ReshapeLike(*bottom[i]);
+    cpu_top_.ReshapeLike(*top[i]);
+    const cpfp* bottom_data = bottom[i]->template cpu_data_as<cpfp>();
+    const int exp_bias = bottom[i]->data_exp_bias();
+    Dtype* cpu_bottom_data = cpu_bottom_.mutable_cpu_data();
+    for (int j = 0; j < cpu_bottom_.count(); ++j)
+      cpu_bottom_data[j] = cpfp2float(bottom_data[j], exp_bias);
+    hwcn_conv_forward_cpu(cpu_bottom_.cpu_data(), weight, bias, params,
+        cpu_top_.mutable_cpu_data());
+    // The top keeps the exponent bias of the bottom, as on the FPGA
+    top[i]->set_data_exp_bias(exp_bias);
+    copyToHalf(cpu_top_.cpu_data(),
+        top[i]->template mutable_cpu_data_as<cpfp>(), cpu_top_.count(),
+        exp_bias);
   }
-  weight_diff = weights_h.mutable_cpu_diff();
-  copyToFloatWeights(weight_diff, weight_diff_dtype,
-      this->blobs_[0]->shape(), ocl_params_bw_);
 }
 
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::forward_cpu_emulated(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // The parameters are converted as for Forward_ocl, and the sums follow the
+  // bursts the engine was planned with, or a single one when it wasn't
+  const int weight_bias = weight_exp_bias();
+  cpu_weights_h_.Reshape(this->blobs_[0]->shape());
+  copyToHalf(this->blobs_[0]->cpu_data(), cpu_weights_h_.mutable_cpu_data(),
+      cpu_weights_h_.count(), weight_bias);
+  for (int i = 0; i < bottom.size(); ++i) {
+    kernel_params params = cpu_params(*bottom[i]);
+    params.burstchannels = ocl_engine_ ? ocl_params_.burstchannels : 0;
+    params.exp_shift = weight_bias;
+    const int exp_bias = bottom[i]->data_exp_bias();
+    const cpfp* bias = NULL;
+    if (this->bias_term_) {
+      cpu_bias_h_.Reshape(this->blobs_[1]->shape());
+      copyToHalf(this->blobs_[1]->cpu_data(), cpu_bias_h_.mutable_cpu_data(),
+          cpu_bias_h_.count(), exp_bias + weight_bias);
+      bias = cpu_bias_h_.cpu_data();
+    }
+    top[i]->set_data_exp_bias(exp_bias);
+    hwcn_conv_forward_cpfp(bottom[i]->template cpu_data_as<cpfp>(),
+        cpu_weights_h_.cpu_data(), bias, params,
+        top[i]->template mutable_cpu_data_as<cpfp>());
+  }
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const bool relu = this->layer_param_.cr_param().relu();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  // The gradients add to the parameter diffs, as in ConvolutionLayer, so
+  // they sum over the bottoms and over the backward passes of an iteration
+  // with iter_size > 1. The solver clears the diffs every iteration
+  Dtype* weight_diff = NULL;
+  if (this->param_propagate_down_[0])
+    weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  Dtype* bias_diff = NULL;
+  if (this->bias_term_ && this->param_propagate_down_[1])
+    bias_diff = this->blobs_[1]->mutable_cpu_diff();
+  for (int i = 0; i < top.size(); ++i) {
+    const kernel_params params = cpu_params(*bottom[i]);
+    cpu_top_.ReshapeLike(*top[i]);
+    // The fused ReLU passes the gradient only where the top is positive
+    const cpfp* top_data = top[i]->template cpu_data_as<cpfp>();
+    const cpfp* top_diff = top[i]->template cpu_diff_as<cpfp>();
+    const int diff_exp_bias = top[i]->diff_exp_bias();
+    Dtype* cpu_top_diff = cpu_top_.mutable_cpu_diff();
+    for (int j = 0; j < cpu_top_.count(); ++j) {
+      cpu_top_diff[j] = (relu && float(top_data[j]) <= 0) ? Dtype(0) :
+          Dtype(cpfp2float(top_diff[j], diff_exp_bias));
+    }
+    cpu_bottom_.ReshapeLike(*bottom[i]);
+    if (weight_diff || bias_diff) {
+      const cpfp* bottom_data = bottom[i]->template cpu_data_as<cpfp>();
+      const int exp_bias = bottom[i]->data_exp_bias();
+      Dtype* cpu_bottom_data = cpu_bottom_.mutable_cpu_data();
+      for (int j = 0; j < cpu_bottom_.count(); ++j)
+        cpu_bottom_data[j] = cpfp2float(bottom_data[j], exp_bias);
+      hwcn_conv_backward_weights_cpu(cpu_bottom_.cpu_data(),
+          cpu_top_.cpu_diff(), params, weight_diff, bias_diff);
+    }
+    if (propagate_down[i]) {
+      hwcn_conv_backward_data_cpu(cpu_top_.cpu_diff(), weight, params,
+          cpu_bottom_.mutable_cpu_diff());
+      bottom[i]->set_diff_exp_bias(diff_exp_bias);
+      copyToHalf(cpu_bottom_.cpu_diff(),
+          bottom[i]->template mutable_cpu_diff_as<cpfp>(),
+          cpu_bottom_.count(), diff_exp_bias);
+    }
+  }
+}
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::Forward_ocl(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (!ocl_engine_) {
+    Forward_cpu(bottom, top);
+    return;
+  }
   kernel_params *params = &ocl_params_;
+  // The products carry the exponent biases of the bottom and the weights,
+  // so the bias joins the sums with both and the engine shifts the finished
+  // tops back to the bias of the bottom
+  const int exp_bias = bottom[0]->data_exp_bias();
+  weight_exp_bias_ = weight_exp_bias();
+  set_exp_shift(&param_vals, weight_exp_bias_);
   copyToHalfWeights(this->blobs_[0]->cpu_data(),
-      weights_h.mutable_cpu_data(), ocl_params_);
+      weights_h.mutable_cpu_data(), ocl_params_, weight_exp_bias_);
   copyToHalf(this->blobs_[1]->mutable_cpu_data(), bias_h.mutable_cpu_data(),
-      params->outchannels * params->numgroups);
+      params->outchannels * params->numgroups, exp_bias + weight_exp_bias_);
   const cpfp *weight_data = weights_h.ocl_data();
   const cpfp *bias_data = bias_h.ocl_data();
 
-  params->backward = 0;
   int numgroups = params->numgroups;
-
-  vector<int> shape(1);
-  shape[0] = sizeof(kernel_params) / sizeof(int);
-  param_vals.Reshape(shape);
-
-  int *conv_params = param_vals.mutable_cpu_data();
-
-  for (int i = 0; i < shape[0]; ++i) {
-    conv_params[i] = ((int *)params)[i];
-  }
   const int* cr_params = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
-
   cpfp *top_data;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    const cpfp* bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_data = reinterpret_cast<cpfp *>(top[i]->mutable_ocl_data(0, outsize));
+    CHECK_EQ(bottom[i]->data_exp_bias(), exp_bias)
+        << "The bottoms of " << this->layer_param_.name()
+        << " need the same exponent bias.";
+    top[i]->set_data_exp_bias(exp_bias);
+    const cpfp* bottom_data = bottom[i]->template ocl_data_as<cpfp>();
+    top_data = top[i]->template mutable_ocl_data_as<cpfp>(0);
     relu_vals = relu_indices.mutable_ocl_data(0);
     launchKernel(bottom_data, weight_data, bias_data, top_data, relu_vals,
-        cr_params, numgroups);
+        cr_params, NULL, numgroups, oclCommandQueue, &events_);
   }
+  waitKernels(&events_);
 }
 
 template <typename Dtype>
 void OCLCRHWCNLayer<Dtype>::Backward_ocl(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (this->bias_term_ && this->param_propagate_down_[1])
+  if (!ocl_engine_) {
+    Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  FinishBackward();
+  bool bias_pass = this->bias_term_ && this->param_propagate_down_[1];
+  bool weights_pass = this->param_propagate_down_[0];
+
+  // When the solver sums the diffs of several backward passes, as for
+  // iter_size > 1, the gradient passes add them to float sums on the device,
+  // which SyncParamDiffs reads back once. Otherwise the cpfp diffs of the
+  // last pass are added to the parameter diffs in Dtype here
+  const bool sum_on_device = this->async_param_diffs_ &&
+    this->param_diff_passes_ > 1;
+  if (!sum_on_device || !diff_sums_on_device_)
+    SyncParamDiffs();
+  diff_sums_on_device_ = sum_on_device;
+  const int diff_exp_bias = top[0]->diff_exp_bias();
+  const int weight_diff_exp_bias = bottom[0]->data_exp_bias() + diff_exp_bias;
+  if (bias_pass)
+    set_accumulate(&param_vals_bb, (!sum_on_device) ? 0 :
+        (pending_bias_diff_ ? 2 : 1), diff_exp_bias);
+  if (weights_pass)
+    set_accumulate(&param_vals_bw, (!sum_on_device) ? 0 :
+        (pending_weight_diff_ ? 2 : 1), weight_diff_exp_bias);
+
+  // The data pass goes first, as the layer below waits for it. The gradient
+  // passes run beside it on their own queue, and nothing waits for them
+  // before the next forward or SyncParamDiffs
+  if (propagate_down[0])
+    backward_data(top, propagate_down, bottom);
+
+  if (bias_pass) {
     backward_bias(top, propagate_down, bottom);
-  
-  if (this->param_propagate_down_[0])
+    pending_bias_diff_ = true;
+    bias_diff_exp_bias_ = diff_exp_bias;
+  }
+
+  if (weights_pass) {
     backward_weights(top, propagate_down, bottom);
+    pending_weight_diff_ = true;
+    weight_diff_exp_bias_ = weight_diff_exp_bias;
+  }
 
-  if (propagate_down[0])
-    backward_data(top, propagate_down, bottom);
+  waitKernels(&events_);
+
+  if (!this->async_param_diffs_)
+    SyncParamDiffs();
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::FinishBackward() {
+  waitKernels(&param_events_);
+}
+
+template <typename Dtype>
+void OCLCRHWCNLayer<Dtype>::SyncParamDiffs() {
+  if (!pending_bias_diff_ && !pending_weight_diff_)
+    return;
+  FinishBackward();
+  std::vector<cl_event> read_events;
+  cl_event event;
+  if (pending_bias_diff_) {
+    if (diff_sums_on_device_)
+      bias_diff_sum_.data()->async_ocl_pull(oclGradientQueue, &event);
+    else
+      bias_h.diff()->async_ocl_pull(oclGradientQueue, &event);
+    read_events.push_back(event);
+  }
+  if (pending_weight_diff_) {
+    if (diff_sums_on_device_)
+      weight_diff_sum_.data()->async_ocl_pull(oclGradientQueue, &event);
+    else
+      weights_h.diff()->async_ocl_pull(oclGradientQueue, &event);
+    read_events.push_back(event);
+  }
+  clWaitForEvents(read_events.size(), read_events.data());
+  for (int i = 0; i < read_events.size(); ++i)
+    clReleaseEvent(read_events[i]);
+
+  // The sums add to the parameter diffs, which the solver clears every
+  // iteration, as Backward_cpu does. The float sums already carry the
+  // exponent biases of their passes
+  if (pending_bias_diff_ && diff_sums_on_device_)
+    copyToFloatBias(bias_diff_sum_.cpu_data(),
+        this->blobs_[1]->mutable_cpu_diff(), ocl_params_bb_, 0);
+  else if (pending_bias_diff_)
+    copyToFloatBias(bias_h.cpu_diff(), this->blobs_[1]->mutable_cpu_diff(),
+        ocl_params_bb_, bias_diff_exp_bias_);
+
+  if (pending_weight_diff_ && diff_sums_on_device_)
+    copyToFloatWeights(weight_diff_sum_.cpu_data(),
+        this->blobs_[0]->mutable_cpu_diff(), this->blobs_[0]->shape(),
+        ocl_params_bw_, 0);
+  else if (pending_weight_diff_)
+    copyToFloatWeights(weights_h.cpu_diff(),
+        this->blobs_[0]->mutable_cpu_diff(), this->blobs_[0]->shape(),
+        ocl_params_bw_, weight_diff_exp_bias_);
+  pending_bias_diff_ = false;
+  pending_weight_diff_ = false;
 }
 
 
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -55,8 +56,13 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  SetUpEngine();
+}
 
+template <typename Dtype>
+void OCLHWCNInnerProductLayer<Dtype>::SetUpEngine() {
   CRParameter cr_param = this->layer_param_.cr_param();
+  use_aux_ = false;
   num_cu_ = cr_param.num_cu();
   num_pe_ = cr_param.num_pe();
   switch(num_pe_) {
@@ -121,6 +127,11 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   params->rpo = params->inchannels / burstchannels_;
   params->pool = 0;
   params->pksize = 2;
+  params->ksize_w = 1;
+  params->stride_w = 1;
+  params->pad_w = 0;
+  params->dilation_h = 1;
+  params->dilation_w = 1;
 
   CHECK(burstoc * (num_ / 16) >= 16);
   CHECK(burstoc * burstchannels_ >= 16);
@@ -143,6 +154,11 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   backward_params->relu = cr_param.relu();
   backward_params->pool = 0;
   backward_params->pksize = 2;
+  backward_params->ksize_w = 1;
+  backward_params->stride_w = 1;
+  backward_params->pad_w = 0;
+  backward_params->dilation_h = 1;
+  backward_params->dilation_w = 1;
   backward_params->burstydim = params->burstydim;
   backward_params->rpofm = params->rpofm;
 
@@ -163,6 +179,11 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   backward_params_bi->relu = cr_param.relu();
   backward_params_bi->pool = 0;
   backward_params_bi->pksize = 2;
+  backward_params_bi->ksize_w = 1;
+  backward_params_bi->stride_w = 1;
+  backward_params_bi->pad_w = 0;
+  backward_params_bi->dilation_h = 1;
+  backward_params_bi->dilation_w = 1;
 
   rpofm = num_cu_;
   burstoc = 1;
@@ -251,6 +272,11 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
   bias_params->relu = cr_param.relu();
   bias_params->pool = 0;
   bias_params->pksize = 2;
+  bias_params->ksize_w = 1;
+  bias_params->stride_w = 1;
+  bias_params->pad_w = 0;
+  bias_params->dilation_h = 1;
+  bias_params->dilation_w = 1;
   vector<int> shape(1);
   shape[0] = this->M_;
   weights_placeholder.Reshape(shape);
@@ -262,11 +288,22 @@ void OCLHWCNInnerProductLayer<Dtype>::LayerSetUp(
 template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->storage(), STORAGE_CPFP)
+      << "OCLHWCNInnerProduct input must hold cpfp values.";
+  // The bursts and image counts of the engine follow the batch size, which
+  // can change after setup, e.g. for the micro-batches of a pipelined net
+  const int num = (bottom[0]->num_axes() == 2) ? bottom[0]->shape(1) :
+      bottom[0]->shape(3);
+  if (num != this->M_) {
+    this->M_ = num;
+    SetUpEngine();
+  }
   kernel_params *bias_params = &ocl_params_bb_;
  
   std::vector<int> top_shape(2);
   top_shape[0] = this->N_;
   top_shape[1] = this->M_;
+  top[0]->set_storage(STORAGE_CPFP);
   top[0]->Reshape(top_shape);
 
   top_shape[0] = bias_params->inchannels;
@@ -307,11 +344,12 @@ void OCLHWCNInnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom
 
 template <typename Dtype>
 void OCLHWCNInnerProductLayer<Dtype>::copyToHalf(const Dtype *input,
-    cpfp *output, int size, int xdim, int xdim_pad) {
+    cpfp *output, int size, int xdim, int xdim_pad, int exp_bias) {
   for (int i = 0; i < size; ++i)
     for (int j = 0; j < xdim_pad; ++j)
       if (j < xdim)
-        output[i * xdim_pad + j] = cpfp((float)input[i * xdim + j]);
+        output[i * xdim_pad + j] = cpfp(float2cpfp((float)input[i * xdim +
+              j], exp_bias));
       else
         output[i * xdim_pad + j] = cpfp(0);
 }
@@ -325,22 +363,27 @@ void OCLHWCNInnerProductLayer<Dtype>::launchKernel(const cpfp *bottom,
   int events_size = 1;
   events.resize(events_size, 0);
   
-  clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
-    (const void *)&bottom);
-  clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
-    (const void *)&weights);
-  clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
-    (const void *)&bias);
-  clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
-    (const void *)&top);
-  clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
-    (const void *)&tags);
-  clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
-    (const void *)&params);
-  clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
-      (const void *)&g);
-  clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
-  clWaitForEvents(events.size(), events.data()); 
+  {
+    boost::mutex::scoped_lock lock(this->ocl_kernel_mutex());
+    clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
+      (const void *)&bottom);
+    clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
+      (const void *)&weights);
+    clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
+      (const void *)&bias);
+    clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
+      (const void *)&top);
+    clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
+      (const void *)&tags);
+    clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
+      (const void *)&params);
+    clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
+        (const void *)&g);
+    clSetKernelArg(this->ocl_kernel, 7, sizeof(cl_mem), NULL);
+    clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
+  }
+  clWaitForEvents(events.size(), events.data());
+  Caffe::count_kernel_time(events.size(), events.data());
 }
 
 template <typename Dtype>
@@ -375,9 +418,12 @@ void OCLHWCNInnerProductLayer<Dtype>::Forward_ocl(
       }
     }
   }
+  // The weights have no exponent bias, so the products and the top keep that
+  // of the bottom
+  const int exp_bias = bottom[0]->data_exp_bias();
   if (this->bias_term_)
     copyToHalf(this->blobs_[1]->mutable_cpu_data(), bias_h.mutable_cpu_data(),
-        params->outchannels, 1, 1);
+        params->outchannels, 1, 1, exp_bias);
   else
     (bias_h.mutable_cpu_data())[0] = cpfp(0);
 
@@ -398,14 +444,12 @@ void OCLHWCNInnerProductLayer<Dtype>::Forward_ocl(
   
   const int* k_params = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
   cpfp *top_data;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
-    const cpfp *bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_data = reinterpret_cast<cpfp *>(top[i]->mutable_ocl_data(0, outsize));
+    const cpfp *bottom_data = bottom[i]->template ocl_data_as<cpfp>();
+    top[i]->set_data_exp_bias(exp_bias);
+    top_data = top[i]->template mutable_ocl_data_as<cpfp>(0);
     relu_vals = relu_indices.mutable_ocl_data(0);
     launchKernel(bottom_data, weight_data, bias_data, top_data, relu_vals,
         k_params);
@@ -436,26 +480,24 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_weights(
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
-
   const cpfp *top_diff;
   int *relu_vals;
   const cpfp *bottom_data;
 
   for (int i = 0; i < bottom.size(); i++) {
     if (use_aux_) {
-      outsize = sizeof(cpfp) * top_aux.count();
-      top_diff = top_aux.ocl_diff(outsize);
+      top_diff = top_aux.ocl_diff();
     } else {
-      top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+      top_diff = top[i]->template ocl_diff_as<cpfp>();
     }
-    bottom_data = reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
+    bottom_data = bottom[i]->template ocl_data_as<cpfp>();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(bottom_data, top_diff, bias_data, weight_diff, relu_vals,
         cr_params_b);
   }
   weight_diff = weights_h.mutable_cpu_diff();
+  // Products of the bottom and the top diff carry both their biases
+  const int exp_bias = bottom[0]->data_exp_bias() + top[0]->diff_exp_bias();
 
   int oc = params->outchannels;
   int ic = params->inchannels;
@@ -473,7 +515,8 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_weights(
             int burst_idx = m * num_pe_ + j + b * bc;
             int out_idx = o * burstoc * ic + n * burstoc * bc + burst_idx;
             if (o * burstoc + b < oc)
-              weight_diff_dtype[in_idx] = (Dtype)float(weight_diff[out_idx]);
+              weight_diff_dtype[in_idx] = (Dtype)cpfp2float(
+                  weight_diff[out_idx], exp_bias);
           }
         }
       }
@@ -506,27 +549,26 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_bias(
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t outsize = sizeof(cpfp) * top[0]->count();
   const cpfp *top_diff;
   int *relu_vals;
   for (int i = 0; i < bottom.size(); i++) {
     if (use_aux_) {
-      outsize = sizeof(cpfp) * top_aux.count();
-      top_diff = top_aux.ocl_diff(outsize);
+      top_diff = top_aux.ocl_diff();
     } else {
-      top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+      top_diff = top[i]->template ocl_diff_as<cpfp>();
     }
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weights_data, (const cpfp *)bias_diff, bias_diff,
         relu_vals, cr_params_b);
   }
   bias_diff = bias_h.mutable_cpu_diff();
+  const int exp_bias = top[0]->diff_exp_bias();
   Dtype *bias_diff_out = this->blobs_[1]->mutable_cpu_diff();
   for (int i = 0; i < bias_h.count() / num_pe_; ++i) {
     for (int j = 0; j < num_pe_; ++j)
       if (i + j * bias_h.count() / num_pe_ < this->blobs_[1]->count())
         bias_diff_out[i + j * bias_h.count() / num_pe_] =
-          (Dtype)float(bias_diff[i * num_pe_ + j]);
+          (Dtype)cpfp2float(bias_diff[i * num_pe_ + j], exp_bias);
   }
 }
 
@@ -581,21 +623,18 @@ void OCLHWCNInnerProductLayer<Dtype>::backward_data(
   
   const int* cr_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
   const cpfp *top_diff;
   int *relu_vals;
   cpfp *bottom_diff;
 
   for (int i = 0; i < bottom.size(); i++) {
     if (use_aux_) {
-      outsize = sizeof(cpfp) * top_aux.count();
-      top_diff = top_aux.ocl_diff(outsize);
+      top_diff = top_aux.ocl_diff();
     } else {
-      top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+      top_diff = top[i]->template ocl_diff_as<cpfp>();
     }
-    bottom_diff =
-      reinterpret_cast<cpfp *>(bottom[i]->mutable_ocl_diff(0, insize));
+    bottom[i]->set_diff_exp_bias(top[i]->diff_exp_bias());
+    bottom_diff = bottom[i]->template mutable_ocl_diff_as<cpfp>(0);
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weight_data_t, bias_data, bottom_diff, relu_vals,
         cr_params_b);
@@ -608,8 +647,7 @@ void OCLHWCNInnerProductLayer<Dtype>::Backward_ocl(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (use_aux_) {
-    const cpfp *top_diff =
-      reinterpret_cast<const cpfp *>(top[0]->cpu_diff());
+    const cpfp *top_diff = top[0]->template cpu_diff_as<cpfp>();
     cpfp *top_diff_aux = top_aux.mutable_cpu_diff();
     for (int j = 0; j < top_aux.shape(0); ++j)
       for (int k = 0; k < top_aux.shape(1); ++k) 
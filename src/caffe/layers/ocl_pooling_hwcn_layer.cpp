@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -32,7 +33,10 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       || (!pool_param.has_stride_h() && !pool_param.has_stride_w()))
       << "Stride is stride OR stride_h and stride_w are required.";
   this->global_pooling_ = pool_param.global_pooling();
-  if (pool_param.has_kernel_size()) {
+  if (this->global_pooling_) {
+    this->kernel_h_ = bottom[0]->shape(0);
+    this->kernel_w_ = bottom[0]->shape(1);
+  } else if (pool_param.has_kernel_size()) {
     this->kernel_h_ = this->kernel_w_ = pool_param.kernel_size();
   } else {
     this->kernel_h_ = pool_param.kernel_h();
@@ -52,6 +56,11 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     this->stride_h_ = pool_param.stride_h();
     this->stride_w_ = pool_param.stride_w();
   }
+  if (this->global_pooling_) {
+    CHECK(this->pad_h_ == 0 && this->pad_w_ == 0 && this->stride_h_ == 1
+        && this->stride_w_ == 1)
+        << "With Global_pooling: true; only pad = 0 and stride = 1";
+  }
   if (this->pad_h_ != 0 || this->pad_w_ != 0) {
     CHECK(this->layer_param_.pooling_param().pool()
         == PoolingParameter_PoolMethod_AVE
@@ -61,6 +70,25 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT(this->pad_h_, this->kernel_h_);
     CHECK_LT(this->pad_w_, this->kernel_w_);
   }
+  // The engine takes the window height and width in 10 bits
+  CHECK_LT(this->kernel_h_, 1024) << "Window size must fit in 10 bits.";
+  CHECK_LT(this->kernel_w_, 1024) << "Window size must fit in 10 bits.";
+  CHECK_LT(this->stride_h_, 16) << "Stride must fit in 4 bits.";
+  CHECK_LT(this->stride_w_, 16) << "Stride must fit in 4 bits.";
+  CHECK_LT(this->pad_h_, 16) << "Padding must fit in 4 bits.";
+  CHECK_LT(this->pad_w_, 16) << "Padding must fit in 4 bits.";
+
+  int pool_mode = 0;
+  switch (pool_param.pool()) {
+  case PoolingParameter_PoolMethod_MAX:
+    pool_mode = 1;
+    break;
+  case PoolingParameter_PoolMethod_AVE:
+    pool_mode = 2;
+    break;
+  default:
+    LOG(FATAL) << "OCLPoolingHWCN only supports MAX and AVE pooling.";
+  }
 
   CRParameter cr_param = this->layer_param_.cr_param(); 
   kernel_params *forward_params = &ocl_params_;
@@ -86,15 +114,20 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   forward_params->rpofm = 0;
   forward_params->xtile_pad = 0;
   forward_params->burstydim = 0;
-  forward_params->stride = 1;
-  forward_params->pad = 1;
+  forward_params->stride = this->stride_h_;
+  forward_params->pad = this->pad_h_;
   forward_params->burstchannels = burstchannels_;
   forward_params->rpo = forward_params->inchannels / burstchannels_;
   forward_params->numgroups = 1;
   forward_params->fc = 0;
   forward_params->relu = 0;
-  forward_params->pool = 1;
+  forward_params->pool = pool_mode;
   forward_params->pksize = this->kernel_h_;
+  forward_params->ksize_w = this->kernel_w_;
+  forward_params->stride_w = this->stride_w_;
+  forward_params->pad_w = this->pad_w_;
+  forward_params->dilation_h = 1;
+  forward_params->dilation_w = 1;
 
   // Backward params
   kernel_params *backward_params = &ocl_params_bi_;
@@ -107,16 +140,21 @@ void OCLPoolingHWCNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_params->rpofm = 0;
   backward_params->xtile_pad = 0;
   backward_params->burstydim = 0;
-  backward_params->stride = 1;
-  backward_params->pad = 1;
+  backward_params->stride = this->stride_h_;
+  backward_params->pad = this->pad_h_;
   backward_params->burstchannels = burstchannels_;
   backward_params->rpo = backward_params->inchannels / burstchannels_;
   backward_params->numgroups = 1;
   backward_params->fc = 0;
   backward_params->relu = 0;
-  backward_params->pool = 1;
+  backward_params->pool = pool_mode;
   backward_params->backward = 1;
   backward_params->pksize = this->kernel_h_;
+  backward_params->ksize_w = this->kernel_w_;
+  backward_params->stride_w = this->stride_w_;
+  backward_params->pad_w = this->pad_w_;
+  backward_params->dilation_h = 1;
+  backward_params->dilation_w = 1;
 }
 
 template <typename Dtype>
@@ -124,17 +162,45 @@ void OCLPoolingHWCNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
       << "corresponding to (num, channels, height, width)";
+  CHECK_EQ(bottom[0]->storage(), STORAGE_CPFP)
+      << "OCLPoolingHWCN input must hold cpfp values.";
   this->num_ = bottom[0]->shape(3);
   this->channels_ = bottom[0]->shape(2);
   this->height_ = bottom[0]->shape(0);
   this->width_ = bottom[0]->shape(1);
+  if (this->global_pooling_) {
+    this->kernel_h_ = this->height_;
+    this->kernel_w_ = this->width_;
+    CHECK_LT(this->kernel_h_, 1024) << "Window size must fit in 10 bits.";
+    CHECK_LT(this->kernel_w_, 1024) << "Window size must fit in 10 bits.";
+  }
+  // The engine tags the position of each max within its window in a short
+  CHECK_LE(this->kernel_h_ * this->kernel_w_, 32768)
+      << "OCLPoolingHWCN windows hold at most 32768 positions.";
   this->pooled_height_ = static_cast<int>(ceil(static_cast<float>(
       this->height_ + 2 * this->pad_h_ - this->kernel_h_) / this->stride_h_))
       + 1;
   this->pooled_width_ = static_cast<int>(ceil(static_cast<float>(
       this->width_ + 2 * this->pad_w_ - this->kernel_w_) / this->stride_w_))
       + 1;
+  // Same as the engine: make sure the last pooling window starts inside the
+  // image or its padding, which also drops the empty windows ceil mode can
+  // produce when the stride exceeds the kernel size
+  if ((this->pooled_height_ - 1) * this->stride_h_ >=
+      this->height_ + this->pad_h_) {
+    --this->pooled_height_;
+  }
+  if ((this->pooled_width_ - 1) * this->stride_w_ >=
+      this->width_ + this->pad_w_) {
+    --this->pooled_width_;
+  }
+  ocl_params_.ydim = ocl_params_bi_.ydim = this->height_;
+  ocl_params_.xdim = ocl_params_bi_.xdim = this->width_;
+  ocl_params_.numimages = ocl_params_bi_.numimages = this->num_;
+  ocl_params_.pksize = ocl_params_bi_.pksize = this->kernel_h_;
+  ocl_params_.ksize_w = ocl_params_bi_.ksize_w = this->kernel_w_;
  
+  top[0]->set_storage(STORAGE_CPFP);
   top[0]->Reshape(this->pooled_height_, this->pooled_width_, this->channels_,
       bottom[0]->shape(3));
 
@@ -153,22 +219,27 @@ void OCLPoolingHWCNLayer<Dtype>::launchKernel(const cpfp *bottom,
   int events_size = 1;
   events.resize(events_size, 0);
   
-  clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
-    (const void *)&bottom);
-  clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
-    (const void *)&weights);
-  clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
-    (const void *)&bias);
-  clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
-    (const void *)&top);
-  clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
-    (const void *)&tags);
-  clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
-    (const void *)&params);
-  clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
-      (const void *)&g);
-  clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
+  {
+    boost::mutex::scoped_lock lock(this->ocl_kernel_mutex());
+    clSetKernelArg(this->ocl_kernel, 0, sizeof(cl_mem),
+      (const void *)&bottom);
+    clSetKernelArg(this->ocl_kernel, 1, sizeof(cl_mem),
+      (const void *)&weights);
+    clSetKernelArg(this->ocl_kernel, 2, sizeof(cl_mem),
+      (const void *)&bias);
+    clSetKernelArg(this->ocl_kernel, 3, sizeof(cl_mem),
+      (const void *)&top);
+    clSetKernelArg(this->ocl_kernel, 4, sizeof(cl_mem),
+      (const void *)&tags);
+    clSetKernelArg(this->ocl_kernel, 5, sizeof(cl_mem),
+      (const void *)&params);
+    clSetKernelArg(this->ocl_kernel, 6, sizeof(cl_int),
+        (const void *)&g);
+    clSetKernelArg(this->ocl_kernel, 7, sizeof(cl_mem), NULL);
+    clEnqueueTask(oclCommandQueue, this->ocl_kernel, 0, NULL, &(events[g]));
+  }
   clWaitForEvents(events.size(), events.data());
+  Caffe::count_kernel_time(events.size(), events.data());
 }
 
 template <typename Dtype>
@@ -188,18 +259,16 @@ void OCLPoolingHWCNLayer<Dtype>::Forward_ocl(
   
   const int* p_params = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
-
   const cpfp *bias_data = bias_placeholder.ocl_data();
   const cpfp *weight_data = weights_placeholder.ocl_data();
   cpfp *top_data;
   int *relu_vals;
 
   for (int i = 0; i < bottom.size(); i++) {
-    const cpfp* bottom_data =
-      reinterpret_cast<const cpfp *>(bottom[i]->ocl_data(insize));
-    top_data = reinterpret_cast<cpfp *>(top[i]->mutable_ocl_data(0, outsize));
+    // Pooling keeps the exponent bias of its inputs
+    top[i]->set_data_exp_bias(bottom[i]->data_exp_bias());
+    const cpfp* bottom_data = bottom[i]->template ocl_data_as<cpfp>();
+    top_data = top[i]->template mutable_ocl_data_as<cpfp>(0);
     relu_vals = relu_indices.mutable_ocl_data(0);
     launchKernel(bottom_data, weight_data, bias_data, top_data, relu_vals,
         p_params);
@@ -226,22 +295,17 @@ void OCLPoolingHWCNLayer<Dtype>::Backward_ocl(const vector<Blob<Dtype>*>& top,
   
   const int* p_params_b = param_vals.ocl_data();
 
-  size_t insize = sizeof(cpfp) * bottom[0]->count();
-  size_t outsize = sizeof(cpfp) * top[0]->count();
- 
   const cpfp *bias_data = bias_placeholder.ocl_data();
   const cpfp *weight_data = weights_placeholder.ocl_data();
   const cpfp *top_diff;
   int *relu_vals;
 
-  cpfp *bottom_diff =
-    reinterpret_cast<cpfp *>(bottom[0]->mutable_cpu_diff());
-  for (int i = 0; i < bottom[0]->count(); ++i)
-    bottom_diff[i] = cpfp(0);
+  // The engine writes every bottom diff, zero where no window covers it,
+  // so nothing is copied to the device first
   for (int i = 0; i < bottom.size(); i++) {
-    cpfp *bottom_diff =
-      reinterpret_cast<cpfp *>(bottom[i]->mutable_ocl_diff(0, insize));
-    top_diff = reinterpret_cast<const cpfp *>(top[i]->ocl_diff(outsize));
+    bottom[i]->set_diff_exp_bias(top[i]->diff_exp_bias());
+    cpfp *bottom_diff = bottom[i]->template mutable_ocl_diff_as<cpfp>(0);
+    top_diff = top[i]->template ocl_diff_as<cpfp>();
     relu_vals = relu_indices.mutable_ocl_data();
     launchKernel(top_diff, weight_data, bias_data, bottom_diff, relu_vals,
         p_params_b);
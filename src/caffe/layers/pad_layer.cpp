@@ -1,7 +1,9 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/pad_layer.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -62,22 +64,30 @@ void PadLayer<Dtype>::Forward_cpu(
   std::vector<int> top_shape = top[0]->shape();
 
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype *bottom_data = bottom[i]->cpu_data();
-    Dtype *top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < shape[0]; ++n) {
-      for (int c = 0; c < shape[1]; ++c) {
-        for (int h = 0; h < shape[2]; ++h) {
-          for (int w = 0; w < shape[3]; ++w) {
-            int bot_idx, top_idx;
-            bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3] + w;
-            top_idx = ((n * top_shape[1] + c) * top_shape[2] + h) *
-              top_shape[3] + w;
-            if (((axis_ == 0) && n < dim_) || ((axis_ == 1) && c < dim_) ||
-                ((axis_ == 2) && h < dim_) || ((axis_ == 3) && w < dim_)) 
-              top_data[top_idx] = bottom_data[bot_idx];
-            else if (pad_)
-              top_data[top_idx] = 0;
-          }
+    caffe_parallel_for(shape[0], caffe_parallel_grain(top[i]->count(1)),
+        boost::bind(&PadLayer<Dtype>::PadItems_cpu, this,
+            bottom[i]->cpu_data(), top[i]->mutable_cpu_data(),
+            boost::cref(shape), boost::cref(top_shape), _1, _2));
+  }
+}
+
+template <typename Dtype>
+void PadLayer<Dtype>::PadItems_cpu(const Dtype* bottom_data, Dtype* top_data,
+    const vector<int>& shape, const vector<int>& top_shape, const int begin,
+    const int end) {
+  for (int n = begin; n < end; ++n) {
+    for (int c = 0; c < shape[1]; ++c) {
+      for (int h = 0; h < shape[2]; ++h) {
+        for (int w = 0; w < shape[3]; ++w) {
+          int bot_idx, top_idx;
+          bot_idx = ((n * shape[1] + c) * shape[2] + h) * shape[3] + w;
+          top_idx = ((n * top_shape[1] + c) * top_shape[2] + h) *
+            top_shape[3] + w;
+          if (((axis_ == 0) && n < dim_) || ((axis_ == 1) && c < dim_) ||
+              ((axis_ == 2) && h < dim_) || ((axis_ == 3) && w < dim_)) 
+            top_data[top_idx] = bottom_data[bot_idx];
+          else if (pad_)
+            top_data[top_idx] = 0;
         }
       }
     }
@@ -1,9 +1,11 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -129,59 +131,82 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    if (use_top_mask) {
+      top_mask = top[1]->mutable_cpu_data();
+    } else {
+      mask = max_idx_.mutable_cpu_data();
+    }
+  }
+  // Every (n, c) plane is pooled on its own.
+  const int plane_work = pooled_height_ * pooled_width_ * kernel_h_ * kernel_w_;
+  caffe_parallel_for(bottom[0]->num() * channels_,
+      caffe_parallel_grain(plane_work),
+      boost::bind(&PoolingLayer<Dtype>::PoolPlanes_cpu, this, bottom_data,
+          top_data, mask, top_mask, _1, _2));
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::PoolPlanes_cpu(const Dtype* bottom_data,
+    Dtype* top_data, int* mask, Dtype* top_mask, const int begin,
+    const int end) {
+  const int bottom_offset = height_ * width_;
+  const int top_offset = pooled_height_ * pooled_width_;
+  const int top_count = (end - begin) * top_offset;
+  bottom_data += begin * bottom_offset;
+  top_data += begin * top_offset;
+  const bool use_top_mask = top_mask != NULL;
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // Initialize
     if (use_top_mask) {
-      top_mask = top[1]->mutable_cpu_data();
+      top_mask += begin * top_offset;
       caffe_set(top_count, Dtype(-1), top_mask);
     } else {
-      mask = max_idx_.mutable_cpu_data();
+      mask += begin * top_offset;
       caffe_set(top_count, -1, mask);
     }
     caffe_set(top_count, Dtype(-FLT_MAX), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
+    for (int plane = begin; plane < end; ++plane) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_);
+          int wend = min(wstart + kernel_w_, width_);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          const int pool_index = ph * pooled_width_ + pw;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              const int index = h * width_ + w;
+              if (bottom_data[index] > top_data[pool_index]) {
+                top_data[pool_index] = bottom_data[index];
+                if (use_top_mask) {
+                  top_mask[pool_index] = static_cast<Dtype>(index);
+                } else {
+                  mask[pool_index] = index;
                 }
               }
             }
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+      }
+      // compute offset
+      bottom_data += bottom_offset;
+      top_data += top_offset;
+      if (use_top_mask) {
+        top_mask += top_offset;
+      } else {
+        mask += top_offset;
       }
     }
     break;
@@ -190,32 +215,30 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       top_data[i] = 0;
     }
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
+    for (int plane = begin; plane < end; ++plane) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          int pool_size = (hend - hstart) * (wend - wstart);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              top_data[ph * pooled_width_ + pw] +=
+                  bottom_data[h * width_ + w];
             }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
           }
+          top_data[ph * pooled_width_ + pw] /= pool_size;
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
       }
+      // compute offset
+      bottom_data += bottom_offset;
+      top_data += top_offset;
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
@@ -1,7 +1,9 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -11,8 +13,16 @@ void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
+  caffe_parallel_for(count, caffe_parallel_grain(1),
+      boost::bind(&ReLULayer<Dtype>::ForwardRange_cpu, this, bottom_data,
+          top_data, _1, _2));
+}
+
+template <typename Dtype>
+void ReLULayer<Dtype>::ForwardRange_cpu(const Dtype* bottom_data,
+    Dtype* top_data, const int begin, const int end) {
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-  for (int i = 0; i < count; ++i) {
+  for (int i = begin; i < end; ++i) {
     top_data[i] = std::max(bottom_data[i], Dtype(0))
         + negative_slope * std::min(bottom_data[i], Dtype(0));
   }
@@ -1,8 +1,10 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -28,13 +30,26 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
   int channels = bottom[0]->shape(softmax_axis_);
   int dim = bottom[0]->count() / outer_num_;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
+  caffe_parallel_for(outer_num_, caffe_parallel_grain(dim * 4),
+      boost::bind(&SoftmaxLayer<Dtype>::ForwardRows_cpu, this, bottom_data,
+          top_data, sum_multiplier_.cpu_data(), channels, _1, _2));
+}
+
+template <typename Dtype>
+void SoftmaxLayer<Dtype>::ForwardRows_cpu(const Dtype* bottom_data,
+    Dtype* top_data, const Dtype* sum_multiplier, const int channels,
+    const int begin, const int end) {
+  const int dim = channels * inner_num_;
+  top_data += begin * dim;
+  caffe_copy((end - begin) * dim, bottom_data + begin * dim, top_data);
+  // Each chunk of rows needs its own scale.
+  vector<Dtype> scale(inner_num_);
+  Dtype* scale_data = &scale[0];
   // We need to subtract the max to avoid numerical issues, compute the exp,
   // and then normalize.
-  for (int i = 0; i < outer_num_; ++i) {
+  for (int i = begin; i < end; ++i) {
     // initialize scale_data to the first plane
     caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
     for (int j = 0; j < channels; j++) {
@@ -45,12 +60,12 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     }
     // subtraction
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
+        1, -1., sum_multiplier, scale_data, 1., top_data);
     // exponentiation
     caffe_exp<Dtype>(dim, top_data, top_data);
     // sum after exp
     caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
+        top_data, sum_multiplier, 0., scale_data);
     // division
     for (int j = 0; j < channels; j++) {
       caffe_div(inner_num_, top_data, scale_data, top_data);
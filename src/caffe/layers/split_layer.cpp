@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/split_layer.hpp"
@@ -17,8 +18,12 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     // some strange effects in practice...)
     CHECK_NE(top[i], bottom[0]) << this->type() << " Layer does not "
         "allow in-place computation.";
+    top[i]->set_storage(bottom[0]->storage());
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
+    // Share the data right away, not only in Forward, so that the tops alias
+    // the bottom once the net is set up.
+    top[i]->ShareData(*bottom[0]);
   }
 }
 
@@ -34,6 +39,28 @@ template <typename Dtype>
 void SplitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
+  if (bottom[0]->storage() == STORAGE_CPFP) {
+    // cpfp diffs are summed on the host, with the largest exponent bias of
+    // the top diffs
+    int exp_bias = top[0]->diff_exp_bias();
+    for (int i = 1; i < top.size(); ++i) {
+      exp_bias = std::max(exp_bias, top[i]->diff_exp_bias());
+    }
+    cpfp* bottom_diff = bottom[0]->template mutable_cpu_diff_as<cpfp>();
+    for (int i = 0; i < top.size(); ++i) {
+      const cpfp* top_diff = top[i]->template cpu_diff_as<cpfp>();
+      const int top_bias = top[i]->diff_exp_bias();
+      for (int j = 0; j < count_; ++j) {
+        const float sum = cpfp2float(top_diff[j], top_bias) + ((i == 0) ? 0 :
+            cpfp2float(bottom_diff[j], exp_bias));
+        bottom_diff[j] = cpfp(float2cpfp(sum, exp_bias));
+      }
+    }
+    bottom[0]->set_diff_exp_bias(exp_bias);
+    return;
+  }
+  CHECK_EQ(bottom[0]->storage(), STORAGE_DTYPE)
+      << "Split backward needs Dtype or cpfp storage";
   if (top.size() == 1) {
     caffe_copy(count_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
     return;
@@ -1,4 +1,6 @@
+#include <boost/thread.hpp>
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <set>
 #include <string>
@@ -15,6 +17,7 @@
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/tensor_file.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -251,6 +254,15 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  if (phase_ == TEST && param.share_activation_memory()) {
+    PlanActivationMemory();
+  }
+  num_micro_batches_ = 0;
+  if (phase_ == TEST && param.micro_batch_size() > 0) {
+    CHECK(!param.share_activation_memory()) << "micro_batch_size cannot be "
+        << "combined with share_activation_memory";
+    PlanPipeline(param.micro_batch_size());
+  }
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -516,6 +528,11 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  // The parameter gradients of the last backward may still read the blobs
+  // this pass overwrites
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->FinishBackward();
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     for (int c = 0; c < before_forward_.size(); ++c) {
@@ -543,10 +560,10 @@ Dtype Net<Dtype>::ForwardTo(int end) {
 
 template <typename Dtype>
 const vector<Blob<Dtype>*>& Net<Dtype>::Forward(Dtype* loss) {
+  const Dtype net_loss = (num_micro_batches_ > 0) ?
+      ForwardPipelined() : ForwardFromTo(0, layers_.size() - 1);
   if (loss != NULL) {
-    *loss = ForwardFromTo(0, layers_.size() - 1);
-  } else {
-    ForwardFromTo(0, layers_.size() - 1);
+    *loss = net_loss;
   }
   return net_output_blobs_;
 }
@@ -574,7 +591,10 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
-      if (debug_info_) { BackwardDebugInfo(i); }
+      if (debug_info_) {
+        layers_[i]->SyncParamDiffs();
+        BackwardDebugInfo(i);
+      }
     }
     for (int c = 0; c < after_backward_.size(); ++c) {
       after_backward_[c]->run(i);
@@ -769,8 +789,15 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  if (H5Fis_hdf5(trained_filename.c_str())) {
+  htri_t is_hdf5;
+  {
+    boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+    is_hdf5 = H5Fis_hdf5(trained_filename.c_str());
+  }
+  if (is_hdf5) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (TensorFile::IsTensorFile(trained_filename)) {
+    CopyTrainedLayersFromTensorFile(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -786,6 +813,7 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -834,6 +862,62 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromTensorFile(const string trained_filename,
+    const bool alias) {
+  shared_ptr<TensorFile> file(new TensorFile(trained_filename));
+  const TensorFileIndex& index = file->index();
+  const bool same_type = index.data_type() == (sizeof(Dtype) == sizeof(float)
+      ? TensorFileIndex_DataType_FLOAT : TensorFileIndex_DataType_DOUBLE);
+  bool aliased = false;
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    const TensorFileEntry& entry = index.tensor(i);
+    if (!layer_names_index_.count(entry.layer())) {
+      if (entry.index() == 0) {
+        LOG(INFO) << "Ignoring source layer " << entry.layer();
+      }
+      continue;
+    }
+    const int target_layer_id = layer_names_index_[entry.layer()];
+    DLOG(INFO) << "Copying source layer " << entry.layer() << " blob "
+        << entry.index();
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_LT(entry.index(), target_blobs.size())
+        << "Incompatible number of blobs for layer " << entry.layer();
+    Blob<Dtype>* target_blob = target_blobs[entry.index()].get();
+    vector<int> source_shape(entry.shape().dim_size());
+    for (int j = 0; j < source_shape.size(); ++j) {
+      source_shape[j] = entry.shape().dim(j);
+    }
+    if (source_shape != target_blob->shape()) {
+      LOG(FATAL) << "Cannot copy param " << entry.index() << " weights from "
+          << "layer '" << entry.layer() << "'; shape mismatch.  Source param "
+          << "shape is " << Blob<Dtype>(source_shape).shape_string() << "; "
+          << "target param shape is " << target_blob->shape_string() << ". "
+          << "To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+    }
+    const int count = target_blob->count();
+    if (same_type && alias) {
+      target_blob->data()->set_cpu_data(file->data(entry));
+      aliased = true;
+    } else if (same_type) {
+      caffe_copy(count, static_cast<const Dtype*>(file->data(entry)),
+          target_blob->mutable_cpu_data());
+    } else if (index.data_type() == TensorFileIndex_DataType_FLOAT) {
+      const float* source = static_cast<const float*>(file->data(entry));
+      std::copy(source, source + count, target_blob->mutable_cpu_data());
+    } else {
+      const double* source = static_cast<const double*>(file->data(entry));
+      std::copy(source, source + count, target_blob->mutable_cpu_data());
+    }
+  }
+  if (aliased) {
+    mapped_weights_.push_back(file);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -848,6 +932,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -903,6 +988,43 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToTensorFile(const string& filename) const {
+  TensorFileWriter<Dtype> writer(filename, name_);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const int num_params = layers_[layer_id]->blobs().size();
+    for (int param_id = 0; param_id < num_params; ++param_id) {
+      const int net_param_id = param_id_vecs_[layer_id][param_id];
+      if (param_owners_[net_param_id] == -1) {
+        // Only save params that own themselves
+        writer.Add(layer_names_[layer_id], param_id, *params_[net_param_id]);
+      }
+    }
+  }
+  writer.Close();
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_async_param_diffs(const bool value) {
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->set_async_param_diffs(value);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_param_diff_passes(const int value) {
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->set_param_diff_passes(value);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::SyncParamDiffs() {
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->SyncParamDiffs();
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
@@ -941,6 +1063,437 @@ void Net<Dtype>::ShareWeights() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::PlanActivationMemory() {
+  const int num_blobs = blobs_.size();
+  // Tops that share the data of a bottom since setup (Split, Flatten,
+  // Reshape, ...) are planned as one group, represented by the first blob.
+  vector<int> group(num_blobs);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    group[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int top_id = top_id_vecs_[layer_id][i];
+      for (int j = 0; j < bottom_id_vecs_[layer_id].size(); ++j) {
+        const int bottom_id = bottom_id_vecs_[layer_id][j];
+        if (top_id != bottom_id && blobs_[top_id]->count() > 0 &&
+            blobs_[bottom_id]->count() > 0 &&
+            blobs_[top_id]->data() == blobs_[bottom_id]->data()) {
+          group[top_id] = group[bottom_id];
+        }
+      }
+    }
+  }
+  // Lifetime of each group, from the layer producing it to its last reader
+  vector<int> first_use(num_blobs, -1);
+  vector<int> last_use(num_blobs, -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[top_id_vecs_[layer_id][i]];
+      if (first_use[g] < 0) {
+        first_use[g] = layer_id;
+      }
+      last_use[g] = std::max(last_use[g], layer_id);
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[bottom_id_vecs_[layer_id][i]];
+      last_use[g] = std::max(last_use[g], layer_id);
+    }
+  }
+  // Inputs, outputs, data layer tops and anything already holding values
+  // keep their own memory.
+  vector<bool> pinned(num_blobs, false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    pinned[group[net_input_blob_indices_[i]]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    pinned[group[net_output_blob_indices_[i]]] = true;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (bottom_id_vecs_[layer_id].size() > 0) { continue; }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      pinned[group[top_id_vecs_[layer_id][i]]] = true;
+    }
+  }
+  vector<size_t> group_bytes(num_blobs, 0);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const int g = group[blob_id];
+    const Blob<Dtype>& blob = *blobs_[blob_id];
+    if (blob.count() == 0 || first_use[g] < 0 ||
+        blob.data()->head() != SyncedMemory::UNINITIALIZED) {
+      pinned[g] = true;
+    } else {
+      group_bytes[g] = std::max(group_bytes[g],
+          blob.count() * blob.element_size());
+    }
+  }
+  // Walk the layers in order, taking a free buffer for every new top and
+  // releasing the buffers of groups read for the last time.
+  vector<size_t> buffer_bytes;
+  vector<int> buffer_owner;
+  vector<int> free_buffers;
+  vector<int> buffer_id(num_blobs, -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[top_id_vecs_[layer_id][i]];
+      if (pinned[g] || buffer_id[g] >= 0 || first_use[g] != layer_id) {
+        continue;
+      }
+      int buffer = -1;
+      // An elementwise layer writes over a bottom that dies here, as long as
+      // both hold the same elements. Element i of a wider top would land on
+      // bottom elements not yet read, e.g. across a CPFPConversion
+      if (layers_[layer_id]->AllowInPlace() &&
+          bottom_id_vecs_[layer_id].size() > 0) {
+        const Blob<Dtype>& top = *blobs_[top_id_vecs_[layer_id][i]];
+        const Blob<Dtype>& bottom = *blobs_[bottom_id_vecs_[layer_id][0]];
+        const int b = group[bottom_id_vecs_[layer_id][0]];
+        if (b != g && last_use[b] == layer_id && buffer_id[b] >= 0 &&
+            buffer_owner[buffer_id[b]] == b &&
+            top.storage() == bottom.storage() &&
+            top.element_size() == bottom.element_size()) {
+          buffer = buffer_id[b];
+        }
+      }
+      if (buffer < 0 && free_buffers.size() > 0) {
+        // Smallest free buffer that fits, else the largest one grows
+        int best = 0;
+        for (int k = 1; k < free_buffers.size(); ++k) {
+          const size_t size = buffer_bytes[free_buffers[k]];
+          const size_t best_size = buffer_bytes[free_buffers[best]];
+          const bool fits = size >= group_bytes[g];
+          const bool best_fits = best_size >= group_bytes[g];
+          if ((fits && (!best_fits || size < best_size)) ||
+              (!fits && !best_fits && size > best_size)) {
+            best = k;
+          }
+        }
+        buffer = free_buffers[best];
+        free_buffers.erase(free_buffers.begin() + best);
+      }
+      if (buffer < 0) {
+        buffer = buffer_bytes.size();
+        buffer_bytes.push_back(0);
+        buffer_owner.push_back(-1);
+      }
+      buffer_bytes[buffer] = std::max(buffer_bytes[buffer], group_bytes[g]);
+      buffer_owner[buffer] = g;
+      buffer_id[g] = buffer;
+    }
+    vector<int> used(bottom_id_vecs_[layer_id]);
+    used.insert(used.end(), top_id_vecs_[layer_id].begin(),
+        top_id_vecs_[layer_id].end());
+    for (int i = 0; i < used.size(); ++i) {
+      const int g = group[used[i]];
+      if (last_use[g] == layer_id && buffer_id[g] >= 0 &&
+          buffer_owner[buffer_id[g]] == g) {
+        free_buffers.push_back(buffer_id[g]);
+        buffer_owner[buffer_id[g]] = -1;
+      }
+    }
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_bytes.size());
+  size_t planned_bytes = 0;
+  for (int k = 0; k < buffers.size(); ++k) {
+    buffers[k].reset(new SyncedMemory(buffer_bytes[k]));
+    planned_bytes += buffer_bytes[k];
+  }
+  size_t naive_bytes = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (group[blob_id] == blob_id && !pinned[blob_id]) {
+      naive_bytes += group_bytes[blob_id];
+    }
+    if (buffer_id[group[blob_id]] >= 0) {
+      blobs_[blob_id]->ShareDataBuffer(buffers[buffer_id[group[blob_id]]]);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Activation memory: " << planned_bytes << " bytes in "
+      << buffers.size() << " shared buffers instead of " << naive_bytes
+      << " bytes for the intermediate blobs";
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanPipeline(const int micro_batch_size) {
+  // The data layers run once on the whole batch.
+  pipeline_begin_ = 0;
+  while (pipeline_begin_ < layers_.size() &&
+      bottom_vecs_[pipeline_begin_].size() == 0 &&
+      !layers_[pipeline_begin_]->RunsOnDevice()) {
+    ++pipeline_begin_;
+  }
+  CHECK_GT(pipeline_begin_, 0) << "micro_batch_size needs data layers";
+  CHECK_LT(pipeline_begin_, layers_.size())
+      << "micro_batch_size needs layers after the data layers";
+  int batch_size = -1;
+  for (int layer_id = 0; layer_id < pipeline_begin_; ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int top_id = top_id_vecs_[layer_id][i];
+      const int axis = layers_[layer_id]->BatchAxis(i);
+      CHECK_GT(blobs_[top_id]->num_axes(), axis) << "Data layer top "
+          << blob_names_[top_id] << " has no batch axis";
+      if (batch_size < 0) {
+        batch_size = blobs_[top_id]->shape(axis);
+      }
+      CHECK_EQ(blobs_[top_id]->shape(axis), batch_size)
+          << "Data layer tops disagree on the batch size";
+      source_blob_ids_.push_back(top_id);
+      source_batch_axes_.push_back(axis);
+    }
+  }
+  CHECK_GT(batch_size, 0);
+  CHECK_EQ(batch_size % micro_batch_size, 0) << "micro_batch_size "
+      << micro_batch_size << " does not divide the batch size " << batch_size;
+  num_micro_batches_ = batch_size / micro_batch_size;
+  // Consecutive layers on the same side form a stage.
+  vector<int> layer_stage(layers_.size(), -1);
+  for (int layer_id = pipeline_begin_; layer_id < layers_.size(); ++layer_id) {
+    const bool on_device = layers_[layer_id]->RunsOnDevice();
+    CHECK(on_device || bottom_vecs_[layer_id].size() > 0)
+        << "micro_batch_size needs the data layers ahead of all other layers, "
+        << "but " << layer_names_[layer_id] << " comes later";
+    if (stage_begin_.size() == 0 || stage_on_device_.back() != on_device) {
+      stage_begin_.push_back(layer_id);
+      stage_on_device_.push_back(on_device);
+    }
+    if (on_device) {
+      CHECK_EQ(micro_batch_size % 16, 0) << "micro_batch_size must be a "
+          << "multiple of the 16 image lanes of " << layer_names_[layer_id];
+    }
+    layer_stage[layer_id] = stage_begin_.size() - 1;
+  }
+  const int num_stages = stage_begin_.size();
+  // Blobs that share data since setup (Split, Flatten, Reshape, ...) stay in
+  // use until the last reader of any of them.
+  const int num_blobs = blobs_.size();
+  vector<int> group(num_blobs);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    group[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int top_id = top_id_vecs_[layer_id][i];
+      for (int j = 0; j < bottom_id_vecs_[layer_id].size(); ++j) {
+        const int bottom_id = bottom_id_vecs_[layer_id][j];
+        if (top_id != bottom_id && blobs_[top_id]->count() > 0 &&
+            blobs_[bottom_id]->count() > 0 &&
+            blobs_[top_id]->data() == blobs_[bottom_id]->data()) {
+          group[top_id] = group[bottom_id];
+        }
+      }
+    }
+  }
+  vector<int> first_stage(num_blobs, -1);
+  vector<int> last_stage(num_blobs, -1);
+  for (int layer_id = pipeline_begin_; layer_id < layers_.size(); ++layer_id) {
+    const int stage = layer_stage[layer_id];
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int top_id = top_id_vecs_[layer_id][i];
+      if (first_stage[top_id] < 0) {
+        first_stage[top_id] = stage;
+      }
+      last_stage[group[top_id]] = std::max(last_stage[group[top_id]], stage);
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[bottom_id_vecs_[layer_id][i]];
+      last_stage[g] = std::max(last_stage[g], stage);
+    }
+  }
+  // Data layer tops and net outputs get a copy for every micro-batch. A blob
+  // passed on from stage p to stage q cycles through q - p + 1 copies, as
+  // stage p may run that many micro-batches ahead of q.
+  vector<bool> pinned(num_blobs, false);
+  for (int i = 0; i < source_blob_ids_.size(); ++i) {
+    pinned[group[source_blob_ids_[i]]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    pinned[group[net_output_blob_indices_[i]]] = true;
+  }
+  micro_blobs_.resize(num_blobs);
+  stage_reuse_.resize(num_stages);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const int g = group[blob_id];
+    int copies = 0;
+    if (pinned[g]) {
+      copies = num_micro_batches_;
+    } else if (first_stage[blob_id] >= 0 &&
+        last_stage[g] > first_stage[blob_id]) {
+      copies = std::min(num_micro_batches_,
+          last_stage[g] - first_stage[blob_id] + 1);
+      stage_reuse_[first_stage[blob_id]].push_back(
+          make_pair(last_stage[g], copies));
+    }
+    for (int k = 0; k < copies; ++k) {
+      micro_blobs_[blob_id].push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      micro_blobs_[blob_id].back()->set_storage(blobs_[blob_id]->storage());
+    }
+  }
+  micro_bottom_vecs_.resize(num_micro_batches_);
+  micro_top_vecs_.resize(num_micro_batches_);
+  for (int m = 0; m < num_micro_batches_; ++m) {
+    micro_bottom_vecs_[m].resize(layers_.size());
+    micro_top_vecs_[m].resize(layers_.size());
+    for (int layer_id = pipeline_begin_; layer_id < layers_.size();
+        ++layer_id) {
+      for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+        micro_bottom_vecs_[m][layer_id].push_back(
+            micro_blob(bottom_id_vecs_[layer_id][i], m));
+      }
+      for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+        micro_top_vecs_[m][layer_id].push_back(
+            micro_blob(top_id_vecs_[layer_id][i], m));
+      }
+    }
+  }
+  pipeline_mutex_.reset(new boost::mutex());
+  pipeline_cond_.reset(new boost::condition_variable());
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Pipelined forward: " << num_micro_batches_ << " micro-batches of "
+      << micro_batch_size << " through " << num_stages << " stages";
+}
+
+namespace {
+
+// Copies micro-batch index of whole, whose batch runs along axis, to part or
+// back from it.
+template <typename Dtype>
+void CopyMicroBatch(Blob<Dtype>* whole, const int axis, const int index,
+    Blob<Dtype>* part, const bool to_part) {
+  CHECK_EQ(whole->storage(), part->storage());
+  const int outer = whole->count(0, axis);
+  const size_t part_bytes = part->count(axis) * part->element_size();
+  const size_t whole_bytes = whole->count(axis) * whole->element_size();
+  const size_t offset = index * part_bytes;
+  if (to_part) {
+    const char* src = static_cast<const char*>(whole->data()->cpu_data());
+    char* dst = static_cast<char*>(part->data()->mutable_cpu_data());
+    for (int i = 0; i < outer; ++i) {
+      memcpy(dst + i * part_bytes, src + i * whole_bytes + offset, part_bytes);
+    }
+  } else {
+    const char* src = static_cast<const char*>(part->data()->cpu_data());
+    char* dst = static_cast<char*>(whole->data()->mutable_cpu_data());
+    for (int i = 0; i < outer; ++i) {
+      memcpy(dst + i * whole_bytes + offset, src + i * part_bytes, part_bytes);
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardPipelined() {
+  Dtype loss = ForwardFromTo(0, pipeline_begin_ - 1);
+  for (int i = 0; i < source_blob_ids_.size(); ++i) {
+    const int blob_id = source_blob_ids_[i];
+    const int axis = source_batch_axes_[i];
+    Blob<Dtype>* whole = blobs_[blob_id].get();
+    vector<int> shape = whole->shape();
+    CHECK_EQ(shape[axis] % num_micro_batches_, 0);
+    shape[axis] /= num_micro_batches_;
+    for (int m = 0; m < num_micro_batches_; ++m) {
+      micro_blobs_[blob_id][m]->set_data_exp_bias(whole->data_exp_bias());
+      micro_blobs_[blob_id][m]->Reshape(shape);
+      CopyMicroBatch(whole, axis, m, micro_blobs_[blob_id][m].get(), true);
+    }
+  }
+  stage_done_.assign(stage_begin_.size(), 0);
+  pipeline_loss_ = 0;
+  boost::thread device_worker(&Net<Dtype>::RunPipelineWorker, this, true,
+      Caffe::mode());
+  RunPipelineWorker(false, Caffe::mode());
+  device_worker.join();
+  // Put the outputs back together: per-item outputs along the axis that the
+  // micro-batches split, reductions such as loss or accuracy averaged.
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int blob_id = net_output_blob_indices_[i];
+    Blob<Dtype>* whole = blobs_[blob_id].get();
+    const vector<shared_ptr<Blob<Dtype> > >& parts = micro_blobs_[blob_id];
+    CHECK_EQ(whole->num_axes(), parts[0]->num_axes());
+    int axis = -1;
+    for (int a = 0; a < whole->num_axes() && axis < 0; ++a) {
+      if (whole->shape(a) != parts[0]->shape(a)) {
+        axis = a;
+      }
+    }
+    if (axis < 0 && num_micro_batches_ > 1) {
+      CHECK_EQ(whole->storage(), STORAGE_DTYPE);
+      Dtype* data = whole->mutable_cpu_data();
+      caffe_set(whole->count(), Dtype(0), data);
+      for (int m = 0; m < num_micro_batches_; ++m) {
+        caffe_axpy(whole->count(), Dtype(1) / num_micro_batches_,
+            parts[m]->cpu_data(), data);
+      }
+    } else {
+      axis = std::max(axis, 0);
+      CHECK_EQ(whole->shape(axis), parts[0]->shape(axis) * num_micro_batches_)
+          << "Output " << blob_names_[blob_id] << " is not split along a "
+          << "single batch axis";
+      for (int m = 0; m < num_micro_batches_; ++m) {
+        CopyMicroBatch(whole, axis, m, parts[m].get(), false);
+      }
+    }
+  }
+  return loss + pipeline_loss_ / num_micro_batches_;
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunPipelineWorker(const bool on_device,
+    const Caffe::Brew mode) {
+  Caffe::set_mode(mode);
+  const int num_stages = stage_begin_.size();
+  // Stage s takes micro-batch t - s in wave t. Within a wave the later stages
+  // go first, so that the older micro-batches drain before new ones start.
+  for (int t = 0; t < num_micro_batches_ + num_stages - 1; ++t) {
+    for (int s = std::min(t, num_stages - 1);
+        s >= 0 && t - s < num_micro_batches_; --s) {
+      if (stage_on_device_[s] != on_device) { continue; }
+      const int m = t - s;
+      WaitForStage(s - 1, m + 1);
+      for (int i = 0; i < stage_reuse_[s].size(); ++i) {
+        WaitForStage(stage_reuse_[s][i].first,
+            m - stage_reuse_[s][i].second + 1);
+      }
+      const int end = (s + 1 < num_stages) ?
+          stage_begin_[s + 1] : layers_.size();
+      Dtype loss = 0;
+      for (int layer_id = stage_begin_[s]; layer_id < end; ++layer_id) {
+        loss += layers_[layer_id]->Forward(micro_bottom_vecs_[m][layer_id],
+            micro_top_vecs_[m][layer_id]);
+      }
+      if (on_device) {
+        // Read the results back here, so that the host stages never wait on
+        // the device queue behind the next micro-batches.
+        for (int layer_id = stage_begin_[s]; layer_id < end; ++layer_id) {
+          for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+            if (micro_blobs_[top_id_vecs_[layer_id][i]].size() > 0 &&
+                micro_top_vecs_[m][layer_id][i]->count() > 0) {
+              micro_top_vecs_[m][layer_id][i]->data()->cpu_data();
+            }
+          }
+        }
+      }
+      {
+        boost::mutex::scoped_lock lock(*pipeline_mutex_);
+        ++stage_done_[s];
+        pipeline_loss_ += loss;
+      }
+      pipeline_cond_->notify_all();
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::WaitForStage(const int stage, const int count) {
+  if (stage < 0 || count <= 0) { return; }
+  boost::mutex::scoped_lock lock(*pipeline_mutex_);
+  while (stage_done_[stage] < count) {
+    pipeline_cond_->wait(lock);
+  }
+}
+
 template <typename Dtype>
 bool Net<Dtype>::has_blob(const string& blob_name) const {
   return blob_names_index_.find(blob_name) != blob_names_index_.end();
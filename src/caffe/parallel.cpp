@@ -1,10 +1,11 @@
 #ifdef USE_NCCL
-
 #include <cuda_runtime.h>
+#endif
 #include <glog/logging.h>
 #include <stdio.h>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/caffe.hpp"
@@ -72,6 +73,277 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
     diff_() {
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver)
+  : Params<Dtype>(root_solver) {
+  data_ = new Dtype[size_];
+  // Copy blob values
+  const vector<Blob<Dtype>*>& net =
+    root_solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, copy);
+
+  diff_ = new Dtype[size_];
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  delete[] data_;
+  delete[] diff_;
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::Configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+    solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
+template<typename Dtype>
+HostSync<Dtype>::HostSync(shared_ptr<Solver<Dtype> > solver)
+  : CPUParams<Dtype>(solver),
+    solver_(solver), rank_(Caffe::solver_rank()), syncs_(), barrier_(),
+    reduce_barrier_(), backward_passes_(), pushed_() {
+  CHECK_NE(Caffe::mode(), Caffe::GPU) << "Use NCCL to train on GPUs.";
+  this->Configure(solver.get());
+  const vector<shared_ptr<Layer<Dtype> > >& layers =
+    solver_->net()->layers();
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  // The first learnable param each layer owns. A layer's learnable params
+  // are those it owns, and they follow those of the layers below.
+  vector<int> layer_params(layers.size());
+  param_offsets_.push_back(0);
+  for (int i = 0; i < layers.size(); ++i) {
+    layer_params[i] = param_offsets_.size() - 1;
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = layers[i]->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      const int param = param_offsets_.size() - 1;
+      if (param < params.size() && blobs[j].get() == params[param]) {
+        param_offsets_.push_back(param_offsets_.back() +
+            params[param]->count());
+      }
+    }
+  }
+  CHECK_EQ(param_offsets_.size() - 1, params.size());
+  // Once backward is done with a layer, the gradients of the params owned by
+  // it and the layers above are complete.
+  const size_t bucket_size = solver_->param().reduce_bucket_size();
+  layer_buckets_.assign(layers.size(), -1);
+  int end = params.size();
+  int end_layer = layers.size();
+  for (int i = layers.size() - 1; i >= 0; --i) {
+    const int begin = layer_params[i];
+    if (begin < end && (i == 0 ||
+        param_offsets_[end] - param_offsets_[begin] >= bucket_size)) {
+      layer_buckets_[i] = buckets_.size();
+      buckets_.push_back(std::make_pair(begin, end));
+      bucket_layers_.push_back(std::make_pair(i, end_layer));
+      end = begin;
+      end_layer = i;
+    }
+  }
+}
+
+template<typename Dtype>
+HostSync<Dtype>::~HostSync() {
+  StopInternalThread();
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::Connect(vector<HostSync<Dtype>*>* syncs,
+    boost::barrier* barrier, boost::barrier* reduce_barrier) {
+  CHECK_LT(rank_, syncs->size());
+  syncs_ = syncs;
+  (*syncs_)[rank_] = this;
+  barrier_ = barrier;
+  reduce_barrier_ = reduce_barrier;
+  StartInternalThread();
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::Broadcast() {
+  barrier_->wait();
+  if (rank_ > 0) {
+    caffe_copy(size_, (*syncs_)[0]->data_, data_);
+  }
+  barrier_->wait();
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::on_start() {
+  backward_passes_ = 0;
+  pushed_ = 0;
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::run(int layer) {
+  CHECK(solver_->param().layer_wise_reduce());
+  // Only the last of iter_size backward passes completes the gradients
+  if (backward_passes_ == solver_->param().iter_size() - 1 &&
+      layer_buckets_[layer] >= 0) {
+    Push(layer_buckets_[layer]);
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::on_gradients_ready() {
+  while (pushed_ < buckets_.size()) {
+    Push(pushed_);
+  }
+  for (int i = 0; i < buckets_.size(); ++i) {
+    done_.pop();
+  }
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::Push(int bucket) {
+  CHECK_EQ(bucket, pushed_);
+  const vector<shared_ptr<Layer<Dtype> > >& layers =
+    solver_->net()->layers();
+  for (int i = bucket_layers_[bucket].first;
+       i < bucket_layers_[bucket].second; ++i) {
+    layers[i]->SyncParamDiffs();
+  }
+  // Make the host buffer the current copy of the gradients for the update.
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  for (int i = buckets_[bucket].first; i < buckets_[bucket].second; ++i) {
+    params[i]->mutable_cpu_diff();
+  }
+  ready_.push(bucket);
+  ++pushed_;
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const int bucket = ready_.pop();
+      Reduce(bucket);
+      done_.push(bucket);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template<typename Dtype>
+void HostSync<Dtype>::Reduce(int bucket) {
+  const int workers = syncs_->size();
+  const size_t begin = param_offsets_[buckets_[bucket].first];
+  const size_t size = param_offsets_[buckets_[bucket].second] - begin;
+  Dtype* own = diff_ + begin;
+  const Dtype* left = (*syncs_)[(rank_ + workers - 1) % workers]->diff_
+      + begin;
+  // Wait for every worker to have the bucket ready
+  reduce_barrier_->wait();
+  // Reduce-scatter: in each step, add the left neighbour's partial sum of a
+  // chunk to ours. Afterwards, we hold the average of chunk rank_ + 1.
+  for (int step = 0; step < workers - 1; ++step) {
+    const int chunk = (rank_ + 2 * workers - step - 1) % workers;
+    const size_t chunk_begin = size * chunk / workers;
+    const int count = size * (chunk + 1) / workers - chunk_begin;
+    caffe_axpy(count, Dtype(1), left + chunk_begin, own + chunk_begin);
+    if (step == workers - 2) {
+      caffe_scal(count, Dtype(1) / workers, own + chunk_begin);
+    }
+    reduce_barrier_->wait();
+  }
+  // All-gather: in each step, copy an average the left neighbour holds.
+  for (int step = 0; step < workers - 1; ++step) {
+    const int chunk = (rank_ + workers - step) % workers;
+    const size_t chunk_begin = size * chunk / workers;
+    const int count = size * (chunk + 1) / workers - chunk_begin;
+    caffe_copy(count, left + chunk_begin, own + chunk_begin);
+    reduce_barrier_->wait();
+  }
+}
+
+template<typename Dtype>
+class HostWorker : public InternalThread {
+ public:
+  explicit HostWorker(shared_ptr<Solver<Dtype> > rank0,
+                      boost::barrier* barrier, boost::barrier* reduce_barrier,
+                      vector<HostSync<Dtype>*>* syncs, const char* restore)
+    : rank0_(rank0), barrier_(barrier), reduce_barrier_(reduce_barrier),
+      syncs_(syncs), restore_(restore) {
+  }
+  virtual ~HostWorker() {}
+
+ protected:
+  void InternalThreadEntry() {
+    // Create solver and install callbacks
+    SolverParameter param(rank0_->param());
+    param.set_type(rank0_->type());
+    shared_ptr<Solver<Dtype> > s(SolverRegistry<Dtype>::CreateSolver(param));
+    CHECK_EQ(s->type(), rank0_->type());
+    if (restore_) {
+      s->Restore(restore_);
+    }
+    HostSync<Dtype> sync(s);
+    s->add_callback(&sync);
+    if (s->param().layer_wise_reduce()) {
+      s->net()->add_after_backward(&sync);
+    }
+    sync.Connect(syncs_, barrier_, reduce_barrier_);
+    // Wait for other threads
+    barrier_->wait();
+    // Broadcast rank 0 state
+    sync.Broadcast();
+    // Solve
+    s->Step(param.max_iter() - s->iter());
+    barrier_->wait();
+  }
+
+  shared_ptr<Solver<Dtype> > rank0_;
+  boost::barrier* barrier_;
+  boost::barrier* reduce_barrier_;
+  vector<HostSync<Dtype>*>* syncs_;
+  const char* restore_;
+};
+
+template<typename Dtype>
+void HostSync<Dtype>::Run(int workers, const char* restore) {
+  CHECK_EQ(Caffe::solver_count(), workers);
+  // The FPGA layers of all nets share one kernel object and the process's
+  // command queues on its one device, so OCL mode trains a single worker.
+  CHECK(Caffe::mode() == Caffe::CPU || workers == 1)
+      << "Multiple workers only train in CPU mode.";
+  boost::barrier barrier(workers);
+  boost::barrier reduce_barrier(workers);
+  vector<HostSync<Dtype>*> syncs(workers);
+  // Create workers
+  vector<shared_ptr<HostWorker<Dtype> > > threads(workers);
+  for (int i = 1; i < workers; ++i) {
+    Caffe::set_solver_rank(i);
+    HostWorker<Dtype>* w = new HostWorker<Dtype>(solver_, &barrier,
+        &reduce_barrier, &syncs, restore);
+    w->StartInternalThread();
+    threads[i].reset(w);
+  }
+  Caffe::set_solver_rank(0);
+  solver_->add_callback(this);
+  if (solver_->param().layer_wise_reduce()) {
+    solver_->net()->add_after_backward(this);
+  }
+  Connect(&syncs, &barrier, &reduce_barrier);
+  // Wait for workers
+  barrier.wait();
+  // Run first solver on current thread
+  Broadcast();
+  solver_->Solve();
+  barrier.wait();
+  // Wait for shutdown
+  for (int i = 1; i < workers; ++i) {
+    threads[i]->StopInternalThread();
+  }
+}
+
+#ifdef USE_NCCL
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
   : Params<Dtype>(root_solver) {
@@ -361,11 +633,15 @@ void NCCL<Dtype>::Run(const vector<int>& gpus, const char* restore) {
   }
 }
 
-INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(Worker);
 INSTANTIATE_CLASS(NCCL);
 
-}  // namespace caffe
-
 #endif  // USE_NCCL
+
+INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
+INSTANTIATE_CLASS(HostWorker);
+INSTANTIATE_CLASS(HostSync);
+
+}  // namespace caffe
@@ -98,6 +98,10 @@ void Solver<Dtype>::InitTrainNet() {
   net_state.MergeFrom(param_.train_state());
   net_param.mutable_state()->CopyFrom(net_state);
   net_.reset(new Net<Dtype>(net_param));
+  // Step completes the parameter diffs before it reads them, once per
+  // iter_size backward passes
+  net_->set_async_param_diffs(true);
+  net_->set_param_diff_passes(param_.iter_size());
 }
 
 template <typename Dtype>
@@ -240,6 +244,7 @@ void Solver<Dtype>::Step(int iters) {
         }
       }
     }
+    net_->SyncParamDiffs();
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
@@ -290,6 +295,10 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  // Leave the last snapshot on disk when Solve returns
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -402,6 +411,13 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  // libhdf5 isn't thread-safe, and HDF5 layers may be using it: HDF5
+  // snapshots are always written on this thread.
+  if (param_.async_snapshot() && snapshot_history() &&
+      param_.snapshot_format() != caffe::SolverParameter_SnapshotFormat_HDF5) {
+    SnapshotAsync();
+    return;
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -410,6 +426,9 @@ void Solver<Dtype>::Snapshot() {
   case caffe::SolverParameter_SnapshotFormat_HDF5:
     model_filename = SnapshotToHDF5();
     break;
+  case caffe::SolverParameter_SnapshotFormat_TENSORS:
+    model_filename = SnapshotToTensorFile();
+    break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
@@ -417,6 +436,33 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+void Solver<Dtype>::SnapshotAsync() {
+  string model_filename, state_filename;
+  switch (param_.snapshot_format()) {
+  case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    model_filename = SnapshotFilename(".caffemodel");
+    state_filename = SnapshotFilename(".solverstate");
+    break;
+  case caffe::SolverParameter_SnapshotFormat_TENSORS:
+    model_filename = SnapshotFilename(".caffetensors");
+    state_filename = SnapshotFilename(".solverstate");
+    break;
+  default:
+    LOG(FATAL) << "Unsupported snapshot format.";
+  }
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(new SnapshotWriter<Dtype>());
+  }
+  SolverState state;
+  state.set_iter(iter_);
+  state.set_learned_net(model_filename);
+  state.set_current_step(current_step_);
+  snapshot_writer_->Write(*net_, *snapshot_history(), state,
+      param_.snapshot_format(), param_.snapshot_diff(), model_filename,
+      state_filename);
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -459,8 +505,19 @@ string Solver<Dtype>::SnapshotToHDF5() {
   return model_filename;
 }
 
+template <typename Dtype>
+string Solver<Dtype>::SnapshotToTensorFile() {
+  string model_filename = SnapshotFilename(".caffetensors");
+  LOG(INFO) << "Snapshotting to tensor file " << model_filename;
+  net_->ToTensorFile(model_filename);
+  return model_filename;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
   string state_filename(state_file);
   if (state_filename.size() >= 3 &&
       state_filename.compare(state_filename.size() - 3, 3, ".h5") == 0) {
@@ -107,6 +107,18 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  SolverUpdateArgs<Dtype> args = this->FusedUpdateArgs(param_id, rate);
+  args.history2 =
+      this->history_[net_params.size() + param_id]->mutable_cpu_data();
+  args.momentum = this->param_.momentum();
+  args.delta = this->param_.delta();
+  caffe_cpu_solver_update(SOLVER_UPDATE_ADADELTA,
+      net_params[param_id]->count(), args);
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
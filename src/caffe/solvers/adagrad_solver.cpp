@@ -64,6 +64,14 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate) {
+  SolverUpdateArgs<Dtype> args = this->FusedUpdateArgs(param_id, rate);
+  args.delta = this->param_.delta();
+  caffe_cpu_solver_update(SOLVER_UPDATE_ADAGRAD,
+      this->net_->learnable_params()[param_id]->count(), args);
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
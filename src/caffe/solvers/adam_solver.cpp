@@ -89,6 +89,25 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  SolverUpdateArgs<Dtype> args = this->FusedUpdateArgs(param_id, rate);
+  args.history2 =
+      this->history_[net_params.size() + param_id]->mutable_cpu_data();
+  args.rate *= correction;
+  args.momentum = beta1;
+  args.momentum2 = beta2;
+  args.delta = this->param_.delta();
+  caffe_cpu_solver_update(SOLVER_UPDATE_ADAM, net_params[param_id]->count(),
+      args);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
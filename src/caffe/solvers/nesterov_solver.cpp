@@ -56,6 +56,14 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate) {
+  SolverUpdateArgs<Dtype> args = this->FusedUpdateArgs(param_id, rate);
+  args.momentum = this->param_.momentum();
+  caffe_cpu_solver_update(SOLVER_UPDATE_NESTEROV,
+      this->net_->learnable_params()[param_id]->count(), args);
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -65,6 +65,15 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate) {
+  SolverUpdateArgs<Dtype> args = this->FusedUpdateArgs(param_id, rate);
+  args.momentum = this->param_.rms_decay();
+  args.delta = this->param_.delta();
+  caffe_cpu_solver_update(SOLVER_UPDATE_RMSPROP,
+      this->net_->learnable_params()[param_id]->count(), args);
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
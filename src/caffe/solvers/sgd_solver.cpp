@@ -106,6 +106,13 @@ void SGDSolver<Dtype>::ApplyUpdate() {
         << ", lr = " << rate;
   }
   ClipGradients();
+  if (fused_update()) {
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      ComputeFusedUpdate(param_id, rate);
+    }
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -115,6 +122,41 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+bool SGDSolver<Dtype>::fused_update() const {
+  // The GPU keeps its fused update kernels
+  return this->param_.fused_update() && Caffe::mode() != Caffe::GPU;
+}
+
+template <typename Dtype>
+SolverUpdateArgs<Dtype> SGDSolver<Dtype>::FusedUpdateArgs(int param_id,
+    Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  SolverUpdateArgs<Dtype> args;
+  args.data = param->mutable_cpu_data();
+  args.diff = param->mutable_cpu_diff();
+  args.history = history_[param_id]->mutable_cpu_data();
+  args.diff_scale = Dtype(1.) / this->param_.iter_size();
+  args.decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  if (args.decay && regularization_type != "L2") {
+    CHECK_EQ(regularization_type, "L1")
+        << "Unknown regularization type: " << regularization_type;
+    args.l1 = true;
+  }
+  args.rate = rate * this->net_->params_lr()[param_id];
+  return args;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeFusedUpdate(int param_id, Dtype rate) {
+  SolverUpdateArgs<Dtype> args = FusedUpdateArgs(param_id, rate);
+  args.momentum = this->param_.momentum();
+  caffe_cpu_solver_update(SOLVER_UPDATE_SGD,
+      this->net_->learnable_params()[param_id]->count(), args);
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -294,6 +336,7 @@ template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    case caffe::SolverParameter_SnapshotFormat_TENSORS:
       SnapshotSolverStateToBinaryProto(model_filename);
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
@@ -329,6 +372,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -356,9 +400,8 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
   ReadProtoFromBinaryFile(state_file, &state);
   this->iter_ = state.iter();
   if (state.has_learned_net()) {
-    NetParameter net_param;
-    ReadNetParamsFromBinaryFileOrDie(state.learned_net().c_str(), &net_param);
-    this->net_->CopyTrainedLayersFrom(net_param);
+    // A binary proto or, with the TENSORS format, a tensor file
+    this->net_->CopyTrainedLayersFrom(state.learned_net());
   }
   this->current_step_ = state.current_step();
   CHECK_EQ(state.history_size(), history_.size())
@@ -371,6 +414,7 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
 
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
@@ -44,27 +44,23 @@ SyncedMemory::~SyncedMemory() {
 #endif
 }
 
-inline void SyncedMemory::to_cpu(size_t size) {
-  size_t tx_size_;
-  if (size != 0)
-    tx_size_ = size;
-  else
-    tx_size_ = size_;
+inline void SyncedMemory::to_cpu() {
   check_device();
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
-    caffe_memset(tx_size_, 0, cpu_ptr_);
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
     break;
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
+      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
       own_cpu_data_ = true;
     }
-    caffe_gpu_memcpy(tx_size_, gpu_ptr_, cpu_ptr_);
+    caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
+    Caffe::count_device_to_host(size_);
     head_ = SYNCED;
 #else
     NO_GPU;
@@ -73,11 +69,12 @@ inline void SyncedMemory::to_cpu(size_t size) {
   case HEAD_AT_OCL:
 #ifdef USE_OCL
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
+      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
       own_cpu_data_ = true;
     }
     clEnqueueReadBuffer(oclCommandQueue, (cl_mem)ocl_ptr_, CL_TRUE, 0,
-        tx_size_, cpu_ptr_, 0, NULL, NULL);
+        size_, cpu_ptr_, 0, NULL, NULL);
+    Caffe::count_device_to_host(size_);
     head_ = SYNCED;
 #else
     NO_OCL;
@@ -105,6 +102,7 @@ inline void SyncedMemory::to_gpu() {
       own_gpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
+    Caffe::count_host_to_device(size_);
     head_ = SYNCED;
     break;
   case HEAD_AT_GPU:
@@ -117,36 +115,31 @@ inline void SyncedMemory::to_gpu() {
 #endif
 }
 
-inline void SyncedMemory::to_ocl(int RW, size_t size) {
+inline void SyncedMemory::to_ocl(int RW) {
 #ifdef USE_OCL
-  size_t tx_size_;
-  if (size != 0)
-    tx_size_ = size;
-  else
-    tx_size_ = size_;
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, tx_size_, &cpu_malloc_use_cuda_);
-    caffe_memset(tx_size_, 0, cpu_ptr_);
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    caffe_memset(size_, 0, cpu_ptr_);
     own_cpu_data_ = true;
     ocl_ptr_ = reinterpret_cast<void *>(clCreateBuffer(oclContext,
-        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, tx_size_, cpu_ptr_, NULL));
-    if (RW)
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size_, cpu_ptr_, NULL));
+    if (RW) {
       clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
-          tx_size_, cpu_ptr_, 0, NULL, NULL);
+          size_, cpu_ptr_, 0, NULL, NULL);
+      Caffe::count_host_to_device(size_);
+    }
     head_ = HEAD_AT_OCL;
     break;
   case HEAD_AT_CPU:
     if (ocl_ptr_ == NULL) {
       ocl_ptr_ = reinterpret_cast<void *>(clCreateBuffer(oclContext,
-          CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, tx_size_, cpu_ptr_, NULL));
-      if (RW)
-        clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
-            tx_size_, cpu_ptr_, 0, NULL, NULL);
-    } else {
-      if (RW)
-        clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
-            tx_size_, cpu_ptr_, 0, NULL, NULL);
+          CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size_, cpu_ptr_, NULL));
+    }
+    if (RW) {
+      clEnqueueWriteBuffer(oclCommandQueue, (cl_mem) ocl_ptr_, CL_TRUE, 0,
+          size_, cpu_ptr_, 0, NULL, NULL);
+      Caffe::count_host_to_device(size_);
     }
     head_ = SYNCED;
     break;
@@ -161,13 +154,7 @@ inline void SyncedMemory::to_ocl(int RW, size_t size) {
 }
 
 const void* SyncedMemory::cpu_data() {
-  to_cpu(0);
-  return (const void*)cpu_ptr_;
-}
-
-const void* SyncedMemory::cpu_data(size_t size) {
-  check_device();
-  to_cpu(size);
+  to_cpu();
   return (const void*)cpu_ptr_;
 }
 
@@ -195,16 +182,7 @@ const void* SyncedMemory::gpu_data() {
 
 const void* SyncedMemory::ocl_data() {
 #ifdef USE_OCL
-  to_ocl(1, 0);
-  return (const void*)ocl_ptr_;
-#else
-  NO_OCL;
-#endif
-}
-
-const void* SyncedMemory::ocl_data(size_t size) {
-#ifdef USE_OCL
-  to_ocl(1, size);
+  to_ocl(1);
   return (const void*)ocl_ptr_;
 #else
   NO_OCL;
@@ -227,14 +205,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 }
 
 void* SyncedMemory::mutable_cpu_data() {
-  to_cpu(0);
-  head_ = HEAD_AT_CPU;
-  return cpu_ptr_;
-}
-
-void* SyncedMemory::mutable_cpu_data(size_t size) {
-  check_device();
-  to_cpu(size);
+  to_cpu();
   head_ = HEAD_AT_CPU;
   return cpu_ptr_;
 }
@@ -253,7 +224,7 @@ void* SyncedMemory::mutable_gpu_data() {
 
 void* SyncedMemory::mutable_ocl_data() {
 #ifdef USE_OCL
-  to_ocl(1, 0);
+  to_ocl(1);
   head_ = HEAD_AT_OCL;
   return ocl_ptr_;
 #else
@@ -263,17 +234,7 @@ void* SyncedMemory::mutable_ocl_data() {
 
 void* SyncedMemory::mutable_ocl_data(int RW) {
 #ifdef USE_OCL
-  to_ocl(RW, 0);
-  head_ = HEAD_AT_OCL;
-  return ocl_ptr_;
-#else
-  NO_OCL;
-#endif
-}
-
-void* SyncedMemory::mutable_ocl_data(int RW, size_t size) {
-#ifdef USE_OCL
-  to_ocl(RW, size);
+  to_ocl(RW);
   head_ = HEAD_AT_OCL;
   return ocl_ptr_;
 #else
@@ -292,11 +253,41 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   }
   const cudaMemcpyKind put = cudaMemcpyHostToDevice;
   CUDA_CHECK(cudaMemcpyAsync(gpu_ptr_, cpu_ptr_, size_, put, stream));
+  Caffe::count_host_to_device(size_);
   // Assume caller will synchronize on the stream before use
   head_ = SYNCED;
 }
 #endif
 
+#ifdef USE_OCL
+void SyncedMemory::async_ocl_push(const cl_command_queue& queue) {
+  CHECK(head_ == HEAD_AT_CPU);
+  if (ocl_ptr_ == NULL) {
+    ocl_ptr_ = reinterpret_cast<void *>(clCreateBuffer(oclContext,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size_, cpu_ptr_, NULL));
+  }
+  clEnqueueWriteBuffer(queue, (cl_mem) ocl_ptr_, CL_FALSE, 0, size_, cpu_ptr_,
+      0, NULL, NULL);
+  Caffe::count_host_to_device(size_);
+  // Assume caller will finish the queue before use
+  head_ = SYNCED;
+}
+
+void SyncedMemory::async_ocl_pull(const cl_command_queue& queue,
+    cl_event* event) {
+  CHECK(head_ == HEAD_AT_OCL);
+  if (cpu_ptr_ == NULL) {
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    own_cpu_data_ = true;
+  }
+  clEnqueueReadBuffer(queue, (cl_mem) ocl_ptr_, CL_FALSE, 0, size_, cpu_ptr_,
+      0, NULL, event);
+  Caffe::count_device_to_host(size_);
+  // Assume caller will wait for event before use
+  head_ = SYNCED;
+}
+#endif
+
 void SyncedMemory::check_device() {
 #ifndef CPU_ONLY
 #ifdef DEBUG
@@ -68,6 +68,25 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestStorage) {
+  EXPECT_EQ(this->blob_preshaped_->storage(), STORAGE_DTYPE);
+  EXPECT_EQ(this->blob_preshaped_->data()->size(),
+      120 * sizeof(TypeParam));
+  this->blob_preshaped_->set_storage(STORAGE_CPFP);
+  EXPECT_EQ(this->blob_preshaped_->count(), 120);
+  EXPECT_EQ(this->blob_preshaped_->element_size(), sizeof(cpfp));
+  EXPECT_EQ(this->blob_preshaped_->data()->size(), 120 * sizeof(cpfp));
+  EXPECT_EQ(this->blob_preshaped_->diff()->size(), 120 * sizeof(cpfp));
+  cpfp* data = this->blob_preshaped_->template mutable_cpu_data_as<cpfp>();
+  for (int i = 0; i < 120; ++i) {
+    data[i] = cpfp(-2.0f);
+  }
+  EXPECT_NEAR(this->blob_preshaped_->asum_data(), 240, 1e-5);
+  EXPECT_NEAR(this->blob_preshaped_->sumsq_data(), 480, 1e-5);
+  this->blob_preshaped_->set_storage(STORAGE_INT8);
+  EXPECT_EQ(this->blob_preshaped_->data()->size(), 120);
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
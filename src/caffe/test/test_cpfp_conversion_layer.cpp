@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/cpfp_conversion_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -56,8 +59,10 @@ TYPED_TEST(CPFPConversionLayerTest, TestForwardToCPFP) {
   layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
   layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
 
-  const cpfp* top_data =
-    reinterpret_cast<const cpfp *>(this->blob_top_->cpu_data());
+  EXPECT_EQ(this->blob_top_->storage(), STORAGE_CPFP);
+  EXPECT_EQ(this->blob_top_->data()->size(),
+      sizeof(cpfp) * this->blob_top_->count());
+  const cpfp* top_data = this->blob_top_->template cpu_data_as<cpfp>();
   const Dtype* bottom_data = this->blob_bottom_->cpu_data();
 
   for (int i = 0; i < this->blob_top_->count(); ++i) {
@@ -88,8 +93,8 @@ TYPED_TEST(CPFPConversionLayerTest, TestForwardToFloat) {
   layer_to_float->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
   layer_to_float->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
 
-  const cpfp* bottom_data =
-    reinterpret_cast<const cpfp *>(this->blob_top_->cpu_data());
+  EXPECT_EQ(this->blob_top_2_->storage(), STORAGE_DTYPE);
+  const cpfp* bottom_data = this->blob_top_->template cpu_data_as<cpfp>();
   const Dtype* top_data = this->blob_top_2_->cpu_data();
 
   for (int i = 0; i < this->blob_top_->count(); ++i) {
@@ -97,4 +102,79 @@ TYPED_TEST(CPFPConversionLayerTest, TestForwardToFloat) {
   }
 }
 
+TYPED_TEST(CPFPConversionLayerTest, TestExpBias) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Far below the smallest normal of the shared exponent range
+  caffe_scal(this->blob_bottom_->count(), Dtype(1e-12),
+      this->blob_bottom_->mutable_cpu_data());
+  LayerParameter layer_param;
+  CPFPConversionParameter* cpfp_conversion_param =
+      layer_param.mutable_cpfp_conversion_param();
+  cpfp_conversion_param->set_exp_bias(-40);
+  shared_ptr<Layer<Dtype> > layer(
+      new CPFPConversionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(-40, this->blob_top_->data_exp_bias());
+
+  this->blob_bottom_vec_.clear();
+  this->blob_top_vec_.clear();
+  this->blob_bottom_vec_.push_back(this->blob_top_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  cpfp_conversion_param->set_convert_to(false);
+  shared_ptr<Layer<Dtype> > layer_to_float(
+      new CPFPConversionLayer<Dtype>(layer_param));
+  layer_to_float->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_to_float->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_2_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    // Within half a unit in the last place of the 5 bit mantissa
+    EXPECT_NEAR(bottom_data[i], top_data[i],
+        std::fabs(bottom_data[i]) / 64 + 1e-30);
+  }
+}
+
+TYPED_TEST(CPFPConversionLayerTest, TestCalibrate) {
+  typedef typename TypeParam::Dtype Dtype;
+  caffe_scal(this->blob_bottom_->count(), Dtype(1e12),
+      this->blob_bottom_->mutable_cpu_data());
+  LayerParameter layer_param;
+  CPFPConversionParameter* cpfp_conversion_param =
+      layer_param.mutable_cpfp_conversion_param();
+  cpfp_conversion_param->set_calibrate(true);
+  shared_ptr<Layer<Dtype> > layer(
+      new CPFPConversionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  const int exp_bias = this->blob_top_->data_exp_bias();
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const cpfp* top_data = this->blob_top_->template cpu_data_as<cpfp>();
+  float largest = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    largest = std::max(largest, std::fabs(float(top_data[i])));
+    EXPECT_NEAR(bottom_data[i], cpfp2float(top_data[i], exp_bias),
+        std::fabs(bottom_data[i]) / 64);
+  }
+  // The largest magnitude lands in [1, 2]
+  EXPECT_GE(largest, 1);
+  EXPECT_LE(largest, 2);
+
+  // The diffs going back to Dtype are converted with the top's diff bias
+  this->blob_top_->set_diff_exp_bias(-20);
+  cpfp* top_diff = this->blob_top_->template mutable_cpu_diff_as<cpfp>();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    top_diff[i] = cpfp(1.5f);
+  }
+  vector<bool> propagate_down(1, true);
+  layer->Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  const Dtype* bottom_diff = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(Dtype(std::ldexp(1.5f, -20)), bottom_diff[i]);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,257 @@
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "fpga_caffe/cpfp.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CPFPEmulationTest : public ::testing::Test {
+ protected:
+  static const uint32 kValues = 1 << FP_WIDTH;
+
+  static uint32 exponent(uint32 value) {
+    return (value >> EXP_SHIFT) & MAX_EXP;
+  }
+
+  // Rounds value to cpfp, to nearest even or towards zero, with results
+  // below the smallest exponent flushed to zero and above the largest
+  // saturated. This is the arithmetic the datapath implements, written
+  // independently of it.
+  static uint32 Round(double value, bool nearest) {
+    const uint32 sign = std::signbit(value) ? SIGN_MASK : 0;
+    int exp;
+    const double frac = std::frexp(std::fabs(value), &exp);
+    if (frac == 0) {
+      return sign;
+    }
+    // frac is in [0.5, 1), so mant holds the hidden bit at MANT_SIZE
+    double mant = std::floor(std::ldexp(frac, MANT_SIZE + 1));
+    const double rest = std::ldexp(frac, MANT_SIZE + 1) - mant;
+    if (nearest && (rest > 0.5 ||
+        (rest == 0.5 && static_cast<uint32>(mant) % 2))) {
+      mant += 1;
+    }
+    if (mant == 2 * MANT_NORM) {
+      mant = MANT_NORM;
+      ++exp;
+    }
+    const int biased = exp - 1 + EXP_OFFSET;
+    if (biased >= MAX_EXP) {
+      return sign | ((MAX_EXP - 1) << EXP_SHIFT) | MAX_MANT;
+    } else if (biased <= 0) {
+      return sign;
+    }
+    return sign | (biased << EXP_SHIFT) |
+        (static_cast<uint32>(mant) & MANT_MASK);
+  }
+};
+
+TEST_F(CPFPEmulationTest, TestMultTruncates) {
+  for (uint32 a = 0; a < kValues; ++a) {
+    for (uint32 b = 0; b < kValues; ++b) {
+      uint32 expected = (a ^ b) & SIGN_MASK;
+      if (exponent(a) && exponent(b)) {
+        expected = Round(double(cpfp2float(a)) * cpfp2float(b), false);
+      }
+      ASSERT_EQ(expected, cpfp_emu_mult(a, b)) << a << " * " << b;
+    }
+  }
+}
+
+TEST_F(CPFPEmulationTest, TestMult2_1) {
+  for (uint32 t1 = 0; t1 < kValues; ++t1) {
+    for (uint32 u = 0; u < kValues; u += 7) {
+      const uint32 t2 = (t1 * 13 + u) % kValues;
+      uint32 o1, o2;
+      cpfp_emu_mult2_1(t1, t2, u, &o1, &o2);
+      ASSERT_EQ(cpfp_emu_mult(t1, u), o1);
+      ASSERT_EQ(cpfp_emu_mult(t2, u), o2);
+    }
+  }
+}
+
+TEST_F(CPFPEmulationTest, TestAdd) {
+  for (uint32 a = 0; a < kValues; ++a) {
+    for (uint32 b = 0; b < kValues; ++b) {
+      if (exponent(a) == MAX_EXP || exponent(b) == MAX_EXP) {
+        continue;
+      }
+      const double sum = double(cpfp2float(a)) + cpfp2float(b);
+      const uint32 result = cpfp_emu_add(a, b);
+      if (sum == 0) {
+        EXPECT_EQ(0u, result & ~SIGN_MASK);
+        continue;
+      }
+      // The far path, taken for additions and for subtractions whose
+      // exponents differ by more than 1, rounds to nearest. The close path
+      // keeps one bit below the mantissa and truncates it.
+      const int diff = int(exponent(a)) - int(exponent(b));
+      const bool far = ((a ^ b) & SIGN_MASK) == 0 || diff > 1 || diff < -1;
+      ASSERT_EQ(Round(sum, far), result) << a << " + " << b;
+    }
+  }
+}
+
+TEST_F(CPFPEmulationTest, TestSpecialValues) {
+  const uint32 one = cpfp(1.0f);
+  const uint32 largest = ((MAX_EXP - 1) << EXP_SHIFT) | MAX_MANT;
+  const uint32 smallest = 1 << EXP_SHIFT;
+  // Products and sums past the largest exponent saturate
+  EXPECT_EQ(largest, cpfp_emu_mult(largest, cpfp(2.0f)));
+  EXPECT_EQ(largest, cpfp_emu_add(largest, largest));
+  EXPECT_EQ(largest | SIGN_MASK,
+      cpfp_emu_add(largest | SIGN_MASK, largest | SIGN_MASK));
+  // Products and differences below the smallest exponent flush to zero
+  EXPECT_EQ(0u, cpfp_emu_mult(smallest, cpfp(0.5f)));
+  EXPECT_EQ(0u, cpfp_emu_sub(smallest | 1, smallest));
+  // Zero keeps the sign of the product
+  EXPECT_EQ(SIGN_MASK, cpfp_emu_mult(0, one | SIGN_MASK));
+  EXPECT_EQ(one, cpfp_emu_add(one, 0));
+  EXPECT_EQ(0u, cpfp_emu_sub(one, one));
+}
+
+TEST_F(CPFPEmulationTest, TestMaxAndRelu) {
+  for (uint32 a = 0; a < kValues; ++a) {
+    for (uint32 b = 0; b < kValues; b += 3) {
+      const uint32 expected = (cpfp(a) < cpfp(b)) ? b : a;
+      ASSERT_EQ(expected, cpfp_emu_max(a, b));
+    }
+    EXPECT_EQ((a & SIGN_MASK) ? 0 : a, cpfp_emu_relu(a));
+  }
+  // -0 orders below +0
+  EXPECT_EQ(0u, cpfp_emu_max(SIGN_MASK, 0));
+  EXPECT_EQ(0u, cpfp_emu_max(0, SIGN_MASK));
+}
+
+TEST_F(CPFPEmulationTest, TestHostOperators) {
+  for (uint32 a = 0; a < kValues; a += 5) {
+    for (uint32 b = 0; b < kValues; b += 3) {
+      EXPECT_EQ(cpfp_emu_mult(a, b), uint32(cpfp(a) * cpfp(b)));
+      EXPECT_EQ(cpfp_emu_add(a, b), uint32(cpfp(a) + cpfp(b)));
+      EXPECT_EQ(cpfp_emu_sub(a, b), uint32(cpfp(a) - cpfp(b)));
+      cpfp o1, o2;
+      mult2_1(cpfp(a), cpfp(b), cpfp(b), &o1, &o2);
+      EXPECT_EQ(cpfp_emu_mult(a, b), uint32(o1));
+      EXPECT_EQ(cpfp_emu_mult(b, b), uint32(o2));
+    }
+  }
+}
+
+TEST_F(CPFPEmulationTest, TestExpShift) {
+  for (uint32 a = 0; a < kValues; ++a) {
+    if (exponent(a) == MAX_EXP) {
+      continue;
+    }
+    for (int shift = -MAX_EXP; shift <= MAX_EXP; ++shift) {
+      // Exact, so rounding only matters for the flush to zero
+      uint32 expected = Round(std::ldexp(double(cpfp2float(a)), shift),
+          false);
+      if (exponent(a) == 0) {
+        expected = a & SIGN_MASK;
+      }
+      ASSERT_EQ(expected, uint32(exp_shift(cpfp(a), shift)))
+          << a << " << " << shift;
+    }
+  }
+}
+
+TEST_F(CPFPEmulationTest, TestExpBias) {
+  for (uint32 a = 0; a < kValues; ++a) {
+    // Only the zeros without mantissa bits convert back to themselves
+    if (exponent(a) == MAX_EXP || (exponent(a) == 0 && (a & MANT_MASK))) {
+      continue;
+    }
+    for (int bias = -CPFP_MAX_EXP_BIAS; bias <= CPFP_MAX_EXP_BIAS; ++bias) {
+      const float value = cpfp2float(a, bias);
+      ASSERT_EQ(std::ldexp(cpfp2float(a), bias), value);
+      ASSERT_EQ(a, float2cpfp(value, bias)) << a << " bias " << bias;
+    }
+  }
+  // Zeros stay zero whatever the bias
+  EXPECT_EQ(0u, float2cpfp(0.f, -CPFP_MAX_EXP_BIAS));
+  EXPECT_EQ(uint32(SIGN_MASK), float2cpfp(-0.f, -CPFP_MAX_EXP_BIAS));
+  EXPECT_EQ(float2cpfp(std::ldexp(0.75f, 30)),
+      float2cpfp(std::ldexp(0.75f, 50), 20));
+}
+
+TEST_F(CPFPEmulationTest, TestLanes) {
+  uint16 a[16], b[16], out[16];
+  for (int i = 0; i < 1000; ++i) {
+    for (int j = 0; j < 16; ++j) {
+      a[j] = caffe_rng_rand() % kValues;
+      b[j] = caffe_rng_rand() % kValues;
+    }
+    cpfp16_emu_mult(a, b, out);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(cpfp_emu_mult(a[j], b[j]), out[j]);
+    }
+    cpfp16_emu_add(a, b, out);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(cpfp_emu_add(a[j], b[j]), out[j]);
+    }
+    cpfp16_emu_max(a, b, out);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(cpfp_emu_max(a[j], b[j]), out[j]);
+    }
+    cpfp16_emu_relu(a, out);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(cpfp_emu_relu(a[j]), out[j]);
+    }
+  }
+}
+
+TEST_F(CPFPEmulationTest, TestAdderTrees) {
+  uint16 in[4][16], weights[4][16], acc[16], out[16];
+  for (int i = 0; i < 100; ++i) {
+    for (int m = 0; m < 4; ++m) {
+      for (int j = 0; j < 16; ++j) {
+        in[m][j] = cpfp(static_cast<float>(caffe_rng_rand() % 2001) / 1000 -
+            1);
+        weights[m][j] = cpfp(static_cast<float>(caffe_rng_rand() % 2001) /
+            1000 - 1);
+      }
+    }
+    for (int j = 0; j < 16; ++j) {
+      acc[j] = in[0][(j + 1) % 16];
+    }
+    // Forward: the four products of a lane are summed in pairs, then added
+    // to the accumulator
+    uint16 expected[16];
+    for (int j = 0; j < 16; ++j) {
+      uint32 products[4];
+      for (int m = 0; m < 4; ++m) {
+        products[m] = cpfp_emu_mult(in[m][j], weights[m][j]);
+      }
+      expected[j] = cpfp_emu_add(acc[j], cpfp_emu_add(
+          cpfp_emu_add(products[0], products[1]),
+          cpfp_emu_add(products[2], products[3])));
+    }
+    cpfp16_emu_add_tree4(in, out);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(cpfp_emu_add(cpfp_emu_add(in[0][j], in[1][j]),
+          cpfp_emu_add(in[2][j], in[3][j])), out[j]);
+    }
+    cpfp16_emu_fw_mac(in, weights, acc);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(expected[j], acc[j]);
+    }
+    // Backward: the 16 lanes are summed with their neighbours, four times
+    uint32 level[16];
+    for (int j = 0; j < 16; ++j) {
+      level[j] = in[0][j];
+    }
+    for (int width = 8; width >= 1; width /= 2) {
+      for (int j = 0; j < width; ++j) {
+        level[j] = cpfp_emu_add(level[j * 2], level[j * 2 + 1]);
+      }
+    }
+    EXPECT_EQ(level[0], cpfp_emu_add_tree16(in[0]));
+  }
+}
+
+}  // namespace caffe
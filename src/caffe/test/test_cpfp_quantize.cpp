@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpfp_quantize.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CPFPQuantizeTest : public ::testing::Test {
+ protected:
+  CPFPQuantizeTest() : values_(10000) {
+    // Magnitudes from far below the smallest cpfp normal to far above the
+    // largest
+    caffe_rng_uniform<float>(values_.size(), -1, 1, &values_[0]);
+    for (int i = 0; i < values_.size(); ++i) {
+      values_[i] = std::ldexp(values_[i], i % 96 - 48);
+    }
+    values_[0] = 0;
+    values_[1] = -0.f;
+  }
+
+  static uint32_t bits(const float value) {
+    uint32_t out;
+    memcpy(&out, &value, sizeof(out));
+    return out;
+  }
+
+  vector<float> values_;
+};
+
+TEST_F(CPFPQuantizeTest, TestMatchesCPFP) {
+  vector<float> quantized(values_);
+  cpfp_quantize(quantized.size(), EXP_SIZE, MANT_SIZE, true, &quantized[0]);
+  for (int i = 0; i < values_.size(); ++i) {
+    EXPECT_EQ(bits(cpfp2float(float2cpfp(values_[i]))), bits(quantized[i]))
+        << values_[i];
+  }
+}
+
+TEST_F(CPFPQuantizeTest, TestTruncates) {
+  vector<float> quantized(values_);
+  cpfp_quantize(quantized.size(), 5, 7, false, &quantized[0]);
+  const float largest = std::ldexp(2 - std::ldexp(1.f, -7), 15);
+  for (int i = 0; i < values_.size(); ++i) {
+    const float magnitude = std::fabs(values_[i]);
+    if (magnitude < std::ldexp(1.f, -14)) {
+      EXPECT_EQ(0, quantized[i]);
+    } else if (magnitude >= largest) {
+      EXPECT_EQ(largest, std::fabs(quantized[i]));
+    } else {
+      // Within one unit in the last place, towards zero
+      EXPECT_LE(std::fabs(quantized[i]), magnitude);
+      EXPECT_GT(std::fabs(quantized[i]), magnitude * (1 - std::ldexp(1.f,
+          -7)));
+    }
+    EXPECT_EQ(std::signbit(values_[i]), std::signbit(quantized[i]));
+  }
+}
+
+TEST_F(CPFPQuantizeTest, TestIdempotent) {
+  vector<float> once(values_);
+  cpfp_quantize(once.size(), 4, 3, true, &once[0]);
+  vector<float> twice(once);
+  cpfp_quantize(twice.size(), 4, 3, true, &twice[0]);
+  for (int i = 0; i < once.size(); ++i) {
+    EXPECT_EQ(bits(once[i]), bits(twice[i]));
+  }
+}
+
+TEST_F(CPFPQuantizeTest, TestSingleFormat) {
+  // 8 exponent and 23 mantissa bits keep every normal float
+  vector<float> quantized(values_);
+  cpfp_quantize(quantized.size(), 8, 23, true, &quantized[0]);
+  for (int i = 0; i < values_.size(); ++i) {
+    EXPECT_EQ(bits(values_[i]), bits(quantized[i]));
+  }
+}
+
+TEST_F(CPFPQuantizeTest, TestDouble) {
+  vector<double> quantized(values_.begin(), values_.end());
+  cpfp_quantize(quantized.size(), EXP_SIZE, MANT_SIZE, true, &quantized[0]);
+  for (int i = 0; i < values_.size(); ++i) {
+    EXPECT_EQ(cpfp2float(float2cpfp(values_[i])), quantized[i]);
+  }
+}
+
+TEST_F(CPFPQuantizeTest, TestCalibrateExpBias) {
+  vector<float> x(3);
+  x[0] = 0.1f;
+  x[1] = -3000.f;
+  x[2] = 7.f;
+  // 3000 is in [2^11, 2^12)
+  EXPECT_EQ(11, cpfp_calibrate_exp_bias(x.size(), &x[0], 0));
+  EXPECT_EQ(1, cpfp_calibrate_exp_bias(x.size(), &x[0], 10));
+  // A target of EXP_OFFSET puts the largest magnitude in the top binade,
+  // rounded but not saturated
+  const int bias = cpfp_calibrate_exp_bias(x.size(), &x[0], EXP_OFFSET);
+  const uint32_t largest = float2cpfp(x[1], bias);
+  EXPECT_EQ(MAX_EXP - 1, (largest >> EXP_SHIFT) & MAX_EXP);
+  EXPECT_EQ(-3008.f, cpfp2float(largest, bias));
+  vector<float> zeros(4, 0);
+  EXPECT_EQ(0, cpfp_calibrate_exp_bias(zeros.size(), &zeros[0], 0));
+  x[2] = 1e-30f;
+  x[1] = 1e-30f;
+  x[0] = 1e-30f;
+  EXPECT_EQ(-CPFP_MAX_EXP_BIAS, cpfp_calibrate_exp_bias(x.size(), &x[0],
+      0));
+}
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -9,8 +10,10 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/data_layer.hpp"
+#include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -39,14 +42,27 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
 
   // Fill the DB with data: if unique_pixels, each pixel is unique but
   // all images are the same; else each image is unique but all pixels within
-  // an image are the same.
-  void Fill(const bool unique_pixels, DataParameter_DB backend) {
+  // an image are the same. With several shards, item i goes to shard
+  // i % shards and the source becomes the list of the shards.
+  void Fill(const bool unique_pixels, DataParameter_DB backend,
+      int shards = 1) {
     backend_ = backend;
-    LOG(INFO) << "Using temporary dataset " << *filename_;
+    string source;
+    for (int s = 0; s < shards; ++s) {
+      const string shard = *filename_ + (shards > 1 ? format_int(s) : "");
+      source += (s > 0 ? "," : "") + shard;
+      FillShard(unique_pixels, backend, shard, s, shards);
+    }
+    *filename_ = source;
+  }
+
+  void FillShard(const bool unique_pixels, DataParameter_DB backend,
+      const string& filename, int shard, int shards) {
+    LOG(INFO) << "Using temporary dataset " << filename;
     scoped_ptr<db::DB> db(db::GetDB(backend));
-    db->Open(*filename_, db::NEW);
+    db->Open(filename, db::NEW);
     scoped_ptr<db::Transaction> txn(db->NewTransaction());
-    for (int i = 0; i < 5; ++i) {
+    for (int i = shard; i < 5; i += shards) {
       Datum datum;
       datum.set_label(i);
       datum.set_channels(2);
@@ -67,7 +83,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  void TestRead(int decode_threads = 1) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +91,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -105,6 +122,98 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  void TestReadStaged() {
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_stage_hwcn(true);
+    data_param->set_stage_pad_to(4);
+    data_param->set_stage_cpfp(true);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->storage(), STORAGE_CPFP);
+    EXPECT_EQ(blob_top_data_->shape(0), 3);
+    EXPECT_EQ(blob_top_data_->shape(1), 4);
+    EXPECT_EQ(blob_top_data_->shape(2), 4);
+    EXPECT_EQ(blob_top_data_->shape(3), 5);
+
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      }
+      const cpfp* data = blob_top_data_->template cpu_data_as<cpfp>();
+      for (int h = 0; h < 3; ++h) {
+        for (int w = 0; w < 4; ++w) {
+          for (int c = 0; c < 4; ++c) {
+            for (int n = 0; n < 5; ++n) {
+              // Every image holds its pixel index; padded channels are zero
+              const float expected = c < 2 ? (c * 3 + h) * 4 + w : 0;
+              EXPECT_EQ(expected, float(data[((h * 4 + w) * 4 + c) * 5 + n]))
+                  << "debug: iter " << iter << " h " << h << " w " << w
+                  << " c " << c << " n " << n;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void TestPipelinedStaged() {
+    // A pipelined net splits the staged HWCN batches along their last axis
+    NetParameter param;
+    param.mutable_state()->set_phase(TEST);
+    LayerParameter* data = param.add_layer();
+    data->set_name("data");
+    data->set_type("Data");
+    data->add_top("data");
+    data->add_top("label");
+    DataParameter* data_param = data->mutable_data_param();
+    data_param->set_batch_size(4);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_stage_hwcn(true);
+    LayerParameter* nchw = param.add_layer();
+    nchw->set_name("nchw");
+    nchw->set_type("HWCN");
+    nchw->add_bottom("data");
+    nchw->add_top("nchw");
+    nchw->mutable_hwcn_param()->set_convert_to(false);
+    // The labels of three batches, read before the pipelined net opens the
+    // database
+    vector<Dtype> labels;
+    {
+      Net<Dtype> net(param);
+      for (int iter = 0; iter < 3; ++iter) {
+        net.Forward();
+        const Blob<Dtype>* label = net.blob_by_name("label").get();
+        labels.insert(labels.end(), label->cpu_data(),
+            label->cpu_data() + label->count());
+      }
+    }
+    param.set_micro_batch_size(2);
+    Net<Dtype> pipelined_net(param);
+    for (int iter = 0; iter < 3; ++iter) {
+      pipelined_net.Forward();
+      const Blob<Dtype>* label = pipelined_net.blob_by_name("label").get();
+      const Blob<Dtype>* images = pipelined_net.blob_by_name("nchw").get();
+      ASSERT_EQ(4, images->shape(0));
+      ASSERT_EQ(24, images->count(1));
+      for (int n = 0; n < 4; ++n) {
+        EXPECT_EQ(labels[iter * 4 + n], label->cpu_data()[n]);
+        // All pixels of an image hold its label
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label->cpu_data()[n], images->cpu_data()[n * 24 + j])
+              << "debug: iter " << iter << " n " << n << " j " << j;
+        }
+      }
+    }
+  }
+
   void TestSkip() {
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -131,6 +240,73 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  // Reads epochs of the shuffled source one item at a time, as solver rank
+  // of size, into labels.
+  void ReadShuffled(int rank, int size, int epochs, vector<int>* labels) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(1);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    Caffe::set_solver_count(size);
+    Caffe::set_solver_rank(rank);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    // Rank r of the size solvers gets every size-th of the 5 items
+    const int epoch_size = (5 - rank + size - 1) / size;
+    labels->clear();
+    for (int iter = 0; iter < epochs * epoch_size; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      labels->push_back(blob_top_label_->cpu_data()[0]);
+    }
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+  }
+
+  void TestShuffle() {
+    const int epochs = 10;
+    vector<int> labels, repeated;
+    ReadShuffled(0, 1, epochs, &labels);
+    ReadShuffled(0, 1, epochs, &repeated);
+    // The same seed gives the same orders
+    EXPECT_TRUE(labels == repeated);
+    // Every epoch visits every item once, not always in the same order
+    bool reordered = false;
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+      vector<int> epoch_labels(labels.begin() + epoch * 5,
+          labels.begin() + (epoch + 1) * 5);
+      reordered |= !std::equal(epoch_labels.begin(), epoch_labels.end(),
+          labels.begin());
+      std::sort(epoch_labels.begin(), epoch_labels.end());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, epoch_labels[i]) << "debug: epoch " << epoch;
+      }
+    }
+    EXPECT_TRUE(reordered);
+  }
+
+  void TestPartition() {
+    const int epochs = 4;
+    vector<int> labels[2];
+    ReadShuffled(0, 2, epochs, &labels[0]);
+    ReadShuffled(1, 2, epochs, &labels[1]);
+    ASSERT_EQ(labels[0].size(), epochs * 3);
+    ASSERT_EQ(labels[1].size(), epochs * 2);
+    // The two solvers split every epoch between them
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+      vector<int> epoch_labels(labels[0].begin() + epoch * 3,
+          labels[0].begin() + (epoch + 1) * 3);
+      epoch_labels.insert(epoch_labels.end(), labels[1].begin() + epoch * 2,
+          labels[1].begin() + (epoch + 1) * 2);
+      std::sort(epoch_labels.begin(), epoch_labels.end());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, epoch_labels[i]) << "debug: epoch " << epoch;
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -250,13 +426,14 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
-  void TestReadCropTrainSequenceSeeded() {
+  void TestReadCropTrainSequenceSeeded(int decode_threads = 1) {
     LayerParameter param;
     param.set_phase(TRAIN);
     DataParameter* data_param = param.mutable_data_param();
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -382,11 +559,40 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadParallelLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead(3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadStagedLevelDB) {
+  if (Caffe::mode() == Caffe::GPU) {
+    return;  // Batches are only staged for the CPU and OCL devices
+  }
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadStaged();
+}
+
+TYPED_TEST(DataLayerTest, TestPipelinedStagedLevelDB) {
+  if (Caffe::mode() == Caffe::GPU) {
+    return;  // Batches are only staged for the CPU and OCL devices
+  }
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestPipelinedStaged();
+}
+
 TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->Fill(false, DataParameter_DB_LEVELDB);
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -405,6 +611,14 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededLevelDB) {
   this->TestReadCropTrainSequenceSeeded();
 }
 
+// Test that the crops stay consistent under Caffe::set_random_seed when
+// several threads decode each batch.
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededParallelLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadCropTrainSequenceSeeded(3);
+}
+
 // Test that the sequence of random crops differs across iterations when
 // Caffe::set_random_seed isn't called (and seeds from srand are ignored).
 TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceUnseededLevelDB) {
@@ -432,6 +646,22 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB, 2);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleShardedLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB, 2);
+  this->TestShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestPartitionShardedLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB, 2);
+  this->TestPartition();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -8,10 +8,13 @@
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -19,6 +22,68 @@ using std::ostringstream;
 
 namespace caffe {
 
+// An InnerProduct layer that, with async_param_diffs, leaves its parameter
+// diffs as they were in Backward and sums the gradients on the side until
+// SyncParamDiffs, as a device layer would. A solver that reads the diffs
+// before syncing them sees only what the earlier iterations left there.
+template <typename Dtype>
+class DeferredInnerProductLayer : public InnerProductLayer<Dtype> {
+ public:
+  explicit DeferredInnerProductLayer(const LayerParameter& param)
+      : InnerProductLayer<Dtype>(param), pending_passes_(0) {}
+  virtual inline const char* type() const { return "DeferredInnerProduct"; }
+
+  // Only touches the diffs if a Backward left gradients to add, as HostSync
+  // may be reducing them by the time the solver syncs the whole net.
+  virtual void SyncParamDiffs() {
+    if (pending_passes_ == 0) { return; }
+    pending_passes_ = 0;
+    for (int i = 0; i < pending_.size(); ++i) {
+      caffe_axpy(pending_[i]->count(), Dtype(1), pending_[i]->cpu_data(),
+          this->blobs_[i]->mutable_cpu_diff());
+      caffe_set(pending_[i]->count(), Dtype(0),
+          pending_[i]->mutable_cpu_data());
+    }
+  }
+
+ protected:
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
+    if (!this->async_param_diffs_) {
+      InnerProductLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+      return;
+    }
+    const int num_params = this->blobs_.size();
+    vector<shared_ptr<Blob<Dtype> > > diffs(num_params);
+    for (int i = 0; i < num_params; ++i) {
+      if (pending_.size() < num_params) {
+        pending_.push_back(shared_ptr<Blob<Dtype> >(
+            new Blob<Dtype>(this->blobs_[i]->shape())));
+      }
+      diffs[i].reset(new Blob<Dtype>(this->blobs_[i]->shape()));
+      caffe_copy(diffs[i]->count(), this->blobs_[i]->cpu_diff(),
+          diffs[i]->mutable_cpu_data());
+      caffe_set(diffs[i]->count(), Dtype(0),
+          this->blobs_[i]->mutable_cpu_diff());
+    }
+    InnerProductLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    // Move this pass's gradients to pending_ and restore the diffs
+    for (int i = 0; i < num_params; ++i) {
+      caffe_axpy(pending_[i]->count(), Dtype(1), this->blobs_[i]->cpu_diff(),
+          pending_[i]->mutable_cpu_data());
+      caffe_copy(diffs[i]->count(), diffs[i]->cpu_data(),
+          this->blobs_[i]->mutable_cpu_diff());
+    }
+    ++pending_passes_;
+  }
+
+  vector<shared_ptr<Blob<Dtype> > > pending_;
+  int pending_passes_;
+};
+
+REGISTER_LAYER_CLASS(DeferredInnerProduct);
+
 template <typename TypeParam>
 class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -26,7 +91,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), fused_update_(true), async_snapshot_(false),
+      snapshot_format_(SolverParameter_SnapshotFormat_BINARYPROTO),
+      inner_product_type_("InnerProduct") {
         input_file_ = new string(
         ABS_TEST_DATA_DIR "/solver_data_list.txt");
       }
@@ -39,11 +106,17 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
 #ifdef USE_NCCL
   shared_ptr<NCCL<Dtype> > nccl_;
 #endif
+  shared_ptr<HostSync<Dtype> > host_sync_;
   int seed_;
   // Dimensions are determined by generate_sample_data.py
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool fused_update_;
+  bool async_snapshot_;
+  SolverParameter::SnapshotFormat snapshot_format_;
+  // Type of the inner product layers of the least squares net
+  string inner_product_type_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -87,7 +160,12 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
        "lr_policy: 'fixed' "
        "iter_size: " << iter_size << " "
        "device_id: " << device_id << " "
-       "layer_wise_reduce: " << (!share_) << " "
+       "layer_wise_reduce: " << (!share_ || Caffe::mode() == Caffe::CPU)
+           << " "
+       "fused_update: " << fused_update_ << " "
+       "async_snapshot: " << async_snapshot_ << " "
+       "snapshot_format: "
+           << SolverParameter_SnapshotFormat_Name(snapshot_format_) << " "
        "net_param { "
        "  name: 'TestNetwork' "
        "  layer { "
@@ -116,7 +194,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     proto <<
        "  layer { "
        "    name: 'innerprod' "
-       "    type: 'InnerProduct' "
+       "    type: '" << inner_product_type_ << "' "
        "    param { name: 'weights' } "
        "    param { name: 'bias' } "
        "    inner_product_param { "
@@ -137,7 +215,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       proto <<
          "  layer { "
          "    name: 'innerprod2' "
-         "    type: 'InnerProduct' "
+         "    type: '" << inner_product_type_ << "' "
          "    param { name: 'weights' } "
          "    param { name: 'bias' } "
          "    inner_product_param { "
@@ -194,6 +272,12 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     }
     if (devices == 1) {
       this->solver_->Solve();
+    } else if (Caffe::mode() == Caffe::CPU) {
+      LOG(INFO) << "Multi-worker CPU test on " << devices << " workers";
+      Caffe::set_solver_count(devices);
+      this->host_sync_.reset(new HostSync<Dtype>(this->solver_));
+      this->host_sync_->Run(devices, from_snapshot);
+      Caffe::set_solver_count(1);
     } else {
       LOG(INFO) << "Multi-GPU test on " << devices << " devices";
       vector<int> gpus;
@@ -215,6 +299,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       ostringstream resume_file;
       resume_file << snapshot_prefix_ << "/_iter_" << num_iters
                   << ".solverstate";
+      if (snapshot_format_ == SolverParameter_SnapshotFormat_HDF5) {
+        resume_file << ".h5";
+      }
       string resume_filename = resume_file.str();
       return resume_filename;
     }
@@ -439,6 +526,93 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  void CheckDataParallel(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kIterSize) {
+    // Workers of HostSync only train in CPU mode
+    if (Caffe::mode() != Caffe::CPU) { return; }
+    const double kPrecision = 1e-4;
+    const double kMinPrecision = 1e-7;
+    const int kNum = num_;
+    for (int workers = 2; workers <= 3; ++workers) {
+      // Solve the whole batch on one worker and save parameters.
+      num_ = kNum * workers;
+      this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+          kNumIters, kIterSize);
+      vector<shared_ptr<Blob<Dtype> > > expected;
+      const vector<Blob<Dtype>*>& params =
+          solver_->net()->learnable_params();
+      for (int i = 0; i < params.size(); ++i) {
+        expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        expected.back()->CopyFrom(*params[i], false, true);
+      }
+      // Solve a share of the batch on each worker, averaging gradients.
+      num_ = kNum;
+      this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+          kNumIters, kIterSize, workers);
+      const vector<Blob<Dtype>*>& parallel_params =
+          solver_->net()->learnable_params();
+      ASSERT_EQ(expected.size(), parallel_params.size());
+      for (int i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(expected[i]->count(), parallel_params[i]->count());
+        for (int j = 0; j < expected[i]->count(); ++j) {
+          const Dtype expected_data = expected[i]->cpu_data()[j];
+          const Dtype error_margin = std::max(kMinPrecision, kPrecision *
+              std::fabs(expected_data));
+          EXPECT_NEAR(expected_data, parallel_params[i]->cpu_data()[j],
+              error_margin);
+        }
+      }
+    }
+  }
+
+  void CheckFusedUpdate(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kIterSize) {
+    const double kPrecision = 1e-4;
+    const double kMinPrecision = 1e-7;
+    // Solve with one pass per update step and save parameters and history.
+    this->fused_update_ = false;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, kIterSize);
+    vector<shared_ptr<Blob<Dtype> > > expected;
+    const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected.back()->CopyFrom(*params[i], false, true);
+      expected.back()->CopyFrom(*params[i], true, true);
+    }
+    for (int i = 0; i < solver_->history().size(); ++i) {
+      expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      expected.back()->CopyFrom(*solver_->history()[i], false, true);
+    }
+    // Solve again with the fused update and compare the parameters, their
+    // diffs (the last update values) and the history.
+    this->fused_update_ = true;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, kIterSize);
+    const vector<Blob<Dtype>*>& fused_params =
+        solver_->net()->learnable_params();
+    ASSERT_EQ(expected.size(),
+        fused_params.size() + solver_->history().size());
+    for (int i = 0; i < expected.size(); ++i) {
+      const bool is_param = i < fused_params.size();
+      const Blob<Dtype>& blob = is_param ? *fused_params[i] :
+          *solver_->history()[i - fused_params.size()];
+      ASSERT_EQ(expected[i]->count(), blob.count());
+      for (int j = 0; j < blob.count(); ++j) {
+        const Dtype expected_data = expected[i]->cpu_data()[j];
+        const Dtype error_margin = std::max(kMinPrecision, kPrecision *
+            std::fabs(expected_data));
+        EXPECT_NEAR(expected_data, blob.cpu_data()[j], error_margin);
+        if (is_param) {
+          const Dtype expected_diff = expected[i]->cpu_diff()[j];
+          const Dtype diff_margin = std::max(kMinPrecision, kPrecision *
+              std::fabs(expected_diff));
+          EXPECT_NEAR(expected_diff, blob.cpu_diff()[j], diff_margin);
+        }
+      }
+    }
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -684,6 +858,17 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestFusedUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -696,6 +881,78 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestDataParallel) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0;
+  const Dtype kMomentum = 0;
+  const int kNumIters = 4;
+  const int kIterSize = 1;
+  this->CheckDataParallel(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestDataParallelWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckDataParallel(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestDataParallelWithEverythingAccumShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->share_ = true;
+  this->CheckDataParallel(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestDeferredParamDiffs) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->inner_product_type_ = "DeferredInnerProduct";
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestDeferredParamDiffsAccumShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->inner_product_type_ = "DeferredInnerProduct";
+  this->share_ = true;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestDeferredParamDiffsDataParallel) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  // HostSync syncs the diffs of each bucket before reducing it
+  this->inner_product_type_ = "DeferredInnerProduct";
+  this->CheckDataParallel(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -707,6 +964,32 @@ TYPED_TEST(SGDSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestAsyncSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->async_snapshot_ = true;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestAsyncSnapshotHDF5) {
+  typedef typename TypeParam::Dtype Dtype;
+  // HDF5 snapshots fall back to being written on the solver thread
+  this->async_snapshot_ = true;
+  this->snapshot_format_ = SolverParameter_SnapshotFormat_HDF5;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -784,6 +1067,17 @@ TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdaGradSolverTest, TestFusedUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -918,6 +1212,17 @@ TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(NesterovSolverTest, TestFusedUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1047,6 +1352,17 @@ TYPED_TEST(AdaDeltaSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdaDeltaSolverTest, TestFusedUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.1;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.95;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaDeltaSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.1;
@@ -1149,6 +1465,17 @@ TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdamSolverTest, TestFusedUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1161,6 +1488,17 @@ TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdamSolverTest, TestDataParallelWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckDataParallel(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1172,6 +1510,18 @@ TYPED_TEST(AdamSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestAsyncSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->async_snapshot_ = true;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1252,6 +1602,17 @@ TYPED_TEST(RMSPropSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(RMSPropSolverTest, TestFusedUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(RMSPropSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
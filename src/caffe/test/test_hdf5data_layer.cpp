@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -162,4 +163,129 @@ TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   Caffe::set_solver_rank(0);
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestStream) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 3;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_stream(true);
+  hdf5_data_param->set_prefetch(2);
+  const int data_size = 8 * 6 * 5;
+
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), batch_size);
+  EXPECT_EQ(this->blob_top_data_->channels(), 8);
+  EXPECT_EQ(this->blob_top_label_->shape(0), batch_size);
+  EXPECT_EQ(this->blob_top_label_->shape(1), 1);
+
+  // Without shuffle, streaming reads the rows in the order loading whole
+  // files does: the 10 rows of each file, then back to the first file. Each
+  // file ends in a partial chunk, so batches straddle chunks and files.
+  for (int iter = 0; iter < 12; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i) {
+      const int row = (iter * batch_size + i) % 20;
+      const int file_offset = (row < 10) ? 0 : 2400;
+      EXPECT_EQ(1 + row % 10, this->blob_top_label_->cpu_data()[i]);
+      EXPECT_EQ(2 + row % 10, this->blob_top_label2_->cpu_data()[i]);
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(file_offset + (row % 10) * data_size + j,
+            this->blob_top_data_->cpu_data()[i * data_size + j])
+            << "debug: iter " << iter << " i " << i;
+      }
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestStreamShuffle) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_stream(true);
+  hdf5_data_param->set_shuffle(true);
+  const int data_size = 8 * 6 * 5;
+  vector<Blob<Dtype>*> top(this->blob_top_vec_.begin(),
+      this->blob_top_vec_.begin() + 2);
+
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, top);
+  // Batches line up with the chunks, so every epoch of 4 batches returns
+  // each chunk of 5 rows of each file once, its rows in some order
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    vector<int> seen(4, 0);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, top);
+      const int file_offset =
+          (this->blob_top_data_->cpu_data()[0] < 2400) ? 0 : 2400;
+      const int chunk = (this->blob_top_label_->cpu_data()[0] - 1) / 5;
+      vector<int> rows;
+      for (int i = 0; i < batch_size; ++i) {
+        const int row = this->blob_top_label_->cpu_data()[i] - 1;
+        EXPECT_EQ(chunk, row / 5);
+        rows.push_back(row);
+        for (int j = 0; j < data_size; ++j) {
+          EXPECT_EQ(file_offset + row * data_size + j,
+              this->blob_top_data_->cpu_data()[i * data_size + j]);
+        }
+      }
+      std::sort(rows.begin(), rows.end());
+      for (int i = 0; i < batch_size; ++i) {
+        EXPECT_EQ(chunk * 5 + i, rows[i]);
+      }
+      ++seen[(file_offset ? 2 : 0) + chunk];
+    }
+    for (int c = 0; c < 4; ++c) {
+      EXPECT_EQ(1, seen[c]) << "epoch " << epoch << " chunk " << c;
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestStreamShuffleSeeded) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 3;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_stream(true);
+  hdf5_data_param->set_shuffle(true);
+  vector<Blob<Dtype>*> top(this->blob_top_vec_.begin(),
+      this->blob_top_vec_.begin() + 2);
+
+  // The prefetch thread shuffles with the layer's own stream, so the same
+  // seed gives the same order of files, chunks and rows.
+  const int kNumIters = 14;
+  vector<vector<Dtype> > values(2);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(1701);
+    HDF5DataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, top);
+    for (int iter = 0; iter < kNumIters; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, top);
+      for (int i = 0; i < batch_size; ++i) {
+        values[run].push_back(this->blob_top_label_->cpu_data()[i]);
+        values[run].push_back(this->blob_top_data_->cpu_data()[
+            i * this->blob_top_data_->count(1)]);
+      }
+    }
+  }
+  EXPECT_TRUE(values[0] == values[1]);
+}
+
 }  // namespace caffe
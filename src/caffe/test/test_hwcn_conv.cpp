@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/hwcn_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Checks the direct HWCN engine against ConvolutionLayer on the same values
+// in NCHW order.
+template <typename Dtype>
+class HWCNConvTest : public ::testing::Test {
+ protected:
+  HWCNConvTest()
+      : blob_bottom_(new Blob<Dtype>(5, 6, 7, 6)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~HWCNConvTest() {
+    caffe_set_cpu_threads(1);
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Sets up a ConvolutionLayer with 10 outputs in 2 groups, so each group has
+  // a full block of four output channels and a remainder of one
+  void SetUpReference(const int kernel, const int stride, const int pad,
+      const int dilation) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kernel);
+    convolution_param->add_stride(stride);
+    convolution_param->add_pad(pad);
+    convolution_param->add_dilation(dilation);
+    convolution_param->set_num_output(10);
+    convolution_param->set_group(2);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    layer_.reset(new ConvolutionLayer<Dtype>(layer_param));
+    layer_->SetUp(blob_bottom_vec_, blob_top_vec_);
+
+    params_ = kernel_params();
+    params_.ydim = blob_bottom_->height();
+    params_.xdim = blob_bottom_->width();
+    params_.inchannels = blob_bottom_->channels() / 2;
+    params_.outchannels = 5;
+    params_.numimages = blob_bottom_->num();
+    params_.numgroups = 2;
+    params_.ksize = params_.ksize_w = kernel;
+    params_.stride = params_.stride_w = stride;
+    params_.pad = params_.pad_w = pad;
+    params_.dilation_h = params_.dilation_w = dilation;
+  }
+
+  // Copies an N x C x H x W blob into an H x W x C x N array
+  void ToHWCN(const Blob<Dtype>& blob, const Dtype* nchw, vector<Dtype>* hwcn) {
+    const int N = blob.num(), C = blob.channels();
+    const int H = blob.height(), W = blob.width();
+    hwcn->resize(blob.count());
+    for (int n = 0; n < N; ++n)
+      for (int c = 0; c < C; ++c)
+        for (int h = 0; h < H; ++h)
+          for (int w = 0; w < W; ++w)
+            (*hwcn)[((h * W + w) * C + c) * N + n] =
+                nchw[((n * C + c) * H + h) * W + w];
+  }
+
+  void CheckHWCN(const Blob<Dtype>& blob, const Dtype* nchw,
+      const vector<Dtype>& hwcn) {
+    vector<Dtype> expected;
+    ToHWCN(blob, nchw, &expected);
+    ASSERT_EQ(expected.size(), hwcn.size());
+    for (int i = 0; i < hwcn.size(); ++i) {
+      EXPECT_NEAR(expected[i], hwcn[i], 1e-4);
+    }
+  }
+
+  void Forward(const bool relu, vector<Dtype>* top) {
+    vector<Dtype> bottom;
+    ToHWCN(*blob_bottom_, blob_bottom_->cpu_data(), &bottom);
+    params_.relu = relu;
+    top->resize(blob_top_->count());
+    hwcn_conv_forward_cpu(&bottom[0], layer_->blobs()[0]->cpu_data(),
+        layer_->blobs()[1]->cpu_data(), params_, &(*top)[0]);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  shared_ptr<ConvolutionLayer<Dtype> > layer_;
+  kernel_params params_;
+};
+
+TYPED_TEST_CASE(HWCNConvTest, TestDtypes);
+
+TYPED_TEST(HWCNConvTest, TestForward) {
+  this->SetUpReference(3, 2, 1, 1);
+  EXPECT_EQ(this->blob_top_->height(), hwcn_conv_top_height(this->params_));
+  EXPECT_EQ(this->blob_top_->width(), hwcn_conv_top_width(this->params_));
+  this->layer_->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<TypeParam> top;
+  this->Forward(false, &top);
+  this->CheckHWCN(*this->blob_top_, this->blob_top_->cpu_data(), top);
+}
+
+TYPED_TEST(HWCNConvTest, TestForwardDilatedReLU) {
+  this->SetUpReference(3, 1, 2, 2);
+  this->layer_->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  TypeParam* ref = this->blob_top_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    ref[i] = std::max(ref[i], TypeParam(0));
+  }
+  vector<TypeParam> top;
+  this->Forward(true, &top);
+  this->CheckHWCN(*this->blob_top_, this->blob_top_->cpu_data(), top);
+}
+
+TYPED_TEST(HWCNConvTest, TestBackward) {
+  typedef TypeParam Dtype;
+  this->SetUpReference(3, 2, 1, 1);
+  this->layer_->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_);
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  this->layer_->Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+
+  vector<Dtype> bottom, top_diff;
+  this->ToHWCN(*this->blob_bottom_, this->blob_bottom_->cpu_data(), &bottom);
+  this->ToHWCN(*this->blob_top_, this->blob_top_->cpu_diff(), &top_diff);
+  vector<Dtype> bottom_diff(bottom.size());
+  const Blob<Dtype>& weights = *this->layer_->blobs()[0];
+  const Blob<Dtype>& bias = *this->layer_->blobs()[1];
+  hwcn_conv_backward_data_cpu(&top_diff[0], weights.cpu_data(),
+      this->params_, &bottom_diff[0]);
+  this->CheckHWCN(*this->blob_bottom_, this->blob_bottom_->cpu_diff(),
+      bottom_diff);
+
+  // The parameter gradients accumulate, as the layer's do
+  vector<Dtype> weight_diff(weights.count(), Dtype(1));
+  vector<Dtype> bias_diff(bias.count(), Dtype(1));
+  hwcn_conv_backward_weights_cpu(&bottom[0], &top_diff[0], this->params_,
+      &weight_diff[0], &bias_diff[0]);
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_NEAR(weights.cpu_diff()[i] + 1, weight_diff[i], 1e-4);
+  }
+  for (int i = 0; i < bias.count(); ++i) {
+    EXPECT_NEAR(bias.cpu_diff()[i] + 1, bias_diff[i], 1e-4);
+  }
+}
+
+TYPED_TEST(HWCNConvTest, TestThreadsMatchSerial) {
+  typedef TypeParam Dtype;
+  this->SetUpReference(3, 1, 1, 1);
+  vector<Dtype> serial, threaded;
+  this->Forward(true, &serial);
+  caffe_set_cpu_threads(4);
+  this->Forward(true, &threaded);
+  EXPECT_EQ(0, memcmp(&serial[0], &threaded[0],
+      serial.size() * sizeof(Dtype)));
+}
+
+// The cpfp forward pass sums as the FPGA engine does: from the bias, over the
+// bursts, the window positions in the image and the groups of four channels
+// a quarter burst apart, each group through the pairwise adder tree. 20
+// images leave a short last group of lanes.
+TEST(HWCNConvCPFPTest, TestForwardEngineOrder) {
+  Caffe::set_random_seed(1701);
+  kernel_params params = kernel_params();
+  params.ydim = 5;
+  params.xdim = 4;
+  params.inchannels = 16;
+  params.outchannels = 3;
+  params.numimages = 20;
+  params.numgroups = 2;
+  params.ksize = params.ksize_w = 3;
+  params.stride = params.stride_w = 1;
+  params.pad = params.pad_w = 1;
+  params.dilation_h = params.dilation_w = 1;
+  params.burstchannels = 8;
+  params.relu = 1;
+  params.exp_shift = -1;
+  const int N = 20, C = 32, O = 6, H = 5, W = 4;
+  vector<cpfp> bottom(H * W * C * N), weights(O * 16 * 9), bias(O);
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom[i] = cpfp(static_cast<float>(caffe_rng_rand() % 2001) / 1000 - 1);
+  }
+  for (int i = 0; i < weights.size(); ++i) {
+    weights[i] = cpfp(static_cast<float>(caffe_rng_rand() % 2001) / 1000 - 1);
+  }
+  for (int i = 0; i < O; ++i) {
+    bias[i] = cpfp(static_cast<float>(caffe_rng_rand() % 2001) / 1000 - 1);
+  }
+  vector<cpfp> top(H * W * O * N);
+  hwcn_conv_forward_cpfp(&bottom[0], &weights[0], &bias[0], params, &top[0]);
+  for (int oh = 0; oh < H; ++oh) {
+    for (int ow = 0; ow < W; ++ow) {
+      for (int o = 0; o < O; ++o) {
+        const int grp = o / 3;
+        for (int n = 0; n < N; ++n) {
+          cpfp acc = bias[o];
+          for (int b = 0; b < 16; b += 8) {
+            for (int kh = 0; kh < 3; ++kh) {
+              const int ih = oh - 1 + kh;
+              if (ih < 0 || ih >= H) { continue; }
+              for (int kw = 0; kw < 3; ++kw) {
+                const int iw = ow - 1 + kw;
+                if (iw < 0 || iw >= W) { continue; }
+                for (int l = 0; l < 2; ++l) {
+                  cpfp p[4];
+                  for (int m = 0; m < 4; ++m) {
+                    const int c = b + m * 2 + l;
+                    p[m] = bottom[((ih * W + iw) * C + grp * 16 + c) * N +
+                        n] * weights[(o * 16 + c) * 9 + kh * 3 + kw];
+                  }
+                  acc = acc + ((p[0] + p[1]) + (p[2] + p[3]));
+                }
+              }
+            }
+          }
+          acc = exp_shift(max(acc), -1);
+          EXPECT_EQ(uint16(acc),
+              uint16(top[((oh * W + ow) * O + o) * N + n]));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,166 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_server.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceServerTest : public ::testing::Test {
+ protected:
+  InferenceServerTest() {
+    Caffe::set_mode(Caffe::CPU);
+    const string proto =
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 1 dim: 2 dim: 3 } } } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+        "  inner_product_param { num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 1 } "
+        "    bias_filler { type: 'constant' value: 0.5 } } } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < kItems; ++i) {
+      Blob<Dtype> item(1, 2, 3, 1);
+      filler.Fill(&item);
+      inputs_.push_back(vector<Dtype>(item.cpu_data(),
+          item.cpu_data() + item.count()));
+    }
+    outputs_.resize(kItems);
+    served_.resize(kItems);
+  }
+
+  // Runs one item through the net on its own, after the server has stopped
+  vector<Dtype> Reference(int item) {
+    Blob<Dtype>* input = net_->top_vecs()[0][0];
+    vector<int> shape = input->shape();
+    shape[0] = 1;
+    input->Reshape(shape);
+    net_->Reshape();
+    caffe_copy(input->count(), &inputs_[item][0], input->mutable_cpu_data());
+    const Blob<Dtype>* output = net_->Forward()[0];
+    return vector<Dtype>(output->cpu_data(),
+        output->cpu_data() + output->count());
+  }
+
+  static const int kItems = 37;
+
+ public:
+  // Public so the test body can bind it to a client thread
+  void Client(InferenceServer<Dtype>* server, int first, int step) {
+    for (int i = first; i < kItems; i += step) {
+      served_[i] = server->Infer(&inputs_[i][0], &outputs_[i]);
+    }
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+  vector<vector<Dtype> > inputs_;
+  vector<vector<vector<Dtype> > > outputs_;
+  // int rather than bool, since clients set their entries concurrently
+  vector<int> served_;
+};
+
+template <typename Dtype>
+const int InferenceServerTest<Dtype>::kItems;
+
+TYPED_TEST_CASE(InferenceServerTest, TestDtypes);
+
+TYPED_TEST(InferenceServerTest, TestConcurrentClients) {
+  typedef TypeParam Dtype;
+  const int kClients = 6;
+  const int items = this->kItems;
+  {
+    InferenceServer<Dtype> server(this->net_, 8, 4, 1000);
+    EXPECT_EQ(6, server.input_size());
+    ASSERT_EQ(1, server.output_sizes().size());
+    EXPECT_EQ(5, server.output_sizes()[0]);
+    vector<shared_ptr<boost::thread> > clients;
+    for (int c = 0; c < kClients; ++c) {
+      clients.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &InferenceServerTest<Dtype>::Client, this, &server, c, kClients)));
+    }
+    for (int c = 0; c < kClients; ++c) {
+      clients[c]->join();
+    }
+    const typename InferenceServer<Dtype>::Stats stats = server.stats();
+    EXPECT_EQ(items, stats.requests);
+    EXPECT_GE(stats.batches, (items + 7) / 8);
+    EXPECT_LE(stats.batches, items);
+    EXPECT_GT(stats.fill, 0);
+    EXPECT_LE(stats.fill, 1);
+    EXPECT_LE(stats.p50_ms, stats.p99_ms);
+  }
+  // Padding and batching must not change any item's outputs
+  for (int i = 0; i < items; ++i) {
+    ASSERT_TRUE(this->served_[i]);
+    ASSERT_EQ(1, this->outputs_[i].size());
+    const vector<Dtype> expected = this->Reference(i);
+    ASSERT_EQ(expected.size(), this->outputs_[i][0].size());
+    for (int j = 0; j < expected.size(); ++j) {
+      EXPECT_NEAR(expected[j], this->outputs_[i][0][j], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(InferenceServerTest, TestBatchBelowDeployBatch) {
+  typedef TypeParam Dtype;
+  // Set up for 16 items but served in batches of 4, so every layer has to
+  // follow the batch of its bottom, HWCN layers included
+  const string proto =
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 16 dim: 2 dim: 3 dim: 1 } } } "
+      "layer { name: 'hwcn' type: 'HWCN' bottom: 'data' top: 'hwcn' "
+      "  hwcn_param { convert_to: true } } "
+      "layer { name: 'nchw' type: 'HWCN' bottom: 'hwcn' top: 'nchw' "
+      "  hwcn_param { convert_to: false } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'nchw' top: 'ip' "
+      "  inner_product_param { num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "    bias_filler { type: 'constant' value: 0.5 } } } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  this->net_.reset(new Net<Dtype>(param));
+  const int items = 9;
+  {
+    InferenceServer<Dtype> server(this->net_, 4, 4, 1000);
+    EXPECT_EQ(6, server.input_size());
+    // One client, so every batch holds a single item padded to 4
+    for (int i = 0; i < items; ++i) {
+      this->served_[i] = server.Infer(&this->inputs_[i][0],
+          &this->outputs_[i]);
+    }
+    EXPECT_EQ(items, server.stats().batches);
+  }
+  for (int i = 0; i < items; ++i) {
+    ASSERT_TRUE(this->served_[i]);
+    ASSERT_EQ(1, this->outputs_[i].size());
+    const vector<Dtype> expected = this->Reference(i);
+    ASSERT_EQ(expected.size(), this->outputs_[i][0].size());
+    for (int j = 0; j < expected.size(); ++j) {
+      EXPECT_NEAR(expected[j], this->outputs_[i][0][j], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(InferenceServerTest, TestInferAfterStop) {
+  typedef TypeParam Dtype;
+  InferenceServer<Dtype> server(this->net_, 8, 4, 1000);
+  server.StopInternalThread();
+  vector<vector<Dtype> > outputs;
+  EXPECT_FALSE(server.Infer(&this->inputs_[0][0], &outputs));
+  EXPECT_EQ(0, outputs.size());
+}
+
+}  // namespace caffe
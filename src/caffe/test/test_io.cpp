@@ -286,6 +286,59 @@ TEST_F(IOTest, TestReadFileToDatum) {
   EXPECT_EQ(datum.data().size(), 140391);
 }
 
+TEST_F(IOTest, TestParseDatumAliasingData) {
+  Datum datum_ref;
+  datum_ref.set_channels(2);
+  datum_ref.set_height(3);
+  datum_ref.set_width(4);
+  datum_ref.set_label(7);
+  for (int i = 0; i < 24; ++i) {
+    datum_ref.mutable_data()->push_back(static_cast<char>(i));
+  }
+  string buffer;
+  datum_ref.SerializeToString(&buffer);
+  Datum datum;
+  const char* data;
+  size_t data_size;
+  EXPECT_TRUE(ParseDatumAliasingData(buffer.data(), buffer.size(), &datum,
+      &data, &data_size));
+  EXPECT_EQ(datum.channels(), datum_ref.channels());
+  EXPECT_EQ(datum.height(), datum_ref.height());
+  EXPECT_EQ(datum.width(), datum_ref.width());
+  EXPECT_EQ(datum.label(), datum_ref.label());
+  EXPECT_EQ(datum.data().size(), 0);
+  // The data is read in place from the buffer
+  EXPECT_GE(data, buffer.data());
+  EXPECT_LE(data + data_size, buffer.data() + buffer.size());
+  EXPECT_EQ(string(data, data_size), datum_ref.data());
+  EXPECT_FALSE(ParseDatumAliasingData(buffer.data(), buffer.size() - 1,
+      &datum, &data, &data_size));
+}
+
+TEST_F(IOTest, TestParseDatumAliasingRepeatedData) {
+  Datum datum_ref;
+  datum_ref.set_channels(1);
+  datum_ref.set_height(1);
+  datum_ref.set_width(3);
+  datum_ref.set_label(7);
+  datum_ref.set_data("abc");
+  Datum datum_more;
+  datum_more.set_data("xyz");
+  // Serialized Datums concatenate to their merge, the last data winning
+  string buffer, more;
+  datum_ref.SerializeToString(&buffer);
+  datum_more.SerializeToString(&more);
+  buffer += more;
+  Datum datum;
+  const char* data;
+  size_t data_size;
+  EXPECT_TRUE(ParseDatumAliasingData(buffer.data(), buffer.size(), &datum,
+      &data, &data_size));
+  EXPECT_EQ(datum.width(), datum_ref.width());
+  EXPECT_EQ(datum.label(), datum_ref.label());
+  EXPECT_EQ(string(data, data_size), "xyz");
+}
+
 TEST_F(IOTest, TestDecodeDatum) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   Datum datum;
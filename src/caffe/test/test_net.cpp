@@ -8,6 +8,8 @@
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/neuron_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -1342,6 +1344,93 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestSharedWeightsResumeFromTensorFile) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  // Create a net with weight sharing; Update it once.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  shared_params.CopyFrom(*ip1_weights, kCopyDiff, kReshape);
+  const int count = ip1_weights->count();
+
+  // Write the net to a tensor file, as in Solver::Snapshot.
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToTensorFile(filename);
+
+  // Reinitialize the net and load the tensor file, both aliasing the mapped
+  // file and copying out of it.
+  for (int alias = 0; alias <= 1; ++alias) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitDiffDataSharedWeightsNet();
+    this->net_->CopyTrainedLayersFromTensorFile(filename, alias);
+    ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+    Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+    EXPECT_NE(ip1_weights, ip2_weights);
+    // Check that data and diff blobs of shared weights share the same memory
+    // locations.
+    EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+    EXPECT_EQ(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
+    for (int i = 0; i < count; ++i) {
+      EXPECT_FLOAT_EQ(shared_params.cpu_data()[i],
+          ip1_weights->cpu_data()[i]);
+    }
+    // Training writes to private copies of the mapped pages, never the file.
+    this->net_->ForwardBackward();
+    this->net_->Update();
+  }
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestRewriteAliasedTensorFile) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  Blob<Dtype> saved_params;
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  saved_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], kCopyDiff,
+      kReshape);
+  const int count = saved_params.count();
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToTensorFile(filename);
+
+  // Alias the file and write the net back over it, as convert_to_tensor_file
+  // does given the same input and output. The writer reads the parameters
+  // from the mapped pages, which must outlive the old file.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitDiffDataSharedWeightsNet();
+  const bool kAlias = true;
+  this->net_->CopyTrainedLayersFromTensorFile(filename, kAlias);
+  this->net_->ToTensorFile(filename);
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(saved_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+
+  // The new file holds the same parameters.
+  Caffe::set_random_seed(this->seed_ + 2);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFromTensorFile(filename, !kAlias);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(saved_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2446,6 +2535,318 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+// An elementwise layer from a cpfp bottom to a Dtype top, whose top is
+// wider than its bottom.
+template <typename Dtype>
+class CPFPToDtypeLayer : public NeuronLayer<Dtype> {
+ public:
+  explicit CPFPToDtypeLayer(const LayerParameter& param)
+      : NeuronLayer<Dtype>(param) {}
+  virtual inline const char* type() const { return "CPFPToDtype"; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    const cpfp* bottom_data = bottom[0]->template cpu_data_as<cpfp>();
+    Dtype* top_data = top[0]->mutable_cpu_data();
+    for (int i = 0; i < top[0]->count(); ++i) {
+      top_data[i] = cpfp2float(bottom_data[i], bottom[0]->data_exp_bias());
+    }
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    NOT_IMPLEMENTED;
+  }
+};
+
+REGISTER_LAYER_CLASS(CPFPToDtype);
+
+TYPED_TEST(NetTest, TestShareActivationMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'SharedActivations' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 4 dim: 5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'ip1' "
+      "  inner_product_param { "
+      "    num_output: 20 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sig1' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'ip1' "
+      "  top: 'sig1' "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'sig1' "
+      "  top: 'ip2' "
+      "  inner_product_param { "
+      "    num_output: 20 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip3' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'sig1' "
+      "  top: 'ip3' "
+      "  inner_product_param { "
+      "    num_output: 20 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'ip2' "
+      "  bottom: 'ip3' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'ip4' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'sum' "
+      "  top: 'ip4' "
+      "  inner_product_param { "
+      "    num_output: 20 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'softmax' "
+      "  type: 'Softmax' "
+      "  bottom: 'ip4' "
+      "  top: 'softmax' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> net(param);
+  param.set_share_activation_memory(true);
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> shared_net(param);
+  // sig1 is written over ip1, and sum reuses that buffer once ip2 and ip3
+  // have read sig1 through its split
+  EXPECT_EQ(shared_net.blob_by_name("ip1")->data(),
+      shared_net.blob_by_name("sig1")->data());
+  EXPECT_EQ(shared_net.blob_by_name("ip1")->data(),
+      shared_net.blob_by_name("sum")->data());
+  EXPECT_NE(shared_net.blob_by_name("ip2")->data(),
+      shared_net.blob_by_name("ip3")->data());
+  EXPECT_NE(shared_net.blob_by_name("sum")->data(),
+      shared_net.blob_by_name("ip2")->data());
+  EXPECT_NE(shared_net.blob_by_name("sum")->data(),
+      shared_net.blob_by_name("ip3")->data());
+  EXPECT_NE(shared_net.blob_by_name("ip4")->data(),
+      shared_net.blob_by_name("sum")->data());
+  EXPECT_NE(shared_net.blob_by_name("softmax")->data(),
+      shared_net.blob_by_name("ip4")->data());
+
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.input_blobs()[0]);
+  shared_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  for (int iter = 0; iter < 2; ++iter) {
+    net.Forward();
+    shared_net.Forward();
+    const Blob<Dtype>* output = net.output_blobs()[0];
+    const Blob<Dtype>* shared_output = shared_net.output_blobs()[0];
+    ASSERT_EQ(output->count(), shared_output->count());
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_FLOAT_EQ(output->cpu_data()[i], shared_output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareActivationMemoryMixedStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'MixedStorage' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 4 dim: 3 dim: 2 dim: 2 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'to_cpfp' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'data' "
+      "  top: 'cpfp' "
+      "  cpfp_conversion_param { "
+      "    convert_to: true "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'from_cpfp' "
+      "  type: 'CPFPToDtype' "
+      "  bottom: 'cpfp' "
+      "  top: 'back' "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Power' "
+      "  bottom: 'back' "
+      "  top: 'scaled' "
+      "  power_param { "
+      "    scale: 2 "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  param.set_share_activation_memory(true);
+  Net<Dtype> shared_net(param);
+  // back is elementwise over cpfp, but holds wider elements, so it can't
+  // be written over it
+  EXPECT_EQ(shared_net.blob_by_name("cpfp")->storage(), STORAGE_CPFP);
+  EXPECT_NE(shared_net.blob_by_name("cpfp")->data(),
+      shared_net.blob_by_name("back")->data());
+
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.input_blobs()[0]);
+  shared_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  net.Forward();
+  shared_net.Forward();
+  const Blob<Dtype>* output = net.output_blobs()[0];
+  const Blob<Dtype>* shared_output = shared_net.output_blobs()[0];
+  ASSERT_EQ(output->count(), shared_output->count());
+  for (int i = 0; i < output->count(); ++i) {
+    EXPECT_FLOAT_EQ(output->cpu_data()[i], shared_output->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestPipelinedForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'Pipelined' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  input_param { "
+      "  shape: { dim: 4 dim: 3 dim: 2 dim: 2 } "
+      "  shape: { dim: 4 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'ip1' "
+      "  inner_product_param { "
+      "    num_output: 10 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'sig1' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'ip1' "
+      "  top: 'sig1' "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'sig1' "
+      "  top: 'ip2' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'softmax' "
+      "  type: 'Softmax' "
+      "  bottom: 'ip2' "
+      "  top: 'softmax' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'SoftmaxWithLoss' "
+      "  bottom: 'ip2' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> net(param);
+  param.set_micro_batch_size(2);
+  Caffe::set_random_seed(this->seed_);
+  Net<Dtype> pipelined_net(param);
+
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int iter = 0; iter < 2; ++iter) {
+    filler.Fill(net.input_blobs()[0]);
+    Dtype* label = net.input_blobs()[1]->mutable_cpu_data();
+    for (int i = 0; i < net.input_blobs()[1]->count(); ++i) {
+      label[i] = (i + iter) % 5;
+    }
+    pipelined_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+    pipelined_net.input_blobs()[1]->CopyFrom(*net.input_blobs()[1]);
+    Dtype loss, pipelined_loss;
+    net.Forward(&loss);
+    pipelined_net.Forward(&pipelined_loss);
+    // Every item goes through the same layers, so the per-item outputs match
+    // and the loss is the mean over the two micro-batches.
+    const Blob<Dtype>* softmax = net.blob_by_name("softmax").get();
+    const Blob<Dtype>* pipelined_softmax =
+        pipelined_net.blob_by_name("softmax").get();
+    ASSERT_EQ(softmax->shape(), pipelined_softmax->shape());
+    for (int i = 0; i < softmax->count(); ++i) {
+      EXPECT_NEAR(softmax->cpu_data()[i], pipelined_softmax->cpu_data()[i],
+          1e-6);
+    }
+    EXPECT_NEAR(loss, pipelined_loss, 1e-5);
+    EXPECT_NEAR(net.blob_by_name("loss")->cpu_data()[0],
+        pipelined_net.blob_by_name("loss")->cpu_data()[0], 1e-5);
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
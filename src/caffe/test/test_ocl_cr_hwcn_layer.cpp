@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
 #include <vector>
 
+#include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
@@ -9,6 +13,7 @@
 #include "caffe/layers/cpfp_conversion_layer.hpp"
 #include "caffe/layers/ocl_cr_hwcn_layer.hpp"
 #include "caffe/layers/XCL_program_layer.hpp"
+#include "caffe/net.hpp"
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
@@ -453,6 +458,209 @@ TYPED_TEST(OCLCRHWCNLayerTest, TestForward5x5) {
     EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-1);
   }
 }
+
+TYPED_TEST(OCLCRHWCNLayerTest, TestPipelinedForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The convolution runs as a device stage on micro-batches of 16 images,
+  // so the engine has to follow the batch of its bottom
+  const string proto =
+      "name: 'PipelinedCR' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 32 dim: 16 dim: 8 dim: 8 } } "
+      "} "
+      "layer { "
+      "  name: 'program' "
+      "  type: 'XCLProgram' "
+      "  xcl_param { "
+      "    xcl_name: 'cr_layer_hwcn_cpfp.xclbin' "
+      "    kernel_name: 'cr_layer_hwcn_cpfp' "
+      "    once: true "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'hwcn' "
+      "  type: 'HWCN' "
+      "  bottom: 'data' "
+      "  top: 'hwcn' "
+      "  hwcn_param { convert_to: true } "
+      "} "
+      "layer { "
+      "  name: 'cpfp' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'hwcn' "
+      "  top: 'cpfp' "
+      "  cpfp_conversion_param { convert_to: true } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'cpfp' "
+      "  top: 'conv' "
+      "  convolution_param { "
+      "    num_output: 64 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "    bias_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "  cr_param { relu: false } "
+      "} "
+      "layer { "
+      "  name: 'float' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'conv' "
+      "  top: 'float' "
+      "  cpfp_conversion_param { convert_to: false } "
+      "} "
+      "layer { "
+      "  name: 'nchw' "
+      "  type: 'HWCN' "
+      "  bottom: 'float' "
+      "  top: 'nchw' "
+      "  hwcn_param { convert_to: false } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(1701);
+  Net<Dtype> net(param);
+  param.set_micro_batch_size(16);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> pipelined_net(param);
+
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int iter = 0; iter < 2; ++iter) {
+    filler.Fill(net.input_blobs()[0]);
+    pipelined_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+    net.Forward();
+    pipelined_net.Forward();
+    const Blob<Dtype>* top = net.blob_by_name("nchw").get();
+    const Blob<Dtype>* pipelined_top = pipelined_net.blob_by_name("nchw").get();
+    ASSERT_EQ(top->shape(), pipelined_top->shape());
+    for (int i = 0; i < top->count(); ++i) {
+      EXPECT_NEAR(top->cpu_data()[i], pipelined_top->cpu_data()[i], 1e-1);
+    }
+  }
+}
+
+TYPED_TEST(OCLCRHWCNLayerTest, TestParamDiffSumsOnDevice) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Over several backward passes, as for iter_size > 1, the weight and bias
+  // diffs add up in float on the device, so they have to match the cpfp
+  // diffs of the single passes added up on the host
+  const string proto =
+      "name: 'ParamDiffSumsCR' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  input_param { "
+      "    shape: { dim: 16 dim: 16 dim: 8 dim: 8 } "
+      "    shape: { dim: 16 dim: 16 dim: 8 dim: 8 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'program' "
+      "  type: 'XCLProgram' "
+      "  xcl_param { "
+      "    xcl_name: 'cr_layer_hwcn_cpfp.xclbin' "
+      "    kernel_name: 'cr_layer_hwcn_cpfp' "
+      "    once: true "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'hwcn' "
+      "  type: 'HWCN' "
+      "  bottom: 'data' "
+      "  top: 'hwcn' "
+      "  hwcn_param { convert_to: true } "
+      "} "
+      "layer { "
+      "  name: 'cpfp' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'hwcn' "
+      "  top: 'cpfp' "
+      "  cpfp_conversion_param { convert_to: true } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'OCLCRHWCN' "
+      "  bottom: 'cpfp' "
+      "  top: 'conv' "
+      "  convolution_param { "
+      "    num_output: 16 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "    bias_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "  cr_param { relu: false } "
+      "} "
+      "layer { "
+      "  name: 'float' "
+      "  type: 'CPFPConversion' "
+      "  bottom: 'conv' "
+      "  top: 'float' "
+      "  cpfp_conversion_param { convert_to: false } "
+      "} "
+      "layer { "
+      "  name: 'nchw' "
+      "  type: 'HWCN' "
+      "  bottom: 'float' "
+      "  top: 'nchw' "
+      "  hwcn_param { convert_to: false } "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'nchw' "
+      "  bottom: 'label' "
+      "  top: 'loss' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  const int passes = 3;
+  Caffe::set_random_seed(1701);
+  Net<Dtype> host_net(param);
+  host_net.set_async_param_diffs(true);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> device_net(param);
+  device_net.set_async_param_diffs(true);
+  device_net.set_param_diff_passes(passes);
+
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  host_net.ClearParamDiffs();
+  device_net.ClearParamDiffs();
+  for (int pass = 0; pass < passes; ++pass) {
+    for (int i = 0; i < host_net.input_blobs().size(); ++i) {
+      filler.Fill(host_net.input_blobs()[i]);
+      device_net.input_blobs()[i]->CopyFrom(*host_net.input_blobs()[i]);
+    }
+    host_net.ForwardBackward();
+    device_net.ForwardBackward();
+  }
+  host_net.SyncParamDiffs();
+  device_net.SyncParamDiffs();
+
+  const vector<shared_ptr<Blob<Dtype> > >& host_params =
+      host_net.layer_by_name("conv")->blobs();
+  const vector<shared_ptr<Blob<Dtype> > >& device_params =
+      device_net.layer_by_name("conv")->blobs();
+  ASSERT_EQ(host_params.size(), 2);
+  for (int j = 0; j < host_params.size(); ++j) {
+    const Dtype* host_diff = host_params[j]->cpu_diff();
+    const Dtype* device_diff = device_params[j]->cpu_diff();
+    for (int i = 0; i < host_params[j]->count(); ++i) {
+      EXPECT_NEAR(device_diff[i], host_diff[i],
+          1e-4 * std::max(Dtype(1), std::fabs(host_diff[i])));
+    }
+  }
+}
 /*
 TYPED_TEST(OCLCRHWCNLayerTest, TestForward3x3_s2) {
   typedef typename TypeParam::Dtype Dtype;
@@ -0,0 +1,168 @@
+#include <boost/bind.hpp>
+#include <cstring>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+namespace {
+
+void CountVisits(vector<int>* visits, vector<int>* begins, const int begin,
+    const int end) {
+  for (int i = begin; i < end; ++i) {
+    ++(*visits)[i];
+  }
+  (*begins)[begin] = 1;
+}
+
+}  // namespace
+
+class ParallelForTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() { caffe_set_cpu_threads(1); }
+};
+
+TEST_F(ParallelForTest, TestChunks) {
+  const int n = 1000;
+  const int grain = 7;
+  for (int threads = 1; threads <= 5; ++threads) {
+    caffe_set_cpu_threads(threads);
+    EXPECT_EQ(threads, caffe_cpu_threads());
+    vector<int> visits(n, 0);
+    vector<int> begins(n, 0);
+    caffe_parallel_for(n, grain,
+        boost::bind(&CountVisits, &visits, &begins, _1, _2));
+    int chunks = 0;
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(1, visits[i]);
+      if (begins[i]) {
+        EXPECT_EQ(0, i % grain);
+        ++chunks;
+      }
+    }
+    EXPECT_EQ(threads, chunks);
+  }
+  // Fewer than two grains stay in one chunk
+  caffe_set_cpu_threads(4);
+  vector<int> visits(n, 0);
+  vector<int> begins(n, 0);
+  caffe_parallel_for(n, n, boost::bind(&CountVisits, &visits, &begins, _1, _2));
+  EXPECT_EQ(1, begins[0]);
+  for (int i = 1; i < n; ++i) {
+    EXPECT_EQ(0, begins[i]);
+  }
+}
+
+template <typename Dtype>
+class ParallelForLayerTest : public ::testing::Test {
+ protected:
+  ParallelForLayerTest()
+      : blob_bottom_a_(new Blob<Dtype>(8, 16, 32, 32)),
+        blob_bottom_b_(new Blob<Dtype>(8, 16, 32, 32)) {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_a_);
+    filler.Fill(blob_bottom_b_);
+    blob_bottom_vec_.push_back(blob_bottom_a_);
+    blob_bottom_vec_.push_back(blob_bottom_b_);
+  }
+  virtual ~ParallelForLayerTest() {
+    caffe_set_cpu_threads(1);
+    delete blob_bottom_a_;
+    delete blob_bottom_b_;
+  }
+
+  // Runs the layer with one thread and with four, and expects the very same
+  // top bytes.
+  void CheckSerialOutput(const string& proto, const int num_bottoms) {
+    LayerParameter layer_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &layer_param));
+    vector<Blob<Dtype>*> bottom(blob_bottom_vec_.begin(),
+        blob_bottom_vec_.begin() + num_bottoms);
+    Blob<Dtype> serial_top, parallel_top;
+    vector<Blob<Dtype>*> serial_top_vec(1, &serial_top);
+    vector<Blob<Dtype>*> parallel_top_vec(1, &parallel_top);
+    caffe_set_cpu_threads(1);
+    shared_ptr<Layer<Dtype> > serial_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    serial_layer->SetUp(bottom, serial_top_vec);
+    serial_layer->Forward(bottom, serial_top_vec);
+    caffe_set_cpu_threads(4);
+    shared_ptr<Layer<Dtype> > parallel_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    parallel_layer->SetUp(bottom, parallel_top_vec);
+    parallel_layer->Forward(bottom, parallel_top_vec);
+    ASSERT_EQ(serial_top.shape(), parallel_top.shape());
+    ASSERT_EQ(serial_top.storage(), parallel_top.storage());
+    EXPECT_EQ(0, memcmp(serial_top.data()->cpu_data(),
+        parallel_top.data()->cpu_data(),
+        serial_top.count() * serial_top.element_size()))
+        << layer_param.type() << " differs from the serial output";
+  }
+
+  Blob<Dtype>* const blob_bottom_a_;
+  Blob<Dtype>* const blob_bottom_b_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+};
+
+TYPED_TEST_CASE(ParallelForLayerTest, TestDtypes);
+
+TYPED_TEST(ParallelForLayerTest, TestPooling) {
+  this->CheckSerialOutput("type: 'Pooling' pooling_param { pool: MAX "
+      "kernel_size: 3 stride: 2 }", 1);
+  this->CheckSerialOutput("type: 'Pooling' pooling_param { pool: AVE "
+      "kernel_size: 3 stride: 2 pad: 1 }", 1);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestLRN) {
+  this->CheckSerialOutput("type: 'LRN' lrn_param { local_size: 5 }", 1);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestReLU) {
+  this->CheckSerialOutput("type: 'ReLU' relu_param { negative_slope: 0.1 }",
+      1);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestSoftmax) {
+  this->CheckSerialOutput("type: 'Softmax'", 1);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestEltwise) {
+  this->CheckSerialOutput("type: 'Eltwise' eltwise_param { operation: PROD }",
+      2);
+  this->CheckSerialOutput("type: 'Eltwise' eltwise_param { operation: SUM "
+      "coeff: 1 coeff: -0.5 }", 2);
+  this->CheckSerialOutput("type: 'Eltwise' eltwise_param { operation: MAX }",
+      2);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestBatchNorm) {
+  this->CheckSerialOutput("type: 'BatchNorm'", 1);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestConcat) {
+  this->CheckSerialOutput("type: 'Concat'", 2);
+}
+
+TYPED_TEST(ParallelForLayerTest, TestConversions) {
+  this->CheckSerialOutput("type: 'HWCN' hwcn_param { convert_to: true }", 1);
+  this->CheckSerialOutput("type: 'Pad' pad_param { pad: true axis: 1 "
+      "pad_to: 20 }", 1);
+  this->CheckSerialOutput("type: 'CPFPConversion' "
+      "cpfp_conversion_param { convert_to: true }", 1);
+}
+
+}  // namespace caffe
@@ -102,6 +102,23 @@ TEST_F(SyncedMemoryTest, TestOCLWrite) {
   delete pattern;
 }
 
+TEST_F(SyncedMemoryTest, TestOCLTransferCounts) {
+  const size_t host_to_device = Caffe::host_to_device_bytes();
+  const size_t device_to_host = Caffe::device_to_host_bytes();
+  SyncedMemory mem(10);
+  mem.mutable_cpu_data();
+  mem.ocl_data();
+  EXPECT_EQ(host_to_device + 10, Caffe::host_to_device_bytes());
+  // Synced data is not copied again
+  mem.ocl_data();
+  mem.cpu_data();
+  EXPECT_EQ(host_to_device + 10, Caffe::host_to_device_bytes());
+  EXPECT_EQ(device_to_host, Caffe::device_to_host_bytes());
+  mem.mutable_ocl_data(0);
+  mem.cpu_data();
+  EXPECT_EQ(device_to_host + 10, Caffe::device_to_host_bytes());
+}
+
 #endif
 
 #ifndef CPU_ONLY  // GPU test
@@ -2,8 +2,10 @@
 #include <string>
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -87,5 +89,11 @@ size_t BlockingQueue<T>::size() const {
 
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
+template class BlockingQueue<HDF5Batch<float>*>;
+template class BlockingQueue<HDF5Batch<double>*>;
+template class BlockingQueue<SnapshotJob<float>*>;
+template class BlockingQueue<SnapshotJob<double>*>;
+template class BlockingQueue<int>;
+template class BlockingQueue<string*>;
 
 }  // namespace caffe
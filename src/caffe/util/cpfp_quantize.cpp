@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpfp_quantize.hpp"
+
+namespace caffe {
+
+namespace {
+
+// float2cpfp() and cpfp2float() in one step, on the IEEE single-precision
+// fields
+inline float quantize(const float value, const int exp_size,
+    const int mant_size, const bool round_nearest) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const int exp_offset = (1 << (exp_size - 1)) - 1;
+  const int shift = 23 - mant_size;
+  const uint32_t max_mant = (1u << mant_size) - 1;
+  const uint32_t sign = bits & 0x80000000u;
+  int exp = static_cast<int>((bits >> 23) & 0xFF) - 127;
+  uint32_t mant = (bits & 0x7FFFFF) >> shift;
+  if (exp < 1 - exp_offset) {
+    bits = sign;
+  } else if (exp > exp_offset) {
+    bits = sign | ((exp_offset + 127) << 23) | (max_mant << shift);
+  } else {
+    if (round_nearest && shift > 0) {
+      const uint32_t guard = (bits >> (shift - 1)) & 0x1;
+      const uint32_t sticky = (bits & ((1u << (shift - 1)) - 1)) != 0;
+      if (guard & (sticky | (mant & 0x1))) {
+        // Rounding up out of the largest exponent is dropped, as in
+        // float2cpfp
+        if (mant != max_mant) {
+          ++mant;
+        } else if (exp < exp_offset) {
+          mant = 0;
+          ++exp;
+        }
+      }
+    }
+    bits = sign | ((exp + 127) << 23) | (mant << shift);
+  }
+  float out;
+  memcpy(&out, &bits, sizeof(out));
+  return out;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void cpfp_quantize(const int n, const int exp_size, const int mant_size,
+    const bool round_nearest, Dtype* x) {
+  CHECK_GE(exp_size, 2);
+  CHECK_LE(exp_size, 8);
+  CHECK_GE(mant_size, 1);
+  CHECK_LE(mant_size, 23);
+  for (int i = 0; i < n; ++i) {
+    x[i] = quantize(static_cast<float>(x[i]), exp_size, mant_size,
+        round_nearest);
+  }
+}
+
+template <typename Dtype>
+int cpfp_calibrate_exp_bias(const int n, const Dtype* x, const int target) {
+  Dtype largest = 0;
+  for (int i = 0; i < n; ++i) {
+    largest = std::max(largest, static_cast<Dtype>(std::fabs(x[i])));
+  }
+  if (largest == 0 || !std::isfinite(largest)) {
+    return 0;
+  }
+  // largest is in [2^(exp - 1), 2^exp)
+  int exp;
+  std::frexp(largest, &exp);
+  return std::min(std::max(exp - 1 - target, -CPFP_MAX_EXP_BIAS),
+      CPFP_MAX_EXP_BIAS);
+}
+
+template void cpfp_quantize<float>(const int n, const int exp_size,
+    const int mant_size, const bool round_nearest, float* x);
+template void cpfp_quantize<double>(const int n, const int exp_size,
+    const int mant_size, const bool round_nearest, double* x);
+
+template int cpfp_calibrate_exp_bias<float>(const int n, const float* x,
+    const int target);
+template int cpfp_calibrate_exp_bias<double>(const int n, const double* x,
+    const int target);
+
+}  // namespace caffe
@@ -1,6 +1,7 @@
 #include "caffe/util/db.hpp"
 #include "caffe/util/db_leveldb.hpp"
 #include "caffe/util/db_lmdb.hpp"
+#include "caffe/util/db_sharded.hpp"
 
 #include <string>
 
@@ -37,5 +38,12 @@ DB* GetDB(const string& backend) {
   return NULL;
 }
 
+DB* GetDB(const DataParameter& param, int rank, int size) {
+  if (param.shuffle() || param.source().find(',') != string::npos) {
+    return new ShardedDB(param, rank, size);
+  }
+  return GetDB(param.backend());
+}
+
 }  // namespace db
 }  // namespace caffe
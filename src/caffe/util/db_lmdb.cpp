@@ -1,7 +1,10 @@
 #ifdef USE_LMDB
 #include "caffe/util/db_lmdb.hpp"
 
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <string>
 
@@ -44,6 +47,26 @@ LMDBCursor* LMDB::NewCursor() {
   return new LMDBCursor(mdb_txn, mdb_cursor);
 }
 
+bool LMDBCursor::value_view(const char** data, size_t* size) {
+  *data = static_cast<const char*>(mdb_value_.mv_data);
+  *size = mdb_value_.mv_size;
+  // The view is usually read a little later by a decode worker; have the
+  // kernel start paging it in now.
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(*data);
+  const uintptr_t page_begin = begin - begin % page_size;
+  posix_madvise(reinterpret_cast<void*>(page_begin),
+      begin + *size - page_begin, POSIX_MADV_WILLNEED);
+  return true;
+}
+
+bool LMDBCursor::SeekToKey(const string& key) {
+  mdb_key_.mv_size = key.size();
+  mdb_key_.mv_data = const_cast<char*>(key.data());
+  Seek(MDB_SET_KEY);
+  return valid_;
+}
+
 LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
@@ -0,0 +1,180 @@
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+
+#include "caffe/util/db_sharded.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe { namespace db {
+
+ShardReader::ShardReader(const ShardedDB* db, int shard)
+    : db_(db), shard_(shard),
+      wait_message_("Waiting for shard " + format_int(shard)),
+      values_(db->read_ahead()) {
+  CHECK_GT(values_.size(), 0) << "shard_read_ahead must be positive.";
+  for (int i = 0; i < values_.size(); ++i) {
+    free_.push(&values_[i]);
+  }
+  StartInternalThread();
+}
+
+ShardReader::~ShardReader() {
+  StopInternalThread();
+}
+
+string* ShardReader::Pop() {
+  return full_.pop(wait_message_);
+}
+
+void ShardReader::InternalThreadEntry() {
+  shared_ptr<Cursor> cursor(db_->shard(shard_)->NewCursor());
+  const vector<ShardedItem>& items = db_->items();
+  vector<int> plan;
+  try {
+    while (!must_stop()) {
+      db_->Plan(epochs_.pop(), &plan);
+      for (int i = 0; i < plan.size(); ++i) {
+        const ShardedItem& item = items[plan[i]];
+        if (item.shard != shard_) {
+          continue;
+        }
+        string* value = free_.pop();
+        // Striped plans walk each shard in key order, so only shuffled ones
+        // have to seek
+        if (!cursor->valid() || cursor->key() != item.key) {
+          CHECK(cursor->SeekToKey(item.key)) << "Key " << item.key
+              << " is missing from shard " << shard_;
+        }
+        *value = cursor->value();
+        cursor->Next();
+        full_.push(value);
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+ShardedCursor::ShardedCursor(const ShardedDB* db)
+    : db_(db), epoch_(-1), position_(0), value_(NULL) {
+  CHECK_GT(db->num_shards(), 0) << "The sharded source isn't open.";
+  for (int i = 0; i < db->num_shards(); ++i) {
+    readers_.push_back(shared_ptr<ShardReader>(new ShardReader(db, i)));
+    readers_[i]->Allow(0);
+  }
+  StartEpoch();
+}
+
+void ShardedCursor::StartEpoch() {
+  ++epoch_;
+  db_->Plan(epoch_, &plan_);
+  // The readers may read ahead into the next epoch once they are done with
+  // this one
+  for (int i = 0; i < readers_.size(); ++i) {
+    readers_[i]->Allow(epoch_ + 1);
+  }
+  position_ = 0;
+  Fetch();
+}
+
+void ShardedCursor::Fetch() {
+  value_ = readers_[db_->items()[plan_[position_]].shard]->Pop();
+}
+
+void ShardedCursor::SeekToFirst() {
+  if (position_ == 0) {
+    return;
+  }
+  while (valid()) {
+    Next();
+  }
+  StartEpoch();
+}
+
+void ShardedCursor::Next() {
+  readers_[db_->items()[plan_[position_]].shard]->Release(value_);
+  value_ = NULL;
+  ++position_;
+  if (valid()) {
+    Fetch();
+  }
+}
+
+string ShardedCursor::key() {
+  return db_->items()[plan_[position_]].key;
+}
+
+bool ShardedCursor::SeekToKey(const string& key) {
+  LOG(FATAL) << "A sharded cursor visits the keys in the order of its plan.";
+  return false;
+}
+
+ShardedDB::ShardedDB(const DataParameter& param, int rank, int size)
+    : param_(param), rank_(rank), size_(size) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, size);
+}
+
+void ShardedDB::Open(const string& source, Mode mode) {
+  CHECK_EQ(mode, READ) << "Sharded sources are read only.";
+  vector<string> sources;
+  boost::split(sources, source, boost::is_any_of(","));
+  vector<vector<int> > shard_items(sources.size());
+  for (int i = 0; i < sources.size(); ++i) {
+    shards_.push_back(shared_ptr<DB>(GetDB(param_.backend())));
+    shards_[i]->Open(sources[i], READ);
+    shared_ptr<Cursor> cursor(shards_[i]->NewCursor());
+    for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+      shard_items[i].push_back(items_.size());
+      ShardedItem item = { i, cursor->key() };
+      items_.push_back(item);
+    }
+  }
+  CHECK_GE(items_.size(), size_) << "Each solver needs at least one item.";
+  for (int j = 0; order_.size() < items_.size(); ++j) {
+    for (int i = 0; i < shard_items.size(); ++i) {
+      if (j < shard_items[i].size()) {
+        order_.push_back(shard_items[i][j]);
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Indexed " << items_.size()
+      << " items in " << shards_.size() << " shards";
+}
+
+void ShardedDB::Close() {
+  order_.clear();
+  items_.clear();
+  shards_.clear();
+}
+
+ShardedCursor* ShardedDB::NewCursor() {
+  return new ShardedCursor(this);
+}
+
+Transaction* ShardedDB::NewTransaction() {
+  LOG(FATAL) << "Sharded sources are read only.";
+  return NULL;
+}
+
+void ShardedDB::Plan(int epoch, vector<int>* plan) const {
+  const vector<int>* order = &order_;
+  vector<int> shuffled;
+  if (param_.shuffle()) {
+    shuffled = order_;
+    rng_t rng(param_.shuffle_seed() + epoch);
+    shuffle(shuffled.begin(), shuffled.end(), &rng);
+    order = &shuffled;
+  }
+  plan->clear();
+  for (int i = rank_; i < order->size(); i += size_) {
+    plan->push_back((*order)[i]);
+  }
+}
+
+}  // namespace db
+}  // namespace caffe
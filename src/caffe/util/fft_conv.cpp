@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fft_conv.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Bytes of image spectra kept at once; images are transformed in chunks that
+// fit, each chunk sharing one transform of every filter
+const size_t kSpectraBytes = 64 << 20;
+
+inline int next_pow2(const int n) {
+  int p = 1;
+  while (p < n) { p <<= 1; }
+  return p;
+}
+
+// In-place radix-2 transform of the n = 2^k values data[0], data[stride],
+// ..., scaled by 1 / n when inverse
+template <typename Dtype>
+void FFT1D(std::complex<Dtype>* data, const int n, const int stride,
+    const bool inverse) {
+  for (int i = 1, j = 0; i < n; ++i) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) { j ^= bit; }
+    j ^= bit;
+    if (i < j) { std::swap(data[i * stride], data[j * stride]); }
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    const double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+    // Twiddles are stepped in double so long transforms stay accurate
+    const std::complex<double> step(std::cos(angle), std::sin(angle));
+    for (int i = 0; i < n; i += len) {
+      std::complex<double> w(1);
+      for (int j = 0; j < len / 2; ++j) {
+        const std::complex<Dtype> u = data[(i + j) * stride];
+        const std::complex<Dtype> v = data[(i + j + len / 2) * stride] *
+            std::complex<Dtype>(w.real(), w.imag());
+        data[(i + j) * stride] = u + v;
+        data[(i + j + len / 2) * stride] = u - v;
+        w *= step;
+      }
+    }
+  }
+  if (inverse) {
+    for (int i = 0; i < n; ++i) { data[i * stride] /= Dtype(n); }
+  }
+}
+
+// Rows then columns of a rows x cols array
+template <typename Dtype>
+void FFT2D(std::complex<Dtype>* data, const int rows, const int cols,
+    const bool inverse) {
+  for (int r = 0; r < rows; ++r) {
+    FFT1D(data + r * cols, cols, 1, inverse);
+  }
+  for (int c = 0; c < cols; ++c) {
+    FFT1D(data + c, rows, cols, inverse);
+  }
+}
+
+// Zero-fills a rows x cols array and places the h x w plane at (top, left)
+template <typename Dtype>
+void PlaceAndTransform(const Dtype* plane, const int h, const int w,
+    const int top, const int left, const int rows, const int cols,
+    std::complex<Dtype>* spectrum) {
+  std::fill(spectrum, spectrum + rows * cols, std::complex<Dtype>(0));
+  for (int i = 0; i < h; ++i) {
+    for (int j = 0; j < w; ++j) {
+      spectrum[(top + i) * cols + left + j] = plane[i * w + j];
+    }
+  }
+  FFT2D(spectrum, rows, cols, false);
+}
+
+}  // namespace
+
+template <typename Dtype>
+void fft_conv_cpu(const Dtype* data_im, const int num, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int group, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, Dtype* data_out) {
+  typedef std::complex<Dtype> Complex;
+  const int in_channels = channels / group;
+  const int out_channels = num_output / group;
+  const int out_h = height + 2 * pad_h - kernel_h + 1;
+  const int out_w = width + 2 * pad_w - kernel_w + 1;
+  const int rows = next_pow2(height + 2 * pad_h);
+  const int cols = next_pow2(width + 2 * pad_w);
+  const int bins = rows * cols;
+  const int chunk = std::max<int>(1, std::min<size_t>(num,
+      kSpectraBytes / (sizeof(Complex) * bins * channels)));
+
+  std::vector<Complex> image_spectra(static_cast<size_t>(chunk) * channels *
+      bins);
+  std::vector<Complex> filter_spectrum(bins);
+  std::vector<Complex> product(static_cast<size_t>(chunk) * bins);
+  for (int n0 = 0; n0 < num; n0 += chunk) {
+    const int images = std::min(chunk, num - n0);
+    for (int n = 0; n < images; ++n) {
+      for (int c = 0; c < channels; ++c) {
+        PlaceAndTransform(data_im + ((n0 + n) * channels + c) * height * width,
+            height, width, pad_h, pad_w, rows, cols,
+            &image_spectra[(static_cast<size_t>(n) * channels + c) * bins]);
+      }
+    }
+    for (int o = 0; o < num_output; ++o) {
+      const int g = o / out_channels;
+      std::fill(product.begin(), product.end(), Complex(0));
+      for (int c = 0; c < in_channels; ++c) {
+        PlaceAndTransform(weights + (o * in_channels + c) * kernel_h *
+            kernel_w, kernel_h, kernel_w, 0, 0, rows, cols,
+            &filter_spectrum[0]);
+        // Correlation is the product with the conjugate filter spectrum
+        for (int n = 0; n < images; ++n) {
+          const Complex* x = &image_spectra[(static_cast<size_t>(n) *
+              channels + g * in_channels + c) * bins];
+          Complex* y = &product[static_cast<size_t>(n) * bins];
+          for (int b = 0; b < bins; ++b) {
+            y[b] += x[b] * std::conj(filter_spectrum[b]);
+          }
+        }
+      }
+      for (int n = 0; n < images; ++n) {
+        Complex* y = &product[static_cast<size_t>(n) * bins];
+        FFT2D(y, rows, cols, true);
+        Dtype* out = data_out + ((n0 + n) * num_output + o) * out_h * out_w;
+        for (int i = 0; i < out_h; ++i) {
+          for (int j = 0; j < out_w; ++j) {
+            out[i * out_w + j] = y[i * cols + j].real();
+          }
+        }
+      }
+    }
+  }
+}
+
+template void fft_conv_cpu<float>(const float* data_im, const int num,
+    const int channels, const int height, const int width,
+    const float* weights, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    float* data_out);
+template void fft_conv_cpu<double>(const double* data_im, const int num,
+    const int channels, const int height, const int width,
+    const double* weights, const int num_output, const int group,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    double* data_out);
+
+}  // namespace caffe
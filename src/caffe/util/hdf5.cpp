@@ -5,11 +5,17 @@
 
 namespace caffe {
 
+boost::recursive_mutex& hdf5_mutex() {
+  static boost::recursive_mutex mutex;
+  return mutex;
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   // Verify that the dataset exists.
   CHECK(H5LTfind_dataset(file_id, dataset_name_))
       << "Failed to find HDF5 dataset " << dataset_name_;
@@ -86,6 +92,7 @@ void hdf5_load_nd_dataset_helper(
 template <>
 void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<float>* blob, bool reshape) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
   herr_t status = H5LTread_dataset_float(
@@ -96,6 +103,7 @@ void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
 template <>
 void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<double>* blob, bool reshape) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
   herr_t status = H5LTread_dataset_double(
@@ -103,10 +111,91 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// Reads a slab of rows of a dataset with at least one axis as mem_type.
+static void hdf5_load_rows_helper(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, hid_t mem_type, vector<int>* shape, void* data) {
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  hid_t dataset = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset, 0) << "Failed to open HDF5 dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset);
+  const int ndims = H5Sget_simple_extent_ndims(file_space);
+  CHECK_GE(ndims, 1) << "Input must have at least 1 axis.";
+  std::vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  CHECK_LE(first_row + num_rows, dims[0]) << "Rows out of range of "
+      << dataset_name_;
+  if (shape) {
+    shape->resize(ndims);
+    (*shape)[0] = num_rows;
+    for (int i = 1; i < ndims; ++i) {
+      (*shape)[i] = dims[i];
+    }
+  }
+  if (data) {
+    std::vector<hsize_t> start(ndims, 0);
+    start[0] = first_row;
+    dims[0] = num_rows;
+    herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+        start.data(), NULL, dims.data(), NULL);
+    CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+    hid_t mem_space = H5Screate_simple(ndims, dims.data(), NULL);
+    status = H5Dread(dataset, mem_type, mem_space, file_space, H5P_DEFAULT,
+        data);
+    CHECK_GE(status, 0) << "Failed to read rows of " << dataset_name_;
+    H5Sclose(mem_space);
+  }
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, Blob<float>* blob) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  vector<int> shape;
+  hdf5_load_rows_helper(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_FLOAT, &shape, NULL);
+  blob->Reshape(shape);
+  hdf5_load_rows_helper(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_FLOAT, NULL, blob->mutable_cpu_data());
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, Blob<double>* blob) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  vector<int> shape;
+  hdf5_load_rows_helper(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_DOUBLE, &shape, NULL);
+  blob->Reshape(shape);
+  hdf5_load_rows_helper(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_DOUBLE, NULL, blob->mutable_cpu_data());
+}
+
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name_, &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name_;
+  CHECK_GE(ndims, 1) << "Input must have at least 1 axis.";
+  std::vector<hsize_t> dims(ndims);
+  status = H5LTget_dataset_info(file_id, dataset_name_, dims.data(), NULL,
+      NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name_;
+  return dims[0];
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
     bool write_diff) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -128,6 +217,7 @@ template <>
 void hdf5_save_nd_dataset<double>(
     hid_t file_id, const string& dataset_name, const Blob<double>& blob,
     bool write_diff) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -146,6 +236,7 @@ void hdf5_save_nd_dataset<double>(
 }
 
 string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   // Get size of dataset
   size_t size;
   H5T_class_t class_;
@@ -163,6 +254,7 @@ string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
 
 void hdf5_save_string(hid_t loc_id, const string& dataset_name,
                       const string& s) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   herr_t status = \
     H5LTmake_dataset_string(loc_id, dataset_name.c_str(), s.c_str());
   CHECK_GE(status, 0)
@@ -170,6 +262,7 @@ void hdf5_save_string(hid_t loc_id, const string& dataset_name,
 }
 
 int hdf5_load_int(hid_t loc_id, const string& dataset_name) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   int val;
   herr_t status = H5LTread_dataset_int(loc_id, dataset_name.c_str(), &val);
   CHECK_GE(status, 0)
@@ -178,6 +271,7 @@ int hdf5_load_int(hid_t loc_id, const string& dataset_name) {
 }
 
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hsize_t one = 1;
   herr_t status = \
     H5LTmake_dataset_int(loc_id, dataset_name.c_str(), 1, &one, &i);
@@ -186,6 +280,7 @@ void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
 }
 
 int hdf5_get_num_links(hid_t loc_id) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   H5G_info_t info;
   herr_t status = H5Gget_info(loc_id, &info);
   CHECK_GE(status, 0) << "Error while counting HDF5 links.";
@@ -193,6 +288,7 @@ int hdf5_get_num_links(hid_t loc_id) {
 }
 
 string hdf5_get_name_by_idx(hid_t loc_id, int idx) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   ssize_t str_size = H5Lget_name_by_idx(
       loc_id, ".", H5_INDEX_NAME, H5_ITER_NATIVE, idx, NULL, 0, H5P_DEFAULT);
   CHECK_GE(str_size, 0) << "Error retrieving HDF5 dataset at index " << idx;
@@ -0,0 +1,377 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/hwcn_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Output channels (input channels for the data pass) whose accumulators are
+// updated from one load of a row of images
+const int kBlock = 4;
+
+// kernel_params with the square defaults of ksize_w == 0 filled in and the
+// channel counts of the whole blob worked out
+struct HWCNGeometry {
+  explicit HWCNGeometry(const kernel_params& params)
+      : height(params.ydim), width(params.xdim), num(params.numimages),
+        groups(params.numgroups), in_per_group(params.inchannels),
+        out_per_group(params.outchannels),
+        channels(params.inchannels * params.numgroups),
+        num_output(params.outchannels * params.numgroups),
+        kernel_h(params.ksize), stride_h(params.stride), pad_h(params.pad),
+        dilation_h(params.ksize_w ? params.dilation_h : 1) {
+    const bool square = (params.ksize_w == 0);
+    kernel_w = square ? params.ksize : params.ksize_w;
+    stride_w = square ? params.stride : params.stride_w;
+    pad_w = square ? params.pad : params.pad_w;
+    dilation_w = square ? 1 : params.dilation_w;
+    top_height = (height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1))
+        / stride_h + 1;
+    top_width = (width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1))
+        / stride_w + 1;
+    kernel_dim = kernel_h * kernel_w;
+  }
+
+  int height, width, num, groups, in_per_group, out_per_group;
+  int channels, num_output;
+  int kernel_h, stride_h, pad_h, dilation_h;
+  int kernel_w, stride_w, pad_w, dilation_w;
+  int top_height, top_width, kernel_dim;
+};
+
+// The grain for loop indices costing work multiply-adds each. work can
+// overflow an int for large layers, but anything past one chunk's worth
+// already gives a grain of 1.
+inline int hwcn_grain(const double work) {
+  return caffe_parallel_grain(static_cast<int>(std::min(work, 16384.)));
+}
+
+template <typename Dtype>
+void ForwardRows(const Dtype* bottom, const Dtype* weights, const Dtype* bias,
+    const HWCNGeometry& g, const bool relu, Dtype* top, int begin, int end) {
+  const int N = g.num;
+  const int w_out_stride = g.in_per_group * g.kernel_dim;
+  std::vector<Dtype> acc(kBlock * N);
+  Dtype* a0 = &acc[0];
+  Dtype* a1 = a0 + N;
+  Dtype* a2 = a1 + N;
+  Dtype* a3 = a2 + N;
+  for (int oh = begin; oh < end; ++oh) {
+    for (int ow = 0; ow < g.top_width; ++ow) {
+      for (int grp = 0; grp < g.groups; ++grp) {
+        for (int ob = 0; ob < g.out_per_group; ob += kBlock) {
+          const int o = grp * g.out_per_group + ob;
+          const int nb = std::min(kBlock, g.out_per_group - ob);
+          for (int k = 0; k < nb; ++k) {
+            std::fill(a0 + k * N, a0 + (k + 1) * N,
+                bias ? bias[o + k] : Dtype(0));
+          }
+          for (int kh = 0; kh < g.kernel_h; ++kh) {
+            const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+            if (ih < 0 || ih >= g.height) { continue; }
+            for (int kw = 0; kw < g.kernel_w; ++kw) {
+              const int iw = ow * g.stride_w - g.pad_w + kw * g.dilation_w;
+              if (iw < 0 || iw >= g.width) { continue; }
+              const Dtype* x = bottom +
+                  ((ih * g.width + iw) * g.channels + grp * g.in_per_group) * N;
+              const Dtype* w = weights + o * w_out_stride + kh * g.kernel_w +
+                  kw;
+              for (int c = 0; c < g.in_per_group; ++c) {
+                const Dtype* xr = x + c * N;
+                const Dtype* wc = w + c * g.kernel_dim;
+                if (nb == kBlock) {
+                  const Dtype w0 = wc[0];
+                  const Dtype w1 = wc[w_out_stride];
+                  const Dtype w2 = wc[2 * w_out_stride];
+                  const Dtype w3 = wc[3 * w_out_stride];
+                  for (int n = 0; n < N; ++n) {
+                    const Dtype xv = xr[n];
+                    a0[n] += w0 * xv;
+                    a1[n] += w1 * xv;
+                    a2[n] += w2 * xv;
+                    a3[n] += w3 * xv;
+                  }
+                } else {
+                  for (int k = 0; k < nb; ++k) {
+                    const Dtype wk = wc[k * w_out_stride];
+                    Dtype* ak = a0 + k * N;
+                    for (int n = 0; n < N; ++n) {
+                      ak[n] += wk * xr[n];
+                    }
+                  }
+                }
+              }
+            }
+          }
+          // The block's channels are adjacent in the top
+          Dtype* t = top + ((oh * g.top_width + ow) * g.num_output + o) * N;
+          for (int i = 0; i < nb * N; ++i) {
+            t[i] = (relu && acc[i] < 0) ? Dtype(0) : acc[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BackwardDataRows(const Dtype* top_diff, const Dtype* weights,
+    const HWCNGeometry& g, Dtype* bottom_diff, int begin, int end) {
+  const int N = g.num;
+  const int w_out_stride = g.in_per_group * g.kernel_dim;
+  std::vector<Dtype> acc(kBlock * N);
+  Dtype* a0 = &acc[0];
+  Dtype* a1 = a0 + N;
+  Dtype* a2 = a1 + N;
+  Dtype* a3 = a2 + N;
+  // Each bottom value gathers the top diffs it fed, so the rows written by
+  // different threads never overlap
+  for (int ih = begin; ih < end; ++ih) {
+    for (int iw = 0; iw < g.width; ++iw) {
+      for (int grp = 0; grp < g.groups; ++grp) {
+        for (int cb = 0; cb < g.in_per_group; cb += kBlock) {
+          const int c = grp * g.in_per_group + cb;
+          const int nb = std::min(kBlock, g.in_per_group - cb);
+          std::fill(a0, a0 + nb * N, Dtype(0));
+          for (int kh = 0; kh < g.kernel_h; ++kh) {
+            const int th = ih + g.pad_h - kh * g.dilation_h;
+            if (th < 0 || th % g.stride_h != 0) { continue; }
+            const int oh = th / g.stride_h;
+            if (oh >= g.top_height) { continue; }
+            for (int kw = 0; kw < g.kernel_w; ++kw) {
+              const int tw = iw + g.pad_w - kw * g.dilation_w;
+              if (tw < 0 || tw % g.stride_w != 0) { continue; }
+              const int ow = tw / g.stride_w;
+              if (ow >= g.top_width) { continue; }
+              const Dtype* d = top_diff + ((oh * g.top_width + ow) *
+                  g.num_output + grp * g.out_per_group) * N;
+              const Dtype* w = weights + grp * g.out_per_group * w_out_stride +
+                  cb * g.kernel_dim + kh * g.kernel_w + kw;
+              for (int o = 0; o < g.out_per_group; ++o) {
+                const Dtype* dr = d + o * N;
+                const Dtype* wo = w + o * w_out_stride;
+                if (nb == kBlock) {
+                  const Dtype w0 = wo[0];
+                  const Dtype w1 = wo[g.kernel_dim];
+                  const Dtype w2 = wo[2 * g.kernel_dim];
+                  const Dtype w3 = wo[3 * g.kernel_dim];
+                  for (int n = 0; n < N; ++n) {
+                    const Dtype dv = dr[n];
+                    a0[n] += w0 * dv;
+                    a1[n] += w1 * dv;
+                    a2[n] += w2 * dv;
+                    a3[n] += w3 * dv;
+                  }
+                } else {
+                  for (int k = 0; k < nb; ++k) {
+                    const Dtype wk = wo[k * g.kernel_dim];
+                    Dtype* ak = a0 + k * N;
+                    for (int n = 0; n < N; ++n) {
+                      ak[n] += wk * dr[n];
+                    }
+                  }
+                }
+              }
+            }
+          }
+          caffe_copy(nb * N, a0,
+              bottom_diff + ((ih * g.width + iw) * g.channels + c) * N);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BackwardWeightsChannels(const Dtype* bottom, const Dtype* top_diff,
+    const HWCNGeometry& g, Dtype* weight_diff, Dtype* bias_diff, int begin,
+    int end) {
+  const int N = g.num;
+  const int filter_dim = g.in_per_group * g.kernel_dim;
+  std::vector<Dtype> acc(filter_dim);
+  // Each thread owns the filters of its output channels
+  for (int o = begin; o < end; ++o) {
+    const int grp = o / g.out_per_group;
+    std::fill(acc.begin(), acc.end(), Dtype(0));
+    Dtype bias_acc = 0;
+    for (int oh = 0; oh < g.top_height; ++oh) {
+      for (int ow = 0; ow < g.top_width; ++ow) {
+        const Dtype* d = top_diff +
+            ((oh * g.top_width + ow) * g.num_output + o) * N;
+        if (bias_diff) {
+          for (int n = 0; n < N; ++n) {
+            bias_acc += d[n];
+          }
+        }
+        if (!weight_diff) { continue; }
+        for (int kh = 0; kh < g.kernel_h; ++kh) {
+          const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+          if (ih < 0 || ih >= g.height) { continue; }
+          for (int kw = 0; kw < g.kernel_w; ++kw) {
+            const int iw = ow * g.stride_w - g.pad_w + kw * g.dilation_w;
+            if (iw < 0 || iw >= g.width) { continue; }
+            const Dtype* x = bottom +
+                ((ih * g.width + iw) * g.channels + grp * g.in_per_group) * N;
+            Dtype* a = &acc[kh * g.kernel_w + kw];
+            for (int c = 0; c < g.in_per_group; ++c) {
+              a[c * g.kernel_dim] += caffe_cpu_dot(N, d, x + c * N);
+            }
+          }
+        }
+      }
+    }
+    if (weight_diff) {
+      caffe_axpy(filter_dim, Dtype(1), &acc[0], weight_diff + o * filter_dim);
+    }
+    if (bias_diff) {
+      bias_diff[o] += bias_acc;
+    }
+  }
+}
+
+
+// The forward pass of the FPGA engine in cpfp, for the images of 16 lanes at
+// a time. Each sum starts from the bias and, burst by burst and window
+// position by position, adds the products of four channels at a time,
+// channels lanes apart in the burst, through the engine's adder tree
+void ForwardRowsCPFP(const cpfp* bottom, const cpfp* weights, const cpfp* bias,
+    const HWCNGeometry& g, const kernel_params& params, cpfp* top, int begin,
+    int end) {
+  const int N = g.num;
+  const int w_out_stride = g.in_per_group * g.kernel_dim;
+  const int burst = params.burstchannels ? params.burstchannels :
+      g.in_per_group;
+  const int lanes = (burst + 3) / 4;
+  uint16 in[4][16], w[4][16], acc[16];
+  for (int oh = begin; oh < end; ++oh) {
+    for (int ow = 0; ow < g.top_width; ++ow) {
+      for (int o = 0; o < g.num_output; ++o) {
+        const int grp = o / g.out_per_group;
+        for (int n0 = 0; n0 < N; n0 += 16) {
+          // A short last group of images leaves its other lanes at zero
+          const int images = std::min(16, N - n0);
+          std::fill(acc, acc + 16, bias ? uint16(bias[o]) : uint16(0));
+          for (int b = 0; b < g.in_per_group; b += burst) {
+            for (int kh = 0; kh < g.kernel_h; ++kh) {
+              const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+              if (ih < 0 || ih >= g.height) { continue; }
+              for (int kw = 0; kw < g.kernel_w; ++kw) {
+                const int iw = ow * g.stride_w - g.pad_w + kw * g.dilation_w;
+                if (iw < 0 || iw >= g.width) { continue; }
+                const cpfp* x = bottom + ((ih * g.width + iw) * g.channels +
+                    grp * g.in_per_group) * N + n0;
+                const cpfp* wo = weights + o * w_out_stride +
+                    kh * g.kernel_w + kw;
+                for (int l = 0; l < lanes; ++l) {
+                  for (int m = 0; m < 4; ++m) {
+                    const int c = b + m * lanes + l;
+                    const bool valid = (m * lanes + l < burst);
+                    std::fill(w[m], w[m] + 16,
+                        valid ? uint16(wo[c * g.kernel_dim]) : uint16(0));
+                    std::fill(in[m], in[m] + 16, uint16(0));
+                    for (int j = 0; valid && j < images; ++j) {
+                      in[m][j] = x[c * N + j];
+                    }
+                  }
+                  cpfp16_emu_fw_mac(in, w, acc);
+                }
+              }
+            }
+          }
+          cpfp* t = top + ((oh * g.top_width + ow) * g.num_output + o) * N +
+              n0;
+          for (int j = 0; j < images; ++j) {
+            uint32 v = acc[j];
+            if (params.relu) { v = cpfp_emu_relu(v); }
+            if (params.exp_shift) { v = cpfp_emu_shift(v, params.exp_shift); }
+            t[j] = cpfp(v);
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int hwcn_conv_top_height(const kernel_params& params) {
+  return HWCNGeometry(params).top_height;
+}
+
+int hwcn_conv_top_width(const kernel_params& params) {
+  return HWCNGeometry(params).top_width;
+}
+
+template <typename Dtype>
+void hwcn_conv_forward_cpu(const Dtype* bottom, const Dtype* weights,
+    const Dtype* bias, const kernel_params& params, Dtype* top) {
+  const HWCNGeometry g(params);
+  const double row_work = static_cast<double>(g.top_width) * g.num_output *
+      g.in_per_group * g.kernel_dim * g.num;
+  caffe_parallel_for(g.top_height, hwcn_grain(row_work),
+      boost::bind(&ForwardRows<Dtype>, bottom, weights, bias, boost::cref(g),
+          params.relu != 0, top, _1, _2));
+}
+
+template void hwcn_conv_forward_cpu<float>(const float* bottom,
+    const float* weights, const float* bias, const kernel_params& params,
+    float* top);
+template void hwcn_conv_forward_cpu<double>(const double* bottom,
+    const double* weights, const double* bias, const kernel_params& params,
+    double* top);
+
+template <typename Dtype>
+void hwcn_conv_backward_data_cpu(const Dtype* top_diff, const Dtype* weights,
+    const kernel_params& params, Dtype* bottom_diff) {
+  const HWCNGeometry g(params);
+  const double row_work = static_cast<double>(g.width) * g.channels *
+      g.out_per_group * g.kernel_dim * g.num;
+  caffe_parallel_for(g.height, hwcn_grain(row_work),
+      boost::bind(&BackwardDataRows<Dtype>, top_diff, weights, boost::cref(g),
+          bottom_diff, _1, _2));
+}
+
+template void hwcn_conv_backward_data_cpu<float>(const float* top_diff,
+    const float* weights, const kernel_params& params, float* bottom_diff);
+template void hwcn_conv_backward_data_cpu<double>(const double* top_diff,
+    const double* weights, const kernel_params& params, double* bottom_diff);
+
+template <typename Dtype>
+void hwcn_conv_backward_weights_cpu(const Dtype* bottom, const Dtype* top_diff,
+    const kernel_params& params, Dtype* weight_diff, Dtype* bias_diff) {
+  const HWCNGeometry g(params);
+  const double channel_work = static_cast<double>(g.top_height) *
+      g.top_width * g.in_per_group * g.kernel_dim * g.num;
+  caffe_parallel_for(g.num_output, hwcn_grain(channel_work),
+      boost::bind(&BackwardWeightsChannels<Dtype>, bottom, top_diff,
+          boost::cref(g), weight_diff, bias_diff, _1, _2));
+}
+
+template void hwcn_conv_backward_weights_cpu<float>(const float* bottom,
+    const float* top_diff, const kernel_params& params, float* weight_diff,
+    float* bias_diff);
+template void hwcn_conv_backward_weights_cpu<double>(const double* bottom,
+    const double* top_diff, const kernel_params& params, double* weight_diff,
+    double* bias_diff);
+
+void hwcn_conv_forward_cpfp(const cpfp* bottom, const cpfp* weights,
+    const cpfp* bias, const kernel_params& params, cpfp* top) {
+  const HWCNGeometry g(params);
+  if (params.burstchannels) {
+    CHECK_EQ(g.in_per_group % params.burstchannels, 0)
+        << "The bursts must divide the input channels of a group.";
+  }
+  const double row_work = static_cast<double>(g.top_width) * g.num_output *
+      g.in_per_group * g.kernel_dim * g.num;
+  caffe_parallel_for(g.top_height, hwcn_grain(row_work),
+      boost::bind(&ForwardRowsCPFP, bottom, weights, bias, boost::cref(g),
+          boost::cref(params), top, _1, _2));
+}
+
+}  // namespace caffe
@@ -2,6 +2,7 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -30,6 +31,7 @@ using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::ZeroCopyOutputStream;
 using google::protobuf::io::CodedOutputStream;
 using google::protobuf::Message;
+using google::protobuf::internal::WireFormatLite;
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
@@ -162,6 +164,60 @@ bool ReadFileToDatum(const string& filename, const int label,
   }
 }
 
+bool ParseDatumAliasingData(const char* buffer, size_t size, Datum* datum,
+    const char** data, size_t* data_size) {
+  // Find the data field; the fields before and after it are serialized
+  // Datum pieces on their own and are parsed as usual.
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer);
+  CodedInputStream input(bytes, size);
+  const uint32_t data_tag = WireFormatLite::MakeTag(Datum::kDataFieldNumber,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  size_t data_begin = size;
+  size_t data_end = size;
+  *data = NULL;
+  *data_size = 0;
+  while (true) {
+    const size_t tag_begin = input.CurrentPosition();
+    const uint32_t tag = input.ReadTag();
+    if (tag == 0) {
+      break;
+    }
+    if (tag != data_tag) {
+      if (!WireFormatLite::SkipField(&input, tag)) {
+        return false;
+      }
+      continue;
+    }
+    // A repeated data field would have to be merged, so the parser takes
+    // the whole Datum and data points at its copy of the bytes.
+    if (*data != NULL) {
+      if (!datum->ParseFromArray(buffer, size)) {
+        return false;
+      }
+      *data = datum->data().data();
+      *data_size = datum->data().size();
+      return true;
+    }
+    uint32_t length;
+    if (!input.ReadVarint32(&length)) {
+      return false;
+    }
+    *data = buffer + input.CurrentPosition();
+    *data_size = length;
+    if (!input.Skip(length)) {
+      return false;
+    }
+    data_begin = tag_begin;
+    data_end = input.CurrentPosition();
+  }
+  if (!input.ConsumedEntireMessage()) {
+    return false;
+  }
+  CodedInputStream tail(bytes + data_end, size - data_end);
+  return datum->ParseFromArray(buffer, data_begin) &&
+      datum->MergeFromCodedStream(&tail);
+}
+
 #ifdef USE_OPENCV
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
   cv::Mat cv_img;
@@ -0,0 +1,153 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Threads waiting for the chunks of the next loop. The calling thread runs
+// chunk 0 and worker i runs chunk i, so the split is fixed by the thread
+// count and the grain alone.
+class ParallelForPool {
+ public:
+  ParallelForPool()
+      : num_threads_(1), stop_(false), generation_(0), remaining_(0),
+        body_(NULL), n_(0), grain_(1), grains_(0), chunks_(0) {}
+  ~ParallelForPool() { StopWorkers(); }
+
+  void set_num_threads(int threads) {
+    CHECK_GE(threads, 0);
+    if (threads == 0) {
+      threads = std::max(1, static_cast<int>(
+          boost::thread::hardware_concurrency()));
+    }
+    boost::mutex::scoped_lock call(call_mutex_);
+    StopWorkers();
+    num_threads_ = threads;
+  }
+  int num_threads() const { return num_threads_; }
+
+  void Run(const int n, const int grain,
+      const boost::function<void(int, int)>& body) {
+    CHECK_GT(grain, 0);
+    if (n <= 0) { return; }
+    const int grains = (n - 1) / grain + 1;
+    boost::unique_lock<boost::mutex> call(call_mutex_, boost::try_to_lock);
+    const int chunks = std::min(num_threads_, grains);
+    if (!call.owns_lock() || chunks < 2) {
+      body(0, n);
+      return;
+    }
+    if (workers_.size() == 0) {
+      StartWorkers();
+    }
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      body_ = &body;
+      n_ = n;
+      grain_ = grain;
+      grains_ = grains;
+      chunks_ = chunks;
+      remaining_ = chunks - 1;
+      ++generation_;
+    }
+    start_.notify_all();
+    RunChunk(0);
+    boost::mutex::scoped_lock lock(mutex_);
+    while (remaining_ > 0) {
+      done_.wait(lock);
+    }
+  }
+
+ private:
+  void RunChunk(const int chunk) {
+    const int begin = static_cast<int>(std::min<int64_t>(n_,
+        static_cast<int64_t>(grains_) * chunk / chunks_ * grain_));
+    const int end = static_cast<int>(std::min<int64_t>(n_,
+        static_cast<int64_t>(grains_) * (chunk + 1) / chunks_ * grain_));
+    if (begin < end) {
+      (*body_)(begin, end);
+    }
+  }
+
+  void WorkerEntry(const int worker, int generation) {
+    while (true) {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!stop_ && generation_ == generation) {
+          start_.wait(lock);
+        }
+        if (stop_) { return; }
+        generation = generation_;
+        if (worker >= chunks_) { continue; }
+      }
+      RunChunk(worker);
+      boost::mutex::scoped_lock lock(mutex_);
+      if (--remaining_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  void StartWorkers() {
+    for (int i = 1; i < num_threads_; ++i) {
+      workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &ParallelForPool::WorkerEntry, this, i, generation_)));
+    }
+  }
+
+  void StopWorkers() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (int i = 0; i < workers_.size(); ++i) {
+      workers_[i]->join();
+    }
+    workers_.clear();
+    stop_ = false;
+  }
+
+  int num_threads_;
+  vector<shared_ptr<boost::thread> > workers_;
+  // Held by the thread whose loop is running on the pool.
+  boost::mutex call_mutex_;
+  // Guards the loop description and the progress below.
+  boost::mutex mutex_;
+  boost::condition_variable start_;
+  boost::condition_variable done_;
+  bool stop_;
+  int generation_;
+  int remaining_;
+  const boost::function<void(int, int)>* body_;
+  int n_;
+  int grain_;
+  int grains_;
+  int chunks_;
+};
+
+ParallelForPool& pool() {
+  static ParallelForPool pool;
+  return pool;
+}
+
+}  // namespace
+
+void caffe_set_cpu_threads(int threads) {
+  pool().set_num_threads(threads);
+}
+
+int caffe_cpu_threads() {
+  return pool().num_threads();
+}
+
+void caffe_parallel_for(const int n, const int grain,
+    const boost::function<void(int, int)>& body) {
+  pool().Run(n, grain, body);
+}
+
+}  // namespace caffe
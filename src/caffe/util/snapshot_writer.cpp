@@ -0,0 +1,183 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+#include "caffe/util/tensor_file.hpp"
+
+namespace caffe {
+
+namespace {
+
+template <typename Dtype>
+void CopyBlob(const Blob<Dtype>& source, const bool copy_diff,
+    shared_ptr<Blob<Dtype> >* copy) {
+  if (!*copy) {
+    copy->reset(new Blob<Dtype>());
+  }
+  (*copy)->ReshapeLike(source);
+  caffe_copy(source.count(), source.cpu_data(), (*copy)->mutable_cpu_data());
+  if (copy_diff) {
+    caffe_copy(source.count(), source.cpu_diff(),
+        (*copy)->mutable_cpu_diff());
+  }
+}
+
+string TempFilename(const string& filename) {
+  return filename + ".tmp";
+}
+
+// Syncs the temporary file of filename to disk and renames it into place.
+void CommitFile(const string& filename) {
+  const string temp = TempFilename(filename);
+  const int fd = open(temp.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "Couldn't open " << temp;
+  CHECK_EQ(fsync(fd), 0) << "Couldn't sync " << temp;
+  close(fd);
+  CHECK_EQ(std::rename(temp.c_str(), filename.c_str()), 0)
+      << "Couldn't rename " << temp << " to " << filename;
+}
+
+}  // namespace
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::SnapshotWriter() {
+  free_.push(&job_);
+  StartInternalThread();
+}
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::~SnapshotWriter() {
+  Wait();
+  StopInternalThread();
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Write(const Net<Dtype>& net,
+    const vector<shared_ptr<Blob<Dtype> > >& history,
+    const SolverState& state, const SolverParameter::SnapshotFormat format,
+    const bool write_diff, const string& model_filename,
+    const string& state_filename) {
+  CHECK_NE(format, SolverParameter_SnapshotFormat_HDF5)
+      << "HDF5 snapshots can't be written asynchronously.";
+  SnapshotJob<Dtype>* job =
+      free_.pop("Waiting for the previous snapshot to be written");
+  CPUTimer timer;
+  timer.Start();
+  job->format_ = format;
+  job->write_diff_ = write_diff;
+  job->model_filename_ = model_filename;
+  job->state_filename_ = state_filename;
+  job->state_.CopyFrom(state);
+  job->state_.clear_history();
+  // Net::ToProto and Net::ToHDF5, less the serialization
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net.layers();
+  const std::set<const Blob<Dtype>*> owned(net.learnable_params().begin(),
+      net.learnable_params().end());
+  job->net_param_.Clear();
+  job->net_param_.set_name(net.name());
+  job->layer_blobs_.resize(layers.size());
+  job->layer_blob_owned_.resize(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    LayerParameter* layer_param = job->net_param_.add_layer();
+    layer_param->CopyFrom(layers[i]->layer_param());
+    layer_param->clear_blobs();
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = layers[i]->blobs();
+    job->layer_blobs_[i].resize(blobs.size());
+    job->layer_blob_owned_[i].resize(blobs.size());
+    for (int j = 0; j < blobs.size(); ++j) {
+      CopyBlob(*blobs[j], write_diff, &job->layer_blobs_[i][j]);
+      job->layer_blob_owned_[i][j] = owned.count(blobs[j].get()) > 0;
+    }
+  }
+  job->history_.resize(history.size());
+  for (int i = 0; i < history.size(); ++i) {
+    CopyBlob(*history[i], false, &job->history_[i]);
+  }
+  LOG(INFO) << "Copied snapshot of iteration " << state.iter() << " in "
+      << timer.MilliSeconds() << " ms";
+  full_.push(job);
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Wait() {
+  free_.push(free_.pop());
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      SnapshotJob<Dtype>* job = full_.pop();
+      WriteJob(*job);
+      free_.push(job);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::WriteJob(const SnapshotJob<Dtype>& job) {
+  CPUTimer timer;
+  timer.Start();
+  const string model_temp = TempFilename(job.model_filename_);
+  const string state_temp = TempFilename(job.state_filename_);
+  switch (job.format_) {
+  case SolverParameter_SnapshotFormat_BINARYPROTO:
+  case SolverParameter_SnapshotFormat_TENSORS: {
+    if (job.format_ == SolverParameter_SnapshotFormat_TENSORS) {
+      LOG(INFO) << "Snapshotting to tensor file " << job.model_filename_;
+      // The writer syncs and renames its own temporary file into place
+      TensorFileWriter<Dtype> writer(job.model_filename_,
+          job.net_param_.name());
+      for (int i = 0; i < job.net_param_.layer_size(); ++i) {
+        for (int j = 0; j < job.layer_blobs_[i].size(); ++j) {
+          if (job.layer_blob_owned_[i][j]) {
+            writer.Add(job.net_param_.layer(i).name(), j,
+                *job.layer_blobs_[i][j]);
+          }
+        }
+      }
+      writer.Close();
+    } else {
+      LOG(INFO) << "Snapshotting to binary proto file "
+          << job.model_filename_;
+      NetParameter net_param(job.net_param_);
+      for (int i = 0; i < net_param.layer_size(); ++i) {
+        for (int j = 0; j < job.layer_blobs_[i].size(); ++j) {
+          job.layer_blobs_[i][j]->ToProto(
+              net_param.mutable_layer(i)->add_blobs(), job.write_diff_);
+        }
+      }
+      WriteProtoToBinaryFile(net_param, model_temp);
+      CommitFile(job.model_filename_);
+    }
+    LOG(INFO) << "Snapshotting solver state to binary proto file "
+        << job.state_filename_;
+    SolverState state(job.state_);
+    for (int i = 0; i < job.history_.size(); ++i) {
+      job.history_[i]->ToProto(state.add_history());
+    }
+    WriteProtoToBinaryFile(state, state_temp);
+    CommitFile(job.state_filename_);
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unsupported asynchronous snapshot format.";
+  }
+  LOG(INFO) << "Wrote snapshot of iteration " << job.state_.iter() << " in "
+      << timer.MilliSeconds() << " ms";
+}
+
+INSTANTIATE_CLASS(SnapshotWriter);
+
+}  // namespace caffe
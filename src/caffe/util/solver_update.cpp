@@ -0,0 +1,112 @@
+#include <boost/bind.hpp>
+#include <cmath>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/solver_update.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Each step is written as the multi-pass path computes it, operand order
+// included, so the two only differ where the BLAS routines round
+// differently. The rule is a template argument so that every loop is free of
+// branches on it and vectorizes.
+template <typename Dtype, SolverUpdateRule rule>
+void solver_update_range(const SolverUpdateArgs<Dtype>* args, const int begin,
+    const int end) {
+  const SolverUpdateArgs<Dtype>& a = *args;
+  const Dtype one = Dtype(1);
+  Dtype* data = a.data;
+  Dtype* diff = a.diff;
+  Dtype* h = a.history;
+  Dtype* h2 = a.history2;
+  for (int i = begin; i < end; ++i) {
+    // Normalize and Regularize
+    Dtype g = diff[i] * a.diff_scale;
+    if (a.decay) {
+      g += a.decay * (a.l1 ? Dtype(caffe_sign(data[i])) : data[i]);
+    }
+    // ComputeUpdateValue
+    Dtype u;
+    switch (rule) {
+    case SOLVER_UPDATE_SGD:
+      h[i] = a.momentum * h[i] + a.rate * g;
+      u = h[i];
+      break;
+    case SOLVER_UPDATE_NESTEROV: {
+      const Dtype previous = h[i];
+      h[i] = a.momentum * h[i] + a.rate * g;
+      u = -a.momentum * previous + (one + a.momentum) * h[i];
+      break;
+    }
+    case SOLVER_UPDATE_ADAGRAD:
+      h[i] = g * g + h[i];
+      u = a.rate * (g / (std::sqrt(h[i]) + a.delta));
+      break;
+    case SOLVER_UPDATE_RMSPROP:
+      h[i] = a.momentum * h[i] + (one - a.momentum) * (g * g);
+      u = a.rate * (g / (std::sqrt(h[i]) + a.delta));
+      break;
+    case SOLVER_UPDATE_ADADELTA:
+      h[i] = a.momentum * h[i] + (one - a.momentum) * (g * g);
+      u = g * std::sqrt((a.delta + h2[i]) / (a.delta + h[i]));
+      h2[i] = a.momentum * h2[i] + (one - a.momentum) * (u * u);
+      u = a.rate * u;
+      break;
+    case SOLVER_UPDATE_ADAM:
+      h[i] = a.momentum * h[i] + (one - a.momentum) * g;
+      h2[i] = a.momentum2 * h2[i] + (one - a.momentum2) * (g * g);
+      u = a.rate * (h[i] / (std::sqrt(h2[i]) + a.delta));
+      break;
+    }
+    // Blob::Update
+    diff[i] = u;
+    data[i] -= u;
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_solver_update(const SolverUpdateRule rule, const int n,
+    const SolverUpdateArgs<Dtype>& args) {
+  void (*range)(const SolverUpdateArgs<Dtype>*, int, int) = NULL;
+  switch (rule) {
+  case SOLVER_UPDATE_SGD:
+    range = &solver_update_range<Dtype, SOLVER_UPDATE_SGD>;
+    break;
+  case SOLVER_UPDATE_NESTEROV:
+    range = &solver_update_range<Dtype, SOLVER_UPDATE_NESTEROV>;
+    break;
+  case SOLVER_UPDATE_ADAGRAD:
+    range = &solver_update_range<Dtype, SOLVER_UPDATE_ADAGRAD>;
+    break;
+  case SOLVER_UPDATE_RMSPROP:
+    range = &solver_update_range<Dtype, SOLVER_UPDATE_RMSPROP>;
+    break;
+  case SOLVER_UPDATE_ADADELTA:
+    range = &solver_update_range<Dtype, SOLVER_UPDATE_ADADELTA>;
+    break;
+  case SOLVER_UPDATE_ADAM:
+    range = &solver_update_range<Dtype, SOLVER_UPDATE_ADAM>;
+    break;
+  default:
+    LOG(FATAL) << "Unknown solver update rule: " << rule;
+  }
+  CHECK(args.data && args.diff && args.history);
+  if (rule == SOLVER_UPDATE_ADADELTA || rule == SOLVER_UPDATE_ADAM) {
+    CHECK(args.history2);
+  }
+  caffe_parallel_for(n, caffe_parallel_grain(16),
+      boost::bind(range, &args, _1, _2));
+}
+
+template void caffe_cpu_solver_update<float>(const SolverUpdateRule rule,
+    const int n, const SolverUpdateArgs<float>& args);
+template void caffe_cpu_solver_update<double>(const SolverUpdateRule rule,
+    const int n, const SolverUpdateArgs<double>& args);
+
+}  // namespace caffe
@@ -0,0 +1,170 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/tensor_file.hpp"
+
+namespace caffe {
+
+namespace {
+
+template <typename Dtype> TensorFileIndex::DataType tensor_file_data_type();
+template <> TensorFileIndex::DataType tensor_file_data_type<float>() {
+  return TensorFileIndex_DataType_FLOAT;
+}
+template <> TensorFileIndex::DataType tensor_file_data_type<double>() {
+  return TensorFileIndex_DataType_DOUBLE;
+}
+
+size_t element_size(const TensorFileIndex::DataType data_type) {
+  switch (data_type) {
+  case TensorFileIndex_DataType_FLOAT:
+    return sizeof(float);
+  case TensorFileIndex_DataType_DOUBLE:
+    return sizeof(double);
+  default:
+    LOG(FATAL) << "Unknown tensor file data type: " << data_type;
+  }
+  return 0;
+}
+
+}  // namespace
+
+template <typename Dtype>
+TensorFileWriter<Dtype>::TensorFileWriter(const string& filename,
+    const string& net_name)
+    : filename_(filename), temp_filename_(filename + ".tmp"),
+      file_(temp_filename_.c_str(), std::ios::out | std::ios::trunc |
+          std::ios::binary) {
+  CHECK(file_.good()) << "Couldn't open " << temp_filename_
+      << " to save weights.";
+  // The header is written last, once the index has a place
+  TensorFileHeader header;
+  memset(&header, 0, sizeof(header));
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  index_.set_name(net_name);
+  index_.set_data_type(tensor_file_data_type<Dtype>());
+}
+
+template <typename Dtype>
+TensorFileWriter<Dtype>::~TensorFileWriter() {
+  Close();
+}
+
+template <typename Dtype>
+void TensorFileWriter<Dtype>::Add(const string& layer, const int index,
+    const Blob<Dtype>& blob) {
+  CHECK(file_.is_open()) << filename_ << " is closed.";
+  const uint64_t position = file_.tellp();
+  const uint64_t padding = (kTensorFileAlignment -
+      position % kTensorFileAlignment) % kTensorFileAlignment;
+  const char zeros[kTensorFileAlignment] = {0};
+  file_.write(zeros, padding);
+  TensorFileEntry* entry = index_.add_tensor();
+  entry->set_layer(layer);
+  entry->set_index(index);
+  for (int i = 0; i < blob.num_axes(); ++i) {
+    entry->mutable_shape()->add_dim(blob.shape(i));
+  }
+  entry->set_offset(position + padding);
+  file_.write(reinterpret_cast<const char*>(blob.cpu_data()),
+      sizeof(Dtype) * blob.count());
+  CHECK(file_.good()) << "Error saving weights to " << filename_ << ".";
+}
+
+template <typename Dtype>
+void TensorFileWriter<Dtype>::Close() {
+  if (!file_.is_open()) { return; }
+  string index;
+  CHECK(index_.SerializeToString(&index));
+  TensorFileHeader header;
+  memcpy(header.magic, kTensorFileMagic, sizeof(header.magic));
+  header.version = kTensorFileVersion;
+  header.alignment = kTensorFileAlignment;
+  header.index_offset = file_.tellp();
+  header.index_size = index.size();
+  file_.write(index.data(), index.size());
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file_.close();
+  CHECK(!file_.fail()) << "Error saving weights to " << temp_filename_ << ".";
+  // Replace, never rewrite, the file: a TensorFile mapping the old one keeps
+  // its pages, and the input of a conversion may be the output too.
+  const int fd = open(temp_filename_.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "Couldn't open " << temp_filename_;
+  CHECK_EQ(fsync(fd), 0) << "Couldn't sync " << temp_filename_;
+  close(fd);
+  CHECK_EQ(std::rename(temp_filename_.c_str(), filename_.c_str()), 0)
+      << "Couldn't rename " << temp_filename_ << " to " << filename_;
+}
+
+TensorFile::TensorFile(const string& filename)
+    : filename_(filename), map_(NULL), size_(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "Couldn't open " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Couldn't stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, sizeof(TensorFileHeader))
+      << filename << " is not a tensor file.";
+  // Private, so that blobs may write to the pages they alias
+  map_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(map_ != MAP_FAILED) << "Couldn't map " << filename;
+  TensorFileHeader header;
+  memcpy(&header, map_, sizeof(header));
+  CHECK_EQ(0, memcmp(header.magic, kTensorFileMagic, sizeof(header.magic)))
+      << filename << " is not a tensor file.";
+  CHECK_EQ(header.version, kTensorFileVersion)
+      << "Unsupported tensor file version in " << filename;
+  CHECK_GT(header.alignment, 0);
+  CHECK_LE(header.index_offset, size_) << filename << " is truncated.";
+  CHECK_LE(header.index_size, size_ - header.index_offset)
+      << filename << " is truncated.";
+  CHECK(index_.ParseFromArray(static_cast<char*>(map_) + header.index_offset,
+      header.index_size)) << "Couldn't parse the index of " << filename;
+  const size_t element = element_size(index_.data_type());
+  for (int i = 0; i < index_.tensor_size(); ++i) {
+    const TensorFileEntry& entry = index_.tensor(i);
+    CHECK_EQ(entry.offset() % header.alignment, 0)
+        << "Misaligned tensor in " << filename;
+    CHECK_LE(entry.offset() + element * count(entry), header.index_offset)
+        << "Tensor " << entry.index() << " of layer " << entry.layer()
+        << " runs past the data of " << filename;
+  }
+}
+
+TensorFile::~TensorFile() {
+  if (map_) {
+    munmap(map_, size_);
+  }
+}
+
+bool TensorFile::IsTensorFile(const string& filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kTensorFileMagic)];
+  file.read(magic, sizeof(magic));
+  return file.good() && memcmp(magic, kTensorFileMagic, sizeof(magic)) == 0;
+}
+
+int TensorFile::count(const TensorFileEntry& entry) {
+  int64_t count = 1;
+  for (int i = 0; i < entry.shape().dim_size(); ++i) {
+    CHECK_GE(entry.shape().dim(i), 0);
+    count *= entry.shape().dim(i);
+    CHECK_LE(count, INT_MAX) << "Tensor " << entry.index() << " of layer "
+        << entry.layer() << " is too large.";
+  }
+  return count;
+}
+
+INSTANTIATE_CLASS(TensorFileWriter);
+
+}  // namespace caffe
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Transform matrices of F(2x2, 3x3) and F(4x4, 3x3), row major. B^T is
+// alpha x alpha, G is alpha x 3 and A^T is tile x alpha, alpha = tile + 2.
+const double kBT2[] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1
+};
+const double kG2[] = {
+  1,    0,    0,
+  0.5,  0.5,  0.5,
+  0.5, -0.5,  0.5,
+  0,    0,    1
+};
+const double kAT2[] = {
+  1,  1,  1,  0,
+  0,  1, -1, -1
+};
+
+const double kBT4[] = {
+  4,  0, -5,  0,  1,  0,
+  0, -4, -4,  1,  1,  0,
+  0,  4, -4, -1,  1,  0,
+  0, -2, -1,  2,  1,  0,
+  0,  2, -1, -2,  1,  0,
+  0,  4,  0, -5,  0,  1
+};
+const double kG4[] = {
+   1. / 4,   0,        0,
+  -1. / 6,  -1. / 6,  -1. / 6,
+  -1. / 6,   1. / 6,  -1. / 6,
+   1. / 24,  1. / 12,  1. / 6,
+   1. / 24, -1. / 12,  1. / 6,
+   0,        0,        1
+};
+const double kAT4[] = {
+  1,  1,  1,  1,  1,  0,
+  0,  1, -1,  2, -2,  0,
+  0,  1,  1,  4,  4,  0,
+  0,  1, -1,  8, -8,  1
+};
+
+// out (rows x cols) = t (rows x inner) * x (inner x cols)
+template <typename Dtype>
+void TransformLeft(const double* t, const int rows, const int inner,
+    const Dtype* x, const int cols, Dtype* out) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += Dtype(t[i * inner + k]) * x[k * cols + j];
+      }
+      out[i * cols + j] = sum;
+    }
+  }
+}
+
+// out (rows x cols) = x (rows x inner) * t^T, for t (cols x inner)
+template <typename Dtype>
+void TransformRight(const Dtype* x, const int rows, const int inner,
+    const double* t, const int cols, Dtype* out) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += x[i * inner + k] * Dtype(t[j * inner + k]);
+      }
+      out[i * cols + j] = sum;
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void winograd_conv_cpu(const Dtype* data_im, const int num,
+    const int channels, const int height, const int width,
+    const Dtype* weights, const int num_output, const int group,
+    const int pad_h, const int pad_w, const int tile, Dtype* data_out) {
+  CHECK(tile == 2 || tile == 4) << "Winograd tiles must be 2 or 4.";
+  const double* BT = (tile == 2) ? kBT2 : kBT4;
+  const double* G = (tile == 2) ? kG2 : kG4;
+  const double* AT = (tile == 2) ? kAT2 : kAT4;
+  const int alpha = tile + 2;
+  const int points = alpha * alpha;
+  const int in_channels = channels / group;
+  const int out_channels = num_output / group;
+  const int out_h = height + 2 * pad_h - 2;
+  const int out_w = width + 2 * pad_w - 2;
+  const int tiles_h = (out_h + tile - 1) / tile;
+  const int tiles_w = (out_w + tile - 1) / tile;
+  const int tiles = tiles_h * tiles_w;
+
+  // U holds the transformed filters as one out_channels x in_channels matrix
+  // per point and group, V the transformed input tiles of an image as one
+  // in_channels x tiles matrix per point and group, and M their products
+  std::vector<Dtype> U(points * num_output * in_channels);
+  std::vector<Dtype> V(points * channels * tiles);
+  std::vector<Dtype> M(points * num_output * tiles);
+  std::vector<Dtype> patch(points), temp(points), transformed(points);
+
+  for (int o = 0; o < num_output; ++o) {
+    const int g = o / out_channels;
+    const int og = o % out_channels;
+    for (int c = 0; c < in_channels; ++c) {
+      TransformLeft(G, alpha, 3, weights + (o * in_channels + c) * 9, 3,
+          &temp[0]);
+      TransformRight(&temp[0], alpha, 3, G, alpha, &transformed[0]);
+      for (int xi = 0; xi < points; ++xi) {
+        U[((xi * group + g) * out_channels + og) * in_channels + c] =
+            transformed[xi];
+      }
+    }
+  }
+
+  for (int n = 0; n < num; ++n) {
+    const Dtype* im = data_im + n * channels * height * width;
+    Dtype* out = data_out + n * num_output * out_h * out_w;
+    for (int c = 0; c < channels; ++c) {
+      const int g = c / in_channels;
+      const int cg = c % in_channels;
+      const Dtype* plane = im + c * height * width;
+      for (int th = 0; th < tiles_h; ++th) {
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          // Neighbouring tiles overlap by the two rows and columns the
+          // filter reaches past the tile
+          const int h0 = th * tile - pad_h;
+          const int w0 = tw * tile - pad_w;
+          for (int i = 0; i < alpha; ++i) {
+            for (int j = 0; j < alpha; ++j) {
+              const int h = h0 + i;
+              const int w = w0 + j;
+              patch[i * alpha + j] =
+                  (h >= 0 && h < height && w >= 0 && w < width) ?
+                  plane[h * width + w] : Dtype(0);
+            }
+          }
+          TransformLeft(BT, alpha, alpha, &patch[0], alpha, &temp[0]);
+          TransformRight(&temp[0], alpha, alpha, BT, alpha, &transformed[0]);
+          const int t = th * tiles_w + tw;
+          for (int xi = 0; xi < points; ++xi) {
+            V[((xi * group + g) * in_channels + cg) * tiles + t] =
+                transformed[xi];
+          }
+        }
+      }
+    }
+    for (int xi = 0; xi < points; ++xi) {
+      for (int g = 0; g < group; ++g) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels,
+            tiles, in_channels, (Dtype)1.,
+            &U[(xi * group + g) * out_channels * in_channels],
+            &V[(xi * group + g) * in_channels * tiles], (Dtype)0.,
+            &M[(xi * group + g) * out_channels * tiles]);
+      }
+    }
+    for (int o = 0; o < num_output; ++o) {
+      const int g = o / out_channels;
+      const int og = o % out_channels;
+      Dtype* plane = out + o * out_h * out_w;
+      for (int t = 0; t < tiles; ++t) {
+        for (int xi = 0; xi < points; ++xi) {
+          patch[xi] = M[((xi * group + g) * out_channels + og) * tiles + t];
+        }
+        TransformLeft(AT, tile, alpha, &patch[0], alpha, &temp[0]);
+        TransformRight(&temp[0], tile, alpha, AT, tile, &transformed[0]);
+        // The last row and column of tiles may hang over the output
+        const int h0 = (t / tiles_w) * tile;
+        const int w0 = (t % tiles_w) * tile;
+        for (int i = 0; i < std::min(tile, out_h - h0); ++i) {
+          for (int j = 0; j < std::min(tile, out_w - w0); ++j) {
+            plane[(h0 + i) * out_w + w0 + j] = transformed[i * tile + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+template void winograd_conv_cpu<float>(const float* data_im, const int num,
+    const int channels, const int height, const int width,
+    const float* weights, const int num_output, const int group,
+    const int pad_h, const int pad_w, const int tile, float* data_out);
+template void winograd_conv_cpu<double>(const double* data_im, const int num,
+    const int channels, const int height, const int width,
+    const double* weights, const int num_output, const int group,
+    const int pad_h, const int pad_w, const int tile, double* data_out);
+
+}  // namespace caffe
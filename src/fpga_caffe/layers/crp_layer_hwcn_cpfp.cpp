@@ -9,51 +9,6 @@
 
 #define OCFACT 1 
 
-/* Computes the maximum value of a 3x3 window via a reduction tree,
- * also saves the window index at each stage to determine the index of the
- * maximum value in the window */
-
-cpfp16 max9(cpfp16 poolInBuf[9][16 * 16], int n, short16 *outMask) {
-#pragma HLS INLINE
-  cpfp16 reduce_s1[4];
-#pragma HLS ARRAY_PARTITION variable=reduce_s1 complete
-  cpfp16 reduce_s2[2];
-#pragma HLS ARRAY_PARTITION variable=reduce_s2 complete
-  cpfp16 reduce_s3;
-  cpfp16 reduce_s4;
-
-  short16 mask_s0[9];
-#pragma HLS ARRAY_PARTITION variable=mask_s0 complete
-  short16 mask_s1[4];
-#pragma HLS ARRAY_PARTITION variable=mask_s1 complete
-  short16 mask_s2[2];
-#pragma HLS ARRAY_PARTITION variable=mask_s2 complete
-  short16 mask_s3;
-
-  short16 mask_s4;
-
-  for (int i = 0; i < 9; ++i)
-    mask_s0[i] = i;
-
-  for (int i = 0; i < 4; ++i)
-    reduce_s1[i] = max(poolInBuf[i * 2][n], poolInBuf[i * 2 + 1][n],
-        mask_s0[i * 2], mask_s0[i * 2 + 1], &mask_s1[i]);
-
-  for (int i = 0; i < 2; ++i)
-    reduce_s2[i] = max(reduce_s1[i * 2], reduce_s1[i * 2 + 1],
-        mask_s1[i * 2], mask_s1[i * 2 + 1], &mask_s2[i]);
-
-  reduce_s3 = max(reduce_s2[0], reduce_s2[1], mask_s2[0], mask_s2[1],
-      &mask_s3);
-
-  reduce_s4 = max(reduce_s3, poolInBuf[8][n], mask_s3, mask_s0[8],
-      &mask_s4);
-
-  *outMask = mask_s4;
-
-  return reduce_s4;
-}
-
 /* Helper function for selecting indices and sizes in forward and backward
  * modes of operation */
 
@@ -118,8 +73,24 @@ void relu_bw(cpfp16 input, bool enable[16], cpfp output[16]) {
   output[15] = (enable[15]) ? input.sf : cpfp(0);
 }
 
+/* Converts 16 finished weight or bias diffs to float with the given exponent
+ * bias and stores them in sum, adding to the floats already there if add is
+ * high */
+
+void accumulate_float(cpfp16 val, float *sum, bool add, int exp_bias) {
+#pragma HLS INLINE
+  cpfp vals[16] = {val.s0, val.s1, val.s2, val.s3, val.s4, val.s5, val.s6,
+    val.s7, val.s8, val.s9, val.sa, val.sb, val.sc, val.sd, val.se, val.sf};
+#pragma HLS ARRAY_PARTITION variable=vals complete
+  for (int j = 0; j < 16; ++j) {
+    float prev = (add) ? sum[j] : 0.0f;
+    sum[j] = prev + cpfp2float(vals[j], exp_bias);
+  }
+}
+
 extern "C" {
-/* Kernel used for computing direct convolution, ReLU, max pooling, and inner
+/* Kernel used for computing direct convolution, ReLU, max/average pooling,
+ * and inner
  * product forward and backward. 
  * input:         Flattened input array containing image data in HWCN format
  * weights:       Convolution filters in forward pass, output diff in backward
@@ -132,11 +103,16 @@ extern "C" {
  *                max pooling mode
  * params:        Engine specific parameters used for controlling the output
  *                and compute modes
- * group_idx:     Group index used for forward convolution only currently
+ * group_idx:     Group index for group convolution, selects the channel
+ *                slice of the inputs, weights and outputs
+ * accum:         Float sums of the weight diffs over several backward
+ *                passes, laid out as output, used only in the weight pass
+ *                when params selects it
  */ 
 
 void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
-    cpfp16 *output, short *tagVals, int *params, int group_idx) { 
+    cpfp16 *output, short *tagVals, int *params, int group_idx,
+    float *accum) { 
 // Ports 
 #pragma HLS data_pack variable=weights
 #pragma HLS data_pack variable=output
@@ -147,6 +123,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
 #pragma HLS INTERFACE m_axi port=bias offset=slave bundle=gmem4
 #pragma HLS INTERFACE m_axi port=tagVals offset=slave bundle=gmem5
 #pragma HLS INTERFACE m_axi port=params offset=slave bundle=gmem6
+#pragma HLS INTERFACE m_axi port=accum offset=slave bundle=gmem7
 #pragma HLS INTERFACE s_axilite port=input bundle=control
 #pragma HLS INTERFACE s_axilite port=output bundle=control
 #pragma HLS INTERFACE s_axilite port=weights bundle=control
@@ -154,6 +131,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
 #pragma HLS INTERFACE s_axilite port=tagVals bundle=control
 #pragma HLS INTERFACE s_axilite port=params bundle=control
 #pragma HLS INTERFACE s_axilite port=group_idx bundle=control
+#pragma HLS INTERFACE s_axilite port=accum bundle=control
 #pragma HLS INTERFACE s_axilite port=return bundle=control
 
   // Input tile buffer
@@ -184,27 +162,23 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   cpfp biasBuf[OCFACT][(6144 / OCFACT)];
 #pragma HLS ARRAY_PARTITION variable=biasBuf complete dim=1
 
-  // Pooling input buffer, used for reading in pooling window data
-  cpfp16 poolInBuf[9][16 * 16];
-#pragma HLS ARRAY_PARTITION variable=poolInBuf complete dim=1
+  // Pooling input buffer, used for reading in one window position
+  cpfp16 poolInBuf[16 * 16];
 
-  // Pooling output buffer, used for outputting max pooling value
+  // Pooling output buffer, accumulates the max or sum over the window
   cpfp16 poolOutBuf[16 * 16];
 
   // Pooling output mask buffer, used for storing max input tags
-  short outMask[16 * 256];
-#pragma HLS ARRAY_PARTITION variable=outMask cyclic factor=16 dim=1
+  short16 outMask[16 * 16];
 
   // Pooling output buffer for backward pass, used for outputting window diff
-  cpfp16 poolOutBufBW[9][16 * 16];
-#pragma HLS ARRAY_PARTITION variable=poolOutBufBW complete dim=1
+  cpfp16 poolOutBufBW[16 * 16];
 
   // Pooling input buffer for backward pass, used for reading input diff
   cpfp16 poolInBufBW[16 * 16];
 
   // Pooling input mask buffer, used for reading tags from the forward pass
-  short inMask[16 * 256];
-#pragma HLS ARRAY_PARTITION variable=inMask cyclic factor=16 dim=1
+  short16 inMask[16 * 16];
 
   cpfp multRes[OCFACT][4][16];
 #pragma HLS ARRAY_PARTITION variable=multRes complete dim=1
@@ -279,10 +253,10 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   ap_uint<10> ydim = params[6];
   // Input image x dimension size
   ap_uint<10> xdim = params[7];
-  // Kernel size, only square kernels support currently
-  ap_uint<5> ksize = params[9];
-  // Number of groups for group convolution, currently only supported in
-  // forward path
+  // Kernel height
+  ap_uint<5> ksize_h = params[9];
+  // Number of groups for group convolution, the engine is launched once per
+  // group in all three passes
   short numgroups = params[10];
   // Number of input/output images, this should be a multiple of 16 and
   // burstoc * numImages / 16 should be >= 12
@@ -297,28 +271,66 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
   // backward == 1: backward wrt weights
   // backward == 2: backward wrt data
   short backward = params[14];
-  // Convolution stride: stride is the same in x and y dimensions currently
-  ap_uint<4> stride = params[15];
-  // Convolution padding: symmetric padding in x and y dimensions
-  ap_uint<4> pad = params[16];
-  // operation: conv, pool
-  short pool = params[17];
-  // Pooling size, 2 or 3 supported currently
-  ap_uint<3> pksize = params[18];
-
-  assert((pksize == 2) || (pksize == 3));
-  assert(ksize <= 11);
-  assert(ksize >= 1);
+  // Convolution/pooling stride in the y dimension
+  ap_uint<4> stride_h = params[15];
+  // Convolution/pooling padding in the y dimension, the same padding is
+  // applied to the top and the bottom of the image
+  ap_uint<4> pad_h = params[16];
+  // operation: 0 = conv, 1 = max pool, 2 = average pool
+  short operation = params[17];
+  // Pooling window height, and its width unless ksize_w is set
+  ap_uint<10> pksize = params[18];
+  // Kernel width, stride and padding in the x dimension, and the kernel
+  // dilation in both dimensions. A kernel width of 0 means only the y values
+  // were set, the kernel is then square with symmetric stride and padding
+  // and no dilation
+  bool squareMode = (params[19] == 0);
+  ap_uint<5> ksize_w = (squareMode) ? (int)ksize_h : params[19];
+  ap_uint<4> stride_w = (squareMode) ? (int)stride_h : params[20];
+  ap_uint<4> pad_w = (squareMode) ? (int)pad_h : params[21];
+  ap_uint<4> dilation_h = (squareMode) ? 1 : params[22];
+  ap_uint<4> dilation_w = (squareMode) ? 1 : params[23];
+  // Pooling windows take their width from the kernel width field
+  ap_uint<10> pksize_w = (squareMode) ? (int)pksize : params[19];
+  // Exponent shift of the finished outputs, from the exponent bias of the
+  // products to that of the output
+  short expShift = params[24];
+  // Weight pass only, 0 writes the cpfp diffs to output, 1 stores them as
+  // floats in accum and 2 adds them to the floats in accum, so that diffs
+  // accumulate over several batches without rounding to cpfp
+  short accumulate = params[25];
+  // Exponent bias of the weight diffs for the conversion to float
+  short accumExpBias = params[26];
+
+  assert((operation == 0) || ((pksize >= 1) && (pksize_w >= 1) &&
+        (pad_h < pksize) && (pad_w < pksize_w)));
+  // Max pooling tags the window position of the max in a short
+  assert((operation == 0) || (pksize * pksize_w <= 32768));
+  assert(ksize_h <= 11);
+  assert(ksize_h >= 1);
+  assert((operation != 0) || (ksize_w <= 11));
+  assert((operation != 0) || (ksize_w >= 1));
+  assert(stride_h >= 1);
+  assert(stride_w >= 1);
+  assert(dilation_h >= 1);
+  assert(dilation_w >= 1);
   assert(burstChannels <= 2048);
   assert(burstChannels >= 4);
   assert(numImages <= 256);
 
   bool bwMode = (backward == 1);
   bool fwMode = (backward == 0);
-  bool poolMode = (operation == 1);
+  bool accMode = bwMode && (accumulate != 0);
+  bool accAdd = (accumulate == 2);
+  bool poolMode = (operation != 0);
+  bool aveMode = (operation == 2);
+
+  // Extent of the dilated kernel window
+  short ksize_h_eff = (ksize_h - 1) * dilation_h + 1;
+  short ksize_w_eff = (ksize_w - 1) * dilation_w + 1;
 
-  ap_uint<10> xdim_out = ((xdim - ksize + 2 * pad) / stride) + 1;
-  ap_uint<10> ydim_out = xdim_out;
+  ap_uint<10> ydim_out = ((ydim - ksize_h_eff + 2 * pad_h) / stride_h) + 1;
+  ap_uint<10> xdim_out = ((xdim - ksize_w_eff + 2 * pad_w) / stride_w) + 1;
 
   ap_uint<8> imgFact = numImages >> 4;
   short burstFact = burstChannels >> 2;
@@ -373,13 +385,13 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
             bool xkset = false;
             bool ykset = false;
             // Iterate over each window position
-            for (int p = 0; p < ksize; ++p) {
-              for (int q = 0; q < ksize; ++q) {
-                short in_y = y * stride - pad + p;
-                short in_x = x * stride - pad + q;
+            for (int p = 0; p < ksize_h; ++p) {
+              for (int q = 0; q < ksize_w; ++q) {
+                short in_y = y * stride_h - pad_h + p * dilation_h;
+                short in_x = x * stride_w - pad_w + q * dilation_w;
                 int inIdx = (((in_y * xdim + in_x) * numgroups + group_idx) *
                     inChannels + n * burstChannels) * imgFact;
-                int inBufIdx = (p * ksize + q) * burstFact * imgFact;
+                int inBufIdx = (p * ksize_w + q) * burstFact * imgFact;
                 short inSize = burstFact * imgFact;
 
                 // Determine the begining of none-zero data for non-zero
@@ -402,10 +414,11 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                 }
 
                 if (in_y >= 0 && in_y < ydim && in_x >= 0 && in_x < xdim) {
-                  if ((x != 0) && (q + stride < ksize)) {
+                  if ((x != 0) && (dilation_w == 1) &&
+                      (q + stride_w < ksize_w)) {
                     // Shift input to the left rather than doing a memory
-                    // transfer for each window (stride of one only)
-                    short q_off = burstFact * imgFact * stride;
+                    // transfer for each window (undilated kernels only)
+                    short q_off = burstFact * imgFact * stride_w;
                     SHIFT_LOOP: for (int i = 0; i < inSize; ++i) {
 #pragma HLS pipeline
 #pragma HLS dependence variable=inBuf inter false
@@ -450,7 +463,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
               // Initialize output to be 0
               short outSizeFW, outSizeBW, outSize; 
               outSizeFW = burstoc * imgFact;
-              outSizeBW = burstoc * ksize * ksize * wcFact;
+              outSizeBW = burstoc * ksize_h * ksize_w * wcFact;
               outSize = mode_select(outSizeFW, outSizeBW, bwMode);
               for (int i = 0; i < outSize; ++i) {
 #pragma HLS pipeline
@@ -465,18 +478,18 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                 int outIdx, outIdxFW, outIdxBW;
                 short outSize, outSizeFW, outSizeBW;
                 outIdxBW = ((o * OCFACT + k) * burstoc + outChannels *
-                    group_idx) * ksize * ksize * icFact + n * burstoc * ksize
-                    * ksize * wcFact;
+                    group_idx) * ksize_h * ksize_w * icFact + n * burstoc *
+                    ksize_h * ksize_w * wcFact;
                 outIdxFW = (((y * xdim_out + x) * numgroups + group_idx) *
                   outChannels + (o * OCFACT + k) * burstoc) * imgFact; 
-                outSizeBW = burstoc * ksize * ksize * wcFact;
+                outSizeBW = burstoc * ksize_h * ksize_w * wcFact;
                 outSizeFW = burstoc * imgFact;
 
                 // Handles the edge case where the burst transfer exceeds the
                 // data size by reducing the burst transfer
                 if ((o * OCFACT + k) * burstoc + burstoc > outChannels) {
                   short newBurst = outChannels - (o * OCFACT + k) * burstoc;
-                  outSizeBW = newBurst * ksize * ksize * wcFact;
+                  outSizeBW = newBurst * ksize_h * ksize_w * wcFact;
                   outSizeFW =  newBurst * imgFact;
                 }
 
@@ -499,16 +512,16 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                   outChannels + (o * OCFACT + k) * burstoc) * imgFact;
               wSizeBW = burstoc * imgFact;
               wIdxFW = ((o * OCFACT + k) * burstoc + outChannels *
-                group_idx) * ksize * ksize * icFact + n * burstoc * ksize *
-                ksize * wcFact;
-              wSizeFW = burstoc * ksize * ksize * wcFact;
+                group_idx) * ksize_h * ksize_w * icFact + n * burstoc *
+                ksize_h * ksize_w * wcFact;
+              wSizeFW = burstoc * ksize_h * ksize_w * wcFact;
               
               // Handles the edge case where the burst transfer exceeds the
               // data size by reducing the burst transfer
 
               if ((o * OCFACT + k) * burstoc + burstoc > outChannels) {
                 short newBurst = outChannels - (o * OCFACT + k) * burstoc;
-                wSizeFW = newBurst * ksize * ksize * wcFact;
+                wSizeFW = newBurst * ksize_h * ksize_w * wcFact;
                 wSizeBW =  newBurst * imgFact;
               }
 
@@ -587,12 +600,12 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
 
               if (counter_bw > counter_bw_lim)
                 counter_bw = 0;
-              short filt_off_fw = (yk_off + ydim_off_fw) * ksize + xk_off +
+              short filt_off_fw = (yk_off + ydim_off_fw) * ksize_w + xk_off +
                 xdim_off_fw;
-              short filt_off_bw = (yk_off + ydim_off_bw) * ksize + xk_off +
+              short filt_off_bw = (yk_off + ydim_off_bw) * ksize_w + xk_off +
                 xdim_off_bw;
-              short wIdxFW = (b_off_fw * ksize * ksize + filt_off_fw) * wcFact
-                + (w_off_fw >> 2);
+              short wIdxFW = (b_off_fw * ksize_h * ksize_w + filt_off_fw) *
+                wcFact + (w_off_fw >> 2);
               short wIdxBW = b_off_bw * imgFact + img_off_bw;
               short foutIdx = counter_bw * 4;
               short inIdxFW = (filt_off_fw * burstFact + w_off_fw) * imgFact
@@ -600,7 +613,7 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
               short inIdxBW = (filt_off_bw * burstFact + w_off_bw) * imgFact
                 + img_off_bw;
               short outIdxFW = b_off_fw * imgFact + img_off_fw;
-              short outIdxBW = b_off_bw * ksize * ksize * wcFact +
+              short outIdxBW = b_off_bw * ksize_h * ksize_w * wcFact +
                 filt_off_bw * wcFact + (w_off_bw >> 2);
               short inIdx = (bwMode) ? inIdxBW : inIdxFW;
               short outIdx = (bwMode) ? outIdxBW : outIdxFW;
@@ -712,15 +725,15 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
               int outIdx, outIdxFW, outIdxBW;
               short outSize, outSizeFW, outSizeBW;
               outIdxBW = ((o * OCFACT + k) * burstoc + outChannels *
-                  group_idx) * ksize * ksize * icFact + n * burstoc * ksize *
-                  ksize * wcFact;
+                  group_idx) * ksize_h * ksize_w * icFact + n * burstoc *
+                  ksize_h * ksize_w * wcFact;
               outIdxFW = (((y * xdim_out + x) * numgroups + group_idx) *
                 outChannels + (o * OCFACT + k) * burstoc) * imgFact;
-              outSizeBW = burstoc * ksize * ksize * wcFact;
+              outSizeBW = burstoc * ksize_h * ksize_w * wcFact;
               outSizeFW = burstoc * imgFact;
               if ((o * OCFACT + k) * burstoc + burstoc > outChannels) { 
                 short newBurst = outChannels - (o * OCFACT + k) * burstoc;
-                outSizeBW = newBurst * ksize * ksize * wcFact;
+                outSizeBW = newBurst * ksize_h * ksize_w * wcFact;
                 outSizeFW =  newBurst * imgFact;
               }
 
@@ -735,157 +748,168 @@ void crp_layer_hwcn_cpfp(cpfp16 *input, cpfp16 *weights, cpfp *bias,
                     outSize);
               }
 
-              if (writeEnable)
+              // Outputs are finished after the last input channel burst in
+              // the forward and data passes, and on every write in the
+              // weight pass
+              if (writeEnable && (expShift != 0) && (bwMode ||
+                    (n == rpo - 1))) {
+                for (int i = 0; i < outSize; ++i) {
+#pragma HLS pipeline
+                  outBuf[k][i] = exp_shift(outBuf[k][i], expShift);
+                }
+              }
+
+              if (writeEnable && accMode) {
+                for (int i = 0; i < outSize; ++i) {
+#pragma HLS pipeline
+                  float sums[16];
+                  if (accAdd)
+                    memcpy(sums, accum + (outIdx + i) * 16,
+                        sizeof(float) * 16);
+                  accumulate_float(outBuf[k][i], sums, accAdd, accumExpBias);
+                  memcpy(accum + (outIdx + i) * 16, sums, sizeof(float) * 16);
+                }
+              } else if (writeEnable) {
                 memcpy(output + outIdx, outBuf[k], sizeof(cpfp16) * outSize);
+              }
             }
           }
         }
       }
     }
   } else {
-    // Max Pooling, 2x2 or 3x3
-    short pooled_height = ydim - pksize;
-    if ((pooled_height & 0x1) == 1)
-      pooled_height = (pooled_height >> 1) + 2;
-    else
-      pooled_height = (pooled_height >> 1) + 1;
-
-    short pooled_width = pooled_height;
+    // Pooling, pksize x pksize_w window with per dimension stride and
+    // padding, max (operation == 1) or average (operation == 2)
+    short pooled_height = (ydim + 2 * pad_h - pksize + stride_h - 1) /
+      stride_h + 1;
+    short pooled_width = (xdim + 2 * pad_w - pksize_w + stride_w - 1) /
+      stride_w + 1;
+    // The last window has to start inside the image or the left padding
+    if ((pooled_height - 1) * stride_h >= ydim + pad_h)
+      pooled_height--;
+    if ((pooled_width - 1) * stride_w >= xdim + pad_w)
+      pooled_width--;
+
+    short burstSize = imgFact * burstChannels;
 
     if (fwMode) {
       // Forward path
       for (int ph = 0; ph < pooled_height; ++ph) {
         for (int pw = 0; pw < pooled_width; ++pw) {
-          int hstart = ph * 2;
-          int wstart = pw * 2;
+          short hstart = ph * stride_h - pad_h;
+          short wstart = pw * stride_w - pad_w;
+          // Average pooling divides by the window size including padding
+          short hend = (hstart + pksize < ydim + pad_h) ? (short)(hstart +
+              pksize) : (short)(ydim + pad_h);
+          short wend = (wstart + pksize_w < xdim + pad_w) ? (short)(wstart +
+              pksize_w) : (short)(xdim + pad_w);
+          cpfp poolScale = cpfp(1.0f / ((hend - hstart) * (wend - wstart)));
           for (int c = 0; c < rpo; ++c) {
-            // Read in a burst of input windows
-            for (int h = 0; h < 3; ++h) {
-              for (int w = 0; w < 3; ++w) {
-                int inIdx = (((hstart + h) * xdim + (wstart + w)) *
-                    inChannels + c * burstChannels) * imgFact;
-                if ((hstart + h < ydim) && (wstart + w < xdim) &&
-                    (h < pksize) && (w < pksize))
-                  memcpy(poolInBuf[h * 3 + w], input + inIdx,
-                      sizeof(cpfp16) * imgFact * burstChannels);
-                else
-                  for (int n = 0; n < imgFact * burstChannels; ++n)
+            for (int n = 0; n < burstSize; ++n) {
+#pragma HLS pipeline
+              if (aveMode)
+                poolOutBuf[n] = cpfp(0);
+              else
+                poolOutBuf[n] = cpfp(CPFP_MIN_VAL);
+              outMask[n] = 0;
+            }
+            // Stream the window in one position at a time, positions in the
+            // padding are skipped
+            for (int h = 0; h < pksize; ++h) {
+              for (int w = 0; w < pksize_w; ++w) {
+                short y = hstart + h;
+                short x = wstart + w;
+                if ((y >= 0) && (y < ydim) && (x >= 0) && (x < xdim)) {
+                  int inIdx = ((y * xdim + x) * inChannels + c *
+                      burstChannels) * imgFact;
+                  memcpy(poolInBuf, input + inIdx, sizeof(cpfp16) *
+                      burstSize);
+                  short16 winIdx;
+                  winIdx = (short)(h * pksize_w + w);
+                  POOL_LOOP: for (int n = 0; n < burstSize; ++n) {
 #pragma HLS pipeline
-                    poolInBuf[h * 3 + w][n] = cpfp(CPFP_MIN_VAL);
+                    if (aveMode)
+                      poolOutBuf[n] = poolOutBuf[n] + poolInBuf[n];
+                    else
+                      poolOutBuf[n] = max(poolOutBuf[n], poolInBuf[n],
+                          outMask[n], winIdx, &outMask[n]);
+                  }
+                }
               }
             }
-            POOL_LOOP: for (int n = 0; n < imgFact * burstChannels; ++n) {
+            if (aveMode) {
+              for (int n = 0; n < burstSize; ++n) {
 #pragma HLS pipeline
-              short16 mask;
-              // Compute 3x3 max window
-              poolOutBuf[n] = max9(poolInBuf, n, &mask);
-              // Set the tag for each input image
-              outMask[n * 16 + 0] = mask.s0;
-              outMask[n * 16 + 1] = mask.s1;
-              outMask[n * 16 + 2] = mask.s2;
-              outMask[n * 16 + 3] = mask.s3;
-              outMask[n * 16 + 4] = mask.s4;
-              outMask[n * 16 + 5] = mask.s5;
-              outMask[n * 16 + 6] = mask.s6;
-              outMask[n * 16 + 7] = mask.s7;
-              outMask[n * 16 + 8] = mask.s8;
-              outMask[n * 16 + 9] = mask.s9;
-              outMask[n * 16 + 10] = mask.sa;
-              outMask[n * 16 + 11] = mask.sb;
-              outMask[n * 16 + 12] = mask.sc;
-              outMask[n * 16 + 13] = mask.sd;
-              outMask[n * 16 + 14] = mask.se;
-              outMask[n * 16 + 15] = mask.sf;
+                poolOutBuf[n] = poolOutBuf[n] * poolScale;
+              }
             }
             // Write the output and tags to on-board memory
             int outIdx = ((ph * pooled_width + pw) * inChannels +
                 c * burstChannels) * imgFact;
-            memcpy(output + outIdx, poolOutBuf, sizeof(cpfp16) *
-                imgFact * burstChannels);
-            memcpy(tagVals + outIdx * 16, outMask,
-                sizeof(short) * numImages * burstChannels);
+            memcpy(output + outIdx, poolOutBuf, sizeof(cpfp16) * burstSize);
+            if (!aveMode)
+              memcpy(tagVals + outIdx * 16, outMask,
+                  sizeof(short16) * burstSize);
           }
         }
       }
     } else {
-      // Backward path
-      for (int ph = 0; ph < pooled_height; ++ph) {
-        for (int c = 0; c < rpo; ++c) {
-          for (int pw = 0; pw < pooled_width; ++pw) {
-            int hstart = ph * 2;
-            int wstart = pw * 2;
-            int inIdx = ((ph * pooled_width + pw) * inChannels + c *
-                burstChannels) * imgFact;
-            // Read the input diffs and the tag values
-            memcpy(poolInBufBW, input + inIdx, sizeof(cpfp16) * imgFact *
-                burstChannels);
-            memcpy(inMask, tagVals + inIdx * 16, sizeof(short) * numImages *
-                burstChannels);
-
-            // Initialization logic to reduce the amount of transfers required
-            
-            if (pksize == 3) {
-              for (int w = 0; w < 3; ++w) {
-                int outIdx = ((hstart * xdim + (wstart + w)) * inChannels +
-                  c * burstChannels) * imgFact;
-                if ((ph != 0) && (hstart < ydim) && (wstart + w < xdim) &&
-                    ((pw == 0) || (w != 0))) {
-                  memcpy(poolOutBufBW[w], output + outIdx,
-                    sizeof(cpfp16) * imgFact * burstChannels); 
-                }
-              }
-            }
-
-            for (int i = 0; i < imgFact * burstChannels; ++i) {
+      // Backward path. Each input position gathers the diffs of the windows
+      // covering it into poolOutBufBW, on chip, and is written once, rather
+      // than every window reading back and rewriting the positions it covers
+      for (int y = 0; y < ydim; ++y) {
+        for (int x = 0; x < xdim; ++x) {
+          // Windows ph in [phstart, phend) and pw in [pwstart, pwend)
+          // cover (y, x)
+          short phstart = (y + pad_h < pksize) ? 0 :
+            (short)((y + pad_h - pksize) / stride_h + 1);
+          short phend = ((y + pad_h) / stride_h + 1 < pooled_height) ?
+            (short)((y + pad_h) / stride_h + 1) : pooled_height;
+          short pwstart = (x + pad_w < pksize_w) ? 0 :
+            (short)((x + pad_w - pksize_w) / stride_w + 1);
+          short pwend = ((x + pad_w) / stride_w + 1 < pooled_width) ?
+            (short)((x + pad_w) / stride_w + 1) : pooled_width;
+          for (int c = 0; c < rpo; ++c) {
+            for (int n = 0; n < burstSize; ++n) {
 #pragma HLS pipeline
-              for (int h = 0; h < 3; ++h) {
-                for (int w = 0; w < 3; ++w) {
-                  if ((pksize != 3) || ((ph == 0) && ((pw == 0) || (w != 0)))
-                    || (((h != 0) && (ph != 0)) && ((pw == 0) || (w != 0)))) {
-                    poolOutBufBW[h * 3 + w][i] = 0;
-                  }
-                }
-              }
+              poolOutBufBW[n] = cpfp(0);
             }
-            // Accumulate diffs in overlapping case, in non-overlapping case
-            // accumulation isn't required
-            for (int n = 0; n < imgFact * burstChannels; ++n) {
+            for (int ph = phstart; ph < phend; ++ph) {
+              for (int pw = pwstart; pw < pwend; ++pw) {
+                short hstart = ph * stride_h - pad_h;
+                short wstart = pw * stride_w - pad_w;
+                short hend = (hstart + pksize < ydim + pad_h) ?
+                  (short)(hstart + pksize) : (short)(ydim + pad_h);
+                short wend = (wstart + pksize_w < xdim + pad_w) ?
+                  (short)(wstart + pksize_w) : (short)(xdim + pad_w);
+                cpfp poolScale = cpfp(1.0f / ((hend - hstart) *
+                      (wend - wstart)));
+                int inIdx = ((ph * pooled_width + pw) * inChannels + c *
+                    burstChannels) * imgFact;
+                // Read the window's diffs and the tag values
+                memcpy(poolInBufBW, input + inIdx, sizeof(cpfp16) *
+                    burstSize);
+                if (!aveMode)
+                  memcpy(inMask, tagVals + inIdx * 16, sizeof(short16) *
+                      burstSize);
+                short winIdx = (short)((y - hstart) * pksize_w +
+                    (x - wstart));
+                for (int n = 0; n < burstSize; ++n) {
 #pragma HLS pipeline
-#pragma HLS DEPENDENCE variable poolInBuf inter false
-              poolOutBufBW[inMask[n * 16 + 0]][n].s0 += poolInBufBW[n].s0;
-              poolOutBufBW[inMask[n * 16 + 1]][n].s1 += poolInBufBW[n].s1;
-              poolOutBufBW[inMask[n * 16 + 2]][n].s2 += poolInBufBW[n].s2;
-              poolOutBufBW[inMask[n * 16 + 3]][n].s3 += poolInBufBW[n].s3;
-              poolOutBufBW[inMask[n * 16 + 4]][n].s4 += poolInBufBW[n].s4;
-              poolOutBufBW[inMask[n * 16 + 5]][n].s5 += poolInBufBW[n].s5;
-              poolOutBufBW[inMask[n * 16 + 6]][n].s6 += poolInBufBW[n].s6;
-              poolOutBufBW[inMask[n * 16 + 7]][n].s7 += poolInBufBW[n].s7;
-              poolOutBufBW[inMask[n * 16 + 8]][n].s8 += poolInBufBW[n].s8;
-              poolOutBufBW[inMask[n * 16 + 9]][n].s9 += poolInBufBW[n].s9;
-              poolOutBufBW[inMask[n * 16 + 10]][n].sa += poolInBufBW[n].sa;
-              poolOutBufBW[inMask[n * 16 + 11]][n].sb += poolInBufBW[n].sb;
-              poolOutBufBW[inMask[n * 16 + 12]][n].sc += poolInBufBW[n].sc;
-              poolOutBufBW[inMask[n * 16 + 13]][n].sd += poolInBufBW[n].sd;
-              poolOutBufBW[inMask[n * 16 + 14]][n].se += poolInBufBW[n].se;
-              poolOutBufBW[inMask[n * 16 + 15]][n].sf += poolInBufBW[n].sf;
-            }
-            // Write the output diff window to on-board memory
-            for (int h = 0; h < pksize; ++h) {
-              for (int w = 0; w < pksize; ++w) {
-                int outIdx = (((hstart + h) * xdim + (wstart + w))
-                    * inChannels + c * burstChannels) * imgFact;
-                if ((hstart + h < ydim) && (wstart + w < xdim))
-                  memcpy(output + outIdx, poolOutBufBW[h * 3 + w],
-                      sizeof(cpfp16) * imgFact * burstChannels);
+                  cpfp16 diff;
+                  if (aveMode)
+                    diff = poolInBufBW[n] * poolScale;
+                  else
+                    diff = select(poolInBufBW[n], inMask[n], winIdx);
+                  poolOutBufBW[n] = poolOutBufBW[n] + diff;
+                }
               }
             }
-            // Shift output window to the left
-            for (int i = 0; i < imgFact * burstChannels; ++i) {
-#pragma HLS pipeline
-              for (int h = 0; h < 3; ++h) {
-                poolOutBufBW[h * 3][i] = poolOutBufBW[h * 3 + 2][i];
-              }
-            } 
+            // Positions no window covers, with a stride above the window
+            // size, get a zero diff
+            int outIdx = ((y * xdim + x) * inChannels + c * burstChannels) *
+              imgFact;
+            memcpy(output + outIdx, poolOutBufBW, sizeof(cpfp16) * burstSize);
           }
         }
       }
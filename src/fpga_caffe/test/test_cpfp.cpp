@@ -118,6 +118,9 @@ TYPED_TEST(CPFPTest, TestMultRandom) {
     for (int j = 0; j < size; ++j) {
       EXPECT_TRUE(checkEQ(this->input[j] * this->weights[j],
             this->hw_results[j], 1e-3, 1e-3));
+      // The host operators emulate the datapath bit for bit
+      EXPECT_EQ(float(cpfp(this->input[j]) * cpfp(this->weights[j])),
+          this->hw_results[j]);
     }
     clReleaseMemObject(this->ocl_input);
     clReleaseMemObject(this->ocl_weights);
@@ -277,6 +280,8 @@ TYPED_TEST(CPFPTest, TestAdd) {
       std::cout<<this->input[j] + this->weights[j]<<" "<<this->hw_results[j]<<std::endl;
       EXPECT_TRUE(checkEQ(this->input[j] + this->weights[j],
             this->hw_results[j], 1e-2, 1e-2));
+      EXPECT_EQ(float(cpfp(this->input[j]) + cpfp(this->weights[j])),
+          this->hw_results[j]);
     }
     clReleaseMemObject(this->ocl_input);
     clReleaseMemObject(this->ocl_weights);
@@ -434,6 +439,8 @@ TYPED_TEST(CPFPTest, TestSub) {
       std::cout<<this->input[j] + this->weights[j]<<" "<<this->hw_results[j]<<std::endl;
       EXPECT_TRUE(checkEQ(this->input[j] + this->weights[j],
             this->hw_results[j], 1e-2, 1e-2));
+      EXPECT_EQ(float(cpfp(this->input[j]) + cpfp(this->weights[j])),
+          this->hw_results[j]);
     }
     clReleaseMemObject(this->ocl_input);
     clReleaseMemObject(this->ocl_weights);
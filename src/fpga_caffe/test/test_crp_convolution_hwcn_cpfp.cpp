@@ -148,6 +148,7 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1F_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -183,6 +184,150 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1F_CPFP) {
   }
 }
 
+TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLURectF_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params(3, this->params[0]);
+  std::vector<cl_event> events;
+
+  // 1x7 and 7x1 kernels on a non-square image, and a dilated 3x3 kernel with
+  // different x and y strides
+  params[0].ydim = 4;
+  params[0].xdim = 6;
+  params[0].ksize = 1;
+  params[0].ksize_w = 7;
+  params[0].stride = 1;
+  params[0].stride_w = 1;
+  params[0].pad = 0;
+  params[0].pad_w = 3;
+  params[0].dilation_h = 1;
+  params[0].dilation_w = 1;
+  params[1] = params[0];
+  params[1].ydim = 6;
+  params[1].xdim = 4;
+  params[1].ksize = 7;
+  params[1].ksize_w = 1;
+  params[1].pad = 3;
+  params[1].pad_w = 0;
+  params[2] = params[0];
+  params[2].ydim = 7;
+  params[2].xdim = 5;
+  params[2].ksize = 3;
+  params[2].ksize_w = 3;
+  params[2].stride = 2;
+  params[2].pad = 2;
+  params[2].pad_w = 1;
+  params[2].dilation_h = 2;
+  params[2].dilation_w = 2;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ydim_out = ref_conv_dim(params[i].ydim, params[i].ksize,
+        params[i].stride, params[i].pad, params[i].dilation_h);
+    int xdim_out = ref_conv_dim(params[i].xdim, params[i].ksize_w,
+        params[i].stride_w, params[i].pad_w, params[i].dilation_w);
+    // Set sizes
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * params[i].ksize * params[i].ksize_w;
+    int outsize = params[i].numimages * params[i].outchannels * ydim_out *
+      xdim_out * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    int relusize = (outsize > insize) ? outsize : insize;
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.assign(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.resize(relusize / 16, -1);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, 0.0, 1.0);
+    fillVectorCPFP(this->weights, -1.0, 1.0);
+    fillVectorCPFP(this->bias, -1.0, 1.0);
+   
+    toCPFP(this->input, this->input_pad_cpfp);
+    toCPFP(this->weights, this->weights_pad_cpfp);
+    toCPFP(this->bias, this->bias_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * relusize / 16, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL, 
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * relusize / 16, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem), 
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem), 
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_conv_layer_hwcn(this->input, this->weights, this->bias,
+        this->sw_results, params[i]);
+    ref_relu_layer(this->sw_results);
+    for (int j = 0; j < outsize; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j],
+            this->hw_results[j], 1e-1, 1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
 TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1B_CPFP) {
   this->ocl.Setup();
   std::vector<kernel_params> params = this->params;
@@ -266,6 +411,7 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1B_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -296,3 +442,485 @@ TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU1x1B_CPFP) {
   }
 }
 
+TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU3x3B_Group_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    // Set sizes
+    int ksize = params[i].ksize;
+    params[i].backward = 1;
+    params[i].numgroups = 2;
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].numimages * params[i].outchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int outsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.resize(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.resize(wsize / 16, -1);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+    fillVectorCPFP(this->weights, 0.0, 1.0);
+    fillVectorCPFP(this->bias, -1.0, 1.0);
+  
+    toCPFP(this->input, this->input_pad_cpfp);
+    toCPFP(this->weights, this->weights_pad_cpfp);
+    toCPFP(this->bias, this->bias_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * wsize / 16, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL, 
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * wsize / 16, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem), 
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem), 
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_backward_conv_layer_hwcn(this->input, this->weights,
+        this->sw_results, params[i]);
+    int size = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+    for (int j = 0; j < size; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j], this->hw_results[j], 1e-1,
+            1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLU3x3BI_Group_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    // The data pass correlates the top diffs of each group with the rotated
+    // filters of that group, the ReLU tags go with the top diffs
+    int ksize = params[i].ksize;
+    params[i].backward = 2;
+    params[i].numgroups = 2;
+    params[i].fc = 0;
+    // Set sizes
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+    int outsize = params[i].numimages * params[i].outchannels * params[i].ydim
+      * params[i].xdim * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.assign(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.assign(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.assign(insize / 16, -1);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+    fillVectorCPFP(this->weights, -1.0, 1.0);
+
+    toCPFP(this->input, this->input_pad_cpfp);
+    toCPFP(this->weights, this->weights_pad_cpfp);
+    toCPFP(this->bias, this->bias_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * insize / 16, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * insize / 16, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem),
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem),
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int),
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_conv_layer_hwcn(this->input, this->weights, this->bias,
+        this->sw_results, params[i]);
+    for (int j = 0; j < outsize; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j], this->hw_results[j], 1e-1,
+            1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLUBias_Group_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    // The bias pass is a 1x1 weight pass of the top diffs against a single
+    // output channel of ones per group, the diffs of each group start on a
+    // 16 channel boundary
+    params[i].backward = 1;
+    params[i].numgroups = 2;
+    params[i].fc = 0;
+    params[i].ksize = 1;
+    params[i].pad = 0;
+    params[i].outchannels = 1;
+    params[i].rpofm = 1;
+    params[i].burstydim = 1;
+    // Set sizes
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].numimages * params[i].outchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int outsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.assign(wsize, 1.0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.assign(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.assign(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.assign(insize / 16, -1);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+
+    toCPFP(this->input, this->input_pad_cpfp);
+    toCPFP(this->weights, this->weights_pad_cpfp);
+    toCPFP(this->bias, this->bias_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * insize / 16, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * insize / 16, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem),
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem),
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int),
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_backward_conv_layer_hwcn(this->input, this->weights,
+        this->sw_results, params[i]);
+    for (int j = 0; j < outsize; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j], this->hw_results[j], 1e-1,
+            1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPConvolutionHWCNCPFPTest, TestConvReLURectB_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params(2, this->params[0]);
+  std::vector<cl_event> events;
+
+  // Weight diffs of a 1x7 kernel on a non-square image, and of a dilated
+  // 3x3 kernel with different x and y strides
+  params[0].ydim = 4;
+  params[0].xdim = 6;
+  params[0].ksize = 1;
+  params[0].ksize_w = 7;
+  params[0].stride = 1;
+  params[0].stride_w = 1;
+  params[0].pad = 0;
+  params[0].pad_w = 3;
+  params[0].dilation_h = 1;
+  params[0].dilation_w = 1;
+  params[0].backward = 1;
+  params[1] = params[0];
+  params[1].ydim = 7;
+  params[1].xdim = 5;
+  params[1].ksize = 3;
+  params[1].ksize_w = 3;
+  params[1].stride = 2;
+  params[1].pad = 2;
+  params[1].pad_w = 1;
+  params[1].dilation_h = 2;
+  params[1].dilation_w = 2;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ydim_out = ref_conv_dim(params[i].ydim, params[i].ksize,
+        params[i].stride, params[i].pad, params[i].dilation_h);
+    int xdim_out = ref_conv_dim(params[i].xdim, params[i].ksize_w,
+        params[i].stride_w, params[i].pad_w, params[i].dilation_w);
+    // Set sizes
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].numimages * params[i].outchannels * ydim_out *
+      xdim_out * params[i].numgroups;
+    int outsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * params[i].ksize * params[i].ksize_w;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.assign(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.assign(wsize / 16, -1);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+    fillVectorCPFP(this->weights, 0.0, 1.0);
+    fillVectorCPFP(this->bias, -1.0, 1.0);
+
+    toCPFP(this->input, this->input_pad_cpfp);
+    toCPFP(this->weights, this->weights_pad_cpfp);
+    toCPFP(this->bias, this->bias_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * wsize / 16, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * wsize / 16, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem),
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem),
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int),
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_backward_conv_layer_hwcn(this->input, this->weights,
+        this->sw_results, params[i]);
+    for (int j = 0; j < outsize; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j], this->hw_results[j], 1e-1,
+            1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
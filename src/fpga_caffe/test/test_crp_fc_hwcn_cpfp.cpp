@@ -202,6 +202,7 @@ TYPED_TEST(CRPFCHWCNCPFPTest, TestFCReLU1x1F_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -320,6 +321,7 @@ TYPED_TEST(CRPFCHWCNCPFPTest, TestFCReLU1x1B_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -72,12 +72,14 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2F_Pool_CPFP) {
     // Set sizes
     params[i].pool = 1;
     params[i].pksize = 2;
+    params[i].stride = 2;
+    params[i].pad = 0;
     int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
       params[i].xdim * params[i].numgroups;
     int wsize = params[i].outchannels * params[i].numgroups *
       params[i].inchannels * ksize * ksize;
 
-    int pooled_height = ceil((params[i].ydim - params[i].pksize) / 2.0) + 1;
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
     int pooled_width = pooled_height;
 
     int outsize = params[i].numimages * params[i].inchannels * pooled_height
@@ -145,6 +147,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2F_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -188,9 +191,11 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2B_Pool_CPFP) {
     // Set sizes
     params[i].pool = 1;
     params[i].pksize = 2;
+    params[i].stride = 2;
+    params[i].pad = 0;
     params[i].backward = 1;
 
-    int pooled_height = ceil((params[i].ydim - params[i].pksize) / 2.0) + 1;
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
     int pooled_width = pooled_height;
 
     int insize = params[i].numimages * params[i].inchannels * pooled_height *
@@ -265,6 +270,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP2x2B_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -304,12 +310,14 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3F_Pool_CPFP) {
     // Set sizes
     params[i].pool = 1;
     params[i].pksize = 3;
+    params[i].stride = 2;
+    params[i].pad = 0;
     int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
       params[i].xdim * params[i].numgroups;
     int wsize = params[i].outchannels * params[i].numgroups *
       params[i].inchannels * ksize * ksize;
 
-    int pooled_height = ceil((params[i].ydim - params[i].pksize) / 2.0) + 1;
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
     int pooled_width = pooled_height;
 
     int outsize = params[i].numimages * params[i].inchannels * pooled_height
@@ -376,6 +384,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3F_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -419,9 +428,11 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3B_Pool_CPFP) {
     // Set sizes
     params[i].pool = 1;
     params[i].pksize = 3;
+    params[i].stride = 2;
+    params[i].pad = 0;
     params[i].backward = 1;
 
-    int pooled_height = ceil((params[i].ydim - params[i].pksize) / 2.0) + 1;
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
     int pooled_width = pooled_height;
 
     int insize = params[i].numimages * params[i].inchannels * pooled_height *
@@ -518,6 +529,7 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3B_Pool_CPFP) {
           &this->ocl_params);
       clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
           &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
       clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
           &(events[g]));
     }
@@ -546,3 +558,612 @@ TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3B_Pool_CPFP) {
     clReleaseMemObject(this->ocl_params);
   }
 }
+
+TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3S1P1F_Pool_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ksize = params[i].ksize;
+    // Set sizes
+    params[i].pool = 1;
+    params[i].pksize = 3;
+    params[i].stride = 1;
+    params[i].pad = 1;
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
+    int pooled_width = pooled_height;
+
+    int outsize = params[i].numimages * params[i].inchannels * pooled_height
+      * pooled_width * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    int relusize = outsize;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, -0.0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.resize(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.resize(relusize, 0);
+    this->sw_relu_vals.resize(relusize, 0);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+   
+    toCPFP(this->input, this->input_pad_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * relusize, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL, 
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem), 
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem), 
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * relusize, this->relu_vals.data(), 0,
+        NULL, NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_pool_layer_hwcn(this->input, this->sw_results, this->sw_relu_vals,
+        params[i]);
+    int size = params[i].numimages * params[i].inchannels *
+      params[i].numgroups * pooled_height * pooled_width;
+    for (int j = 0; j < size; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j],
+            this->hw_results[j], 1e-1, 1e-1));
+      EXPECT_EQ(this->relu_vals[j], this->sw_relu_vals[j]);
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3F_AvePool_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ksize = params[i].ksize;
+    // Set sizes
+    params[i].pool = 2;
+    params[i].pksize = 3;
+    params[i].stride = 2;
+    params[i].pad = 1;
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
+    int pooled_width = pooled_height;
+
+    int outsize = params[i].numimages * params[i].inchannels * pooled_height
+      * pooled_width * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    int relusize = outsize;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, -0.0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.resize(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.resize(relusize, 0);
+    this->sw_relu_vals.resize(relusize, 0);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+   
+    toCPFP(this->input, this->input_pad_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * relusize, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL, 
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem), 
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem), 
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * relusize, this->relu_vals.data(), 0,
+        NULL, NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_pool_layer_hwcn(this->input, this->sw_results, this->sw_relu_vals,
+        params[i]);
+    int size = params[i].numimages * params[i].inchannels *
+      params[i].numgroups * pooled_height * pooled_width;
+    for (int j = 0; j < size; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j],
+            this->hw_results[j], 1e-1, 1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRP3x3B_AvePool_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ksize = params[i].ksize;
+    // Set sizes
+    params[i].pool = 2;
+    params[i].pksize = 3;
+    params[i].stride = 2;
+    params[i].pad = 1;
+    params[i].backward = 1;
+
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
+    int pooled_width = pooled_height;
+
+    int insize = params[i].numimages * params[i].inchannels * pooled_height *
+      pooled_width * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+    
+    int outsize = params[i].numimages * params[i].inchannels * params[i].ydim
+      * params[i].xdim * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    int relusize = insize;
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.resize(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.resize(relusize, 0);
+    this->sw_relu_vals.resize(relusize, 0);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, 0.0, 1.0);
+   
+    toCPFP(this->input, this->input_pad_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * relusize, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL, 
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * relusize, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem), 
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem), 
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_backward_pool_layer_hwcn(this->input, this->sw_results,
+        this->relu_vals, params[i]);
+    int size = params[i].numimages * params[i].inchannels *
+      params[i].numgroups * params[i].ydim * params[i].xdim;
+    for (int j = 0; j < size; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j],
+            this->hw_results[j], 1e-1, 1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRPGlobalF_AvePool_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params = this->params;
+  std::vector<cl_event> events;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ksize = params[i].ksize;
+    // Set sizes
+    params[i].pool = 2;
+    params[i].pksize = params[i].ydim;
+    params[i].stride = 1;
+    params[i].pad = 0;
+    int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
+      params[i].xdim * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
+    int pooled_width = pooled_height;
+
+    int outsize = params[i].numimages * params[i].inchannels * pooled_height
+      * pooled_width * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    int relusize = outsize;
+    events.clear();
+    // Resize vectors
+    this->input.resize(insize, -0.0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.resize(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.resize(relusize, 0);
+    this->sw_relu_vals.resize(relusize, 0);
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+   
+    toCPFP(this->input, this->input_pad_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * relusize, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL, 
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem), 
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem), 
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int), 
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * relusize, this->relu_vals.data(), 0,
+        NULL, NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_pool_layer_hwcn(this->input, this->sw_results, this->sw_relu_vals,
+        params[i]);
+    int size = params[i].numimages * params[i].inchannels *
+      params[i].numgroups * pooled_height * pooled_width;
+    for (int j = 0; j < size; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j],
+            this->hw_results[j], 1e-1, 1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
+
+TYPED_TEST(CRPPoolingHWCNCPFPTest, TestCRPRectB_Pool_CPFP) {
+  this->ocl.Setup();
+  std::vector<kernel_params> params(2, this->params[0]);
+  std::vector<cl_event> events;
+
+  // Max and average pooling of 2x3 windows with different x and y strides
+  // and pads on a non-square image
+  params[0].ydim = 5;
+  params[0].xdim = 6;
+  params[0].pool = 1;
+  params[0].pksize = 2;
+  params[0].ksize_w = 3;
+  params[0].stride = 2;
+  params[0].stride_w = 1;
+  params[0].pad = 0;
+  params[0].pad_w = 1;
+  params[0].dilation_h = 1;
+  params[0].dilation_w = 1;
+  params[0].backward = 1;
+  params[1] = params[0];
+  params[1].pool = 2;
+
+  for (int i = 0; i < params.size(); ++i) {
+    int ksize = params[i].ksize;
+    int pksize_w, stride_w, pad_w;
+    ref_pool_geometry(params[i], &pksize_w, &stride_w, &pad_w);
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
+    int pooled_width = ref_pooled_dim(params[i].xdim, pksize_w, stride_w,
+        pad_w);
+    // Set sizes
+    int insize = params[i].numimages * params[i].inchannels * pooled_height *
+      pooled_width * params[i].numgroups;
+    int wsize = params[i].outchannels * params[i].numgroups *
+      params[i].inchannels * ksize * ksize;
+    int outsize = params[i].numimages * params[i].inchannels * params[i].ydim
+      * params[i].xdim * params[i].numgroups;
+    int bsize = params[i].outchannels * params[i].numgroups;
+    int events_size = params[i].numgroups;
+    int relusize = insize;
+    // Resize vectors
+    this->input.resize(insize, 0);
+    this->input_pad_cpfp.resize(insize, cpfp(0));
+    this->weights.resize(wsize, 0);
+    this->weights_pad_cpfp.resize(wsize, cpfp(0));
+    this->bias.resize(bsize, 0);
+    this->bias_cpfp.resize(bsize, cpfp(0));
+    this->sw_results.assign(outsize, 0);
+    this->hw_results.resize(outsize, 0);
+    this->hw_results_cpfp.resize(outsize, cpfp(0));
+    this->relu_vals.assign(relusize, 0);
+
+    // Take the max positions from a forward pass over a random bottom
+    std::vector<float> bottom(outsize, 0);
+    std::vector<float> top(insize, 0);
+    fillVectorCPFP(bottom, -1.0, 1.0);
+    ref_pool_layer_hwcn(bottom, top, this->relu_vals, params[i]);
+
+    events.resize(events_size);
+    // Populate vectors
+    fillVectorCPFP(this->input, -1.0, 1.0);
+
+    toCPFP(this->input, this->input_pad_cpfp);
+
+    // Create buffers
+    this->ocl_input = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * insize, NULL, NULL);
+    this->ocl_weights = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * wsize, NULL, NULL);
+    this->ocl_output = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_WRITE,
+        sizeof(cpfp) * outsize, NULL, NULL);
+    this->ocl_bias = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(cpfp) * bsize, NULL, NULL);
+    this->ocl_relu_vals = clCreateBuffer(this->ocl.oclContext,
+        CL_MEM_READ_WRITE, sizeof(short) * relusize, NULL, NULL);
+    this->ocl_params = clCreateBuffer(this->ocl.oclContext, CL_MEM_READ_ONLY,
+        sizeof(kernel_params), NULL, NULL);
+
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_input, CL_TRUE,
+        0, sizeof(cpfp) * insize, this->input_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_weights, CL_TRUE,
+        0, sizeof(cpfp) * wsize, this->weights_pad_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_bias, CL_TRUE, 0,
+        sizeof(cpfp) * bsize, this->bias_cpfp.data(), 0, NULL,
+        NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_relu_vals,
+        CL_TRUE, 0, sizeof(short) * relusize, this->relu_vals.data(), 0,
+        NULL, NULL);
+    clEnqueueWriteBuffer(this->ocl.oclCommandQueue, this->ocl_params, CL_TRUE,
+        0, sizeof(kernel_params), &params[i], 0, NULL, NULL);
+
+    for (int g = 0; g < params[i].numgroups; ++g) {
+      clSetKernelArg(this->ocl.oclKernel, 0, sizeof(cl_mem),
+          &this->ocl_input);
+      clSetKernelArg(this->ocl.oclKernel, 1, sizeof(cl_mem),
+          &this->ocl_weights);
+      clSetKernelArg(this->ocl.oclKernel, 2, sizeof(cl_mem),
+          &this->ocl_bias);
+      clSetKernelArg(this->ocl.oclKernel, 3, sizeof(cl_mem),
+          &this->ocl_output);
+      clSetKernelArg(this->ocl.oclKernel, 4, sizeof(cl_mem),
+          &this->ocl_relu_vals);
+      clSetKernelArg(this->ocl.oclKernel, 5, sizeof(cl_mem),
+          &this->ocl_params);
+      clSetKernelArg(this->ocl.oclKernel, 6, sizeof(cl_int),
+          &g);
+      clSetKernelArg(this->ocl.oclKernel, 7, sizeof(cl_mem), NULL);
+      clEnqueueTask(this->ocl.oclCommandQueue, this->ocl.oclKernel, 0, NULL,
+          &(events[g]));
+    }
+
+    clWaitForEvents(events_size, events.data());
+
+    clEnqueueReadBuffer(this->ocl.oclCommandQueue, this->ocl_output, CL_TRUE,
+        0, sizeof(cpfp) * outsize, this->hw_results_cpfp.data(), 0, NULL,
+        NULL);
+
+    toFloat(this->hw_results_cpfp, this->hw_results);
+
+    ref_backward_pool_layer_hwcn(this->input, this->sw_results,
+        this->relu_vals, params[i]);
+    for (int j = 0; j < outsize; ++j) {
+      EXPECT_TRUE(checkEQ(this->sw_results[j],
+            this->hw_results[j], 1e-1, 1e-1));
+    }
+    clReleaseMemObject(this->ocl_input);
+    clReleaseMemObject(this->ocl_weights);
+    clReleaseMemObject(this->ocl_output);
+    clReleaseMemObject(this->ocl_bias);
+    clReleaseMemObject(this->ocl_relu_vals);
+    clReleaseMemObject(this->ocl_params);
+  }
+}
@@ -160,32 +160,61 @@ void ref_relu_layer(std::vector<float>& output) {
     output[i] = std::max((float)0.0, output[i]);
 }
 
+int ref_pooled_dim(int dim, int pksize, int stride, int pad) {
+  int pooled = static_cast<int>(ceil(static_cast<float>(
+       dim + 2 * pad - pksize) / stride)) + 1;
+  if ((pooled - 1) * stride >= dim + pad)
+    --pooled;
+  return pooled;
+}
+
+int ref_pooled_dim(int dim, kernel_params params) {
+  return ref_pooled_dim(dim, params.pksize, params.stride, params.pad);
+}
+
+void ref_pool_geometry(kernel_params params, int *pksize_w, int *stride_w,
+    int *pad_w) {
+  // Same as the engine, a ksize_w of 0 means a square window with the same
+  // stride and pad in x
+  bool square = (params.ksize_w == 0);
+  *pksize_w = square ? params.pksize : params.ksize_w;
+  *stride_w = square ? params.stride : params.stride_w;
+  *pad_w = square ? params.pad : params.pad_w;
+}
+
 void ref_pool_layer_hwcn(std::vector<float> input, std::vector<float>& output,
     std::vector<short>& sw_relu_vals, kernel_params params) {
 
+  bool ave = (params.pool == 2);
   for (int i = 0; i < output.size(); ++i)
-    output[i] = -FLT_MAX;
+    output[i] = ave ? 0 : -FLT_MAX;
 
-  int pooled_height_ = static_cast<int>(ceil(static_cast<float>(
-       params.ydim - params.pksize) / 2)) + 1;
-  int pooled_width_ = pooled_height_;
+  int kernel_w_, stride_w_, pad_w_;
+  ref_pool_geometry(params, &kernel_w_, &stride_w_, &pad_w_);
+  int pooled_height_ = ref_pooled_dim(params.ydim, params);
+  int pooled_width_ = ref_pooled_dim(params.xdim, kernel_w_, stride_w_,
+      pad_w_);
   int kernel_h_ = params.pksize;
-  int kernel_w_ = params.pksize;
   int height_ = params.ydim;
   int width_ = params.xdim;
   int channels_ = params.inchannels;
   int num_ = params.numimages;
-  int stride_h_ = 2;
-  int stride_w_ = 2;
+  int stride_h_ = params.stride;
+  int pad_h_ = params.pad;
  
   for (int ph = 0; ph < pooled_height_; ++ph) {
     for (int pw = 0; pw < pooled_width_; ++pw) {
-      int hstart = ph * stride_h_;
-      int wstart = pw * stride_w_;
-      int hend = std::min(hstart + kernel_h_, height_);
-      int wend = std::min(wstart + kernel_w_, width_);
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = std::min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = std::min(wstart + kernel_w_, width_ + pad_w_);
+      int pool_size = (hend - hstart) * (wend - wstart);
+      int hoff = hstart;
+      int woff = wstart;
       hstart = std::max(hstart, 0);
       wstart = std::max(wstart, 0);
+      hend = std::min(hend, height_);
+      wend = std::min(wend, width_);
       for (int h = hstart; h < hend; ++h) {
         for (int w = wstart; w < wend; ++w) {
           for (int c = 0; c < channels_; ++c) {
@@ -194,9 +223,12 @@ void ref_pool_layer_hwcn(std::vector<float> input, std::vector<float>& output,
                 * num_ + n;
               int index = h * width_ + w;
               int bot_offset = (index * channels_ + c) * num_ + n;
-              if (input[bot_offset] > output[top_offset]) {
+              if (ave) {
+                output[top_offset] += input[bot_offset] / pool_size;
+              } else if (input[bot_offset] > output[top_offset]) {
                 output[top_offset] = input[bot_offset];
-                sw_relu_vals[top_offset] = (h - hstart) * 3 + (w - wstart);
+                sw_relu_vals[top_offset] = (h - hoff) * kernel_w_ +
+                  (w - woff);
               }
             }
           }
@@ -213,34 +245,69 @@ void ref_backward_pool_layer_hwcn(std::vector<float> input,
   for (int i = 0; i < output.size(); ++i)
     output[i] = 0;
 
-  int pooled_height_ = static_cast<int>(ceil(static_cast<float>(
-       params.ydim - params.pksize) / 2)) + 1;
-  int pooled_width_ = pooled_height_;
+  int kernel_w_, stride_w_, pad_w_;
+  ref_pool_geometry(params, &kernel_w_, &stride_w_, &pad_w_);
+  int pooled_height_ = ref_pooled_dim(params.ydim, params);
+  int pooled_width_ = ref_pooled_dim(params.xdim, kernel_w_, stride_w_,
+      pad_w_);
+  int kernel_h_ = params.pksize;
+  int height_ = params.ydim;
   int width_ = params.xdim;
   int channels_ = params.inchannels;
   int num_ = params.numimages;
-  int stride_h_ = 2;
-  int stride_w_ = 2;
+  int stride_h_ = params.stride;
+  int pad_h_ = params.pad;
  
   for (int ph = 0; ph < pooled_height_; ++ph) {
     for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = std::min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = std::min(wstart + kernel_w_, width_ + pad_w_);
+      int pool_size = (hend - hstart) * (wend - wstart);
       for (int c = 0; c < channels_; ++c) {
         for (int n = 0; n < num_; ++n) {
           int in_idx = ((ph * pooled_width_ + pw) * channels_ + c) * num_ + n;
-          int hw = relu_vals[in_idx];
-          int hstart = ph * stride_h_;
-          int wstart = pw * stride_w_;
-          int w = hw % 3;
-          int h = hw / 3;
-          int bottom_index = (((hstart + h) * width_ + (wstart + w))
-              * channels_ + c) * num_ + n;
-          output[bottom_index] += input[in_idx];
+          if (params.pool == 2) {
+            for (int h = std::max(hstart, 0); h < std::min(hend, height_);
+                ++h) {
+              for (int w = std::max(wstart, 0); w < std::min(wend, width_);
+                  ++w) {
+                int bottom_index = ((h * width_ + w) * channels_ + c) * num_
+                  + n;
+                output[bottom_index] += input[in_idx] / pool_size;
+              }
+            }
+          } else {
+            int hw = relu_vals[in_idx];
+            int w = hw % kernel_w_;
+            int h = hw / kernel_w_;
+            int bottom_index = (((hstart + h) * width_ + (wstart + w))
+                * channels_ + c) * num_ + n;
+            output[bottom_index] += input[in_idx];
+          }
         }
       }
     }
   }
 }
 
+void ref_conv_geometry(kernel_params params, int *ksize_w, int *stride_w,
+    int *pad_w, int *dilation_h, int *dilation_w) {
+  // Same as the engine, a ksize_w of 0 means a square kernel with the same
+  // stride and pad in x and no dilation
+  bool square = (params.ksize_w == 0);
+  *ksize_w = square ? params.ksize : params.ksize_w;
+  *stride_w = square ? params.stride : params.stride_w;
+  *pad_w = square ? params.pad : params.pad_w;
+  *dilation_h = square ? 1 : params.dilation_h;
+  *dilation_w = square ? 1 : params.dilation_w;
+}
+
+int ref_conv_dim(int dim, int ksize, int stride, int pad, int dilation) {
+  return (dim - ((ksize - 1) * dilation + 1) + 2 * pad) / stride + 1;
+}
+
 void ref_conv_layer_hwcn(std::vector<float> input, std::vector<float> weights,
     std::vector<float> bias, std::vector<float>& output, kernel_params params,
     bool wino) {
@@ -251,16 +318,16 @@ void ref_conv_layer_hwcn(std::vector<float> input, std::vector<float> weights,
   int inchannels = params.inchannels * numgroups;
   int outchannels = params.outchannels * numgroups;
   int numimages = params.numimages;
-  int ksize = params.ksize;
+  int ksize_h = params.ksize;
+  int stride_h = params.stride;
+  int pad_h = params.pad;
+  int ksize_w, stride_w, pad_w, dilation_h, dilation_w;
+  ref_conv_geometry(params, &ksize_w, &stride_w, &pad_w, &dilation_h,
+      &dilation_w);
   int ydim = params.ydim;
   int xdim = params.xdim;
-  int outYDim = (params.ydim - params.ksize + 2 * params.pad) /
-    params.stride + 1;
-  int outXDim = (params.xdim - params.ksize + 2 * params.pad) /
-    params.stride + 1;
-
-  int pad = params.pad;
-  int stride = params.stride;
+  int outYDim = ref_conv_dim(ydim, ksize_h, stride_h, pad_h, dilation_h);
+  int outXDim = ref_conv_dim(xdim, ksize_w, stride_w, pad_w, dilation_w);
 
   int burstoc = params.burstydim;
   int rpofm = params.rpofm;
@@ -280,10 +347,10 @@ void ref_conv_layer_hwcn(std::vector<float> input, std::vector<float> weights,
               for (int m = 0; m < 4; ++m) {
                 for (int y = 0; y < outYDim; y++) {
                   for (int x = 0; x < outXDim; x++) {
-                    for (int p = 0; p < ksize; p++) {
-                      for (int q = 0; q < ksize; q++) {
-                        int in_y = y * stride - pad + p;
-                        int in_x = x * stride - pad + q;
+                    for (int p = 0; p < ksize_h; p++) {
+                      for (int q = 0; q < ksize_w; q++) {
+                        int in_y = y * stride_h - pad_h + p * dilation_h;
+                        int in_x = x * stride_w - pad_w + q * dilation_w;
                         if (in_y >= 0 && in_y < ydim && in_x >= 0 &&
                             in_x < xdim && o * burstoc + b < o_g) {
                           out_idx = ((y * outXDim + x) * outchannels +
@@ -293,15 +360,16 @@ void ref_conv_layer_hwcn(std::vector<float> input, std::vector<float> weights,
                             k_head) * numimages + n;
                           if (wino) {
                             int burst_idx = p * burstchannels + k * 4 + m +
-                              b * ksize * burstchannels;
-                            k_idx = (q * o_g + o_head + o * burstoc) * ksize *
-                              k_g + r * burstchannels * ksize * burstoc +
-                              burst_idx;
+                              b * ksize_h * burstchannels;
+                            k_idx = (q * o_g + o_head + o * burstoc) *
+                              ksize_h * k_g + r * burstchannels * ksize_h *
+                              burstoc + burst_idx;
                           } else {
-                            int burst_idx = (p * ksize + q) * burstchannels +
-                              k * 4 + m + b * ksize * ksize * burstchannels;
-                            k_idx = (o_head + o * burstoc) * ksize * ksize *
-                              k_g + r * burstchannels * ksize * ksize *
+                            int burst_idx = (p * ksize_w + q) * burstchannels
+                              + k * 4 + m + b * ksize_h * ksize_w *
+                              burstchannels;
+                            k_idx = (o_head + o * burstoc) * ksize_h * ksize_w
+                              * k_g + r * burstchannels * ksize_h * ksize_w *
                               burstoc + burst_idx;
                           }
                           output[out_idx] += input[in_idx] * weights[k_idx];
@@ -339,16 +407,16 @@ void ref_backward_conv_layer_hwcn(std::vector<float> input,
   int inchannels = params.inchannels * numgroups;
   int outchannels = params.outchannels * numgroups;
   int numimages = params.numimages;
-  int ksize = params.ksize;
-
-  int pad = params.pad;
-  int stride = params.stride;
+  int ksize_h = params.ksize;
+  int stride_h = params.stride;
+  int pad_h = params.pad;
+  int ksize_w, stride_w, pad_w, dilation_h, dilation_w;
+  ref_conv_geometry(params, &ksize_w, &stride_w, &pad_w, &dilation_h,
+      &dilation_w);
   int ydim = params.ydim;
   int xdim = params.xdim;
-  int outYDim = (params.ydim - params.ksize + 2 * params.pad) /
-    params.stride + 1;
-  int outXDim = (params.xdim - params.ksize + 2 * params.pad) /
-    params.stride + 1;
+  int outYDim = ref_conv_dim(ydim, ksize_h, stride_h, pad_h, dilation_h);
+  int outXDim = ref_conv_dim(xdim, ksize_w, stride_w, pad_w, dilation_w);
   int burstoc = params.burstydim;
   int rpofm = params.rpofm;
   int burstchannels = params.burstchannels;
@@ -367,10 +435,10 @@ void ref_backward_conv_layer_hwcn(std::vector<float> input,
               for (int m = 0; m < 4; ++m) {
                 for (int p = 0; p < outYDim; p++) {
                   for (int q = 0; q < outXDim; q++) {
-                    for (int y = 0; y < ksize; y++) {
-                      for (int x = 0; x < ksize; x++) {
-                        int in_y = p * stride - pad + y;
-                        int in_x = q * stride - pad + x;
+                    for (int y = 0; y < ksize_h; y++) {
+                      for (int x = 0; x < ksize_w; x++) {
+                        int in_y = p * stride_h - pad_h + y * dilation_h;
+                        int in_x = q * stride_w - pad_w + x * dilation_w;
                         if (in_y >= 0 && in_y < ydim
                           && in_x >= 0 && in_x < xdim
                           && o * burstoc + b < o_g) {
@@ -379,11 +447,11 @@ void ref_backward_conv_layer_hwcn(std::vector<float> input,
                           in_idx = ((in_y * xdim + in_x) * inchannels + m *
                             (burstchannels / 4) + r * burstchannels + k +
                             k_head) * numimages + n;
-                          int burst_idx = (y * ksize + x) * burstchannels +
-                            k * 4 + m + b * ksize * ksize * burstchannels;
-                          k_idx = (o_head + o * burstoc) * ksize * ksize * k_g
-                            + r * burstchannels * ksize * ksize * burstoc +
-                            burst_idx;
+                          int burst_idx = (y * ksize_w + x) * burstchannels +
+                            k * 4 + m + b * ksize_h * ksize_w * burstchannels;
+                          k_idx = (o_head + o * burstoc) * ksize_h * ksize_w *
+                            k_g + r * burstchannels * ksize_h * ksize_w *
+                            burstoc + burst_idx;
 
 //                          k_idx = (((o + o_head) * ksize + y) * ksize + x) *
 //                            k_g + k * 4 + m;
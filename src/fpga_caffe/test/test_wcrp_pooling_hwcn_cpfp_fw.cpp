@@ -72,12 +72,14 @@ TYPED_TEST(WCRPPoolingHWCNCPFPTest, TestWCRP2x2F_Pool_CPFP) {
     // Set sizes
     params[i].pool = 1;
     params[i].pksize = 2;
+    params[i].stride = 2;
+    params[i].pad = 0;
     int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
       params[i].xdim * params[i].numgroups;
     int wsize = params[i].outchannels * params[i].numgroups *
       params[i].inchannels * ksize * ksize;
 
-    int pooled_height = ceil((params[i].ydim - params[i].pksize) / 2.0) + 1;
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
     int pooled_width = pooled_height;
 
     int outsize = params[i].numimages * params[i].inchannels * pooled_height
@@ -187,12 +189,14 @@ TYPED_TEST(WCRPPoolingHWCNCPFPTest, TestWCRP3x3F_Pool_CPFP) {
     // Set sizes
     params[i].pool = 1;
     params[i].pksize = 3;
+    params[i].stride = 2;
+    params[i].pad = 0;
     int insize = params[i].numimages * params[i].inchannels * params[i].ydim *
       params[i].xdim * params[i].numgroups;
     int wsize = params[i].outchannels * params[i].numgroups *
       params[i].inchannels * ksize * ksize;
 
-    int pooled_height = ceil((params[i].ydim - params[i].pksize) / 2.0) + 1;
+    int pooled_height = ref_pooled_dim(params[i].ydim, params[i]);
     int pooled_width = pooled_height;
 
     int outsize = params[i].numimages * params[i].inchannels * pooled_height
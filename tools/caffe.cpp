@@ -5,18 +5,32 @@ namespace bp = boost::python;
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
 #include <map>
+#include <numeric>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/cpfp_quantize.hpp"
+#include "caffe/util/parallel_for.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
 using caffe::Caffe;
+using caffe::InferenceServer;
 using caffe::Net;
 using caffe::Layer;
 using caffe::Solver;
@@ -49,7 +63,41 @@ DEFINE_string(weights, "",
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
 
+DEFINE_int32(warmup, 1,
+    "Optional; the number of untimed forward-backward iterations 'time' runs "
+    "before timing, at least 1.");
+DEFINE_string(json, "",
+    "Optional; the file 'time' writes its per-layer report to as JSON.");
 DEFINE_int32(ocl, -1, "Run using OCL mode.");
+DEFINE_int32(workers, 1,
+    "Optional; the number of data parallel workers to train with in CPU "
+    "mode, each on a thread of its own. The effective training batch size "
+    "is multiplied by the number of workers. OCL mode (-ocl) trains a "
+    "single worker, as the FPGA layers share one device.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads the CPU layers split their loops "
+    "over. Use '-cpu_threads 0' for one per hardware thread.");
+
+DEFINE_string(socket, "",
+    "The Unix socket path 'serve' listens on.");
+DEFINE_int32(max_batch, 64,
+    "Optional; the most items 'serve' gathers into one batch.");
+DEFINE_int32(batch_multiple, 16,
+    "Optional; 'serve' zero-pads each batch to a multiple of this. Keep the "
+    "default of 16 for nets with FPGA layers.");
+DEFINE_int32(max_delay_us, 2000,
+    "Optional; how long 'serve' holds the oldest queued item while the "
+    "batch fills, in microseconds.");
+
+DEFINE_string(precisions, "float,6:5:nearest",
+    "The formats 'sweep' scores, separated by ',': 'float', or "
+    "exponent_bits:mantissa_bits:rounding with rounding 'nearest' or 'zero'.");
+DEFINE_string(fpga_layers, "Convolution,InnerProduct,Pooling,ReLU",
+    "Optional; the layer types whose inputs, outputs and weights 'sweep' "
+    "rounds to each format, those the FPGA kernels run.");
+DEFINE_string(source, "",
+    "Optional; the validation LMDB 'sweep' reads, replacing the source of "
+    "the model's Data layers.");
 
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
@@ -219,6 +267,10 @@ int train() {
       LOG(INFO) << "Use CPU.";
       Caffe::set_mode(Caffe::CPU);
     }
+    CHECK_GT(FLAGS_workers, 0);
+    CHECK(Caffe::mode() == Caffe::CPU || FLAGS_workers == 1)
+        << "Multiple workers only train in CPU mode.";
+    Caffe::set_solver_count(FLAGS_workers);
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -262,6 +314,11 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (gpus.size() == 0 && FLAGS_workers > 1) {
+    LOG(INFO) << "Using " << FLAGS_workers << " workers";
+    caffe::HostSync<float> sync(solver);
+    sync.Run(FLAGS_workers,
+        FLAGS_snapshot.size() > 0 ? FLAGS_snapshot.c_str() : NULL);
   } else {
     solver->Solve();
   }
@@ -347,9 +404,151 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Samples of one pass, forward or backward, of a layer or the whole net,
+// gathered by 'time'. The traffic and kernel time are totals over all the
+// timed iterations; flops are per iteration and only known for layers whose
+// work is dominated by multiply-accumulates.
+struct PassProfile {
+  vector<double> us;
+  double host_to_device_bytes;
+  double device_to_host_bytes;
+  double kernel_us;
+  double flops;
+  PassProfile()
+      : host_to_device_bytes(0), device_to_host_bytes(0), kernel_us(0),
+        flops(0) {}
+};
+
+struct LayerProfile {
+  PassProfile forward;
+  PassProfile backward;
+};
+
+// Times one pass of one layer for the lifetime of the object, along with the
+// host-device traffic and OCL kernel time it caused on this thread.
+class PassSample {
+ public:
+  explicit PassSample(PassProfile* profile)
+      : profile_(profile),
+        host_to_device_(Caffe::host_to_device_bytes()),
+        device_to_host_(Caffe::device_to_host_bytes()),
+        kernel_us_(Caffe::kernel_us()) {
+    timer_.Start();
+  }
+  ~PassSample() {
+    profile_->us.push_back(timer_.MicroSeconds());
+    profile_->host_to_device_bytes +=
+        Caffe::host_to_device_bytes() - host_to_device_;
+    profile_->device_to_host_bytes +=
+        Caffe::device_to_host_bytes() - device_to_host_;
+    profile_->kernel_us += Caffe::kernel_us() - kernel_us_;
+  }
+
+ private:
+  PassProfile* profile_;
+  Timer timer_;
+  size_t host_to_device_;
+  size_t device_to_host_;
+  double kernel_us_;
+};
+
+// The sample at fraction p of the sorted samples, or 0 with none.
+static double Percentile(vector<double> samples, double p) {
+  if (samples.size() == 0) { return 0; }
+  const int k = static_cast<int>(p * (samples.size() - 1) + 0.5);
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+static double Mean(const vector<double>& samples) {
+  if (samples.size() == 0) { return 0; }
+  return std::accumulate(samples.begin(), samples.end(), 0.) /
+      samples.size();
+}
+
+// Counts 2 flops per multiply-accumulate of the layers built around one,
+// taking the backward pass as one such product for the bottom diff and one
+// for the weight diff.
+static void SetLayerFlops(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top,
+    const vector<bool>& need_backward, LayerProfile* profile) {
+  const string type = layer->type();
+  if (layer->blobs().size() == 0 || top.size() == 0) { return; }
+  const Blob<float>& weights = *layer->blobs()[0];
+  double macs = 0;
+  if (type == "Convolution") {
+    // Each output sums (C / group) x kernel products, for plain and HWCN
+    // layouts alike
+    macs = static_cast<double>(top[0]->count()) * weights.count(1);
+  } else if (type == "Deconvolution") {
+    macs = static_cast<double>(bottom[0]->count()) * weights.count(1);
+  } else if (type == "InnerProduct" || type == "OCLHWCNInnerProduct") {
+    const int num_output = layer->layer_param().inner_product_param()
+        .num_output();
+    macs = static_cast<double>(top[0]->count()) * weights.count() /
+        num_output;
+  } else {
+    return;
+  }
+  profile->forward.flops = 2 * macs;
+  const bool data_pass = need_backward.size() && need_backward[0];
+  const bool weight_pass = layer->param_propagate_down(0);
+  profile->backward.flops = 2 * macs * (data_pass + weight_pass);
+}
+
+// Times in ms, traffic in MB and throughput per iteration, for the log.
+static string PassSummary(const PassProfile& pass) {
+  const int iterations = std::max<int>(pass.us.size(), 1);
+  ostringstream summary;
+  summary << Mean(pass.us) / 1000 << " / " <<
+      Percentile(pass.us, 0) / 1000 << " / " <<
+      Percentile(pass.us, 0.5) / 1000 << " / " <<
+      Percentile(pass.us, 0.99) / 1000 << " ms.";
+  if (pass.host_to_device_bytes || pass.device_to_host_bytes) {
+    summary << " H2D " << pass.host_to_device_bytes / iterations / 1e6 <<
+        " MB, D2H " << pass.device_to_host_bytes / iterations / 1e6 << " MB.";
+  }
+  if (pass.kernel_us) {
+    summary << " Kernels " << pass.kernel_us / iterations / 1000 << " ms.";
+  }
+  if (pass.flops && Mean(pass.us)) {
+    summary << " " << pass.flops / Mean(pass.us) / 1000 << " GFLOP/s.";
+  }
+  return summary.str();
+}
+
+static string PassJson(const PassProfile& pass) {
+  const int iterations = std::max<int>(pass.us.size(), 1);
+  const double mean_us = Mean(pass.us);
+  ostringstream json;
+  json << "{\"mean_ms\": " << mean_us / 1000 <<
+      ", \"min_ms\": " << Percentile(pass.us, 0) / 1000 <<
+      ", \"p50_ms\": " << Percentile(pass.us, 0.5) / 1000 <<
+      ", \"p99_ms\": " << Percentile(pass.us, 0.99) / 1000 <<
+      ", \"kernel_ms\": " << pass.kernel_us / iterations / 1000 <<
+      ", \"host_to_device_bytes\": " <<
+      pass.host_to_device_bytes / iterations <<
+      ", \"device_to_host_bytes\": " <<
+      pass.device_to_host_bytes / iterations <<
+      ", \"flops\": " << pass.flops <<
+      ", \"gflops_per_s\": " <<
+      (mean_us ? pass.flops / mean_us / 1000 : 0) << "}";
+  return json.str();
+}
+
+static string JsonEscape(const string& text) {
+  string escaped;
+  for (int i = 0; i < text.size(); ++i) {
+    if (text[i] == '"' || text[i] == '\\') { escaped += '\\'; }
+    escaped += text[i];
+  }
+  return escaped;
+}
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  CHECK_GE(FLAGS_warmup, 1) << "The first iteration always warms up.";
   caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
   vector<string> stages = get_stages_from_flags();
 
@@ -381,66 +580,442 @@ int time() {
   LOG(INFO) << "Performing Backward";
   caffe_net.Backward();
 
+  for (int j = 1; j < FLAGS_warmup; ++j) {
+    caffe_net.Forward();
+    caffe_net.Backward();
+  }
+
   const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
   const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
   const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
       caffe_net.bottom_need_backward();
+  vector<LayerProfile> profiles(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    SetLayerFlops(layers[i].get(), bottom_vecs[i], top_vecs[i],
+        bottom_need_backward[i], &profiles[i]);
+  }
   LOG(INFO) << "*** Benchmark begins ***";
-  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
+  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations after "
+      << FLAGS_warmup << " warm-up iterations.";
   Timer total_timer;
   total_timer.Start();
   Timer forward_timer;
   Timer backward_timer;
-  Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
+  PassProfile forward_pass;
+  PassProfile backward_pass;
   for (int j = 0; j < FLAGS_iterations; ++j) {
     Timer iter_timer;
     iter_timer.Start();
     forward_timer.Start();
     for (int i = 0; i < layers.size(); ++i) {
-      timer.Start();
+      PassSample sample(&profiles[i].forward);
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
     }
-    forward_time += forward_timer.MicroSeconds();
+    forward_pass.us.push_back(forward_timer.MicroSeconds());
     backward_timer.Start();
     for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
+      PassSample sample(&profiles[i].backward);
       layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
                           bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
     }
-    backward_time += backward_timer.MicroSeconds();
+    backward_pass.us.push_back(backward_timer.MicroSeconds());
     LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
       << iter_timer.MilliSeconds() << " ms.";
   }
-  LOG(INFO) << "Average time per layer: ";
+  total_timer.Stop();
+  LOG(INFO) << "Time per layer (mean / min / p50 / p99): ";
   for (int i = 0; i < layers.size(); ++i) {
     const caffe::string& layername = layers[i]->layer_param().name();
     LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+      "\tforward: " << PassSummary(profiles[i].forward);
     LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+      "\tbackward: " << PassSummary(profiles[i].backward);
   }
-  total_timer.Stop();
-  LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
+  LOG(INFO) << "Forward pass: " << PassSummary(forward_pass);
+  LOG(INFO) << "Backward pass: " << PassSummary(backward_pass);
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+
+  if (FLAGS_json.size()) {
+    std::ofstream json(FLAGS_json.c_str());
+    CHECK(json) << "Cannot write " << FLAGS_json;
+    json << "{\n  \"model\": \"" << JsonEscape(FLAGS_model) << "\",\n"
+        << "  \"mode\": \"" << (Caffe::mode() == Caffe::CPU ? "CPU" :
+        Caffe::mode() == Caffe::GPU ? "GPU" : "OCL") << "\",\n"
+        << "  \"cpu_threads\": " << caffe::caffe_cpu_threads() << ",\n"
+        << "  \"warmup\": " << FLAGS_warmup << ",\n"
+        << "  \"iterations\": " << FLAGS_iterations << ",\n"
+        << "  \"forward\": " << PassJson(forward_pass) << ",\n"
+        << "  \"backward\": " << PassJson(backward_pass) << ",\n"
+        << "  \"layers\": [";
+    for (int i = 0; i < layers.size(); ++i) {
+      json << (i ? ",\n" : "\n") << "    {\"name\": \""
+          << JsonEscape(layers[i]->layer_param().name()) << "\", \"type\": \""
+          << JsonEscape(layers[i]->type()) << "\",\n"
+          << "     \"forward\": " << PassJson(profiles[i].forward) << ",\n"
+          << "     \"backward\": " << PassJson(profiles[i].backward) << "}";
+    }
+    json << "\n  ]\n}\n";
+    LOG(INFO) << "Wrote the benchmark to " << FLAGS_json;
+  }
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Reads or writes exactly size bytes, returning false on EOF or error.
+static bool ReadFully(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size) {
+    const ssize_t n = read(fd, p, size);
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool WriteFully(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size) {
+    // A client hanging up mid-reply must not raise SIGPIPE
+    const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Serves one client until it disconnects. Each request is a uint32 count
+// followed by that many floats, the count being the net's input size; each
+// reply is, for every net output in order, a uint32 count and its floats.
+static void ServeConnection(InferenceServer<float>* server, int fd) {
+  vector<float> input(server->input_size());
+  vector<vector<float> > outputs;
+  uint32_t count;
+  while (ReadFully(fd, &count, sizeof(count))) {
+    if (count != input.size()) {
+      LOG(ERROR) << "Dropping client sending " << count << " values; the "
+          << "net takes " << input.size() << ".";
+      break;
+    }
+    if (!ReadFully(fd, &input[0], count * sizeof(float)) ||
+        !server->Infer(&input[0], &outputs)) {
+      break;
+    }
+    bool ok = true;
+    for (int i = 0; ok && i < outputs.size(); ++i) {
+      count = outputs[i].size();
+      ok = WriteFully(fd, &count, sizeof(count)) &&
+          (count == 0 ||
+           WriteFully(fd, &outputs[i][0], count * sizeof(float)));
+    }
+    if (!ok) { break; }
+  }
+  close(fd);
+}
+
+// Serve: answer inference requests on a Unix socket with dynamic batching.
+int serve() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  CHECK_GT(FLAGS_socket.size(), 0) << "Need a socket path to listen on.";
+  vector<string> stages = get_stages_from_flags();
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else if (FLAGS_ocl >= 0) {
+    Caffe::SetOCLDevice();
+    Caffe::set_mode(Caffe::OCL);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  shared_ptr<Net<float> > caffe_net(
+      new Net<float>(FLAGS_model, caffe::TEST, FLAGS_level, &stages));
+  if (FLAGS_weights.size()) {
+    caffe_net->CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  InferenceServer<float> server(caffe_net, FLAGS_max_batch,
+      FLAGS_batch_multiple, FLAGS_max_delay_us);
+
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CHECK_LT(FLAGS_socket.size(), sizeof(address.sun_path))
+      << "Socket path too long: " << FLAGS_socket;
+  strncpy(address.sun_path, FLAGS_socket.c_str(), sizeof(address.sun_path));
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(listener, 0) << "Cannot create a Unix socket.";
+  unlink(FLAGS_socket.c_str());
+  CHECK_EQ(bind(listener, reinterpret_cast<sockaddr*>(&address),
+      sizeof(address)), 0) << "Cannot bind " << FLAGS_socket;
+  CHECK_EQ(listen(listener, SOMAXCONN), 0);
+  LOG(INFO) << "Serving " << FLAGS_model << " on " << FLAGS_socket
+      << ", batches of up to " << FLAGS_max_batch << " padded to multiples of "
+      << FLAGS_batch_multiple << ", waiting up to " << FLAGS_max_delay_us
+      << " us.";
+
+  const int kStatsIntervalMs = 10000;
+  int last_requests = 0;
+  // The stats are due every interval, however busy accepting clients keeps
+  // the listener
+  boost::system_time stats_due = boost::get_system_time() +
+      boost::posix_time::milliseconds(kStatsIntervalMs);
+  while (true) {
+    const int wait_ms = std::max<int>(0,
+        (stats_due - boost::get_system_time()).total_milliseconds());
+    pollfd pending;
+    pending.fd = listener;
+    pending.events = POLLIN;
+    if (poll(&pending, 1, wait_ms) > 0) {
+      const int fd = accept(listener, NULL, NULL);
+      if (fd >= 0) {
+        boost::thread(ServeConnection, &server, fd).detach();
+      }
+    }
+    if (boost::get_system_time() < stats_due) {
+      continue;
+    }
+    stats_due = boost::get_system_time() +
+        boost::posix_time::milliseconds(kStatsIntervalMs);
+    const InferenceServer<float>::Stats stats = server.stats();
+    if (stats.requests != last_requests) {
+      LOG(INFO) << "Served " << stats.requests << " requests in "
+          << stats.batches << " batches, fill " << stats.fill
+          << ", p50 " << stats.p50_ms << " ms, p99 " << stats.p99_ms << " ms.";
+      last_requests = stats.requests;
+    }
+  }
+  return 0;
+}
+RegisterBrewFunction(serve);
+
+// One cpfp format scored by 'sweep', with the copy of the net it runs in
+struct SweepConfig {
+  string name;
+  bool quantize;
+  int exp_size;
+  int mant_size;
+  bool round_nearest;
+  shared_ptr<Net<float> > net;
+  // Whether each layer runs on the FPGA, its values passing through cpfp
+  vector<bool> fpga;
+  // The layer bottoms kept in float for the other layers reading them
+  vector<shared_ptr<Blob<float> > > saved;
+  vector<float> scores;
+};
+
+// Parses exponent_bits:mantissa_bits:rounding, or 'float' for no rounding.
+static SweepConfig ParsePrecision(const string& spec) {
+  SweepConfig config;
+  config.name = spec;
+  config.quantize = spec != "float";
+  if (!config.quantize) {
+    return config;
+  }
+  vector<string> fields;
+  boost::split(fields, spec, boost::is_any_of(":"));
+  CHECK(fields.size() == 3 && (fields[2] == "nearest" || fields[2] == "zero"))
+      << "Precisions are exponent_bits:mantissa_bits:nearest or "
+      << "exponent_bits:mantissa_bits:zero, not " << spec;
+  config.exp_size = boost::lexical_cast<int>(fields[0]);
+  config.mant_size = boost::lexical_cast<int>(fields[1]);
+  config.round_nearest = fields[2] == "nearest";
+  CHECK(config.exp_size >= 2 && config.exp_size <= 8 &&
+      config.mant_size >= 1 && config.mant_size <= 23)
+      << "Precisions need 2 to 8 exponent and 1 to 23 mantissa bits: "
+      << spec;
+  return config;
+}
+
+static void QuantizeBlob(const SweepConfig& config, Blob<float>* blob) {
+  caffe::cpfp_quantize(blob->count(), config.exp_size, config.mant_size,
+      config.round_nearest, blob->mutable_cpu_data());
+}
+
+// Runs the configs [begin, end) on the shared batch, passing the inputs,
+// outputs and weights of the FPGA layers through their format.
+static void SweepBatch(vector<SweepConfig>* configs,
+    const vector<Blob<float>*>* batch, int begin, int end) {
+  for (int c = begin; c < end; ++c) {
+    SweepConfig& config = (*configs)[c];
+    Net<float>* net = config.net.get();
+    const vector<Blob<float>*>& input = net->top_vecs()[0];
+    for (int j = 0; j < input.size(); ++j) {
+      input[j]->CopyFrom(*(*batch)[j]);
+    }
+    for (int i = 1; i < net->layers().size(); ++i) {
+      const vector<Blob<float>*>& bottom = net->bottom_vecs()[i];
+      const vector<Blob<float>*>& top = net->top_vecs()[i];
+      const bool fpga = config.quantize && config.fpga[i];
+      vector<bool> restore(bottom.size(), false);
+      for (int j = 0; fpga && j < bottom.size(); ++j) {
+        // In-place bottoms are the layer's own output and need no copy
+        restore[j] = std::find(top.begin(), top.end(), bottom[j]) ==
+            top.end();
+        if (restore[j]) {
+          if (config.saved.size() <= j) {
+            config.saved.push_back(shared_ptr<Blob<float> >(
+                new Blob<float>()));
+          }
+          config.saved[j]->CopyFrom(*bottom[j], false, true);
+        }
+        QuantizeBlob(config, bottom[j]);
+      }
+      net->ForwardFromTo(i, i);
+      for (int j = 0; fpga && j < bottom.size(); ++j) {
+        if (restore[j]) {
+          bottom[j]->CopyFrom(*config.saved[j]);
+        }
+      }
+      for (int j = 0; fpga && j < top.size(); ++j) {
+        QuantizeBlob(config, top[j]);
+      }
+    }
+    int idx = 0;
+    const vector<Blob<float>*>& result = net->output_blobs();
+    for (int j = 0; j < result.size(); ++j) {
+      const float* result_vec = result[j]->cpu_data();
+      for (int k = 0; k < result[j]->count(); ++k, ++idx) {
+        if (config.scores.size() <= idx) {
+          config.scores.push_back(0);
+        }
+        config.scores[idx] += result_vec[k];
+      }
+    }
+  }
+}
+
+// Sweep: score a float model at a list of cpfp precisions.
+int sweep() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to score.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to score.";
+  Caffe::set_mode(Caffe::CPU);
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  param.mutable_state()->set_level(FLAGS_level);
+  const vector<string> stages = get_stages_from_flags();
+  for (int i = 0; i < stages.size(); ++i) {
+    param.mutable_state()->add_stage(stages[i]);
+  }
+  if (FLAGS_source.size()) {
+    for (int i = 0; i < param.layer_size(); ++i) {
+      if (param.layer(i).type() == "Data") {
+        caffe::DataParameter* data_param =
+            param.mutable_layer(i)->mutable_data_param();
+        data_param->set_source(FLAGS_source);
+        data_param->set_backend(caffe::DataParameter_DB_LMDB);
+      }
+    }
+  }
+  caffe::NetParameter filtered;
+  Net<float>::FilterNet(param, &filtered);
+
+  // The leading layers without bottoms produce the batches, once for all
+  // the configs
+  int data_layers = 0;
+  while (data_layers < filtered.layer_size() &&
+      filtered.layer(data_layers).bottom_size() == 0) {
+    ++data_layers;
+  }
+  CHECK_GT(data_layers, 0) << "The model needs leading data layers.";
+  Net<float> feeder(param);
+  const int last_data_layer = std::find(feeder.layer_names().begin(),
+      feeder.layer_names().end(), filtered.layer(data_layers - 1).name()) -
+      feeder.layer_names().begin();
+
+  // Each config's net takes the batch through an Input layer in their place
+  vector<Blob<float>*> batch;
+  caffe::NetParameter config_param(filtered);
+  config_param.clear_layer();
+  caffe::LayerParameter* input = config_param.add_layer();
+  input->set_name("sweep_input");
+  input->set_type("Input");
+  for (int i = 0; i < data_layers; ++i) {
+    for (int j = 0; j < filtered.layer(i).top_size(); ++j) {
+      const string& name = filtered.layer(i).top(j);
+      batch.push_back(feeder.blob_by_name(name).get());
+      input->add_top(name);
+      caffe::BlobShape* shape = input->mutable_input_param()->add_shape();
+      for (int k = 0; k < batch.back()->num_axes(); ++k) {
+        shape->add_dim(batch.back()->shape(k));
+      }
+    }
+  }
+  for (int i = data_layers; i < filtered.layer_size(); ++i) {
+    config_param.add_layer()->CopyFrom(filtered.layer(i));
+  }
+
+  vector<string> fpga_types;
+  boost::split(fpga_types, FLAGS_fpga_layers, boost::is_any_of(","));
+  vector<string> precisions;
+  boost::split(precisions, FLAGS_precisions, boost::is_any_of(","));
+  vector<SweepConfig> configs;
+  for (int c = 0; c < precisions.size(); ++c) {
+    configs.push_back(ParsePrecision(precisions[c]));
+    SweepConfig& config = configs.back();
+    config.net.reset(new Net<float>(config_param));
+    config.net->CopyTrainedLayersFrom(FLAGS_weights);
+    const vector<shared_ptr<Layer<float> > >& layers = config.net->layers();
+    for (int i = 0; i < layers.size(); ++i) {
+      config.fpga.push_back(std::find(fpga_types.begin(), fpga_types.end(),
+          layers[i]->type()) != fpga_types.end());
+      for (int j = 0; config.quantize && config.fpga[i] &&
+          j < layers[i]->blobs().size(); ++j) {
+        QuantizeBlob(config, layers[i]->blobs()[j].get());
+      }
+    }
+  }
+  LOG(INFO) << "Scoring " << configs.size() << " precisions for "
+      << FLAGS_iterations << " iterations on "
+      << std::min<int>(caffe::caffe_cpu_threads(), configs.size())
+      << " threads.";
+
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    feeder.ForwardTo(last_data_layer);
+    caffe::caffe_parallel_for(configs.size(), 1,
+        boost::bind(&SweepBatch, &configs, &batch, _1, _2));
+  }
+
+  // One row per precision, one column per output value
+  const Net<float>& net = *configs[0].net;
+  ostringstream header;
+  header << std::left << std::setw(16) << "precision";
+  for (int j = 0; j < net.num_outputs(); ++j) {
+    const string& output_name =
+        net.blob_names()[net.output_blob_indices()[j]];
+    for (int k = 0; k < net.output_blobs()[j]->count(); ++k) {
+      ostringstream column;
+      column << output_name;
+      if (net.output_blobs()[j]->count() > 1) {
+        column << "[" << k << "]";
+      }
+      header << " " << std::setw(14) << column.str();
+    }
+  }
+  LOG(INFO) << header.str();
+  for (int c = 0; c < configs.size(); ++c) {
+    ostringstream row;
+    row << std::left << std::setw(16) << configs[c].name;
+    for (int k = 0; k < configs[c].scores.size(); ++k) {
+      row << " " << std::setw(14)
+          << configs[c].scores[k] / FLAGS_iterations;
+    }
+    LOG(INFO) << row.str();
+  }
+  return 0;
+}
+RegisterBrewFunction(sweep);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -453,9 +1028,12 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  serve           answer batched inference requests on a Unix socket\n"
+      "  sweep           score a float model at several cpfp precisions");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  caffe::caffe_set_cpu_threads(FLAGS_cpu_threads);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -0,0 +1,69 @@
+// Converts trained weights to a tensor file, which Net::CopyTrainedLayersFrom
+// maps into memory instead of parsing.
+//
+// Usage:
+//    convert_to_tensor_file [FLAGS] INPUT OUTPUT
+//
+// INPUT is a binary proto caffemodel or, given -model, any weights the net
+// can load (binary proto, HDF5 or tensor file). OUTPUT is written under a
+// temporary name and renamed into place, so it may be INPUT itself.
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/tensor_file.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "",
+    "Optional; the model definition protocol buffer text file. With it, the "
+    "input is loaded into the net and only the parameters it owns are "
+    "written; without it, every blob of the input binary proto is.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert trained weights to a tensor file\n"
+        "Usage:\n"
+        "    convert_to_tensor_file [FLAGS] INPUT OUTPUT\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/convert_to_tensor_file");
+    return 1;
+  }
+  const string input_filename(argv[1]);
+  const string output_filename(argv[2]);
+  Caffe::set_mode(Caffe::CPU);
+
+  if (FLAGS_model.size()) {
+    Net<float> net(FLAGS_model, caffe::TEST);
+    net.CopyTrainedLayersFrom(input_filename);
+    net.ToTensorFile(output_filename);
+  } else {
+    NetParameter net_param;
+    ReadNetParamsFromBinaryFileOrDie(input_filename, &net_param);
+    TensorFileWriter<float> writer(output_filename, net_param.name());
+    Blob<float> blob;
+    for (int i = 0; i < net_param.layer_size(); ++i) {
+      const LayerParameter& layer_param = net_param.layer(i);
+      for (int j = 0; j < layer_param.blobs_size(); ++j) {
+        blob.FromProto(layer_param.blobs(j));
+        writer.Add(layer_param.name(), j, blob);
+      }
+    }
+    writer.Close();
+  }
+  LOG(INFO) << "Wrote tensor file " << output_filename;
+  return 0;
+}
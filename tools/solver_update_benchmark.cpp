@@ -0,0 +1,163 @@
+// Times one solver update of a set of parameter blobs with the multi-pass
+// Normalize / Regularize / ComputeUpdateValue / Blob::Update path and with
+// the fused single-pass update, for each of the SGD solver family.
+//
+// Usage:
+//    solver_update_benchmark [FLAGS]
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/sgd_solvers.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(types, "SGD,Nesterov,AdaGrad,RMSProp,AdaDelta,Adam",
+    "Comma-separated list of solver types to time.");
+DEFINE_int32(count, 1 << 22, "The number of values in each parameter blob.");
+DEFINE_int32(params, 4, "The number of parameter blobs.");
+DEFINE_int32(iterations, 20, "The number of timed updates per path.");
+DEFINE_int32(iter_size, 2,
+    "The solver iter_size, so the gradient is normalized.");
+DEFINE_double(weight_decay, 5e-4, "The solver weight_decay.");
+DEFINE_int32(cpu_threads, 1,
+    "The number of threads the fused update is split over. Use "
+    "'-cpu_threads 0' for one per hardware thread.");
+
+// Gives the benchmark the protected ApplyUpdate of each solver.
+template <typename Solver>
+class UpdateBenchmark : public Solver {
+ public:
+  explicit UpdateBenchmark(const SolverParameter& param) : Solver(param) {}
+  void Update() { this->ApplyUpdate(); }
+};
+
+template <typename Solver>
+float TimeUpdate(const SolverParameter& param) {
+  UpdateBenchmark<Solver> solver(param);
+  const vector<Blob<float>*>& params = solver.net()->learnable_params();
+  // The update overwrites the gradient, so it is restored before each call.
+  // Gradients that shrank into denormals would distort the timing.
+  Blob<float> gradient;
+  gradient.ReshapeLike(*params[0]);
+  caffe_rng_gaussian<float>(gradient.count(), 0, 1e-2,
+      gradient.mutable_cpu_data());
+  for (int i = 0; i < params.size(); ++i) {
+    caffe_rng_gaussian<float>(params[i]->count(), 0, 1,
+        params[i]->mutable_cpu_data());
+  }
+  Timer timer;
+  float total_ms = 0;
+  // One untimed update touches every history page first.
+  for (int iter = 0; iter <= FLAGS_iterations; ++iter) {
+    for (int i = 0; i < params.size(); ++i) {
+      caffe_copy(gradient.count(), gradient.cpu_data(),
+          params[i]->mutable_cpu_diff());
+    }
+    timer.Start();
+    solver.Update();
+    timer.Stop();
+    if (iter > 0) {
+      total_ms += timer.MilliSeconds();
+    }
+  }
+  return total_ms / FLAGS_iterations;
+}
+
+float TimeUpdate(const string& type, const SolverParameter& param) {
+  if (type == "SGD") {
+    return TimeUpdate<SGDSolver<float> >(param);
+  } else if (type == "Nesterov") {
+    return TimeUpdate<NesterovSolver<float> >(param);
+  } else if (type == "AdaGrad") {
+    return TimeUpdate<AdaGradSolver<float> >(param);
+  } else if (type == "RMSProp") {
+    return TimeUpdate<RMSPropSolver<float> >(param);
+  } else if (type == "AdaDelta") {
+    return TimeUpdate<AdaDeltaSolver<float> >(param);
+  } else if (type == "Adam") {
+    return TimeUpdate<AdamSolver<float> >(param);
+  }
+  LOG(FATAL) << "Unknown solver type: " << type;
+  return 0;
+}
+
+SolverParameter BenchmarkSolverParameter(const string& type) {
+  SolverParameter param;
+  param.set_type(type);
+  param.set_base_lr(0.01);
+  param.set_lr_policy("fixed");
+  param.set_display(0);
+  param.set_iter_size(FLAGS_iter_size);
+  param.set_weight_decay(FLAGS_weight_decay);
+  if (type == "SGD" || type == "Nesterov" || type == "Adam") {
+    param.set_momentum(0.9);
+  } else if (type == "AdaDelta") {
+    param.set_momentum(0.95);
+  }
+  param.set_snapshot_after_train(false);
+  param.set_solver_mode(SolverParameter_SolverMode_CPU);
+  // A net of nothing but the parameters
+  NetParameter* net_param = param.mutable_net_param();
+  net_param->set_name("UpdateBenchmark");
+  for (int i = 0; i < FLAGS_params; ++i) {
+    LayerParameter* layer = net_param->add_layer();
+    layer->set_name("param" + format_int(i));
+    layer->set_type("Parameter");
+    layer->add_top(layer->name());
+    layer->mutable_parameter_param()->mutable_shape()->add_dim(FLAGS_count);
+  }
+  return param;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Compare the multi-pass and fused solver updates\n"
+        "Usage:\n"
+        "    solver_update_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_count, 0);
+  CHECK_GT(FLAGS_params, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+  caffe_set_cpu_threads(FLAGS_cpu_threads);
+
+  vector<string> types;
+  boost::split(types, FLAGS_types, boost::is_any_of(","));
+  const double megabytes = double(FLAGS_count) * FLAGS_params *
+      sizeof(float) / (1 << 20);
+  LOG(INFO) << FLAGS_params << " parameters of " << FLAGS_count
+      << " values (" << megabytes << " MB of weights), "
+      << caffe_cpu_threads() << " threads";
+  for (int i = 0; i < types.size(); ++i) {
+    SolverParameter param = BenchmarkSolverParameter(types[i]);
+    param.set_fused_update(false);
+    const float multi_pass_ms = TimeUpdate(types[i], param);
+    param.set_fused_update(true);
+    const float fused_ms = TimeUpdate(types[i], param);
+    char line[128];
+    snprintf(line, sizeof(line),
+        "%-9s multi-pass %9.3f ms  fused %9.3f ms  speedup %5.2fx",
+        types[i].c_str(), multi_pass_ms, fused_ms,
+        multi_pass_ms / std::max(fused_ms, 1e-6f));
+    LOG(INFO) << line;
+  }
+  return 0;
+}